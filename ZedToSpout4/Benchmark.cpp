@@ -0,0 +1,1201 @@
+#include "stdafx.h"
+#include "Benchmark.h"
+#include "DepthKernels.h"
+#include "DepthEncoding.h"
+#include "DepthCodec.h"
+#include "NetworkDepth.h"
+#include "TileDelta.h"
+#include "DepthStats.h"
+#include "SpoutMemorySender.h"
+#include "FrameDemand.h"
+#include "ZedFrameSource.h"
+#include "PointCloud.h"
+#include "TemporalFilter.h"
+#include "SpatialFilter.h"
+#include "PreviewScaler.h"
+#include "HeapCount.h"
+#include "Opencv2Opengl.h"
+#include "opencv2/core.hpp"
+#include "opencv2/imgproc.hpp"
+#include "opencv2/highgui.hpp"
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <iomanip>
+#include <iostream>
+#ifndef _WIN32
+#include <time.h>
+#endif
+using namespace std;
+
+// The plane built from separate OpenCV passes : range, scale, narrow, mask, flip
+static void multiPassPlane(const cv::Mat &depth, cv::Mat &plane, bool inverse)
+{
+	cv::Mat finite, invalid, values, scaled;
+	cv::inRange(depth, -FLT_MAX, FLT_MAX, finite);
+	double minDepth = 0, maxDepth = 0;
+	cv::minMaxLoc(depth, &minDepth, &maxDepth, NULL, NULL, finite);
+	if (inverse)
+	{
+		double k = 255.0 / (1.0 / minDepth - 1.0 / maxDepth);
+		cv::divide(1.0, depth, values);
+		values.convertTo(scaled, CV_8U, k, -k / maxDepth);
+	}
+	else
+	{
+		double k = 255.0 / (maxDepth - minDepth);
+		depth.convertTo(scaled, CV_8U, -k, maxDepth * k);
+	}
+	cv::bitwise_not(finite, invalid);
+	scaled.setTo(0, invalid);
+	cv::flip(scaled, plane, 0);
+}
+
+// The band mask from one inRange pass per band
+static void multiPassBandMask(const cv::Mat &depth, cv::Mat &mask, const vector<DepthBand> &bands, BandMaskMode mode)
+{
+	cv::Mat inBand, combined = cv::Mat::zeros(depth.size(), CV_8UC1);
+	for (size_t n = 0; n < bands.size(); n++)
+	{
+		// Labels go in last band first so the first matching band wins
+		size_t i = mode == BAND_LABELS ? bands.size() - 1 - n : n;
+		cv::inRange(depth, bands[i].lowerMm, bands[i].upperMm, inBand);
+		if (mode == BAND_BITS)
+			cv::bitwise_or(combined, cv::Scalar(1 << i), combined, inBand);
+		else
+			combined.setTo(mode == BAND_LABELS ? bands[i].label : 255, inBand);
+	}
+	cv::flip(combined, mask, 0);
+}
+
+// 0 for measures, then one class per sentinel
+static int depthClass(float z)
+{
+	return (z != z) ? 3 : (z == INFINITY) ? 1 : (z == -INFINITY) ? 2 : 0;
+}
+
+// Largest difference between measures, or -1 if a sentinel changed
+static double depthError(const cv::Mat &expected, const cv::Mat &actual)
+{
+	double error = 0;
+	for (int y = 0; y < expected.rows; y++)
+	{
+		const float* e = expected.ptr<float>(y);
+		const float* a = actual.ptr<float>(y);
+		for (int x = 0; x < expected.cols; x++)
+		{
+			if (depthClass(e[x]) != depthClass(a[x]))
+				return -1;
+			if (depthClass(e[x]) == 0 && fabs(e[x] - a[x]) > error)
+				error = fabs(e[x] - a[x]);
+		}
+	}
+	return error;
+}
+
+// Counts the Mat buffers taken from the heap while it is the default allocator
+class CountingAllocator : public cv::MatAllocator
+{
+public:
+	CountingAllocator() : m_count(0) {}
+	unsigned long long count() const { return m_count; }
+
+	cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+		int flags, cv::UMatUsageFlags usageFlags) const
+	{
+		if (!data)
+			m_count++;
+		return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+	}
+	bool allocate(cv::UMatData* u, int accessFlags, cv::UMatUsageFlags usageFlags) const
+	{
+		return cv::Mat::getStdAllocator()->allocate(u, accessFlags, usageFlags);
+	}
+	void deallocate(cv::UMatData* u) const
+	{
+		cv::Mat::getStdAllocator()->deallocate(u);
+	}
+private:
+	mutable atomic<unsigned long long> m_count;
+};
+
+static double millisecondsPerCall(const std::function<void()> &call, int iterations)
+{
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++)
+		call();
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / iterations;
+}
+
+int runKernelBenchmark(FrameSource &source)
+{
+	DepthFrame frame;
+	if (!source.grab(frame) || frame.depth.empty())
+		return 1;
+
+	const int iterations = 200;
+	const KernelIsa isas[] = { KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2 };
+	int result = 0;
+	cout << "depthToPlane " << frame.depth.cols << "x" << frame.depth.rows
+		<< ", best instruction set " << kernelIsaName(bestKernelIsa()) << endl;
+	cout << fixed << setprecision(3);
+
+	// tests/DepthKernelsTest checks the planes and masks against these passes
+	for (int inverse = 0; inverse < 2; inverse++)
+	{
+		DepthPlaneParams params;
+		params.inverse = inverse != 0;
+		params.flip = true;
+
+		cv::Mat reference, plane;
+		cout << (params.inverse ? " inverse" : " linear") << endl;
+		cout << setw(10) << "multipass" << " : " << millisecondsPerCall([&]() {
+			multiPassPlane(frame.depth, reference, params.inverse);
+		}, iterations) << " ms" << endl;
+		for (int i = 0; i < 3 && isas[i] <= bestKernelIsa(); i++)
+		{
+			cout << setw(10) << kernelIsaName(isas[i]) << " : " << millisecondsPerCall([&]() {
+				depthToPlane(frame.depth, plane, params, isas[i]);
+			}, iterations) << " ms" << endl;
+		}
+	}
+
+	// Band masks, overlapping bands so the modes differ
+	vector<DepthBand> bands;
+	parseDepthBands("500:1500,1200:3000,3000:6000:200", bands);
+	const BandMaskMode modes[] = { BAND_BINARY, BAND_LABELS, BAND_BITS };
+	cout << " bands " << formatDepthBands(bands) << endl;
+	for (int m = 0; m < 3; m++)
+	{
+		cv::Mat reference, mask;
+		cout << setw(10) << bandMaskModeName(modes[m]) << " : multipass " << millisecondsPerCall([&]() {
+			multiPassBandMask(frame.depth, reference, bands, modes[m]);
+		}, iterations) << " ms";
+		for (int i = 0; i < 3 && isas[i] <= bestKernelIsa(); i++)
+		{
+			cout << ", " << kernelIsaName(isas[i]) << " " << millisecondsPerCall([&]() {
+				depthBandMask(frame.depth, mask, bands, modes[m], true, isas[i]);
+			}, iterations) << " ms";
+		}
+		cout << endl;
+	}
+
+	// Exact encodings : encode, pack as the memoryshare map would, decode on the receiver side
+	const DepthEncoding encodings[] = { DEPTH_R16_MM, DEPTH_R32F_M, DEPTH_RG8_HILO };
+	for (int i = 0; i < 3; i++)
+	{
+		cv::Mat encoded, rgba(frame.depth.size(), CV_8UC4), decoded;
+		double encodeMs = millisecondsPerCall([&]() {
+			encodeDepth(frame.depth, encoded, encodings[i], true);
+		}, iterations);
+		SpoutMemorySender::writeRGBA(encoded, rgba.data, false);
+		double decodeMs = millisecondsPerCall([&]() {
+			decodeDepthRGBA(rgba, encodings[i], decoded, true);
+		}, iterations);
+		double error = depthError(frame.depth, decoded);
+		// Millimeter encodings round to the nearest millimeter, meters come back within a float step
+		bool ok = error >= 0 && error <= (encodings[i] == DEPTH_R32F_M ? 0.002 : 0.5);
+		if (!ok)
+			result = 1;
+		cout << setw(10) << depthEncodingName(encodings[i]) << " : encode " << encodeMs << " ms, decode " << decodeMs << " ms, "
+			<< (ok ? "round trip ok" : "ROUND TRIP FAILED") << " (max error " << error << " mm)" << endl;
+	}
+
+	// Point cloud, checked point by point by tests/PointCloudTest
+	PointCloudProjector projector;
+	projector.setIntrinsics(source.intrinsics());
+	PointCloudParams cloudParams;
+	PointCloud cloud, decimated;
+	const KernelIsa cloudIsas[] = { KERNEL_SCALAR, KERNEL_AVX2 };
+	for (int i = 0; i < 2 && cloudIsas[i] <= bestKernelIsa(); i++)
+	{
+		cout << setw(10) << kernelIsaName(cloudIsas[i]) << " : " << millisecondsPerCall([&]() {
+			projector.project(frame.depth, frame.left, frame.confidence, cloudParams, cloud, cloudIsas[i]);
+		}, iterations) << " ms, " << cloud.count << " points" << endl;
+	}
+	const float leaves[] = { 10.0f, 50.0f };
+	VoxelGrid voxels;
+	for (int i = 0; i < 2; i++)
+	{
+		double voxelMs = millisecondsPerCall([&]() { voxels.filter(cloud, leaves[i], decimated); }, iterations / 10);
+		cout << setw(8) << leaves[i] << "mm : " << voxelMs << " ms, " << decimated.count << " voxels" << endl;
+	}
+	cv::Mat positions;
+	double textureMs = millisecondsPerCall([&]() { pointCloudToTexture(cloud, frame.depth.size(), positions); }, iterations);
+	vector<unsigned char> packed;
+	size_t packedSize = 0;
+	double packMs = millisecondsPerCall([&]() { packedSize = packPointCloud(decimated, packed); }, iterations);
+	cout << setw(10) << "texture" << " : " << textureMs << " ms, binary " << packMs << " ms for " << packedSize << " bytes" << endl;
+
+	// Preview windows : the three images the UI shows, against the copy then resize they
+	// replace, which tests/PreviewScalerTest checks them against
+	const cv::Size displaySize(720, 404);
+	cv::Mat plane, copied, resized, converted;
+	depthToPlane(frame.depth, plane, DepthPlaneParams());
+	double copyResizeMs = millisecondsPerCall([&]() {
+		plane.copyTo(copied);
+		cv::resize(copied, resized, displaySize, 0, 0, cv::INTER_AREA);
+		frame.left.copyTo(copied);
+		cv::resize(copied, resized, displaySize, 0, 0, cv::INTER_AREA);
+		frame.confidence.copyTo(copied);
+		cv::resize(copied, resized, displaySize, 0, 0, cv::INTER_AREA);
+		resized.convertTo(converted, CV_8U, 2.55);
+	}, iterations / 4);
+	cout << "preview " << displaySize.width << "x" << displaySize.height << ", copy and resize " << copyResizeMs << " ms" << endl;
+	const cv::Mat* previewSources[] = { &plane, &frame.left, &frame.confidence };
+	const float previewScales[] = { 1.0f, 1.0f, 2.55f };
+	PreviewScaler scaler;
+	for (int i = 0; i < 3 && isas[i] <= bestKernelIsa(); i++)
+	{
+		cv::Mat scaled[3];
+		cout << setw(10) << kernelIsaName(isas[i]) << " : " << millisecondsPerCall([&]() {
+			for (int s = 0; s < 3; s++)
+				scaler.resize(*previewSources[s], scaled[s], displaySize, previewScales[s], s == 0, isas[i]);
+		}, iterations / 4) << " ms" << endl;
+	}
+	cout << endl;
+	return result;
+}
+
+int runTemporalFilterBenchmark(FrameSource &source)
+{
+	// Cost per frame at the source size, the filtering itself is checked by TemporalFilterTest
+	DepthFrame sourceFrame;
+	if (!source.grab(sourceFrame, FRAME_DEPTH | FRAME_CONFIDENCE))
+		return 1;
+	TemporalFilterParams params;
+	cout << "temporal filter " << formatTemporalFilter(params) << endl;
+	const KernelIsa isas[] = { KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2 };
+	const int iterations = 100;
+	for (int i = 0; i < 3 && isas[i] <= bestKernelIsa(); i++)
+	{
+		TemporalFilter filter;
+		filter.setParams(params);
+		cv::Mat out;
+		cout << setw(12) << kernelIsaName(isas[i]) << " : " << millisecondsPerCall([&]() {
+			filter.apply(sourceFrame.depth, sourceFrame.confidence, out, isas[i]);
+		}, iterations) << " ms for " << sourceFrame.depth.cols << "x" << sourceFrame.depth.rows << endl;
+	}
+	cout << endl;
+	return 0;
+}
+
+// Measured depths of truth with noise, and round holes punched in them
+static void punchHoles(const cv::Mat &truth, cv::Mat &depth, cv::RNG &rng, double holeShare)
+{
+	depth.create(truth.size(), CV_32FC1);
+	for (int y = 0; y < truth.rows; y++)
+	{
+		const float* t = truth.ptr<float>(y);
+		float* z = depth.ptr<float>(y);
+		for (int x = 0; x < truth.cols; x++)
+			z[x] = fabsf(t[x]) < INFINITY ? t[x] + (float)rng.gaussian(0.005 * t[x]) : t[x];
+	}
+	// Holes of 1 to 8 pixels radius, the sizes STANDARD mode leaves around edges
+	int holes = (int)(holeShare * truth.total() / 60.0);
+	for (int i = 0; i < holes; i++)
+		cv::circle(depth, cv::Point(rng.uniform(0, truth.cols), rng.uniform(0, truth.rows)), rng.uniform(1, 9),
+			cv::Scalar(NAN), -1);
+}
+
+int runSpatialFilterBenchmark()
+{
+	const cv::Size sizes[] = { cv::Size(1280, 720), cv::Size(1920, 1080) };
+	const KernelIsa isas[] = { KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2 };
+	const int iterations = 20;
+	int result = 0;
+	cv::RNG rng(12345);
+	cout << "spatial filter, best instruction set " << kernelIsaName(bestKernelIsa()) << endl;
+
+	// From holes only to the smoothest, so quality can be weighed against the cost
+	SpatialFilterParams configs[4];
+	configs[0].smooth = false;
+	configs[0].iterations = 1;
+	configs[2].iterations = 3;
+	configs[3].sigmaSpatial = 40.0f;
+	configs[3].iterations = 3;
+
+	for (int s = 0; s < 2; s++)
+	{
+		SyntheticFrameSource scene(sizes[s].width, sizes[s].height);
+		DepthFrame frame;
+		if (!scene.grab(frame, FRAME_DEPTH | FRAME_LEFT))
+			return 1;
+		cv::Mat depth, filtered, reference;
+		punchHoles(frame.depth, depth, rng, 0.04);
+		size_t holes = 0;
+		double noise = 0;
+		size_t measures = 0;
+		for (int y = 0; y < depth.rows; y++)
+		{
+			for (int x = 0; x < depth.cols; x++)
+			{
+				float z = depth.at<float>(y, x), t = frame.depth.at<float>(y, x);
+				if (z != z)
+					holes++;
+				else if (fabsf(z) < INFINITY)
+				{
+					noise += (z - t) * (z - t);
+					measures++;
+				}
+			}
+		}
+		cout << " " << sizes[s].width << "x" << sizes[s].height << ", " << 100.0 * holes / depth.total() << "% holes, "
+			<< sqrt(noise / measures) << " mm rms noise" << endl;
+
+		for (int c = 0; c < 4; c++)
+		{
+			SpatialFilter filter;
+			filter.setParams(configs[c]);
+			filter.apply(depth, frame.left, reference, KERNEL_SCALAR);
+
+			// Holes left, then the error against the scene of the filled holes and of the measures
+			size_t open = 0, filled = 0;
+			double filledError = 0, measuredError = 0;
+			for (int y = 0; y < depth.rows; y++)
+			{
+				for (int x = 0; x < depth.cols; x++)
+				{
+					float z = depth.at<float>(y, x), f = reference.at<float>(y, x), t = frame.depth.at<float>(y, x);
+					if (f != f)
+						open++;
+					else if (z != z && fabsf(t) < INFINITY && fabsf(f) < INFINITY)
+					{
+						filledError += (f - t) * (f - t);
+						filled++;
+					}
+					else if (fabsf(z) < INFINITY)
+						measuredError += (f - t) * (f - t);
+				}
+			}
+			cout << setw(24) << formatSpatialFilter(configs[c]) << " : " << 100.0 * open / depth.total() << "% open, filled "
+				<< (filled ? sqrt(filledError / filled) : 0) << " mm, measures " << sqrt(measuredError / measures) << " mm rms" << endl;
+			if (open >= holes)
+				result = 1;
+
+			cout << setw(24) << "";
+			for (int i = 0; i < 3 && isas[i] <= bestKernelIsa(); i++)
+			{
+				filter.apply(depth, frame.left, filtered, isas[i]);
+				bool ok = memcmp(reference.data, filtered.data, reference.total() * sizeof(float)) == 0;
+				if (!ok)
+					result = 1;
+				cout << (i ? ", " : "   ") << kernelIsaName(isas[i]) << " " << millisecondsPerCall([&]() {
+					filter.apply(depth, frame.left, filtered, isas[i]);
+				}, iterations) << " ms" << (ok ? "" : " MISMATCH");
+			}
+			cout << endl;
+		}
+	}
+	cout << endl;
+	return result;
+}
+
+// Stands in for the camera : forwards grabs and counts the streams each one asked for
+class CountingFrameSource : public FrameSource
+{
+public:
+	explicit CountingFrameSource(FrameSource &source) : m_source(source), m_grabs(0)
+	{
+		for (int i = 0; i < 4; i++)
+			m_requests[i] = 0;
+	}
+	cv::Size size() const { return m_source.size(); }
+	bool grab(DepthFrame &frame, unsigned int streams)
+	{
+		m_grabs++;
+		for (int i = 0; i < 4; i++)
+			if (streams & (1 << i))
+				m_requests[i]++;
+		return m_source.grab(frame, streams);
+	}
+	int grabs() const { return m_grabs; }
+	int requests(FrameStream stream) const
+	{
+		int i = 0;
+		while ((1 << i) != stream)
+			i++;
+		return m_requests[i];
+	}
+private:
+	FrameSource &m_source;
+	int m_grabs, m_requests[4];
+};
+
+int runDemandCheck(FrameSource &source)
+{
+	int result = 0;
+	cout << "Stream demand" << endl;
+
+	// Consumers like the UI registers them : depth for every frame, the rest for previews only
+	FrameDemand demand;
+	demand.add("spout", FRAME_DEPTH);
+	demand.add("view window", FRAME_VIEW, true);
+	int confidence = demand.add("confidence window", 0, true);
+
+	CountingFrameSource counting(source);
+	DepthFrame frame;
+	const int frames = 40, previewEvery = 5;
+	for (int i = 0; i < frames; i++)
+	{
+		// Confidence window opened half way
+		if (i == frames / 2)
+			demand.update(confidence, FRAME_CONFIDENCE);
+		bool preview = i % previewEvery == 0;
+		unsigned int streams = demand.streams(preview);
+		if (!counting.grab(frame, streams))
+			return 1;
+		// Recordings may lack a stream, so only what wasn't asked for has to be missing
+		if (frame.depth.empty() || (!(streams & (FRAME_LEFT | FRAME_VIEW)) && !frame.left.empty()) ||
+			(!(streams & FRAME_CONFIDENCE) && !frame.confidence.empty()))
+			result = 1;
+	}
+
+	const int previews = frames / previewEvery;
+	struct { FrameStream stream; int expected; } expected[] = {
+		{ FRAME_DEPTH, frames }, { FRAME_VIEW, previews }, { FRAME_CONFIDENCE, previews / 2 }, { FRAME_LEFT, 0 },
+	};
+	string names;
+	for (int i = 0; i < 4; i++)
+	{
+		int requested = counting.requests(expected[i].stream);
+		bool ok = requested == expected[i].expected;
+		if (!ok)
+			result = 1;
+		cout << setw(12) << frameStreamNames(expected[i].stream, names) << " : asked for in " << requested
+			<< " of " << counting.grabs() << " grabs" << (ok ? "" : " MISMATCH") << endl;
+	}
+	cout << "  " << (result ? "frames held streams NOT asked for" : "frames held only the streams asked for") << endl;
+
+	// What the camera would compute for each mask
+	const unsigned int masks[] = { 0, FRAME_LEFT, FRAME_VIEW, FRAME_CONFIDENCE, FRAME_DEPTH, FRAME_ALL };
+	const bool measure[] = { false, false, false, false, true, true };
+	const bool disparity[] = { false, false, false, true, true, true };
+	for (int i = 0; i < 6; i++)
+	{
+		sl::zed::GrabParams params = ZedFrameSource::grabParams(masks[i], sl::zed::STANDARD);
+		bool ok = params.computeMeasure == measure[i] && params.computeDisparity == disparity[i] && !params.computeXYZ;
+		if (!ok)
+			result = 1;
+		cout << setw(12) << frameStreamNames(masks[i], names) << " : measure " << params.computeMeasure
+			<< ", disparity " << params.computeDisparity << ", XYZ " << params.computeXYZ << (ok ? "" : " MISMATCH") << endl;
+	}
+	cout << endl;
+	return result;
+}
+
+int runPipelineBenchmark(FrameSource &source, int seconds, FramePipeline::DropPolicy policy, bool memoryShare)
+{
+	FramePipeline pipeline(4, policy);
+	pipeline.setCapture([&](PipelineFrame &frame) -> bool {
+		return source.grab(frame.source, FRAME_DEPTH);
+	});
+	pipeline.setProcess([](PipelineFrame &frame) {
+		DepthPlaneParams params;
+		params.flip = true;
+		depthToPlane(frame.source.depth, frame.plane, params);
+	});
+
+	// Published like the application does, and a GL sender's frame read back the way receivers do
+	Opencv2Spout* sender = NULL;
+	char name[] = "ZedToSpoutBenchmark"; // kept by initReceiver
+	bool bReceiver = false;
+	cv::Mat received;
+	unsigned long long receivedFrames = 0;
+	pipeline.setPublish([&](PipelineFrame &frame) {
+		sender->draw(frame.plane, false, true);
+		if (bReceiver)
+		{
+			received = sender->receiveTexture();
+			if (!received.empty())
+				receivedFrames++;
+		}
+	}, [&]() {
+		char program[] = "ZedToSpout4";
+		char* argv[] = { program, NULL };
+		Opencv2Spout::setHiddenWindow(true);
+		sender = new Opencv2Spout(1, argv, source.size().width, source.size().height, false, memoryShare, 0, name);
+		bReceiver = !memoryShare && sender->initReceiver(name);
+	});
+
+	cout << "Pipeline benchmark, " << seconds << " s, "
+		<< (policy == FramePipeline::DROP_OLDEST ? "drop oldest" : "blocking") << ", "
+		<< (memoryShare ? "memoryshare" : "texture sharing") << endl;
+
+	// After the first second every frame must reuse buffers : nothing from the
+	// heap in any thread, no Mat from the OpenCV allocator, no new pool slot.
+	// Nothing is printed meanwhile, the stats come at the end.
+	CountingAllocator counting;
+	cv::Mat::setDefaultAllocator(&counting);
+	unsigned long long warmAllocations = 0, warmHeap = 0, warmFrames = 0, warmSlots = 0;
+	TelemetrySnapshot snapshot;
+
+	pipeline.start();
+	this_thread::sleep_for(chrono::seconds(1));
+	pipeline.printStats(cout);
+	cout << endl;
+	warmSlots = pipeline.pool().stats().heapAllocations;
+	pipeline.telemetry().snapshot(snapshot);
+	warmFrames = snapshot.frames;
+	warmAllocations = counting.count();
+	setHeapCounting(true);
+	warmHeap = heapAllocations();
+	this_thread::sleep_for(chrono::seconds(seconds > 1 ? seconds - 1 : 1));
+	unsigned long long heap = heapAllocations() - warmHeap;
+	unsigned long long allocations = counting.count() - warmAllocations;
+	setHeapCounting(false);
+	pipeline.stop();
+	cv::Mat::setDefaultAllocator(NULL);
+
+	pipeline.printStats(cout);
+	cout << endl;
+	pipeline.telemetry().snapshot(snapshot);
+	FramePool::Stats pool = pipeline.pool().stats();
+	unsigned long long slots = pool.heapAllocations - warmSlots;
+	unsigned long long frames = snapshot.frames - warmFrames;
+	bool ok = heap == 0 && allocations == 0 && slots == 0 && frames > 0;
+	cout << "Steady state : ";
+	if (heapCounted())
+		cout << heap << (heapCountsMalloc() ? " heap allocations (malloc and new), " : " operator new calls, ");
+	else
+		cout << "heap not counted (Bench configuration only), ";
+	cout << allocations << " Mat heap allocations and " << slots << " new pool buffers over " << frames << " frames";
+	if (bReceiver)
+		cout << ", " << receivedFrames << " received back";
+	cout << ", " << (ok ? "ok" : "FAILED") << endl;
+	cout << "Frame pool : " << pool.hits << " hits, " << pool.misses << " misses, "
+		<< pool.heapAllocations << " buffers" << endl;
+	return ok ? 0 : 1;
+}
+
+// Published frames per second after the first second, with the preview
+// windows and the UI loop of the application on this thread, or without
+static double measurePipelineFps(FrameSource &source, int seconds, bool windowed)
+{
+	FramePipeline pipeline(4, FramePipeline::DROP_OLDEST);
+	pipeline.setPreviewInterval(windowed ? 66 : 0);
+	pipeline.setCapture([&](PipelineFrame &frame) -> bool {
+		return source.grab(frame.source, frame.preview ? FRAME_DEPTH | FRAME_LEFT : FRAME_DEPTH);
+	});
+	pipeline.setProcess([](PipelineFrame &frame) {
+		DepthPlaneParams params;
+		params.flip = true;
+		depthToPlane(frame.source.depth, frame.plane, params);
+	});
+
+	SpoutMemorySender sender;
+	if (!sender.create("ZedToSpoutBenchmark", source.size().width, source.size().height))
+		return 0;
+	pipeline.setPublish([&](PipelineFrame &frame) {
+		sender.send(frame.plane, false);
+	});
+
+	const cv::Size previewSize(source.size().width / 2, source.size().height / 2);
+	PreviewScaler planeScaler, viewScaler;
+	pipeline.setPreview([&](PipelineFrame &frame, PipelinePreview &preview) {
+		planeScaler.resize(frame.plane, preview.plane, previewSize, 1.0f, true);
+		if (!frame.source.left.empty())
+			viewScaler.resize(frame.source.left, preview.view, previewSize);
+	});
+
+	pipeline.start();
+	this_thread::sleep_for(chrono::seconds(1));
+	TelemetrySnapshot warm, done;
+	pipeline.telemetry().snapshot(warm);
+	chrono::steady_clock::time_point end = chrono::steady_clock::now() + chrono::seconds(seconds);
+	PipelinePreview preview;
+	if (windowed)
+	{
+		while (chrono::steady_clock::now() < end)
+		{
+			if (pipeline.latestPreview(preview))
+			{
+				if (!preview.plane.empty())
+					cv::imshow("DEPTH", preview.plane);
+				if (!preview.view.empty())
+					cv::imshow("VIEW", preview.view);
+			}
+			cv::waitKey(66);
+		}
+	}
+	else
+		this_thread::sleep_until(end);
+	pipeline.telemetry().snapshot(done);
+	pipeline.stop();
+	if (windowed)
+		cv::destroyAllWindows();
+
+	TelemetrySnapshot measured = done.since(warm);
+	return measured.seconds > 0 ? measured.frames / measured.seconds : 0;
+}
+
+int runHeadlessBenchmark(FrameSource &source, int seconds)
+{
+	cout << "Headless benchmark, " << seconds << " s each" << endl;
+	double windowed = measurePipelineFps(source, seconds, true);
+	double headless = measurePipelineFps(source, seconds, false);
+	if (windowed <= 0 || headless <= 0)
+	{
+		cout << "No frames published" << endl;
+		return 1;
+	}
+	cout << fixed << setprecision(1)
+		<< "Windowed : " << windowed << " fps, headless : " << headless << " fps, "
+		<< showpos << 100.0 * (headless - windowed) / windowed << noshowpos << "%" << endl;
+	return 0;
+}
+
+//
+// Frame events
+//
+
+static double threadCpuSeconds()
+{
+#ifdef _WIN32
+	FILETIME created, exited, kernel, user;
+	if (!GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user))
+		return 0;
+	ULARGE_INTEGER k, u;
+	k.LowPart = kernel.dwLowDateTime;
+	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;
+	u.HighPart = user.dwHighDateTime;
+	return (k.QuadPart + u.QuadPart) * 1e-7;
+#else
+	struct timespec t;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+#endif
+}
+
+struct FrameEventResult
+{
+	unsigned long long frames; // new frames picked up
+	unsigned long long reads;  // receive() calls that copied the map
+	double latencyMs;          // mean, publish to pick up
+	double cpuMs;              // receiver thread CPU per second
+};
+
+// A receiver over seconds, polling the map at the render tick or woken by the sender's event
+static FrameEventResult runFrameEventReceiver(const char* name, unsigned int width, unsigned int height,
+	int seconds, int tickMsec, bool useEvents)
+{
+	FrameEventResult result;
+	memset(&result, 0, sizeof(result));
+	SpoutMemoryReceiver receiver;
+	if (!receiver.open(name, width, height))
+		return result;
+	// The polling receiver can't tell a new frame from the last one, the sequence is only read to measure it
+	SpoutFrameEvent probe;
+	probe.open(name);
+	unsigned int seen = probe.sequence();
+
+	cv::Mat img;
+	double latency = 0;
+	double cpuStart = threadCpuSeconds();
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	chrono::steady_clock::time_point end = start + chrono::seconds(seconds);
+	while (chrono::steady_clock::now() < end)
+	{
+		if (useEvents)
+		{
+			if (!receiver.waitFrame(tickMsec))
+				continue;
+		}
+		else
+			this_thread::sleep_for(chrono::milliseconds(tickMsec));
+		if (!receiver.receive(img))
+			continue;
+		result.reads++;
+		unsigned int sequence = probe.sequence();
+		if (sequence != seen)
+		{
+			seen = sequence;
+			result.frames++;
+			unsigned long long now = (unsigned long long)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+			unsigned long long sent = probe.timestamp();
+			latency += now > sent ? (now - sent) * 1e-6 : 0.0;
+		}
+	}
+	double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	result.cpuMs = (threadCpuSeconds() - cpuStart) * 1000.0 / elapsed;
+	result.latencyMs = result.frames > 0 ? latency / result.frames : 0;
+	return result;
+}
+
+int runFrameEventBenchmark(int seconds)
+{
+	const char* name = "ZedToSpoutEvents";
+	const unsigned int width = 1280, height = 720;
+	const double senderFps = 30;
+	const int tickMsec = 16; // a 60 Hz render loop
+	SpoutMemorySender sender;
+	if (!sender.create(name, width, height))
+		return 1;
+	cout << "Frame events, " << seconds << " s each, sender at " << senderFps << " fps, receiver tick "
+		<< tickMsec << " ms" << endl;
+
+	atomic<bool> sending(true);
+	thread senderThread([&]() {
+		cv::Mat frame(height, width, CV_8UC4, cv::Scalar(40, 80, 120, 255));
+		SourcePacer pacer(senderFps);
+		while (sending)
+		{
+			pacer.wait();
+			sender.send(frame);
+		}
+	});
+
+	FrameEventResult polled = runFrameEventReceiver(name, width, height, seconds, tickMsec, false);
+	FrameEventResult evented = runFrameEventReceiver(name, width, height, seconds, 100, true);
+	sending = false;
+	senderThread.join();
+
+	const FrameEventResult* results[2] = { &polled, &evented };
+	const char* labels[2] = { "Polling", "Events" };
+	cout << fixed << setprecision(2);
+	for (int i = 0; i < 2; i++)
+		cout << labels[i] << " : " << results[i]->frames << " frames from " << results[i]->reads << " reads, "
+			<< results[i]->latencyMs << " ms mean pickup latency, " << results[i]->cpuMs << " ms CPU per second" << endl;
+	// A frame sent between the wake and the read makes the next wake read nothing new, rarely
+	bool ok = evented.frames > 0 && evented.reads <= evented.frames + evented.frames / 20 + 1;
+	cout << "Frame events : " << (ok ? "ok" : "FAILED") << endl;
+	return ok ? 0 : 1;
+}
+
+// Encodes and decodes with every instruction set, the scalar code is the reference
+static bool depthCodecRoundTrip(const cv::Mat &codes, const DepthCodecParams &params, vector<unsigned char> &encoded,
+	cv::Mat &decoded, size_t &size)
+{
+	vector<unsigned char> reference(depthCodecBound(codes.cols, codes.rows));
+	DepthCodecParams scalar = params;
+	scalar.isa = KERNEL_SCALAR;
+	size = depthCodecEncode((const unsigned short*)codes.data, codes.cols, codes.rows, codes.step, &scalar, reference.data(), reference.size());
+	if (size == 0)
+		return false;
+	encoded.resize(reference.size());
+	decoded.create(codes.size(), CV_16UC1);
+	cv::Mat other(codes.size(), CV_16UC1);
+	const KernelIsa isas[] = { KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2 };
+	for (int i = 0; i < 3 && isas[i] <= bestKernelIsa(); i++)
+	{
+		DepthCodecParams isa = params;
+		isa.isa = isas[i];
+		if (depthCodecEncode((const unsigned short*)codes.data, codes.cols, codes.rows, codes.step, &isa, encoded.data(), encoded.size()) != size ||
+			memcmp(reference.data(), encoded.data(), size) != 0)
+			return false;
+		cv::Mat &out = i == 0 ? decoded : other;
+		if (!depthCodecDecode(encoded.data(), size, (unsigned short*)out.data, out.cols, out.rows, out.step, isas[i]))
+			return false;
+		if (i > 0 && cv::norm(decoded, other, cv::NORM_INF) != 0)
+			return false;
+	}
+	return true;
+}
+
+// Quantized codes come back within half a step, the step growing with the square of the depth
+static bool withinQuantization(const cv::Mat &codes, const cv::Mat &decoded, const DepthCodecParams &params)
+{
+	for (int y = 0; y < codes.rows; y++)
+	{
+		for (int x = 0; x < codes.cols; x++)
+		{
+			unsigned short c = codes.at<unsigned short>(y, x), d = decoded.at<unsigned short>(y, x);
+			if (c == DEPTH16_OCCLUSION || c == DEPTH16_TOO_CLOSE || c == DEPTH16_TOO_FAR)
+			{
+				if (d != c)
+					return false;
+				continue;
+			}
+			// Nearer than the first code : the first code
+			if (c <= params.nearMm)
+			{
+				if (fabs(d - params.nearMm) > 1)
+					return false;
+				continue;
+			}
+			// Codes are even in 1 / depth : the far side of a step is the wider one
+			double farthest = (c > d ? c : d) / 1000.0;
+			double step = params.stepMm * farthest * farthest;
+			if (fabs((double)d - c) > step / 2 + 1)
+				return false;
+		}
+	}
+	return true;
+}
+
+int runDepthCodecBenchmark(FrameSource &source)
+{
+	DepthFrame frame;
+	if (!source.grab(frame, FRAME_DEPTH) || frame.depth.empty())
+		return 1;
+	cv::Mat codes;
+	encodeDepth(frame.depth, codes, DEPTH_R16_MM, false);
+
+	const KernelIsa isas[] = { KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2 };
+	const int iterations = 30;
+	int result = 0;
+	cout << "depth codec " << codes.cols << "x" << codes.rows << ", best instruction set " << kernelIsaName(bestKernelIsa()) << endl;
+	cout << fixed << setprecision(3);
+
+	// Lossless, then quantized coarser and coarser
+	const float steps[] = { 0, 1, 4 };
+	for (int q = 0; q < 3; q++)
+	{
+		DepthCodecParams params;
+		depthCodecDefaults(&params);
+		if (steps[q] > 0)
+		{
+			params.mode = DEPTH_CODEC_QUANTIZED;
+			params.stepMm = steps[q];
+		}
+		vector<unsigned char> encoded;
+		cv::Mat decoded;
+		size_t size = 0;
+		bool ok = depthCodecRoundTrip(codes, params, encoded, decoded, size) &&
+			(steps[q] > 0 ? withinQuantization(codes, decoded, params) : cv::norm(codes, decoded, cv::NORM_INF) == 0);
+		if (!ok)
+			result = 1;
+		if (steps[q] > 0)
+			cout << " quantized, " << steps[q] << " mm at 1 m";
+		else
+			cout << " lossless";
+		cout << " : " << size << " bytes, ratio " << codes.total() * 2.0 / (size ? size : 1) << (ok ? "" : " MISMATCH") << endl;
+		if (!ok)
+			continue;
+
+		for (int i = 0; i < 3 && isas[i] <= bestKernelIsa(); i++)
+		{
+			params.isa = isas[i];
+			cout << setw(10) << kernelIsaName(isas[i]) << " : encode " << millisecondsPerCall([&]() {
+				depthCodecEncode((const unsigned short*)codes.data, codes.cols, codes.rows, codes.step, &params, encoded.data(), encoded.size());
+			}, iterations) << " ms, decode " << millisecondsPerCall([&]() {
+				depthCodecDecode(encoded.data(), size, (unsigned short*)decoded.data, decoded.cols, decoded.rows, decoded.step, isas[i]);
+			}, iterations) << " ms" << endl;
+		}
+	}
+
+	// Odd sizes, nothing but sentinels, noise and runs of one pixel, each of
+	// them whole and then cut short and with bits flipped, which must fail or
+	// at least stay inside the buffers
+	const cv::Size sizes[] = { cv::Size(1, 1), cv::Size(17, 3), cv::Size(1000, 1), cv::Size(64, 64) };
+	cv::RNG rng(21);
+	bool edgesOk = true, truncatedOk = true;
+	for (int s = 0; s < 4; s++)
+	{
+		for (int pattern = 0; pattern < 4; pattern++)
+		{
+			cv::Mat edge(sizes[s], CV_16UC1);
+			for (int i = 0; i < (int)edge.total(); i++)
+			{
+				unsigned short &c = ((unsigned short*)edge.data)[i];
+				switch (pattern)
+				{
+				case 0: c = i % 3 ? DEPTH16_OCCLUSION : DEPTH16_TOO_FAR; break;
+				case 1: c = (unsigned short)rng.uniform(0, 65536); break;
+				case 2: c = i % 2 ? DEPTH16_OCCLUSION : (unsigned short)rng.uniform(2, 65535); break;
+				default: c = (unsigned short)(1000 + rng.uniform(0, 50)); break;
+				}
+			}
+			DepthCodecParams params;
+			depthCodecDefaults(&params);
+			vector<unsigned char> encoded;
+			cv::Mat decoded;
+			size_t size = 0;
+			if (!depthCodecRoundTrip(edge, params, encoded, decoded, size) || cv::norm(edge, decoded, cv::NORM_INF) != 0)
+			{
+				edgesOk = false;
+				continue;
+			}
+			if (depthCodecDecode(encoded.data(), size - 4, (unsigned short*)decoded.data, decoded.cols, decoded.rows, decoded.step, KERNEL_AUTO))
+				truncatedOk = false;
+			for (int flip = 0; flip < 20; flip++)
+			{
+				vector<unsigned char> corrupt(encoded.begin(), encoded.begin() + size);
+				corrupt[rng.uniform(0, (int)size)] ^= (unsigned char)(1 << rng.uniform(0, 8));
+				depthCodecDecode(corrupt.data(), size, (unsigned short*)decoded.data, decoded.cols, decoded.rows, decoded.step, KERNEL_AUTO);
+			}
+		}
+	}
+	if (!edgesOk || !truncatedOk)
+		result = 1;
+	cout << " edge cases " << (edgesOk ? "ok" : "MISMATCH") << ", truncated frames " << (truncatedOk ? "rejected" : "ACCEPTED") << endl;
+	cout << "depth codec : " << (result == 0 ? "ok" : "FAILED") << endl << endl;
+	return result;
+}
+
+//
+// Network
+//
+
+struct NetworkRunResult
+{
+	unsigned long long sent, received, mismatched;
+	double latencyMs, maxLatencyMs; // send to pick up
+	double megabytesPerSecond;      // on the wire
+	NetworkReceiverStats stats;
+};
+
+// Sends the frames round and round at fps over loopback while a thread picks them up
+static NetworkRunResult runNetworkTransfer(const vector<cv::Mat> &frames, NetworkTransport transport, bool compress,
+	double fps, int seconds, double dropRate, int parityGroup, const TileDeltaParams* delta = NULL)
+{
+	NetworkRunResult result;
+	memset(&result, 0, sizeof(result));
+	NetworkDepthReceiver receiver;
+	NetworkDepthSender sender;
+	if (!receiver.open(0, transport) || !sender.open("127.0.0.1", receiver.port(), transport, compress))
+		return result;
+	sender.setParityGroup(parityGroup);
+	sender.setDropRate(dropRate);
+	sender.setDelta(delta);
+
+	atomic<bool> receiving(true);
+	double latency = 0;
+	thread receiverThread([&]() {
+		cv::Mat image;
+		NetworkFrameInfo info;
+		while (receiving)
+		{
+			if (!receiver.receive(image, info, 50))
+				continue;
+			unsigned long long now = (unsigned long long)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+			double ms = now > info.timestamp ? (now - info.timestamp) * 1e-6 : 0.0;
+			latency += ms;
+			if (ms > result.maxLatencyMs)
+				result.maxLatencyMs = ms;
+			result.received++;
+			const cv::Mat &expected = frames[info.sequence % frames.size()];
+			if (image.size() != expected.size() || image.type() != expected.type() ||
+				memcmp(image.data, expected.data, expected.total() * expected.elemSize()) != 0)
+				result.mismatched++;
+		}
+	});
+
+	SourcePacer pacer(fps);
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	chrono::steady_clock::time_point end = start + chrono::seconds(seconds);
+	while (chrono::steady_clock::now() < end)
+	{
+		pacer.wait();
+		unsigned long long now = (unsigned long long)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+		sender.send(frames[sender.sequence() % frames.size()], now);
+		result.sent++;
+	}
+	double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	// The last frames in flight
+	this_thread::sleep_for(chrono::milliseconds(200));
+	receiving = false;
+	receiverThread.join();
+
+	result.latencyMs = result.received > 0 ? latency / result.received : 0;
+	result.megabytesPerSecond = sender.bytesSent() / elapsed * 1e-6;
+	result.stats = receiver.stats();
+	return result;
+}
+
+int runNetworkBenchmark(FrameSource &source, int seconds)
+{
+	// A few different frames, so a frame delivered for another shows
+	vector<cv::Mat> frames;
+	for (int i = 0; i < 8; i++)
+	{
+		DepthFrame frame;
+		if (!source.grab(frame, FRAME_DEPTH) || frame.depth.empty())
+			return 1;
+		cv::Mat codes;
+		encodeDepth(frame.depth, codes, DEPTH_R16_MM, false);
+		frames.push_back(codes);
+	}
+	cout << "Network depth over loopback, " << frames[0].cols << "x" << frames[0].rows << " 16-bit, " << seconds << " s each" << endl;
+	cout << fixed << setprecision(2);
+
+	struct Run
+	{
+		NetworkTransport transport;
+		bool compress;
+		double fps, dropRate;
+		int parityGroup;
+	};
+	const Run runs[] = {
+		{ NETWORK_UDP, false, 30, 0, NETWORK_PARITY_GROUP },
+		{ NETWORK_UDP, true, 30, 0, NETWORK_PARITY_GROUP },
+		{ NETWORK_TCP, false, 30, 0, 0 },
+		{ NETWORK_TCP, true, 30, 0, 0 },
+		{ NETWORK_UDP, false, 60, 0, NETWORK_PARITY_GROUP },
+		{ NETWORK_UDP, true, 60, 0, NETWORK_PARITY_GROUP },
+		{ NETWORK_TCP, false, 60, 0, 0 },
+		{ NETWORK_TCP, true, 60, 0, 0 },
+		// Loss recovery : datagrams dropped at the sender, with and without parity
+		{ NETWORK_UDP, true, 30, 0.001, NETWORK_PARITY_GROUP },
+		{ NETWORK_UDP, true, 30, 0.01, NETWORK_PARITY_GROUP },
+		{ NETWORK_UDP, true, 30, 0.01, 0 },
+	};
+	bool ok = true;
+	for (size_t r = 0; r < sizeof(runs) / sizeof(runs[0]); r++)
+	{
+		const Run &run = runs[r];
+		NetworkRunResult result = runNetworkTransfer(frames, run.transport, run.compress, run.fps, seconds, run.dropRate, run.parityGroup);
+		cout << (run.transport == NETWORK_UDP ? " UDP" : " TCP") << (run.compress ? " RVL" : " raw") << " " << (int)run.fps << " fps";
+		if (run.dropRate > 0)
+			cout << ", " << run.dropRate * 100 << "% lost, parity " << (run.parityGroup ? "on" : "off");
+		cout << " : " << result.received << " / " << result.sent << " frames, " << result.latencyMs << " ms mean latency ("
+			<< result.maxLatencyMs << " max), " << result.megabytesPerSecond << " MB/s, " << result.stats.dropped << " dropped, "
+			<< result.stats.late << " late, " << result.stats.recovered << " datagrams rebuilt";
+		// Losses are the network's, a frame that isn't the one sent is ours
+		bool runOk = result.received > 0 && result.mismatched == 0 && result.stats.corrupt == 0;
+		cout << (runOk ? "" : " FAILED") << endl;
+		ok = ok && runOk;
+	}
+	cout << "Network depth : " << (ok ? "ok" : "FAILED") << endl << endl;
+	return ok ? 0 : 1;
+}
+
+//
+// Tile deltas
+//
+
+// Adds sensor-like noise to the valid codes, more of it further away
+static void addDepthNoise(const cv::Mat &codes, cv::Mat &noisy, cv::RNG &rng, double sigmaAt1m)
+{
+	codes.copyTo(noisy);
+	for (int y = 0; y < noisy.rows; y++)
+	{
+		unsigned short* row = noisy.ptr<unsigned short>(y);
+		for (int x = 0; x < noisy.cols; x++)
+		{
+			if (row[x] == DEPTH16_OCCLUSION || row[x] == DEPTH16_TOO_CLOSE || row[x] == DEPTH16_TOO_FAR)
+				continue;
+			double meters = row[x] / 1000.0;
+			double z = row[x] + rng.gaussian(sigmaAt1m * meters * meters);
+			row[x] = (unsigned short)(z < 2 ? 2 : z > 65534 ? 65534 : z + 0.5);
+		}
+	}
+}
+
+int runTileDeltaBenchmark(FrameSource &source, int frames, int seconds)
+{
+	// The sequence as the source gives it, and with the noise a camera adds to a still room
+	vector<cv::Mat> clean, noisy;
+	cv::RNG rng(23);
+	for (int i = 0; i < frames; i++)
+	{
+		DepthFrame frame;
+		if (!source.grab(frame, FRAME_DEPTH) || frame.depth.empty())
+			return 1;
+		cv::Mat codes, noise;
+		encodeDepth(frame.depth, codes, DEPTH_R16_MM, false);
+		addDepthNoise(codes, noise, rng, 2.0);
+		clean.push_back(codes);
+		noisy.push_back(noise);
+	}
+	const size_t fullBytes = clean[0].total() * sizeof(unsigned short);
+	cout << "Tile deltas of " << frames << " frames " << clean[0].cols << "x" << clean[0].rows << ", " << fullBytes
+		<< " bytes a whole frame, best instruction set " << kernelIsaName(bestKernelIsa()) << endl;
+	cout << fixed << setprecision(3);
+
+	bool ok = true;
+	const int tileSizes[] = { 16, 32, 64 };
+	const int tolerances[] = { 0, 8, 24 };
+	for (int n = 0; n < 2; n++)
+	{
+		const vector<cv::Mat> &sequence = n == 0 ? clean : noisy;
+		for (int t = 0; t < 3; t++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				TileDeltaParams params;
+				params.tileSize = tileSizes[t];
+				params.toleranceMm = tolerances[k];
+				TileDeltaEncoder encoder;
+				encoder.setParams(params);
+				TileDeltaDecoder decoder;
+				vector<unsigned char> encoded;
+				unsigned long long bytes = 0, changed = 0, tiles = 0;
+				double encodeMs = 0, decodeMs = 0;
+				for (size_t i = 0; i < sequence.size(); i++)
+				{
+					chrono::steady_clock::time_point start = chrono::steady_clock::now();
+					size_t size = encoder.encode(sequence[i], encoded);
+					chrono::steady_clock::time_point decodeStart = chrono::steady_clock::now();
+					decoder.apply(encoded.data(), size);
+					decodeMs += chrono::duration<double, milli>(chrono::steady_clock::now() - decodeStart).count();
+					encodeMs += chrono::duration<double, milli>(decodeStart - start).count();
+					bytes += size;
+					changed += encoder.changedTiles();
+					tiles += encoder.tileCount();
+				}
+				cout << (n == 0 ? " clean" : " noisy") << " tile " << setw(2) << params.tileSize << ", tolerance " << setw(2)
+					<< params.toleranceMm << " mm : " << setw(8) << bytes / sequence.size() << " bytes a frame ("
+					<< setprecision(1) << 100.0 * bytes / sequence.size() / fullBytes << "%), " << 100.0 * changed / tiles
+					<< "% tiles" << setprecision(3) << ", encode " << encodeMs / sequence.size() << " ms, decode "
+					<< decodeMs / sequence.size() << " ms" << endl;
+			}
+		}
+	}
+
+	// Instruction sets on the noisy sequence
+	TileDeltaParams params;
+	vector<unsigned char> encoded;
+	const KernelIsa isas[] = { KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2 };
+	for (int i = 0; i < 3 && isas[i] <= bestKernelIsa(); i++)
+	{
+		params.isa = isas[i];
+		TileDeltaEncoder encoder;
+		encoder.setParams(params);
+		size_t f = 0;
+		cout << setw(10) << kernelIsaName(isas[i]) << " : encode " << millisecondsPerCall([&]() {
+			encoder.encode(noisy[f++ % noisy.size()], encoded);
+		}, (int)noisy.size()) << " ms a frame" << endl;
+	}
+
+	// Over loopback, exact so the receiver checks every frame, against whole frames
+	cout << setprecision(2);
+	TileDeltaParams exact;
+	exact.toleranceMm = 0;
+	for (int transport = 0; transport < 2; transport++)
+	{
+		for (int delta = 0; delta < 2; delta++)
+		{
+			NetworkTransport t = transport == 0 ? NETWORK_UDP : NETWORK_TCP;
+			NetworkRunResult result = runNetworkTransfer(clean, t, false, 30, seconds, 0, t == NETWORK_UDP ? NETWORK_PARITY_GROUP : 0,
+				delta ? &exact : NULL);
+			bool runOk = result.received > 0 && result.mismatched == 0 && result.stats.corrupt == 0;
+			cout << (t == NETWORK_UDP ? " UDP" : " TCP") << (delta ? " delta" : " whole") << " 30 fps : " << result.received << " / "
+				<< result.sent << " frames, " << result.megabytesPerSecond << " MB/s, " << result.stats.refused << " refused"
+				<< (runOk ? "" : " FAILED") << endl;
+			ok = ok && runOk;
+		}
+	}
+	cout << "Tile deltas : " << (ok ? "ok" : "FAILED") << endl << endl;
+	return ok ? 0 : 1;
+}
+
+//
+// Depth statistics and auto range
+//
+
+int runDepthStatsBenchmark(FrameSource &source)
+{
+	// tests/DepthStatsTest checks the statistics and the auto range
+	DepthFrame frame;
+	if (!source.grab(frame, FRAME_DEPTH))
+		return 1;
+	cout << "Depth statistics" << endl;
+	const KernelIsa isas[] = { KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2 };
+
+	// The statistics pass against the range pass it takes the place of
+	const int iterations = 100;
+	cout << setprecision(3);
+	for (int i = 0; i < 3 && isas[i] <= bestKernelIsa(); i++)
+	{
+		float minDepth, maxDepth;
+		DepthFrameStats stats;
+		double rangeMs = millisecondsPerCall([&]() { depthRange(frame.depth, minDepth, maxDepth, isas[i]); }, iterations);
+		double statsMs = millisecondsPerCall([&]() { depthStats(frame.depth, stats, isas[i]); }, iterations);
+		cout << setw(12) << kernelIsaName(isas[i]) << " : range " << rangeMs << " ms, statistics " << statsMs << " ms for "
+			<< frame.depth.cols << "x" << frame.depth.rows << endl;
+	}
+	cout << endl;
+	return 0;
+}
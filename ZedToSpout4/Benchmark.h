@@ -0,0 +1,78 @@
+#pragma once
+#include "FramePipeline.h"
+#include "FrameSource.h"
+
+// Runs the capture / process / publish pipeline on a camera-less source for
+// the given number of seconds and prints per-stage latency and throughput
+// after the first second and for the rest. Frames are published through
+// Opencv2Spout::draw, as a texture read back with receiveTexture or through
+// the memoryshare map. Returns non-zero when the frames after the first
+// second took a Mat or a pool buffer from the heap, or anything at all from
+// it in builds that count it, see HeapCount.h.
+int runPipelineBenchmark(FrameSource &source, int seconds, FramePipeline::DropPolicy policy, bool memoryShare);
+
+// Runs the same pipeline on the source once with the preview windows and
+// the UI loop the application shows, once headless, and compares the frames
+// per second published. Give it a recording or the synthetic scene without
+// a rate limit, a paced source runs at its rate either way.
+int runHeadlessBenchmark(FrameSource &source, int seconds);
+
+// A memoryshare sender publishes at 30 fps while a receiver first polls the
+// map on a 60 Hz render tick, then waits for the sender's frame event, and
+// reports the frames picked up, the map reads, the mean latency from publish
+// to pick up and the receiver CPU time. Returns non-zero when the event
+// receiver missed every frame or read one twice.
+int runFrameEventBenchmark(int seconds);
+
+// Compresses a frame of the source as 16-bit millimeters with DepthCodec,
+// lossless and quantized, and reports the ratio and the encode and decode
+// times of each instruction set. Checks the lossless frames come back
+// exactly, the quantized ones within half a step, every instruction set
+// writes the same bytes, odd sizes and sentinel-only frames round trip and
+// truncated frames are rejected. Returns non-zero when a check fails.
+int runDepthCodecBenchmark(FrameSource &source);
+
+// Sends 16-bit depth from the source over loopback with NetworkDepthSender,
+// UDP and TCP, raw and compressed, at 30 and 60 fps, then with datagrams
+// dropped at the sender with and without parity. Reports the frames
+// received, the latency from send to pick up, the bytes on the wire and the
+// datagrams rebuilt. Returns non-zero when a received frame isn't the one
+// sent or nothing arrives.
+int runNetworkBenchmark(FrameSource &source, int seconds);
+
+// Encodes the frames of the source as tile deltas, as they come and with
+// camera-like noise added, at a few tile sizes and tolerances, and reports
+// the bytes a frame, the tiles changed and the encode and decode times of
+// every instruction set, then sends them over UDP and TCP loopback, where the
+// rate is compared with whole frames. tests/TileDeltaRingTest checks the
+// frames rebuilt, in memory and through a frame ring. Returns non-zero when
+// a loopback run loses or garbles frames.
+int runTileDeltaBenchmark(FrameSource &source, int frames, int seconds);
+
+// Times the depth statistics pass of every instruction set against the range
+// pass it takes the place of, on a frame of the source; tests/DepthStatsTest
+// checks the statistics and the auto range.
+int runDepthStatsBenchmark(FrameSource &source);
+
+// Times every depthToPlane and band mask instruction set on a frame of the
+// source against the multi-pass OpenCV conversion, which
+// tests/DepthKernelsTest checks them against, the point clouds and the
+// preview scaling, which tests/PointCloudTest and tests/PreviewScalerTest
+// check. The encodings are timed and checked here too. Returns non-zero when
+// a round trip fails.
+int runKernelBenchmark(FrameSource &source);
+
+// Times the temporal filter of every instruction set on a frame of the
+// source; tests/TemporalFilterTest checks what it does to the noise.
+int runTemporalFilterBenchmark(FrameSource &source);
+
+// Fills holes punched in noisy synthetic frames at 720p and 1080p with a
+// few spatial filter settings, reports the holes left and the error of the
+// filled and measured depths against the scene, and times every instruction
+// set. Returns non-zero when holes stay open or the kernels disagree.
+int runSpatialFilterBenchmark();
+
+// Checks that the streams grabbed follow the registered consumers : a
+// counting wrapper around the source records what every grab asked for and
+// what came back, and the ZED grab parameters are checked for each mask.
+int runDemandCheck(FrameSource &source);
@@ -0,0 +1,317 @@
+#include "stdafx.h"
+#include "BlockCodec.h"
+#include <string.h>
+
+static const int MIN_MATCH = 4;
+static const int LAST_LITERALS = 5;  // the format requires the block to end with literals
+static const int MATCH_LIMIT = 12;   // no match may start in the last 12 bytes
+static const int HASH_LOG = 14;
+static const size_t MAX_OFFSET = 65535;
+
+static inline unsigned int read32(const unsigned char* p)
+{
+	unsigned int v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+static inline unsigned int hash32(unsigned int v)
+{
+	return (v * 2654435761U) >> (32 - HASH_LOG);
+}
+
+static unsigned char* writeLength(unsigned char* op, size_t length)
+{
+	while (length >= 255)
+	{
+		*op++ = 255;
+		length -= 255;
+	}
+	*op++ = (unsigned char)length;
+	return op;
+}
+
+static bool readLength(const unsigned char* &ip, const unsigned char* end, size_t &length)
+{
+	unsigned char b;
+	do
+	{
+		if (ip >= end)
+			return false;
+		b = *ip++;
+		length += b;
+	} while (b == 255);
+	return true;
+}
+
+static unsigned char* writeLiterals(unsigned char* op, unsigned char* token, const unsigned char* literals, size_t length)
+{
+	*token = (unsigned char)((length >= 15 ? 15 : length) << 4);
+	if (length >= 15)
+		op = writeLength(op, length - 15);
+	if (length)
+		memcpy(op, literals, length);
+	return op + length;
+}
+
+size_t BlockCodec::lzCompress(const unsigned char* src, size_t size, unsigned char* dst, std::vector<unsigned int> &hashTable)
+{
+	const unsigned char* ip = src;
+	const unsigned char* anchor = src;
+	const unsigned char* end = src + size;
+	unsigned char* op = dst;
+
+	if (size > (size_t)MATCH_LIMIT)
+	{
+		const unsigned char* matchEnd = end - LAST_LITERALS;
+		const unsigned char* searchEnd = end - MATCH_LIMIT;
+		hashTable.assign((size_t)1 << HASH_LOG, 0);
+
+		ip++;
+		while (ip < searchEnd)
+		{
+			unsigned int sequence = read32(ip);
+			unsigned int h = hash32(sequence);
+			const unsigned char* ref = src + hashTable[h];
+			hashTable[h] = (unsigned int)(ip - src);
+			if (ref >= ip || (size_t)(ip - ref) > MAX_OFFSET || read32(ref) != sequence)
+			{
+				ip++;
+				continue;
+			}
+
+			// Grow the match backwards over pending literals, then forwards
+			while (ip > anchor && ref > src && ip[-1] == ref[-1])
+			{
+				ip--;
+				ref--;
+			}
+			const unsigned char* mp = ip + MIN_MATCH;
+			const unsigned char* rp = ref + MIN_MATCH;
+			while (mp < matchEnd && *mp == *rp)
+			{
+				mp++;
+				rp++;
+			}
+
+			unsigned char* token = op++;
+			op = writeLiterals(op, token, anchor, ip - anchor);
+			size_t offset = ip - ref;
+			*op++ = (unsigned char)offset;
+			*op++ = (unsigned char)(offset >> 8);
+			size_t matchLength = mp - ip - MIN_MATCH;
+			*token |= (unsigned char)(matchLength >= 15 ? 15 : matchLength);
+			if (matchLength >= 15)
+				op = writeLength(op, matchLength - 15);
+
+			ip = anchor = mp;
+			if (ip < searchEnd)
+				hashTable[hash32(read32(ip - 2))] = (unsigned int)(ip - 2 - src);
+		}
+	}
+
+	unsigned char* token = op++;
+	op = writeLiterals(op, token, anchor, end - anchor);
+	return op - dst;
+}
+
+bool BlockCodec::lzDecompress(const unsigned char* src, size_t srcSize, unsigned char* dst, size_t dstSize)
+{
+	const unsigned char* ip = src;
+	const unsigned char* end = src + srcSize;
+	unsigned char* op = dst;
+	unsigned char* dstEnd = dst + dstSize;
+
+	while (ip < end)
+	{
+		unsigned int token = *ip++;
+		size_t length = token >> 4;
+		if (length == 15 && !readLength(ip, end, length))
+			return false;
+		if ((size_t)(end - ip) < length || (size_t)(dstEnd - op) < length)
+			return false;
+		if (length)
+			memcpy(op, ip, length);
+		op += length;
+		ip += length;
+		if (ip == end)
+			break; // the last sequence has no match
+
+		if (end - ip < 2)
+			return false;
+		size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (size_t)(op - dst))
+			return false;
+		length = token & 15;
+		if (length == 15 && !readLength(ip, end, length))
+			return false;
+		length += MIN_MATCH;
+		if ((size_t)(dstEnd - op) < length)
+			return false;
+
+		const unsigned char* ref = op - offset;
+		if (offset >= length)
+		{
+			memcpy(op, ref, length);
+			op += length;
+		}
+		else
+		{
+			// Overlapping copy, this is how runs are encoded
+			for (size_t i = 0; i < length; i++)
+				*op++ = *ref++;
+		}
+	}
+	return op == dstEnd;
+}
+
+// Elements are split into byte planes : plane k holds byte k of every element,
+// bytes past the last whole element are copied as they are.
+static size_t filterElementSize(BlockFilter filter)
+{
+	switch (filter)
+	{
+	case FILTER_BGRA: return 4;
+	case FILTER_U16:  return 2;
+	case FILTER_F32:  return 4;
+	default:          return 1;
+	}
+}
+
+void BlockCodec::applyFilter(BlockFilter filter, const unsigned char* src, size_t size, unsigned char* dst)
+{
+	size_t elementSize = filterElementSize(filter);
+	size_t n = size / elementSize;
+	size_t tail = n * elementSize;
+
+	switch (filter)
+	{
+	case FILTER_BGRA:
+		for (int k = 0; k < 4; k++)
+		{
+			unsigned char* plane = dst + k * n;
+			unsigned char prev = 0;
+			for (size_t i = 0; i < n; i++)
+			{
+				unsigned char v = src[i * 4 + k];
+				plane[i] = (unsigned char)(v - prev);
+				prev = v;
+			}
+		}
+		break;
+	case FILTER_U16:
+	{
+		unsigned short prev = 0;
+		for (size_t i = 0; i < n; i++)
+		{
+			unsigned short v;
+			memcpy(&v, src + i * 2, 2);
+			short d = (short)(v - prev);
+			unsigned short z = (unsigned short)(((unsigned short)d << 1) ^ (d >> 15));
+			dst[i] = (unsigned char)z;
+			dst[n + i] = (unsigned char)(z >> 8);
+			prev = v;
+		}
+		break;
+	}
+	case FILTER_F32:
+	{
+		unsigned int prev = 0;
+		for (size_t i = 0; i < n; i++)
+		{
+			unsigned int v = read32(src + i * 4);
+			unsigned int x = v ^ prev;
+			dst[i] = (unsigned char)x;
+			dst[n + i] = (unsigned char)(x >> 8);
+			dst[2 * n + i] = (unsigned char)(x >> 16);
+			dst[3 * n + i] = (unsigned char)(x >> 24);
+			prev = v;
+		}
+		break;
+	}
+	default:
+		tail = 0;
+		break;
+	}
+	if (size > tail)
+		memcpy(dst + tail, src + tail, size - tail);
+}
+
+void BlockCodec::revertFilter(BlockFilter filter, const unsigned char* src, size_t size, unsigned char* dst)
+{
+	size_t elementSize = filterElementSize(filter);
+	size_t n = size / elementSize;
+	size_t tail = n * elementSize;
+
+	switch (filter)
+	{
+	case FILTER_BGRA:
+		for (int k = 0; k < 4; k++)
+		{
+			const unsigned char* plane = src + k * n;
+			unsigned char prev = 0;
+			for (size_t i = 0; i < n; i++)
+			{
+				prev = (unsigned char)(prev + plane[i]);
+				dst[i * 4 + k] = prev;
+			}
+		}
+		break;
+	case FILTER_U16:
+	{
+		unsigned short prev = 0;
+		for (size_t i = 0; i < n; i++)
+		{
+			unsigned short z = (unsigned short)(src[i] | (src[n + i] << 8));
+			short d = (short)((z >> 1) ^ (unsigned short)(-(short)(z & 1)));
+			prev = (unsigned short)(prev + d);
+			memcpy(dst + i * 2, &prev, 2);
+		}
+		break;
+	}
+	case FILTER_F32:
+	{
+		unsigned int prev = 0;
+		for (size_t i = 0; i < n; i++)
+		{
+			unsigned int x = src[i] | (src[n + i] << 8) | (src[2 * n + i] << 16) | ((unsigned int)src[3 * n + i] << 24);
+			prev ^= x;
+			memcpy(dst + i * 4, &prev, 4);
+		}
+		break;
+	}
+	default:
+		tail = 0;
+		break;
+	}
+	if (size > tail)
+		memcpy(dst + tail, src + tail, size - tail);
+}
+
+size_t BlockCodec::compress(BlockFilter filter, const unsigned char* src, size_t size, std::vector<unsigned char> &out)
+{
+	if (filter != FILTER_NONE)
+	{
+		m_filtered.resize(size);
+		applyFilter(filter, src, size, m_filtered.data());
+		src = m_filtered.data();
+	}
+	out.resize(lzBound(size));
+	size_t compressed = lzCompress(src, size, out.data(), m_hashTable);
+	if (compressed >= size)
+		return 0;
+	out.resize(compressed);
+	return compressed;
+}
+
+bool BlockCodec::decompress(BlockFilter filter, const unsigned char* src, size_t srcSize, unsigned char* dst, size_t dstSize)
+{
+	if (filter == FILTER_NONE)
+		return lzDecompress(src, srcSize, dst, dstSize);
+	m_filtered.resize(dstSize);
+	if (!lzDecompress(src, srcSize, m_filtered.data(), dstSize))
+		return false;
+	revertFilter(filter, m_filtered.data(), dstSize, dst);
+	return true;
+}
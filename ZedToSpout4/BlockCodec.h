@@ -0,0 +1,35 @@
+#pragma once
+#include <stddef.h>
+#include <vector>
+
+// Byte layout filters run before compression. Each one turns a frame into
+// byte planes of small residuals so the LZ stage finds long runs.
+enum BlockFilter
+{
+	FILTER_NONE,
+	FILTER_BGRA, // 8-bit BGRA : per channel difference to the previous pixel
+	FILTER_U16,  // uint16 : zigzag difference to the previous value, low / high byte planes
+	FILTER_F32,  // float : xor with the previous value, four byte planes
+};
+
+// Lossless block compression for recordings : a filter followed by an LZ77
+// coder writing the LZ4 block format (greedy matching, 64 KB window).
+// Keeps its scratch buffers, so use one instance per thread.
+class BlockCodec
+{
+public:
+	// Compresses size bytes into out, returns the compressed size or 0 when it would not be smaller
+	size_t compress(BlockFilter filter, const unsigned char* src, size_t size, std::vector<unsigned char> &out);
+	// dstSize must be the exact uncompressed size, returns false on corrupt input
+	bool decompress(BlockFilter filter, const unsigned char* src, size_t srcSize, unsigned char* dst, size_t dstSize);
+
+	static size_t lzBound(size_t size) { return size + size / 255 + 16; }
+	static size_t lzCompress(const unsigned char* src, size_t size, unsigned char* dst, std::vector<unsigned int> &hashTable);
+	static bool lzDecompress(const unsigned char* src, size_t srcSize, unsigned char* dst, size_t dstSize);
+
+	static void applyFilter(BlockFilter filter, const unsigned char* src, size_t size, unsigned char* dst);
+	static void revertFilter(BlockFilter filter, const unsigned char* src, size_t size, unsigned char* dst);
+private:
+	std::vector<unsigned char> m_filtered;
+	std::vector<unsigned int> m_hashTable;
+};
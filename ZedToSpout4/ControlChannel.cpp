@@ -0,0 +1,113 @@
+#include "stdafx.h"
+#include "SocketUtil.h"
+#include "ControlChannel.h"
+#include <iostream>
+using namespace std;
+
+static const int RECEIVE_TIMEOUT_MSEC = 100; // how often the thread checks for close
+static const int MAX_COMMAND = 1024;
+
+static void trimCommand(string &command)
+{
+	size_t end = command.find_last_not_of(" \t\r\n;");
+	command.erase(end == string::npos ? 0 : end + 1);
+}
+
+ControlChannel::ControlChannel() : m_socket(NO_SOCKET), m_bRunning(false)
+{
+}
+
+ControlChannel::~ControlChannel()
+{
+	close();
+}
+
+bool ControlChannel::open(unsigned short port, Handler handler, bool anyInterface)
+{
+	close();
+	m_socket = openUdpSocket(port, anyInterface);
+	if (m_socket == NO_SOCKET)
+		return false;
+	setReceiveTimeout(m_socket, RECEIVE_TIMEOUT_MSEC);
+	m_handler = handler;
+	m_bRunning = true;
+	m_thread = thread(&ControlChannel::receiveLoop, this);
+	return true;
+}
+
+void ControlChannel::close()
+{
+	m_bRunning = false;
+	if (m_thread.joinable())
+		m_thread.join();
+	closeSocket(m_socket);
+	m_socket = NO_SOCKET;
+}
+
+void ControlChannel::receiveLoop()
+{
+	const SOCKET s = (SOCKET)m_socket;
+	char buffer[MAX_COMMAND + 1];
+	while (m_bRunning)
+	{
+		sockaddr_in from;
+		socklen_t fromLength = sizeof(from);
+		int n = recvfrom(s, buffer, MAX_COMMAND, 0, (sockaddr*)&from, &fromLength);
+		if (n <= 0)
+			continue; // timeout
+		buffer[n] = '\0';
+
+		// Max and netcat both end their messages with line breaks or nulls
+		string command(buffer);
+		trimCommand(command);
+		if (command.empty())
+			continue;
+
+		string reply = m_handler(command) + "\n";
+		sendto(s, reply.c_str(), (int)reply.size(), 0, (const sockaddr*)&from, fromLength);
+	}
+}
+
+//
+// ConsoleControl
+//
+
+ConsoleControl::ConsoleControl()
+{
+}
+
+ConsoleControl::~ConsoleControl()
+{
+	close();
+}
+
+void ConsoleControl::open(ControlChannel::Handler handler)
+{
+	close();
+	m_state = make_shared<State>();
+	m_state->handler = handler;
+	thread(&ConsoleControl::readLoop, m_state).detach();
+}
+
+void ConsoleControl::close()
+{
+	if (!m_state)
+		return;
+	lock_guard<mutex> lock(m_state->mutex);
+	m_state->handler = nullptr;
+}
+
+void ConsoleControl::readLoop(shared_ptr<State> state)
+{
+	string command;
+	while (getline(cin, command))
+	{
+		trimCommand(command);
+		if (command.empty())
+			continue;
+		lock_guard<mutex> lock(state->mutex);
+		if (!state->handler)
+			return;
+		cout << state->handler(command) << endl;
+	}
+}
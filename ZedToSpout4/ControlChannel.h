@@ -0,0 +1,60 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+
+// Text commands over UDP, one command per datagram. Each command is handed
+// to the handler on the channel's own thread and the reply goes back to the
+// sender, so "echo bands 500:1500 | nc -u -w1 127.0.0.1 7000" changes the
+// sender while it runs.
+class ControlChannel
+{
+public:
+	typedef std::function<std::string(const std::string &command)> Handler;
+
+	ControlChannel();
+	~ControlChannel();
+	// Listens on localhost unless anyInterface is set
+	bool open(unsigned short port, Handler handler, bool anyInterface = false);
+	void close();
+	bool isOpen() const { return m_bRunning; }
+private:
+	ControlChannel(const ControlChannel&);
+	ControlChannel& operator=(const ControlChannel&);
+	void receiveLoop();
+
+	intptr_t m_socket;
+	Handler m_handler;
+	std::atomic<bool> m_bRunning;
+	std::thread m_thread;
+};
+
+// The same commands read from standard input, one per line, for running
+// without windows. Replies are printed. The reading thread can't be woken
+// from its read, so it is left to end with the input; once close() returns
+// it never calls the handler again.
+class ConsoleControl
+{
+public:
+	ConsoleControl();
+	~ConsoleControl();
+	void open(ControlChannel::Handler handler);
+	void close();
+private:
+	ConsoleControl(const ConsoleControl&);
+	ConsoleControl& operator=(const ConsoleControl&);
+
+	// Shared with the reading thread, which may outlive this object
+	struct State
+	{
+		std::mutex mutex;
+		ControlChannel::Handler handler; // empty once closed
+	};
+	static void readLoop(std::shared_ptr<State> state);
+
+	std::shared_ptr<State> m_state;
+};
@@ -0,0 +1,126 @@
+#include "stdafx.h"
+#include "DepthBands.h"
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+using namespace std;
+
+static const char* BAND_MODE_NAMES[] = { "binary", "labels", "bits" };
+
+static string lowerCase(const string &text)
+{
+	string lower;
+	for (size_t i = 0; i < text.size(); i++)
+		lower += (char)tolower((unsigned char)text[i]);
+	return lower;
+}
+
+const char* bandMaskModeName(BandMaskMode mode)
+{
+	return BAND_MODE_NAMES[mode];
+}
+
+bool parseBandMaskMode(const string &text, BandMaskMode &mode)
+{
+	string lower = lowerCase(text);
+	for (int i = 0; i < 3; i++)
+	{
+		if (lower == BAND_MODE_NAMES[i])
+		{
+			mode = (BandMaskMode)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool parseBand(const string &item, int number, DepthBand &band)
+{
+	const char* p = item.c_str();
+	char* end;
+	band.lowerMm = (float)strtod(p, &end);
+	if (end == p || *end != ':')
+		return false;
+	p = end + 1;
+	band.upperMm = (float)strtod(p, &end);
+	if (end == p)
+		return false;
+	long label = number;
+	if (*end == ':')
+	{
+		p = end + 1;
+		label = strtol(p, &end, 10);
+		if (end == p || label < 0 || label > 255)
+			return false;
+	}
+	if (*end != '\0')
+		return false;
+	band.label = (unsigned char)label;
+	// Finite limits only, so the sentinels stay outside every band
+	return fabsf(band.lowerMm) < INFINITY && fabsf(band.upperMm) < INFINITY && band.lowerMm <= band.upperMm;
+}
+
+bool parseDepthBands(const string &text, vector<DepthBand> &bands)
+{
+	vector<DepthBand> parsed;
+	if (lowerCase(text) != "off")
+	{
+		size_t start = 0;
+		while (start < text.size())
+		{
+			size_t end = text.find_first_of(", \t", start);
+			if (end == string::npos)
+				end = text.size();
+			if (end > start)
+			{
+				DepthBand band;
+				if ((int)parsed.size() == MAX_DEPTH_BANDS || !parseBand(text.substr(start, end - start), (int)parsed.size() + 1, band))
+					return false;
+				parsed.push_back(band);
+			}
+			start = end + 1;
+		}
+	}
+	bands.swap(parsed);
+	return true;
+}
+
+string formatDepthBands(const vector<DepthBand> &bands)
+{
+	if (bands.empty())
+		return "off";
+	string text;
+	for (size_t i = 0; i < bands.size(); i++)
+	{
+		char item[64];
+		sprintf(item, "%s%g:%g:%d", i ? "," : "", bands[i].lowerMm, bands[i].upperMm, bands[i].label);
+		text += item;
+	}
+	return text;
+}
+
+//
+// DepthBandSet
+//
+
+void DepthBandSet::set(const vector<DepthBand> &bands)
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_bands = bands;
+}
+
+void DepthBandSet::setMode(BandMaskMode mode)
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_mode = mode;
+}
+
+bool DepthBandSet::get(vector<DepthBand> &bands, BandMaskMode &mode) const
+{
+	lock_guard<mutex> lock(m_mutex);
+	bands = m_bands;
+	mode = m_mode;
+	return !bands.empty();
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Depth band, inclusive at both ends like the lowerLimit (>=p) / upperLimit
+// (<=p) pair of the denseSpace patch. Sentinels never fall inside a band.
+struct DepthBand
+{
+	float lowerMm, upperMm;
+	unsigned char label; // written for this band in BAND_LABELS mode
+};
+
+// How the bands are written into the single channel mask
+enum BandMaskMode
+{
+	BAND_BINARY, // 255 inside any band
+	BAND_LABELS, // label of the first band containing the pixel
+	BAND_BITS,   // bit i set inside band i, one binary mask per bit
+};
+
+static const int MAX_DEPTH_BANDS = 8;
+
+const char* bandMaskModeName(BandMaskMode mode);
+bool parseBandMaskMode(const std::string &text, BandMaskMode &mode);
+
+// "lower:upper[:label]" separated by commas or spaces, in millimeters. Labels
+// default to the band number starting at 1. "off" or nothing clears the list.
+bool parseDepthBands(const std::string &text, std::vector<DepthBand> &bands);
+std::string formatDepthBands(const std::vector<DepthBand> &bands);
+
+// Bands shared between the thread updating them and the processing thread
+class DepthBandSet
+{
+public:
+	DepthBandSet() : m_mode(BAND_BINARY) {}
+	void set(const std::vector<DepthBand> &bands);
+	void setMode(BandMaskMode mode);
+	// Copies the current bands, returns false when there are none
+	bool get(std::vector<DepthBand> &bands, BandMaskMode &mode) const;
+private:
+	mutable std::mutex m_mutex;
+	std::vector<DepthBand> m_bands;
+	BandMaskMode m_mode;
+};
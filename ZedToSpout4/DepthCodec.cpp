@@ -0,0 +1,726 @@
+#include "stdafx.h"
+#include "DepthCodec.h"
+#include "DepthEncoding.h"
+#include "KernelIsa.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+using namespace std;
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DEPTH_CODEC_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define KERNEL_AVX2_TARGET
+#else
+#define KERNEL_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+static const unsigned int CODEC_MAGIC = 0x4C565244; // "DRVL"
+static const unsigned short CODEC_VERSION = 1;
+// Differences are handled this many at a time between the nibbles and the SIMD passes
+static const size_t CODEC_CHUNK = 1024;
+// Longest variable length value, 30 bits : runs of up to a gigapixel
+static const int CODEC_MAX_NIBBLES = 10;
+static const size_t CODEC_MAX_PIXELS = (size_t)1 << 30;
+
+struct CodecHeader
+{
+	unsigned int magic;
+	unsigned short version, mode;
+	unsigned short width, height;
+	float nearMm, stepMm;
+	unsigned int payloadSize; // bytes of nibbles after the header, a multiple of 4
+};
+
+static KernelIsa resolveIsa(int isa)
+{
+	KernelIsa best = bestKernelIsa();
+	return (isa == KERNEL_AUTO || isa > best || isa < KERNEL_AUTO) ? best : (KernelIsa)isa;
+}
+
+static inline unsigned int zigzag(int d)
+{
+	return ((unsigned int)d << 1) ^ (unsigned int)(d >> 31);
+}
+
+//
+// Quantization : code 2 + round(k * (1 / near - 1 / z)) with k = 1e6 / step,
+// so that one code is step * (z / 1 m)^2 millimeters at depth z
+//
+
+struct QuantTables
+{
+	float nearMm, stepMm;
+	unsigned int farCode;          // the too far sentinel, right after the last depth
+	vector<unsigned short> toCode; // by millimeter code
+	vector<unsigned short> toMm;   // by quantized code
+};
+
+static bool quantCodes(float nearMm, float stepMm, unsigned int &farCode)
+{
+	if (!(nearMm >= 2.0f && nearMm <= 65534.0f && stepMm > 0.0f))
+		return false;
+	double k = 1e6 / stepMm;
+	double last = floor(k * (1.0 / nearMm - 1.0 / 65534.0) + 0.5);
+	if (last > 65532.0)
+		return false;
+	farCode = 2 + (unsigned int)last + 1;
+	return true;
+}
+
+static shared_ptr<const QuantTables> quantTables(float nearMm, float stepMm)
+{
+	// The last tables asked for, built again only when the params change
+	static mutex lock;
+	static shared_ptr<const QuantTables> cached;
+	{
+		lock_guard<mutex> guard(lock);
+		if (cached && cached->nearMm == nearMm && cached->stepMm == stepMm)
+			return cached;
+	}
+
+	unsigned int farCode;
+	if (!quantCodes(nearMm, stepMm, farCode))
+		return shared_ptr<const QuantTables>();
+	shared_ptr<QuantTables> tables = make_shared<QuantTables>();
+	tables->nearMm = nearMm;
+	tables->stepMm = stepMm;
+	tables->farCode = farCode;
+	const double k = 1e6 / stepMm, inverseNear = 1.0 / nearMm;
+
+	tables->toCode.resize(65536);
+	tables->toCode[DEPTH16_OCCLUSION] = DEPTH16_OCCLUSION;
+	tables->toCode[DEPTH16_TOO_CLOSE] = DEPTH16_TOO_CLOSE;
+	tables->toCode[DEPTH16_TOO_FAR] = (unsigned short)farCode;
+	for (unsigned int mm = 2; mm < DEPTH16_TOO_FAR; mm++)
+		tables->toCode[mm] = (unsigned short)(2 + (mm <= nearMm ? 0 : (unsigned int)floor(k * (inverseNear - 1.0 / mm) + 0.5)));
+
+	tables->toMm.resize(farCode + 1);
+	tables->toMm[DEPTH16_OCCLUSION] = DEPTH16_OCCLUSION;
+	tables->toMm[DEPTH16_TOO_CLOSE] = DEPTH16_TOO_CLOSE;
+	tables->toMm[farCode] = DEPTH16_TOO_FAR;
+	for (unsigned int code = 2; code < farCode; code++)
+	{
+		double mm = floor(1.0 / (inverseNear - (code - 2) / k) + 0.5);
+		tables->toMm[code] = (unsigned short)(mm < 2.0 ? 2.0 : mm > 65534.0 ? 65534.0 : mm);
+	}
+
+	lock_guard<mutex> guard(lock);
+	cached = tables;
+	return tables;
+}
+
+//
+// Nibbles
+//
+
+// Value as nibbles, the first in the low bits
+struct NibbleCode
+{
+	unsigned long long bits;
+	int count;
+};
+
+static inline NibbleCode nibbleCode(unsigned int value)
+{
+	NibbleCode code = { 0, 0 };
+	do
+	{
+		unsigned int nibble = value & 7;
+		value >>= 3;
+		if (value)
+			nibble |= 8;
+		code.bits |= (unsigned long long)nibble << (4 * code.count);
+		code.count++;
+	} while (value);
+	return code;
+}
+
+// Values of 1 to 3 nibbles, most of the differences
+static struct ShortCodes
+{
+	NibbleCode codes[512];
+	ShortCodes()
+	{
+		for (unsigned int v = 0; v < 512; v++)
+			codes[v] = nibbleCode(v);
+	}
+} s_shortCodes;
+
+static inline int lowestBit64(unsigned long long v)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+#ifdef _M_X64
+	_BitScanForward64(&index, v);
+#else
+	if (!_BitScanForward(&index, (unsigned long)v))
+	{
+		_BitScanForward(&index, (unsigned long)(v >> 32));
+		index += 32;
+	}
+#endif
+	return (int)index;
+#else
+	return __builtin_ctzll(v);
+#endif
+}
+
+// Nibbles go out low first, each byte filled from its low bits. The pending
+// bits are stored as a whole 64-bit word every time and the pointer moves on
+// by the bytes complete : no branch on a word filling up.
+class NibbleWriter
+{
+public:
+	NibbleWriter(unsigned char* out) : m_out(out), m_bits(0), m_count(0) {}
+
+	void put(unsigned int value)
+	{
+		if (value < 512)
+		{
+			putCode(s_shortCodes.codes[value]);
+			return;
+		}
+		NibbleCode code = nibbleCode(value);
+		// At most 6 nibbles at once, with the 7 bits left over they stay within 64
+		if (code.count > 6)
+		{
+			NibbleCode low = { code.bits & 0xFFFFFF, 6 };
+			putCode(low);
+			code.bits >>= 24;
+			code.count -= 6;
+		}
+		putCode(code);
+	}
+
+	// Pads with zero nibbles to 4 bytes, returns the end
+	unsigned char* finish(unsigned char* start)
+	{
+		if (m_count > 0)
+			m_out++;
+		while ((m_out - start) % 4)
+			*m_out++ = 0;
+		return m_out;
+	}
+
+private:
+	void putCode(const NibbleCode &code)
+	{
+		m_bits |= code.bits << m_count;
+		m_count += 4 * code.count;
+		memcpy(m_out, &m_bits, 8);
+		int bytes = m_count >> 3;
+		m_out += bytes;
+		m_bits >>= 8 * bytes;
+		m_count &= 7;
+	}
+
+	unsigned char* m_out;
+	unsigned long long m_bits; // the low m_count are still to be written
+	int m_count;
+};
+
+// Reads values a 64-bit window at a time : the nibbles without their high
+// bit end the values, so one mask of them splits up the window and the
+// values in it are taken out one after the other without going back to
+// memory. Past the end of the input it reads zeros, the caller compares
+// position() to size().
+class NibbleReader
+{
+public:
+	NibbleReader(const unsigned char* in, size_t size) : m_in(in), m_size(size), m_position(0) {}
+
+	bool get(unsigned int* values, size_t count)
+	{
+		size_t k = 0;
+		while (k < count)
+		{
+			unsigned long long window = load();
+			// 15 whole nibbles, the window may start half way through a byte
+			unsigned long long stops = ~window & 0x0888888888888888ull;
+			int start = 0;
+			while (stops && k < count)
+			{
+				int end = lowestBit64(stops) / 4;
+				int length = end - start + 1;
+				unsigned long long bits = window >> (4 * start);
+				// Up to 15 bits without a loop, differences are hardly ever longer
+				if (length <= 5)
+					values[k] = (unsigned int)(((bits & 7) | ((bits >> 1) & 0x38) | ((bits >> 2) & 0x1C0) |
+						((bits >> 3) & 0xE00) | ((bits >> 4) & 0x7000)) & ((1u << (3 * length)) - 1));
+				else if (length <= CODEC_MAX_NIBBLES)
+				{
+					unsigned int value = 0;
+					for (int i = 0; i < length; i++)
+						value |= (unsigned int)((bits >> (4 * i)) & 7) << (3 * i);
+					values[k] = value;
+				}
+				else
+					return false;
+				k++;
+				start = end + 1;
+				stops &= stops - 1;
+			}
+			// No value ends in the window : too long
+			if (start == 0)
+				return false;
+			m_position += start;
+		}
+		return true;
+	}
+
+	// In nibbles
+	size_t position() const { return m_position; }
+	size_t size() const { return m_size * 2; }
+
+	// True when only the zero nibbles padding the last 4 bytes are left
+	bool atEnd() const
+	{
+		if (m_position > size() || size() - m_position >= 8)
+			return false;
+		return (load() & ((1ull << (4 * (size() - m_position))) - 1)) == 0;
+	}
+
+private:
+	unsigned long long load() const
+	{
+		size_t byte = m_position / 2;
+		unsigned long long window = 0;
+		if (byte + 8 <= m_size)
+			memcpy(&window, m_in + byte, 8);
+		else if (byte < m_size)
+			memcpy(&window, m_in + byte, m_size - byte);
+		return window >> (4 * (m_position & 1));
+	}
+
+	const unsigned char* m_in;
+	size_t m_size;
+	size_t m_position; // nibbles
+};
+
+//
+// Runs and differences, one version per instruction set
+//
+
+static size_t zeroRunScalar(const unsigned short* p, size_t n)
+{
+	size_t i = 0;
+	while (i < n && p[i] == 0)
+		i++;
+	return i;
+}
+
+static size_t valueRunScalar(const unsigned short* p, size_t n)
+{
+	size_t i = 0;
+	while (i < n && p[i] != 0)
+		i++;
+	return i;
+}
+
+// zz[k] for p[1..n), zz[0] is the caller's
+static void differencesScalar(const unsigned short* p, size_t n, unsigned int* zz)
+{
+	for (size_t k = 1; k < n; k++)
+		zz[k] = zigzag((int)p[k] - (int)p[k - 1]);
+}
+
+// Back from zigzag differences, false when a depth leaves 1 - 65535
+static bool integrateScalar(const unsigned int* zz, size_t n, int &prev, unsigned short* out)
+{
+	int v = prev;
+	for (size_t k = 0; k < n; k++)
+	{
+		int d = (int)(zz[k] >> 1) ^ -(int)(zz[k] & 1);
+		v += d;
+		if (v < 1 || v > 65535)
+			return false;
+		out[k] = (unsigned short)v;
+	}
+	prev = v;
+	return true;
+}
+
+#ifdef DEPTH_CODEC_X86
+static inline int lowestBit(unsigned int mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (int)index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+// Equal to zero or not, 2 mask bits a pixel
+static size_t runSSE2(const unsigned short* p, size_t n, bool zeros)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const unsigned int all = zeros ? 0xFFFF : 0;
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_loadu_si128((const __m128i*)(p + i)), zero));
+		if (mask != all)
+			return i + lowestBit(mask ^ all) / 2;
+	}
+	return i + (zeros ? zeroRunScalar(p + i, n - i) : valueRunScalar(p + i, n - i));
+}
+
+static void differencesSSE2(const unsigned short* p, size_t n, unsigned int* zz)
+{
+	const __m128i zero = _mm_setzero_si128();
+	size_t k = 1;
+	for (; k + 8 <= n; k += 8)
+	{
+		__m128i cur = _mm_loadu_si128((const __m128i*)(p + k));
+		__m128i prev = _mm_loadu_si128((const __m128i*)(p + k - 1));
+		__m128i dLo = _mm_sub_epi32(_mm_unpacklo_epi16(cur, zero), _mm_unpacklo_epi16(prev, zero));
+		__m128i dHi = _mm_sub_epi32(_mm_unpackhi_epi16(cur, zero), _mm_unpackhi_epi16(prev, zero));
+		_mm_storeu_si128((__m128i*)(zz + k), _mm_xor_si128(_mm_slli_epi32(dLo, 1), _mm_srai_epi32(dLo, 31)));
+		_mm_storeu_si128((__m128i*)(zz + k + 4), _mm_xor_si128(_mm_slli_epi32(dHi, 1), _mm_srai_epi32(dHi, 31)));
+	}
+	for (; k < n; k++)
+		zz[k] = zigzag((int)p[k] - (int)p[k - 1]);
+}
+
+// 4 differences to depths : unzigzag, prefix sum, range check, narrow
+static inline bool integrate4SSE2(__m128i z, __m128i &carry, unsigned short* out)
+{
+	const __m128i one = _mm_set1_epi32(1);
+	__m128i d = _mm_xor_si128(_mm_srli_epi32(z, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(z, one)));
+	d = _mm_add_epi32(d, _mm_slli_si128(d, 4));
+	d = _mm_add_epi32(d, _mm_slli_si128(d, 8));
+	__m128i v = _mm_add_epi32(d, carry);
+	__m128i bad = _mm_or_si128(_mm_cmplt_epi32(v, one), _mm_cmpgt_epi32(v, _mm_set1_epi32(65535)));
+	if (_mm_movemask_epi8(bad) != 0)
+		return false;
+	carry = _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 3));
+	// Unsigned narrowing without SSE4.1 : shift into the signed range and back
+	const __m128i bias = _mm_set1_epi32(32768);
+	__m128i packed = _mm_packs_epi32(_mm_sub_epi32(v, bias), _mm_sub_epi32(v, bias));
+	packed = _mm_xor_si128(packed, _mm_set1_epi16((short)0x8000));
+	_mm_storel_epi64((__m128i*)out, packed);
+	return true;
+}
+
+static bool integrateSSE2(const unsigned int* zz, size_t n, int &prev, unsigned short* out)
+{
+	__m128i carry = _mm_set1_epi32(prev);
+	size_t k = 0;
+	for (; k + 4 <= n; k += 4)
+		if (!integrate4SSE2(_mm_loadu_si128((const __m128i*)(zz + k)), carry, out + k))
+			return false;
+	prev = _mm_cvtsi128_si32(carry);
+	return integrateScalar(zz + k, n - k, prev, out + k);
+}
+
+KERNEL_AVX2_TARGET static size_t runAVX2(const unsigned short* p, size_t n, bool zeros)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const unsigned int all = zeros ? 0xFFFFFFFF : 0;
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16)
+	{
+		unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i*)(p + i)), zero));
+		if (mask != all)
+			return i + lowestBit(mask ^ all) / 2;
+	}
+	return i + (zeros ? zeroRunScalar(p + i, n - i) : valueRunScalar(p + i, n - i));
+}
+
+KERNEL_AVX2_TARGET static void differencesAVX2(const unsigned short* p, size_t n, unsigned int* zz)
+{
+	size_t k = 1;
+	for (; k + 8 <= n; k += 8)
+	{
+		__m256i cur = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(p + k)));
+		__m256i prev = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(p + k - 1)));
+		__m256i d = _mm256_sub_epi32(cur, prev);
+		_mm256_storeu_si256((__m256i*)(zz + k), _mm256_xor_si256(_mm256_slli_epi32(d, 1), _mm256_srai_epi32(d, 31)));
+	}
+	for (; k < n; k++)
+		zz[k] = zigzag((int)p[k] - (int)p[k - 1]);
+}
+
+KERNEL_AVX2_TARGET static bool integrateAVX2(const unsigned int* zz, size_t n, int &prev, unsigned short* out)
+{
+	const __m256i one = _mm256_set1_epi32(1), max = _mm256_set1_epi32(65535);
+	__m256i carry = _mm256_set1_epi32(prev);
+	size_t k = 0;
+	for (; k + 8 <= n; k += 8)
+	{
+		__m256i z = _mm256_loadu_si256((const __m256i*)(zz + k));
+		__m256i d = _mm256_xor_si256(_mm256_srli_epi32(z, 1), _mm256_sub_epi32(_mm256_setzero_si256(), _mm256_and_si256(z, one)));
+		// Prefix sum in each lane, then the low lane's total into the high lane
+		d = _mm256_add_epi32(d, _mm256_slli_si256(d, 4));
+		d = _mm256_add_epi32(d, _mm256_slli_si256(d, 8));
+		__m256i low = _mm256_shuffle_epi32(d, _MM_SHUFFLE(3, 3, 3, 3));
+		d = _mm256_add_epi32(d, _mm256_permute2x128_si256(low, low, 0x08));
+		__m256i v = _mm256_add_epi32(d, carry);
+		__m256i bad = _mm256_or_si256(_mm256_cmpgt_epi32(one, v), _mm256_cmpgt_epi32(v, max));
+		if (_mm256_movemask_epi8(bad) != 0)
+			return false;
+		carry = _mm256_permutevar8x32_epi32(v, _mm256_set1_epi32(7));
+		__m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+		_mm_storeu_si128((__m128i*)(out + k), packed);
+	}
+	prev = _mm256_cvtsi256_si32(carry);
+	return integrateScalar(zz + k, n - k, prev, out + k);
+}
+#endif
+
+static size_t zeroRun(const unsigned short* p, size_t n, KernelIsa isa)
+{
+#ifdef DEPTH_CODEC_X86
+	if (isa == KERNEL_AVX2)
+		return runAVX2(p, n, true);
+	if (isa == KERNEL_SSE2)
+		return runSSE2(p, n, true);
+#endif
+	return zeroRunScalar(p, n);
+}
+
+static size_t valueRun(const unsigned short* p, size_t n, KernelIsa isa)
+{
+#ifdef DEPTH_CODEC_X86
+	if (isa == KERNEL_AVX2)
+		return runAVX2(p, n, false);
+	if (isa == KERNEL_SSE2)
+		return runSSE2(p, n, false);
+#endif
+	return valueRunScalar(p, n);
+}
+
+static void differences(const unsigned short* p, size_t n, unsigned int* zz, KernelIsa isa)
+{
+#ifdef DEPTH_CODEC_X86
+	if (isa == KERNEL_AVX2)
+		return differencesAVX2(p, n, zz);
+	if (isa == KERNEL_SSE2)
+		return differencesSSE2(p, n, zz);
+#endif
+	differencesScalar(p, n, zz);
+}
+
+static bool integrate(const unsigned int* zz, size_t n, int &prev, unsigned short* out, KernelIsa isa)
+{
+#ifdef DEPTH_CODEC_X86
+	if (isa == KERNEL_AVX2)
+		return integrateAVX2(zz, n, prev, out);
+	if (isa == KERNEL_SSE2)
+		return integrateSSE2(zz, n, prev, out);
+#endif
+	return integrateScalar(zz, n, prev, out);
+}
+
+//
+// Frames
+//
+
+static unsigned char* encodeRvl(const unsigned short* in, size_t n, unsigned char* out, KernelIsa isa)
+{
+	unsigned int zz[CODEC_CHUNK];
+	NibbleWriter writer(out);
+	int prev = 0;
+	size_t i = 0;
+	while (i < n)
+	{
+		size_t zeros = zeroRun(in + i, n - i, isa);
+		writer.put((unsigned int)zeros);
+		i += zeros;
+		size_t values = valueRun(in + i, n - i, isa);
+		writer.put((unsigned int)values);
+		for (size_t done = 0; done < values; done += CODEC_CHUNK)
+		{
+			const unsigned short* p = in + i + done;
+			size_t count = values - done < CODEC_CHUNK ? values - done : CODEC_CHUNK;
+			zz[0] = zigzag((int)p[0] - prev);
+			differences(p, count, zz, isa);
+			for (size_t k = 0; k < count; k++)
+				writer.put(zz[k]);
+			prev = p[count - 1];
+		}
+		i += values;
+	}
+	return writer.finish(out);
+}
+
+static bool decodeRvl(const unsigned char* in, size_t size, unsigned short* out, size_t n, KernelIsa isa)
+{
+	unsigned int zz[CODEC_CHUNK];
+	NibbleReader reader(in, size);
+	int prev = 0;
+	size_t i = 0;
+	while (i < n)
+	{
+		unsigned int zeros, values;
+		if (!reader.get(&zeros, 1) || zeros > n - i)
+			return false;
+		memset(out + i, 0, zeros * sizeof(unsigned short));
+		i += zeros;
+		// Never both empty in a frame, but both read 0 past the end of the input
+		if (!reader.get(&values, 1) || values > n - i || (zeros == 0 && values == 0))
+			return false;
+		for (size_t done = 0; done < values; done += CODEC_CHUNK)
+		{
+			size_t count = values - done < CODEC_CHUNK ? values - done : CODEC_CHUNK;
+			if (!reader.get(zz, count) || reader.position() > reader.size() || !integrate(zz, count, prev, out + i + done, isa))
+				return false;
+		}
+		i += values;
+	}
+	return reader.atEnd();
+}
+
+void depthCodecDefaults(DepthCodecParams* params)
+{
+	params->mode = DEPTH_CODEC_LOSSLESS;
+	params->nearMm = 300.0f;
+	params->stepMm = 1.0f;
+	params->isa = KERNEL_AUTO;
+}
+
+size_t depthCodecBound(int width, int height)
+{
+	// A difference takes 6 nibbles at most, and a run count no more nibbles than
+	// pixels in the run, so 7 a pixel and the counts at both ends
+	size_t nibbles = (size_t)width * height * 7 + 2 * CODEC_MAX_NIBBLES;
+	// and the 8 bytes the writer stores at once
+	return sizeof(CodecHeader) + (nibbles + 7) / 8 * 4 + 8;
+}
+
+size_t depthCodecEncode(const unsigned short* depth, int width, int height, size_t stride,
+	const DepthCodecParams* params, unsigned char* out, size_t capacity)
+{
+	const size_t pixels = (size_t)width * height;
+	if (width <= 0 || height <= 0 || width > 65535 || height > 65535 || pixels > CODEC_MAX_PIXELS ||
+		stride < (size_t)width * sizeof(unsigned short) || capacity < depthCodecBound(width, height))
+		return 0;
+	DepthCodecParams defaults;
+	depthCodecDefaults(&defaults);
+	if (!params)
+		params = &defaults;
+	const KernelIsa isa = resolveIsa(params->isa);
+
+	// Runs go on across rows : gather strided or quantized frames first
+	vector<unsigned short> gathered;
+	const unsigned short* in = depth;
+	shared_ptr<const QuantTables> tables;
+	if (params->mode == DEPTH_CODEC_QUANTIZED)
+	{
+		tables = quantTables(params->nearMm, params->stepMm);
+		if (!tables)
+			return 0;
+		gathered.resize(pixels);
+		const unsigned short* toCode = tables->toCode.data();
+		for (int y = 0; y < height; y++)
+		{
+			const unsigned short* row = (const unsigned short*)((const unsigned char*)depth + y * stride);
+			unsigned short* codes = gathered.data() + (size_t)y * width;
+			for (int x = 0; x < width; x++)
+				codes[x] = toCode[row[x]];
+		}
+		in = gathered.data();
+	}
+	else if (params->mode != DEPTH_CODEC_LOSSLESS)
+		return 0;
+	else if (stride != (size_t)width * sizeof(unsigned short))
+	{
+		gathered.resize(pixels);
+		for (int y = 0; y < height; y++)
+			memcpy(gathered.data() + (size_t)y * width, (const unsigned char*)depth + y * stride, width * sizeof(unsigned short));
+		in = gathered.data();
+	}
+
+	CodecHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = CODEC_MAGIC;
+	header.version = CODEC_VERSION;
+	header.mode = (unsigned short)params->mode;
+	header.width = (unsigned short)width;
+	header.height = (unsigned short)height;
+	header.nearMm = tables ? params->nearMm : 0.0f;
+	header.stepMm = tables ? params->stepMm : 0.0f;
+	unsigned char* end = encodeRvl(in, pixels, out + sizeof(header), isa);
+	header.payloadSize = (unsigned int)(end - out - sizeof(header));
+	memcpy(out, &header, sizeof(header));
+	return end - out;
+}
+
+static bool readHeader(const unsigned char* in, size_t size, CodecHeader &header)
+{
+	static_assert(sizeof(CodecHeader) == 24, "the header is part of the stream format");
+	if (!in || size < sizeof(header))
+		return false;
+	memcpy(&header, in, sizeof(header));
+	return header.magic == CODEC_MAGIC && header.version == CODEC_VERSION &&
+		(header.mode == DEPTH_CODEC_LOSSLESS || header.mode == DEPTH_CODEC_QUANTIZED) &&
+		header.width > 0 && header.height > 0 && header.payloadSize % 4 == 0 &&
+		header.payloadSize <= size - sizeof(header);
+}
+
+int depthCodecInfo(const unsigned char* in, size_t size, int* width, int* height)
+{
+	CodecHeader header;
+	if (!readHeader(in, size, header))
+		return 0;
+	*width = header.width;
+	*height = header.height;
+	return 1;
+}
+
+int depthCodecDecode(const unsigned char* in, size_t size, unsigned short* depth, int width, int height,
+	size_t stride, int isa)
+{
+	CodecHeader header;
+	if (!readHeader(in, size, header) || header.width != width || header.height != height ||
+		stride < (size_t)width * sizeof(unsigned short))
+		return 0;
+	const size_t pixels = (size_t)width * height;
+
+	shared_ptr<const QuantTables> tables;
+	if (header.mode == DEPTH_CODEC_QUANTIZED)
+	{
+		tables = quantTables(header.nearMm, header.stepMm);
+		if (!tables)
+			return 0;
+	}
+	const bool direct = !tables && stride == (size_t)width * sizeof(unsigned short);
+	vector<unsigned short> decoded;
+	if (!direct)
+		decoded.resize(pixels);
+	unsigned short* out = direct ? depth : decoded.data();
+	if (!decodeRvl(in + sizeof(header), header.payloadSize, out, pixels, resolveIsa(isa)))
+		return 0;
+	if (direct)
+		return 1;
+
+	for (int y = 0; y < height; y++)
+	{
+		const unsigned short* codes = decoded.data() + (size_t)y * width;
+		unsigned short* row = (unsigned short*)((unsigned char*)depth + y * stride);
+		if (!tables)
+		{
+			memcpy(row, codes, width * sizeof(unsigned short));
+			continue;
+		}
+		const unsigned short* toMm = tables->toMm.data();
+		const unsigned int farCode = tables->farCode;
+		for (int x = 0; x < width; x++)
+		{
+			if (codes[x] > farCode)
+				return 0;
+			row[x] = toMm[codes[x]];
+		}
+	}
+	return 1;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <stddef.h>
+
+// Lossless compression of 16-bit millimeter depth (the DEPTH16_* codes of
+// DepthEncoding.h) after Wilson's RVL : the frame is one sequence of pixels,
+// written as a run of zeros (occlusions), then a run of measured pixels as
+// zigzag differences to the previous measured pixel. Counts and differences
+// are variable length, 3 bits a nibble with the fourth saying another nibble
+// follows, packed low nibble first.
+//
+// The quantized mode maps the millimeters to codes first, one code a step
+// that grows with the square of the depth like the camera's own error, so
+// the near range keeps its precision and the far differences get small.
+// Depths decode to the middle of their step; depths nearer than nearMm come
+// back as nearMm. The sentinels pass through unchanged.
+//
+// A plain C interface so the recorder, a network sender or a receiver in
+// another language can share it. Encoded frames are self-contained : a
+// 24-byte header (size, mode, quantization), then the nibbles padded to 4 bytes.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum DepthCodecMode
+{
+	DEPTH_CODEC_LOSSLESS = 0,
+	DEPTH_CODEC_QUANTIZED = 1,
+};
+
+typedef struct DepthCodecParams
+{
+	int mode;       // DepthCodecMode
+	float nearMm;   // quantized : the first code
+	float stepMm;   // quantized : the step at 1 m
+	int isa;        // KernelIsa, 0 for the best the processor has
+} DepthCodecParams;
+
+// Lossless, best instruction set; quantized would start at 300 mm with 1 mm steps at 1 m
+void depthCodecDefaults(DepthCodecParams* params);
+// Largest encoded frame
+size_t depthCodecBound(int width, int height);
+
+// Encodes width x height codes, stride bytes apart row to row, into out.
+// Returns the encoded size, 0 when capacity is too small or the params are
+// invalid (a step too fine for 16-bit codes).
+size_t depthCodecEncode(const unsigned short* depth, int width, int height, size_t stride,
+	const DepthCodecParams* params, unsigned char* out, size_t capacity);
+
+// Reads the size of an encoded frame, returns 0 when it isn't one
+int depthCodecInfo(const unsigned char* in, size_t size, int* width, int* height);
+// Decodes into width x height codes, which must match the frame. Returns 0
+// on corrupt or truncated input, leaving depth partly written. isa as above.
+int depthCodecDecode(const unsigned char* in, size_t size, unsigned short* depth, int width, int height,
+	size_t stride, int isa);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,199 @@
+#include "stdafx.h"
+#include "DepthEncoding.h"
+#include <ctype.h>
+#include <math.h>
+#include <string.h>
+#include <string>
+
+// DXGI_FORMAT values, the DX headers are only needed by Spout itself
+static const unsigned int DXGI_R32G32B32A32_FLOAT = 2;
+static const unsigned int DXGI_R16G16B16A16_UNORM = 11;
+
+static const char* ENCODING_NAMES[] = { "plane8", "r16_mm", "r32f_m", "rg8_hilo" };
+
+const char* depthEncodingName(DepthEncoding encoding)
+{
+	return ENCODING_NAMES[encoding];
+}
+
+bool parseDepthEncoding(const char* name, DepthEncoding &encoding)
+{
+	std::string lower;
+	for (const char* c = name; *c; c++)
+		lower += (char)tolower((unsigned char)*c);
+	if (lower.compare(0, 6, "depth_") == 0)
+		lower = lower.substr(6);
+	for (int i = 0; i < 4; i++)
+	{
+		if (lower == ENCODING_NAMES[i])
+		{
+			encoding = (DepthEncoding)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+unsigned int depthEncodingDXFormat(DepthEncoding encoding)
+{
+	switch (encoding)
+	{
+	case DEPTH_R16_MM: return DXGI_R16G16B16A16_UNORM;
+	case DEPTH_R32F_M: return DXGI_R32G32B32A32_FLOAT;
+	default:           return 0;
+	}
+}
+
+static inline unsigned short toCode16(float z)
+{
+	if (z != z)
+		return DEPTH16_OCCLUSION;
+	if (z < 2.0f)
+		return (z == -INFINITY) ? DEPTH16_TOO_CLOSE : 2;
+	if (z > 65534.0f)
+		return (z == INFINITY) ? DEPTH16_TOO_FAR : 65534;
+	return (unsigned short)(z + 0.5f);
+}
+
+static inline float fromCode16(unsigned short code)
+{
+	switch (code)
+	{
+	case DEPTH16_OCCLUSION: return NAN;
+	case DEPTH16_TOO_CLOSE: return -INFINITY;
+	case DEPTH16_TOO_FAR:   return INFINITY;
+	default:                return code;
+	}
+}
+
+static inline bool validCode16(unsigned short code)
+{
+	return code != DEPTH16_OCCLUSION && code != DEPTH16_TOO_CLOSE && code != DEPTH16_TOO_FAR;
+}
+
+void encodeDepth(const cv::Mat &depth, cv::Mat &encoded, DepthEncoding encoding, bool flip)
+{
+	CV_Assert(depth.type() == CV_32FC1 && encoding != DEPTH_PLANE8);
+	const int width = depth.cols;
+	switch (encoding)
+	{
+	case DEPTH_R16_MM:
+		encoded.create(depth.size(), CV_16UC1);
+		break;
+	case DEPTH_R32F_M:
+		encoded.create(depth.size(), CV_32FC1);
+		break;
+	default:
+		encoded.create(depth.size(), CV_8UC4);
+		break;
+	}
+
+	for (int y = 0; y < depth.rows; y++)
+	{
+		const float* in = depth.ptr<float>(flip ? depth.rows - 1 - y : y);
+		switch (encoding)
+		{
+		case DEPTH_R16_MM:
+		{
+			unsigned short* out = encoded.ptr<unsigned short>(y);
+			for (int x = 0; x < width; x++)
+				out[x] = toCode16(in[x]);
+			break;
+		}
+		case DEPTH_R32F_M:
+		{
+			// Sentinels go through the multiply unchanged
+			float* out = encoded.ptr<float>(y);
+			for (int x = 0; x < width; x++)
+				out[x] = depthToMeters(in[x]);
+			break;
+		}
+		default:
+		{
+			// BGRA in memory : B valid mask, G low byte, R high byte
+			unsigned char* out = encoded.ptr(y);
+			for (int x = 0; x < width; x++, out += 4)
+			{
+				unsigned short code = toCode16(in[x]);
+				out[0] = validCode16(code) ? 255 : 0;
+				out[1] = (unsigned char)code;
+				out[2] = (unsigned char)(code >> 8);
+				out[3] = 255;
+			}
+			break;
+		}
+		}
+	}
+}
+
+void decodeDepth(const cv::Mat &encoded, DepthEncoding encoding, cv::Mat &depth, bool flip)
+{
+	const int width = encoded.cols;
+	depth.create(encoded.size(), CV_32FC1);
+	for (int y = 0; y < encoded.rows; y++)
+	{
+		float* out = depth.ptr<float>(flip ? encoded.rows - 1 - y : y);
+		switch (encoding)
+		{
+		case DEPTH_R16_MM:
+		{
+			CV_Assert(encoded.type() == CV_16UC1);
+			const unsigned short* in = encoded.ptr<unsigned short>(y);
+			for (int x = 0; x < width; x++)
+				out[x] = fromCode16(in[x]);
+			break;
+		}
+		case DEPTH_R32F_M:
+		{
+			CV_Assert(encoded.type() == CV_32FC1);
+			const float* in = encoded.ptr<float>(y);
+			for (int x = 0; x < width; x++)
+				out[x] = depthFromMeters(in[x]);
+			break;
+		}
+		case DEPTH_RG8_HILO:
+		{
+			CV_Assert(encoded.type() == CV_8UC4);
+			const unsigned char* in = encoded.ptr(y);
+			for (int x = 0; x < width; x++, in += 4)
+				out[x] = fromCode16((unsigned short)(in[1] | (in[2] << 8)));
+			break;
+		}
+		default:
+			CV_Error(cv::Error::StsBadArg, "the 8-bit plane holds no depth");
+		}
+	}
+}
+
+void decodeDepthRGBA(const cv::Mat &rgba, DepthEncoding encoding, cv::Mat &depth, bool flip)
+{
+	CV_Assert(rgba.type() == CV_8UC4);
+	const int width = rgba.cols;
+	depth.create(rgba.size(), CV_32FC1);
+	for (int y = 0; y < rgba.rows; y++)
+	{
+		const unsigned char* in = rgba.ptr(y);
+		float* out = depth.ptr<float>(flip ? rgba.rows - 1 - y : y);
+		switch (encoding)
+		{
+		case DEPTH_R16_MM:
+			for (int x = 0; x < width; x++, in += 4)
+				out[x] = fromCode16((unsigned short)(in[0] | (in[1] << 8)));
+			break;
+		case DEPTH_R32F_M:
+			for (int x = 0; x < width; x++, in += 4)
+			{
+				float meters;
+				memcpy(&meters, in, sizeof(meters));
+				out[x] = depthFromMeters(meters);
+			}
+			break;
+		case DEPTH_RG8_HILO:
+			for (int x = 0; x < width; x++, in += 4)
+				out[x] = fromCode16((unsigned short)((in[0] << 8) | in[1]));
+			break;
+		default:
+			CV_Error(cv::Error::StsBadArg, "the 8-bit plane holds no depth");
+		}
+	}
+}
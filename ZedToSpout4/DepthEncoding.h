@@ -0,0 +1,60 @@
+#pragma once
+#include <float.h>
+#include <math.h>
+#include "opencv2/core.hpp"
+
+// 16-bit millimeter codes : 0 where no measure exists, 1 for too close,
+// 65535 for too far, valid depths rounded and clamped to 2-65534
+static const unsigned short DEPTH16_OCCLUSION = 0;
+static const unsigned short DEPTH16_TOO_CLOSE = 1;
+static const unsigned short DEPTH16_TOO_FAR = 65535;
+
+// What the sender publishes. Every encoding except DEPTH_PLANE8 keeps the
+// measured depth exactly (R16 and RG8 to the millimeter), so receivers can
+// threshold without renormalizing.
+//
+//   encoding        Mat (sent texture)             memoryshare map bytes (R, G, B, A)
+//   DEPTH_PLANE8    CV_8UC1 normalized (GL_RGB)    level, level, level, 255
+//   DEPTH_R16_MM    CV_16UC1 millimeters (GL_R16)  low byte, high byte, 0, 255
+//   DEPTH_R32F_M    CV_32FC1 meters (GL_R32F)      the float, little endian
+//   DEPTH_RG8_HILO  CV_8UC4 BGRA (GL_RGBA8)        high byte, low byte, valid ? 255 : 0, 255
+//
+// 16-bit values use the DEPTH16_* sentinel codes, R32F keeps NAN / +-INFINITY.
+// RG8 is the one that survives any 8-bit RGBA path : R alone is a coarse
+// 256 mm step depth and B masks the invalid pixels.
+enum DepthEncoding { DEPTH_PLANE8, DEPTH_R16_MM, DEPTH_R32F_M, DEPTH_RG8_HILO };
+
+// R32F meters. Scaling by 0.001f maps two millimeter floats to one meters
+// value in about one in twenty near the top of each power of two, so the
+// round trip is exact elsewhere and within one float step of the
+// millimeters there, under 0.002 mm below 32.768 m. The decoded depth is
+// always one that encodes back to the same meters. Sentinels pass through.
+static inline float depthToMeters(float mm)
+{
+	return mm * 0.001f;
+}
+
+static inline float depthFromMeters(float meters)
+{
+	// The float nearest the exact product, or the one next to it on the side that encodes back
+	float mm = (float)((double)meters * 1000.0);
+	if (depthToMeters(mm) == meters || !(fabsf(meters) <= FLT_MAX))
+		return mm;
+	float next = nextafterf(mm, depthToMeters(mm) < meters ? INFINITY : -INFINITY);
+	return depthToMeters(next) == meters ? next : mm;
+}
+
+const char* depthEncodingName(DepthEncoding encoding);
+// Accepts the names above without the DEPTH_ prefix, case insensitive ("r16_mm", "rg8_hilo" ...)
+bool parseDepthEncoding(const char* name, DepthEncoding &encoding);
+// DX11 format for the shared texture so GL senders keep the precision, 0 for the Spout default
+unsigned int depthEncodingDXFormat(DepthEncoding encoding);
+
+// Millimeter float depth to one of the exact encodings, rows bottom-up when flip is set
+void encodeDepth(const cv::Mat &depth, cv::Mat &encoded, DepthEncoding encoding, bool flip);
+
+// Receiver side : back to CV_32FC1 millimeters with the ZED sentinels.
+// decodeDepth takes the Mat or texture contents in its native type,
+// decodeDepthRGBA the memoryshare map as a CV_8UC4 RGBA image.
+void decodeDepth(const cv::Mat &encoded, DepthEncoding encoding, cv::Mat &depth, bool flip);
+void decodeDepthRGBA(const cv::Mat &rgba, DepthEncoding encoding, cv::Mat &depth, bool flip);
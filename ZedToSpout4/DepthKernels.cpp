@@ -0,0 +1,510 @@
+#include "stdafx.h"
+#include "DepthKernels.h"
+#include <math.h>
+#include <float.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DEPTH_KERNELS_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define KERNEL_AVX2_TARGET
+#else
+#define KERNEL_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+static KernelIsa resolveIsa(KernelIsa isa)
+{
+	// Never run code the processor cannot execute, even when asked to
+	KernelIsa best = bestKernelIsa();
+	return (isa == KERNEL_AUTO || isa > best) ? best : isa;
+}
+
+//
+// depthRange
+//
+
+static inline bool isFinite(float z)
+{
+	return fabsf(z) < INFINITY;
+}
+
+static void rangeScalar(const float* src, int n, float &minDepth, float &maxDepth)
+{
+	for (int x = 0; x < n; x++)
+	{
+		if (isFinite(src[x]))
+		{
+			if (src[x] < minDepth) minDepth = src[x];
+			if (src[x] > maxDepth) maxDepth = src[x];
+		}
+	}
+}
+
+#ifdef DEPTH_KERNELS_X86
+static void rangeSSE2(const float* src, int n, float &minDepth, float &maxDepth)
+{
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	const __m128 inf = _mm_set1_ps(INFINITY);
+	const __m128 big = _mm_set1_ps(FLT_MAX), small = _mm_set1_ps(-FLT_MAX);
+	__m128 vmin = _mm_set1_ps(minDepth), vmax = _mm_set1_ps(maxDepth);
+	int x = 0;
+	for (; x + 4 <= n; x += 4)
+	{
+		__m128 z = _mm_loadu_ps(src + x);
+		// False for NAN and both infinities
+		__m128 finite = _mm_cmplt_ps(_mm_and_ps(z, absMask), inf);
+		vmin = _mm_min_ps(vmin, _mm_or_ps(_mm_and_ps(finite, z), _mm_andnot_ps(finite, big)));
+		vmax = _mm_max_ps(vmax, _mm_or_ps(_mm_and_ps(finite, z), _mm_andnot_ps(finite, small)));
+	}
+	float mins[4], maxs[4];
+	_mm_storeu_ps(mins, vmin);
+	_mm_storeu_ps(maxs, vmax);
+	for (int i = 0; i < 4; i++)
+	{
+		if (mins[i] < minDepth) minDepth = mins[i];
+		if (maxs[i] > maxDepth) maxDepth = maxs[i];
+	}
+	rangeScalar(src + x, n - x, minDepth, maxDepth);
+}
+
+KERNEL_AVX2_TARGET
+static void rangeAVX2(const float* src, int n, float &minDepth, float &maxDepth)
+{
+	const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+	const __m256 inf = _mm256_set1_ps(INFINITY);
+	const __m256 big = _mm256_set1_ps(FLT_MAX), small = _mm256_set1_ps(-FLT_MAX);
+	__m256 vmin = _mm256_set1_ps(minDepth), vmax = _mm256_set1_ps(maxDepth);
+	int x = 0;
+	for (; x + 8 <= n; x += 8)
+	{
+		__m256 z = _mm256_loadu_ps(src + x);
+		__m256 finite = _mm256_cmp_ps(_mm256_and_ps(z, absMask), inf, _CMP_LT_OQ);
+		vmin = _mm256_min_ps(vmin, _mm256_blendv_ps(big, z, finite));
+		vmax = _mm256_max_ps(vmax, _mm256_blendv_ps(small, z, finite));
+	}
+	float mins[8], maxs[8];
+	_mm256_storeu_ps(mins, vmin);
+	_mm256_storeu_ps(maxs, vmax);
+	for (int i = 0; i < 8; i++)
+	{
+		if (mins[i] < minDepth) minDepth = mins[i];
+		if (maxs[i] > maxDepth) maxDepth = maxs[i];
+	}
+	rangeScalar(src + x, n - x, minDepth, maxDepth);
+}
+#endif
+
+bool depthRange(const cv::Mat &depth, float &minDepth, float &maxDepth, KernelIsa isa)
+{
+	CV_Assert(depth.type() == CV_32FC1);
+	isa = resolveIsa(isa);
+	minDepth = FLT_MAX;
+	maxDepth = -FLT_MAX;
+	for (int y = 0; y < depth.rows; y++)
+	{
+		const float* src = depth.ptr<float>(y);
+		switch (isa)
+		{
+#ifdef DEPTH_KERNELS_X86
+		case KERNEL_AVX2: rangeAVX2(src, depth.cols, minDepth, maxDepth); break;
+		case KERNEL_SSE2: rangeSSE2(src, depth.cols, minDepth, maxDepth); break;
+#endif
+		default:          rangeScalar(src, depth.cols, minDepth, maxDepth); break;
+		}
+	}
+	return minDepth <= maxDepth;
+}
+
+//
+// depthToPlane
+//
+// value = clamp(g(z) * scale + offset, 0, 255) rounded half up, with g(z) = z
+// or 1 / z. The vector paths do the same float operations in the same order
+// as the scalar one, so all of them agree to the bit.
+//
+
+struct PlaneMapping
+{
+	float scale, offset;
+	float tooClose, tooFar, occlusion; // sentinel outputs + 0.5, ready for truncation
+};
+
+static PlaneMapping planeMapping(float nearMm, float farMm, const DepthPlaneParams &params)
+{
+	PlaneMapping m;
+	m.scale = 0.0f;
+	m.offset = 0.0f;
+	if (farMm > nearMm)
+	{
+		if (params.inverse)
+		{
+			if (nearMm < 1.0f)
+				nearMm = 1.0f;
+			float k = 255.0f / (1.0f / nearMm - 1.0f / farMm);
+			m.scale = k;
+			m.offset = -k / farMm;
+		}
+		else
+		{
+			float k = 255.0f / (farMm - nearMm);
+			m.scale = -k;
+			m.offset = farMm * k;
+		}
+	}
+	m.tooClose = params.tooClose + 0.5f;
+	m.tooFar = params.tooFar + 0.5f;
+	m.occlusion = params.occlusion + 0.5f;
+	return m;
+}
+
+template <bool INVERSE>
+static void rowScalar(const float* src, unsigned char* dst, int n, const PlaneMapping &m)
+{
+	for (int x = 0; x < n; x++)
+	{
+		float z = src[x];
+		float t;
+		if (z != z)
+			t = m.occlusion;
+		else if (z == INFINITY)
+			t = m.tooFar;
+		else if (z == -INFINITY)
+			t = m.tooClose;
+		else
+		{
+			t = (INVERSE ? 1.0f / z : z) * m.scale + m.offset;
+			// Written like MAXPS / MINPS so a NAN product also lands on 0
+			t = t > 0.0f ? t : 0.0f;
+			t = t < 255.0f ? t : 255.0f;
+			t += 0.5f;
+		}
+		dst[x] = (unsigned char)(int)t;
+	}
+}
+
+#ifdef DEPTH_KERNELS_X86
+struct PlaneMappingSSE2
+{
+	__m128 scale, offset, zero, max, half, one, inf, ninf, tooClose, tooFar, occlusion;
+
+	explicit PlaneMappingSSE2(const PlaneMapping &m)
+	{
+		scale = _mm_set1_ps(m.scale);
+		offset = _mm_set1_ps(m.offset);
+		zero = _mm_setzero_ps();
+		max = _mm_set1_ps(255.0f);
+		half = _mm_set1_ps(0.5f);
+		one = _mm_set1_ps(1.0f);
+		inf = _mm_set1_ps(INFINITY);
+		ninf = _mm_set1_ps(-INFINITY);
+		tooClose = _mm_set1_ps(m.tooClose);
+		tooFar = _mm_set1_ps(m.tooFar);
+		occlusion = _mm_set1_ps(m.occlusion);
+	}
+};
+
+static inline __m128 selectSSE2(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+template <bool INVERSE>
+static inline __m128i mapSSE2(const float* src, const PlaneMappingSSE2 &c)
+{
+	__m128 z = _mm_loadu_ps(src);
+	__m128 g = INVERSE ? _mm_div_ps(c.one, z) : z;
+	__m128 t = _mm_add_ps(_mm_mul_ps(g, c.scale), c.offset);
+	t = _mm_add_ps(_mm_min_ps(_mm_max_ps(t, c.zero), c.max), c.half);
+	t = selectSSE2(_mm_cmpeq_ps(z, c.inf), c.tooFar, t);
+	t = selectSSE2(_mm_cmpeq_ps(z, c.ninf), c.tooClose, t);
+	t = selectSSE2(_mm_cmpunord_ps(z, z), c.occlusion, t);
+	return _mm_cvttps_epi32(t);
+}
+
+template <bool INVERSE>
+static void rowSSE2(const float* src, unsigned char* dst, int n, const PlaneMapping &m)
+{
+	const PlaneMappingSSE2 c(m);
+	int x = 0;
+	for (; x + 16 <= n; x += 16)
+	{
+		__m128i a = _mm_packs_epi32(mapSSE2<INVERSE>(src + x, c), mapSSE2<INVERSE>(src + x + 4, c));
+		__m128i b = _mm_packs_epi32(mapSSE2<INVERSE>(src + x + 8, c), mapSSE2<INVERSE>(src + x + 12, c));
+		_mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(a, b));
+	}
+	rowScalar<INVERSE>(src + x, dst + x, n - x, m);
+}
+
+struct PlaneMappingAVX2
+{
+	__m256 scale, offset, zero, max, half, one, inf, ninf, tooClose, tooFar, occlusion;
+	__m256i order;
+
+	KERNEL_AVX2_TARGET
+	explicit PlaneMappingAVX2(const PlaneMapping &m)
+	{
+		scale = _mm256_set1_ps(m.scale);
+		offset = _mm256_set1_ps(m.offset);
+		zero = _mm256_setzero_ps();
+		max = _mm256_set1_ps(255.0f);
+		half = _mm256_set1_ps(0.5f);
+		one = _mm256_set1_ps(1.0f);
+		inf = _mm256_set1_ps(INFINITY);
+		ninf = _mm256_set1_ps(-INFINITY);
+		tooClose = _mm256_set1_ps(m.tooClose);
+		tooFar = _mm256_set1_ps(m.tooFar);
+		occlusion = _mm256_set1_ps(m.occlusion);
+		// The packs work within 128-bit lanes, this puts the 4-byte groups back in order
+		order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	}
+};
+
+template <bool INVERSE>
+KERNEL_AVX2_TARGET
+static inline __m256i mapAVX2(const float* src, const PlaneMappingAVX2 &c)
+{
+	__m256 z = _mm256_loadu_ps(src);
+	__m256 g = INVERSE ? _mm256_div_ps(c.one, z) : z;
+	__m256 t = _mm256_add_ps(_mm256_mul_ps(g, c.scale), c.offset);
+	t = _mm256_add_ps(_mm256_min_ps(_mm256_max_ps(t, c.zero), c.max), c.half);
+	t = _mm256_blendv_ps(t, c.tooFar, _mm256_cmp_ps(z, c.inf, _CMP_EQ_OQ));
+	t = _mm256_blendv_ps(t, c.tooClose, _mm256_cmp_ps(z, c.ninf, _CMP_EQ_OQ));
+	t = _mm256_blendv_ps(t, c.occlusion, _mm256_cmp_ps(z, z, _CMP_UNORD_Q));
+	return _mm256_cvttps_epi32(t);
+}
+
+template <bool INVERSE>
+KERNEL_AVX2_TARGET
+static void rowAVX2(const float* src, unsigned char* dst, int n, const PlaneMapping &m)
+{
+	const PlaneMappingAVX2 c(m);
+	int x = 0;
+	for (; x + 32 <= n; x += 32)
+	{
+		__m256i a = _mm256_packs_epi32(mapAVX2<INVERSE>(src + x, c), mapAVX2<INVERSE>(src + x + 8, c));
+		__m256i b = _mm256_packs_epi32(mapAVX2<INVERSE>(src + x + 16, c), mapAVX2<INVERSE>(src + x + 24, c));
+		__m256i packed = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(a, b), c.order);
+		_mm256_storeu_si256((__m256i*)(dst + x), packed);
+	}
+	rowScalar<INVERSE>(src + x, dst + x, n - x, m);
+}
+#endif
+
+typedef void(*PlaneRowFunc)(const float* src, unsigned char* dst, int n, const PlaneMapping &m);
+
+static PlaneRowFunc planeRowFunc(KernelIsa isa, bool inverse)
+{
+	switch (isa)
+	{
+#ifdef DEPTH_KERNELS_X86
+	case KERNEL_AVX2: return inverse ? rowAVX2<true> : rowAVX2<false>;
+	case KERNEL_SSE2: return inverse ? rowSSE2<true> : rowSSE2<false>;
+#endif
+	default:          return inverse ? rowScalar<true> : rowScalar<false>;
+	}
+}
+
+void depthToPlane(const cv::Mat &depth, cv::Mat &plane, const DepthPlaneParams &params, KernelIsa isa)
+{
+	CV_Assert(depth.type() == CV_32FC1);
+	isa = resolveIsa(isa);
+
+	float nearMm = params.nearMm, farMm = params.farMm;
+	if (params.autoRange && !depthRange(depth, nearMm, farMm, isa))
+		nearMm = farMm = 0.0f;
+	const PlaneMapping m = planeMapping(nearMm, farMm, params);
+	const PlaneRowFunc row = planeRowFunc(isa, params.inverse);
+
+	plane.create(depth.size(), CV_8UC1);
+	for (int y = 0; y < depth.rows; y++)
+		row(depth.ptr<float>(params.flip ? depth.rows - 1 - y : y), plane.ptr(y), depth.cols, m);
+}
+
+//
+// depthBandMask
+//
+// Each band is one compare pair on the float depth, lower <= z <= upper, so
+// NAN and both infinities fall outside every band without extra tests. Bands
+// either OR their value into the result (binary and bit masks) or overwrite
+// it (labels, applied last band first so the first matching band wins).
+//
+
+static const int BAND_TILE_ROWS = 32;
+
+struct BandMapping
+{
+	int count;
+	float lower[MAX_DEPTH_BANDS], upper[MAX_DEPTH_BANDS];
+	int value[MAX_DEPTH_BANDS];
+};
+
+static BandMapping bandMapping(const std::vector<DepthBand> &bands, BandMaskMode mode)
+{
+	BandMapping m;
+	m.count = bands.size() < (size_t)MAX_DEPTH_BANDS ? (int)bands.size() : MAX_DEPTH_BANDS;
+	for (int i = 0; i < m.count; i++)
+	{
+		const DepthBand &band = bands[mode == BAND_LABELS ? m.count - 1 - i : i];
+		m.lower[i] = band.lowerMm;
+		m.upper[i] = band.upperMm;
+		m.value[i] = mode == BAND_LABELS ? band.label : mode == BAND_BITS ? 1 << i : 255;
+	}
+	return m;
+}
+
+template <bool LABELS>
+static void bandRowScalar(const float* src, unsigned char* dst, int n, const BandMapping &m)
+{
+	for (int x = 0; x < n; x++)
+	{
+		float z = src[x];
+		int v = 0;
+		for (int b = 0; b < m.count; b++)
+			if (z >= m.lower[b] && z <= m.upper[b])
+				v = LABELS ? m.value[b] : v | m.value[b];
+		dst[x] = (unsigned char)v;
+	}
+}
+
+#ifdef DEPTH_KERNELS_X86
+struct BandMappingSSE2
+{
+	__m128 lower[MAX_DEPTH_BANDS], upper[MAX_DEPTH_BANDS];
+	__m128i value[MAX_DEPTH_BANDS];
+
+	explicit BandMappingSSE2(const BandMapping &m)
+	{
+		for (int b = 0; b < m.count; b++)
+		{
+			lower[b] = _mm_set1_ps(m.lower[b]);
+			upper[b] = _mm_set1_ps(m.upper[b]);
+			value[b] = _mm_set1_epi32(m.value[b]);
+		}
+	}
+};
+
+template <bool LABELS>
+static inline __m128i bandSSE2(const float* src, const BandMappingSSE2 &c, int count)
+{
+	__m128 z = _mm_loadu_ps(src);
+	__m128i v = _mm_setzero_si128();
+	for (int b = 0; b < count; b++)
+	{
+		__m128i in = _mm_castps_si128(_mm_and_ps(_mm_cmpge_ps(z, c.lower[b]), _mm_cmple_ps(z, c.upper[b])));
+		v = LABELS ? _mm_or_si128(_mm_and_si128(in, c.value[b]), _mm_andnot_si128(in, v))
+			: _mm_or_si128(v, _mm_and_si128(in, c.value[b]));
+	}
+	return v;
+}
+
+template <bool LABELS>
+static void bandRowSSE2(const float* src, unsigned char* dst, int n, const BandMapping &m)
+{
+	const BandMappingSSE2 c(m);
+	int x = 0;
+	for (; x + 16 <= n; x += 16)
+	{
+		__m128i a = _mm_packs_epi32(bandSSE2<LABELS>(src + x, c, m.count), bandSSE2<LABELS>(src + x + 4, c, m.count));
+		__m128i b = _mm_packs_epi32(bandSSE2<LABELS>(src + x + 8, c, m.count), bandSSE2<LABELS>(src + x + 12, c, m.count));
+		_mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(a, b));
+	}
+	bandRowScalar<LABELS>(src + x, dst + x, n - x, m);
+}
+
+struct BandMappingAVX2
+{
+	__m256 lower[MAX_DEPTH_BANDS], upper[MAX_DEPTH_BANDS];
+	__m256i value[MAX_DEPTH_BANDS];
+	__m256i order;
+
+	KERNEL_AVX2_TARGET
+	explicit BandMappingAVX2(const BandMapping &m)
+	{
+		for (int b = 0; b < m.count; b++)
+		{
+			lower[b] = _mm256_set1_ps(m.lower[b]);
+			upper[b] = _mm256_set1_ps(m.upper[b]);
+			value[b] = _mm256_set1_epi32(m.value[b]);
+		}
+		order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	}
+};
+
+template <bool LABELS>
+KERNEL_AVX2_TARGET
+static inline __m256i bandAVX2(const float* src, const BandMappingAVX2 &c, int count)
+{
+	__m256 z = _mm256_loadu_ps(src);
+	__m256i v = _mm256_setzero_si256();
+	for (int b = 0; b < count; b++)
+	{
+		__m256i in = _mm256_castps_si256(_mm256_and_ps(_mm256_cmp_ps(z, c.lower[b], _CMP_GE_OQ), _mm256_cmp_ps(z, c.upper[b], _CMP_LE_OQ)));
+		v = LABELS ? _mm256_blendv_epi8(v, c.value[b], in) : _mm256_or_si256(v, _mm256_and_si256(in, c.value[b]));
+	}
+	return v;
+}
+
+template <bool LABELS>
+KERNEL_AVX2_TARGET
+static void bandRowAVX2(const float* src, unsigned char* dst, int n, const BandMapping &m)
+{
+	const BandMappingAVX2 c(m);
+	int x = 0;
+	for (; x + 32 <= n; x += 32)
+	{
+		__m256i a = _mm256_packs_epi32(bandAVX2<LABELS>(src + x, c, m.count), bandAVX2<LABELS>(src + x + 8, c, m.count));
+		__m256i b = _mm256_packs_epi32(bandAVX2<LABELS>(src + x + 16, c, m.count), bandAVX2<LABELS>(src + x + 24, c, m.count));
+		__m256i packed = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(a, b), c.order);
+		_mm256_storeu_si256((__m256i*)(dst + x), packed);
+	}
+	bandRowScalar<LABELS>(src + x, dst + x, n - x, m);
+}
+#endif
+
+typedef void(*BandRowFunc)(const float* src, unsigned char* dst, int n, const BandMapping &m);
+
+static BandRowFunc bandRowFunc(KernelIsa isa, bool labels)
+{
+	switch (isa)
+	{
+#ifdef DEPTH_KERNELS_X86
+	case KERNEL_AVX2: return labels ? bandRowAVX2<true> : bandRowAVX2<false>;
+	case KERNEL_SSE2: return labels ? bandRowSSE2<true> : bandRowSSE2<false>;
+#endif
+	default:          return labels ? bandRowScalar<true> : bandRowScalar<false>;
+	}
+}
+
+// One tile of rows per call, OpenCV hands the tiles to its worker threads
+class BandMaskBody : public cv::ParallelLoopBody
+{
+public:
+	BandMaskBody(const cv::Mat &depth, cv::Mat &mask, const BandMapping &m, BandRowFunc row, bool flip)
+		: m_depth(depth), m_mask(mask), m_mapping(m), m_row(row), m_bFlip(flip) {}
+
+	void operator()(const cv::Range &rows) const
+	{
+		for (int y = rows.start; y < rows.end; y++)
+			m_row(m_depth.ptr<float>(m_bFlip ? m_depth.rows - 1 - y : y), m_mask.ptr(y), m_depth.cols, m_mapping);
+	}
+private:
+	const cv::Mat &m_depth;
+	cv::Mat &m_mask;
+	const BandMapping &m_mapping;
+	BandRowFunc m_row;
+	bool m_bFlip;
+};
+
+void depthBandMask(const cv::Mat &depth, cv::Mat &mask, const std::vector<DepthBand> &bands, BandMaskMode mode, bool flip, KernelIsa isa)
+{
+	CV_Assert(depth.type() == CV_32FC1);
+	isa = resolveIsa(isa);
+
+	const BandMapping m = bandMapping(bands, mode);
+	mask.create(depth.size(), CV_8UC1);
+	BandMaskBody body(depth, mask, m, bandRowFunc(isa, mode == BAND_LABELS), flip);
+	cv::parallel_for_(cv::Range(0, depth.rows), body, (depth.rows + BAND_TILE_ROWS - 1) / BAND_TILE_ROWS);
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <vector>
+#include "opencv2/core.hpp"
+#include "DepthBands.h"
+#include "KernelIsa.h"
+
+// How depth maps to the single channel 8-bit frame sent to Spout
+struct DepthPlaneParams
+{
+	bool autoRange;      // stretch the valid depth range of each frame, else use nearMm - farMm
+	float nearMm, farMm; // near maps to 255, far to 0
+	bool inverse;        // map 1 / depth, which spreads the levels like disparity
+	bool flip;           // write rows bottom-up, as GL textures and Spout expect
+	unsigned char tooClose, tooFar, occlusion; // values written for the sentinels
+
+	DepthPlaneParams() : autoRange(true), nearMm(300.0f), farMm(20000.0f), inverse(false), flip(false),
+		tooClose(0), tooFar(0), occlusion(0) {}
+};
+
+// Normalizes, flips and narrows CV_32FC1 depth to CV_8UC1 in one pass. Every
+// instruction set produces exactly the same bytes.
+void depthToPlane(const cv::Mat &depth, cv::Mat &plane, const DepthPlaneParams &params, KernelIsa isa = KERNEL_AUTO);
+// Range of the finite depths, returns false when there are none
+bool depthRange(const cv::Mat &depth, float &minDepth, float &maxDepth, KernelIsa isa = KERNEL_AUTO);
+
+// Thresholds CV_32FC1 depth against the bands into a CV_8UC1 mask, rows
+// bottom-up when flip is set. Tiles of rows run on the OpenCV thread pool.
+void depthBandMask(const cv::Mat &depth, cv::Mat &mask, const std::vector<DepthBand> &bands, BandMaskMode mode,
+	bool flip, KernelIsa isa = KERNEL_AUTO);
@@ -0,0 +1,410 @@
+#include "stdafx.h"
+#include "DepthQuery.h"
+#include "opencv2/imgproc.hpp"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+using namespace std;
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DEPTH_QUERY_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define KERNEL_AVX2_TARGET
+#else
+#define KERNEL_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+// Gathering writes whole vectors, the last one past the measured depths
+static const size_t GATHER_SLACK = 8;
+
+struct RegionAccum
+{
+	unsigned int pixels, valid, occluded, tooClose, tooFar;
+	float minDepth, maxDepth;
+	double sum;
+};
+
+static inline int bitCount(unsigned int bits)
+{
+	bits = bits - ((bits >> 1) & 0x55555555);
+	bits = (bits & 0x33333333) + ((bits >> 2) & 0x33333333);
+	return (int)((((bits + (bits >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24);
+}
+
+//
+// Row gathering : the measured depths of the row where the mask is set go
+// to out, the rest is counted by kind
+//
+
+static size_t gatherRowScalar(const float* src, const unsigned char* mask, int n, float* out, RegionAccum &acc)
+{
+	size_t k = 0;
+	float sum = 0.0f;
+	for (int x = 0; x < n; x++)
+	{
+		if (mask && !mask[x])
+			continue;
+		acc.pixels++;
+		float z = src[x];
+		if (z != z)
+			acc.occluded++;
+		else if (z == INFINITY)
+			acc.tooFar++;
+		else if (z == -INFINITY)
+			acc.tooClose++;
+		else
+		{
+			out[k++] = z;
+			if (z < acc.minDepth) acc.minDepth = z;
+			if (z > acc.maxDepth) acc.maxDepth = z;
+			sum += z;
+		}
+	}
+	acc.valid += (unsigned int)k;
+	acc.sum += sum;
+	return k;
+}
+
+#ifdef DEPTH_QUERY_X86
+static size_t gatherRowSSE2(const float* src, const unsigned char* mask, int n, float* out, RegionAccum &acc)
+{
+	const __m128 inf = _mm_set1_ps(INFINITY), negInf = _mm_set1_ps(-INFINITY);
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	const __m128i zero = _mm_setzero_si128();
+	__m128 vmin = inf, vmax = negInf, vsum = _mm_setzero_ps();
+	size_t k = 0;
+	int x = 0;
+	for (; x + 4 <= n; x += 4)
+	{
+		__m128 v = _mm_loadu_ps(src + x);
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		if (mask)
+		{
+			int bytes;
+			memcpy(&bytes, mask + x, 4);
+			__m128i m = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero);
+			inside = _mm_castsi128_ps(_mm_cmpgt_epi32(m, zero));
+		}
+		// NAN compares false, so only finite depths are under infinity
+		__m128 keep = _mm_and_ps(_mm_cmplt_ps(_mm_and_ps(v, absMask), inf), inside);
+		int insideBits = _mm_movemask_ps(inside);
+		int keepBits = _mm_movemask_ps(keep);
+		acc.pixels += bitCount(insideBits);
+		acc.occluded += bitCount(_mm_movemask_ps(_mm_cmpunord_ps(v, v)) & insideBits);
+		acc.tooFar += bitCount(_mm_movemask_ps(_mm_cmpeq_ps(v, inf)) & insideBits);
+		acc.tooClose += bitCount(_mm_movemask_ps(_mm_cmpeq_ps(v, negInf)) & insideBits);
+		vmin = _mm_min_ps(vmin, _mm_or_ps(_mm_and_ps(keep, v), _mm_andnot_ps(keep, inf)));
+		vmax = _mm_max_ps(vmax, _mm_or_ps(_mm_and_ps(keep, v), _mm_andnot_ps(keep, negInf)));
+		vsum = _mm_add_ps(vsum, _mm_and_ps(keep, v));
+		if (keepBits == 0xF)
+		{
+			_mm_storeu_ps(out + k, v);
+			k += 4;
+		}
+		else if (keepBits)
+		{
+			// Edges of holes, lane by lane
+			float lanes[4];
+			_mm_storeu_ps(lanes, v);
+			for (int i = 0; i < 4; i++)
+				if (keepBits & (1 << i))
+					out[k++] = lanes[i];
+		}
+	}
+	float lanes[4];
+	_mm_storeu_ps(lanes, vmin);
+	for (int i = 0; i < 4; i++)
+		if (lanes[i] < acc.minDepth) acc.minDepth = lanes[i];
+	_mm_storeu_ps(lanes, vmax);
+	for (int i = 0; i < 4; i++)
+		if (lanes[i] > acc.maxDepth) acc.maxDepth = lanes[i];
+	_mm_storeu_ps(lanes, vsum);
+	acc.sum += (double)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	acc.valid += (unsigned int)k;
+	return k + gatherRowScalar(src + x, mask ? mask + x : NULL, n - x, out + k, acc);
+}
+
+// Lane indices that move the lanes set in a byte to the front, for PERMPS
+struct CompactTable
+{
+	int lanes[256][8];
+	CompactTable()
+	{
+		for (int bits = 0; bits < 256; bits++)
+		{
+			int k = 0;
+			for (int i = 0; i < 8; i++)
+				if (bits & (1 << i))
+					lanes[bits][k++] = i;
+			for (; k < 8; k++)
+				lanes[bits][k] = 0;
+		}
+	}
+};
+static const CompactTable s_compact;
+
+KERNEL_AVX2_TARGET
+static size_t gatherRowAVX2(const float* src, const unsigned char* mask, int n, float* out, RegionAccum &acc)
+{
+	const __m256 inf = _mm256_set1_ps(INFINITY), negInf = _mm256_set1_ps(-INFINITY);
+	const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+	__m256 vmin = inf, vmax = negInf, vsum = _mm256_setzero_ps();
+	size_t k = 0;
+	int x = 0;
+	for (; x + 8 <= n; x += 8)
+	{
+		__m256 v = _mm256_loadu_ps(src + x);
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		if (mask)
+		{
+			__m256i m = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(mask + x)));
+			inside = _mm256_castsi256_ps(_mm256_cmpgt_epi32(m, _mm256_setzero_si256()));
+		}
+		__m256 keep = _mm256_and_ps(_mm256_cmp_ps(_mm256_and_ps(v, absMask), inf, _CMP_LT_OQ), inside);
+		int insideBits = _mm256_movemask_ps(inside);
+		int keepBits = _mm256_movemask_ps(keep);
+		acc.pixels += bitCount(insideBits);
+		acc.occluded += bitCount(_mm256_movemask_ps(_mm256_cmp_ps(v, v, _CMP_UNORD_Q)) & insideBits);
+		acc.tooFar += bitCount(_mm256_movemask_ps(_mm256_cmp_ps(v, inf, _CMP_EQ_OQ)) & insideBits);
+		acc.tooClose += bitCount(_mm256_movemask_ps(_mm256_cmp_ps(v, negInf, _CMP_EQ_OQ)) & insideBits);
+		vmin = _mm256_min_ps(vmin, _mm256_blendv_ps(inf, v, keep));
+		vmax = _mm256_max_ps(vmax, _mm256_blendv_ps(negInf, v, keep));
+		vsum = _mm256_add_ps(vsum, _mm256_and_ps(keep, v));
+		// The kept lanes packed to the front, the whole vector stored
+		__m256i order = _mm256_loadu_si256((const __m256i*)s_compact.lanes[keepBits]);
+		_mm256_storeu_ps(out + k, _mm256_permutevar8x32_ps(v, order));
+		k += bitCount(keepBits);
+	}
+	float lanes[8];
+	_mm256_storeu_ps(lanes, vmin);
+	for (int i = 0; i < 8; i++)
+		if (lanes[i] < acc.minDepth) acc.minDepth = lanes[i];
+	_mm256_storeu_ps(lanes, vmax);
+	for (int i = 0; i < 8; i++)
+		if (lanes[i] > acc.maxDepth) acc.maxDepth = lanes[i];
+	_mm256_storeu_ps(lanes, vsum);
+	double sum = 0;
+	for (int i = 0; i < 8; i++)
+		sum += lanes[i];
+	acc.sum += sum;
+	acc.valid += (unsigned int)k;
+	return k + gatherRowSSE2(src + x, mask ? mask + x : NULL, n - x, out + k, acc);
+}
+#endif
+
+typedef size_t (*GatherRowFunc)(const float*, const unsigned char*, int, float*, RegionAccum&);
+
+static GatherRowFunc gatherRowFunc(KernelIsa isa)
+{
+	KernelIsa best = bestKernelIsa();
+	if (isa == KERNEL_AUTO || isa > best)
+		isa = best;
+#ifdef DEPTH_QUERY_X86
+	if (isa == KERNEL_AVX2)
+		return gatherRowAVX2;
+	if (isa == KERNEL_SSE2)
+		return gatherRowSSE2;
+#endif
+	return gatherRowScalar;
+}
+
+void depthRegionStats(const cv::Mat &depth, cv::Rect rect, const cv::Mat &mask, float percentile, DepthRoiStats &stats,
+	vector<float> &values, KernelIsa isa)
+{
+	CV_Assert(depth.empty() || depth.type() == CV_32FC1);
+	CV_Assert(mask.empty() || (mask.type() == CV_8UC1 && mask.size() == rect.size()));
+	cv::Rect clipped = rect & cv::Rect(0, 0, depth.cols, depth.rows);
+
+	RegionAccum acc;
+	memset(&acc, 0, sizeof(acc));
+	acc.minDepth = INFINITY;
+	acc.maxDepth = -INFINITY;
+	if (clipped.area() > 0)
+	{
+		const cv::Mat region = mask.empty() ? cv::Mat() : mask(cv::Rect(clipped.tl() - rect.tl(), clipped.size()));
+		if (values.size() < (size_t)clipped.area() + GATHER_SLACK)
+			values.resize((size_t)clipped.area() + GATHER_SLACK);
+		GatherRowFunc gather = gatherRowFunc(isa);
+		size_t k = 0;
+		for (int y = 0; y < clipped.height; y++)
+			k += gather(depth.ptr<float>(clipped.y + y) + clipped.x, region.empty() ? NULL : region.ptr<unsigned char>(y),
+				clipped.width, &values[k], acc);
+	}
+
+	stats.pixels = acc.pixels;
+	stats.valid = acc.valid;
+	stats.occluded = acc.occluded;
+	stats.tooClose = acc.tooClose;
+	stats.tooFar = acc.tooFar;
+	if (acc.valid == 0)
+	{
+		stats.minDepth = stats.maxDepth = stats.median = stats.percentile = NAN;
+		stats.mean = NAN;
+		return;
+	}
+	stats.minDepth = acc.minDepth;
+	stats.maxDepth = acc.maxDepth;
+	stats.mean = acc.sum / acc.valid;
+
+	// Two ranks sorted into place, the second one within the side of the first it falls on
+	const size_t n = acc.valid;
+	const double p = percentile < 0.0f ? 0.0 : percentile > 100.0f ? 100.0 : percentile;
+	const size_t median = (n - 1) / 2;
+	const size_t rank = (size_t)(p / 100.0 * (n - 1) + 0.5);
+	vector<float>::iterator first = values.begin(), last = values.begin() + n;
+	nth_element(first, first + median, last);
+	stats.median = values[median];
+	if (rank > median)
+		nth_element(first + median + 1, first + rank, last);
+	else if (rank < median)
+		nth_element(first, first + rank, first + median);
+	stats.percentile = values[rank];
+}
+
+//
+// DepthQueryService
+//
+
+DepthQueryService::DepthQueryService() : m_published(0)
+{
+}
+
+void DepthQueryService::publish(const cv::Mat &depth, unsigned long long frameId, unsigned long long timestamp,
+	const DepthFrameStats* stats)
+{
+	CV_Assert(depth.type() == CV_32FC1);
+	shared_ptr<DepthSnapshot> back;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		back.swap(m_spare);
+	}
+	// Still held by a reader : it stays as it is, a new one takes its place
+	if (!back || back.use_count() > 1)
+		back = make_shared<DepthSnapshot>();
+	// use_count is a relaxed load : without the fence the writes below could
+	// race the last reads of a reader that just let the snapshot go
+	atomic_thread_fence(memory_order_acquire);
+	depth.copyTo(back->depth);
+	back->frameId = frameId;
+	back->timestamp = timestamp;
+	if (stats)
+		back->stats = *stats;
+	else
+		back->stats = DepthFrameStats();
+
+	lock_guard<mutex> lock(m_mutex);
+	m_spare.swap(m_latest);
+	m_latest.swap(back);
+	m_published++;
+}
+
+shared_ptr<const DepthSnapshot> DepthQueryService::snapshot() const
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_latest;
+}
+
+unsigned long long DepthQueryService::published() const
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_published;
+}
+
+unsigned long long DepthQueryService::depthAt(const vector<cv::Point> &points, vector<float> &depths) const
+{
+	shared_ptr<const DepthSnapshot> latest = snapshot();
+	depths.assign(points.size(), NAN);
+	if (!latest)
+		return 0;
+	const cv::Mat &depth = latest->depth;
+	for (size_t i = 0; i < points.size(); i++)
+	{
+		const cv::Point &p = points[i];
+		if (p.x >= 0 && p.y >= 0 && p.x < depth.cols && p.y < depth.rows)
+			depths[i] = depth.at<float>(p.y, p.x);
+	}
+	return latest->frameId;
+}
+
+unsigned long long DepthQueryService::regionStats(const cv::Rect &rect, float percentile, DepthRoiStats &stats) const
+{
+	shared_ptr<const DepthSnapshot> latest = snapshot();
+	vector<float> values;
+	depthRegionStats(latest ? latest->depth : cv::Mat(), rect, cv::Mat(), percentile, stats, values);
+	return latest ? latest->frameId : 0;
+}
+
+unsigned long long DepthQueryService::regionStats(const vector<cv::Point> &polygon, float percentile, DepthRoiStats &stats) const
+{
+	shared_ptr<const DepthSnapshot> latest = snapshot();
+	const cv::Mat depth = latest ? latest->depth : cv::Mat();
+	cv::Rect rect = polygon.empty() ? cv::Rect() : cv::boundingRect(polygon) & cv::Rect(0, 0, depth.cols, depth.rows);
+	cv::Mat mask;
+	if (rect.area() > 0)
+	{
+		mask = cv::Mat::zeros(rect.size(), CV_8UC1);
+		vector<cv::Point> shifted(polygon.size());
+		for (size_t i = 0; i < polygon.size(); i++)
+			shifted[i] = polygon[i] - rect.tl();
+		const cv::Point* contour = &shifted[0];
+		int count = (int)shifted.size();
+		cv::fillPoly(mask, &contour, &count, 1, cv::Scalar(255));
+	}
+	vector<float> values;
+	depthRegionStats(depth, rect, mask, percentile, stats, values);
+	return latest ? latest->frameId : 0;
+}
+
+//
+// Text forms for the control channel and the console
+//
+
+bool parseDepthPoints(const string &text, vector<cv::Point> &points)
+{
+	vector<cv::Point> parsed;
+	const char* p = text.c_str();
+	while (*p)
+	{
+		char* end;
+		long x = strtol(p, &end, 10);
+		if (end == p || *end != ',')
+			return false;
+		p = end + 1;
+		long y = strtol(p, &end, 10);
+		if (end == p || (*end && *end != ';'))
+			return false;
+		parsed.push_back(cv::Point((int)x, (int)y));
+		p = *end ? end + 1 : end;
+	}
+	if (parsed.empty())
+		return false;
+	points.swap(parsed);
+	return true;
+}
+
+string formatDepth(float depth)
+{
+	if (depth != depth)
+		return "occluded";
+	if (depth == INFINITY)
+		return "too far";
+	if (depth == -INFINITY)
+		return "too close";
+	char text[32];
+	sprintf(text, "%.1f", depth);
+	return text;
+}
+
+string formatDepthRoiStats(const DepthRoiStats &stats, float percentile)
+{
+	char text[256];
+	sprintf(text, "pixels %u valid %u min %.1f median %.1f p%g %.1f max %.1f mean %.1f occluded %u too_close %u too_far %u",
+		stats.pixels, stats.valid, stats.minDepth, stats.median, percentile, stats.percentile, stats.maxDepth, stats.mean,
+		stats.occluded, stats.tooClose, stats.tooFar);
+	return text;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "opencv2/core.hpp"
+#include "DepthKernels.h"
+#include "DepthStats.h"
+
+// Depth of a region of CV_32FC1 millimeter depth. Order statistics are
+// depths that were measured, never interpolated : the median is the lower
+// one of an even count, a percentile the nearest rank.
+struct DepthRoiStats
+{
+	unsigned int pixels;                          // of the region inside the image
+	unsigned int valid;                           // with a measured depth
+	unsigned int occluded, tooClose, tooFar;      // NAN, -INFINITY, +INFINITY
+	float minDepth, maxDepth, median, percentile; // NAN when nothing is valid
+	double mean;
+};
+
+// Region statistics of depth over rect, clipped to the image. mask, CV_8UC1
+// the size of rect, keeps the pixels where it isn't zero; empty takes them
+// all. values is scratch space kept by the caller between calls. The
+// measured depths are gathered with SIMD compares, which also give the
+// counts, min, max and sum, then only the two ranks asked for are sorted
+// into place. Every instruction set gives the same counts, min, max and
+// order statistics, the mean agrees to float rounding.
+void depthRegionStats(const cv::Mat &depth, cv::Rect rect, const cv::Mat &mask, float percentile, DepthRoiStats &stats,
+	std::vector<float> &values, KernelIsa isa = KERNEL_AUTO);
+
+// One published depth frame, never written again while anyone holds it
+struct DepthSnapshot
+{
+	cv::Mat depth; // CV_32FC1 millimeters
+	unsigned long long frameId, timestamp;
+	DepthFrameStats stats; // of the whole frame, pixels 0 when none were given
+};
+
+// Depth queries from any thread - the UI, control commands, scripts - on
+// the latest frame the pipeline published. The pipeline copies each frame
+// into the snapshot no reader holds, there are two of them unless a reader
+// keeps one for long, then a new one is made rather than waiting. Readers
+// take a reference to the latest under a lock held for a pointer copy, and
+// all their queries on it see the same frame.
+class DepthQueryService
+{
+public:
+	DepthQueryService();
+	// Processing thread : depth, CV_32FC1, becomes the latest snapshot, with
+	// the frame statistics when they were made
+	void publish(const cv::Mat &depth, unsigned long long frameId, unsigned long long timestamp,
+		const DepthFrameStats* stats = NULL);
+	// NULL before the first frame
+	std::shared_ptr<const DepthSnapshot> snapshot() const;
+	unsigned long long published() const;
+
+	// The depth at each point, NAN outside the image. These return the frame
+	// id of the snapshot the answer comes from, 0 before the first frame.
+	unsigned long long depthAt(const std::vector<cv::Point> &points, std::vector<float> &depths) const;
+	unsigned long long regionStats(const cv::Rect &rect, float percentile, DepthRoiStats &stats) const;
+	// Inside the polygon, edges included
+	unsigned long long regionStats(const std::vector<cv::Point> &polygon, float percentile, DepthRoiStats &stats) const;
+private:
+	DepthQueryService(const DepthQueryService&);
+	DepthQueryService& operator=(const DepthQueryService&);
+
+	mutable std::mutex m_mutex; // guards the two pointers only
+	std::shared_ptr<DepthSnapshot> m_latest, m_spare;
+	unsigned long long m_published;
+};
+
+// "x,y;x,y;..." in image pixels, false on anything else
+bool parseDepthPoints(const std::string &text, std::vector<cv::Point> &points);
+// "1234.5", "occluded", "too close" or "too far"
+std::string formatDepth(float depth);
+// count, valid, min, median, percentile, max and mean on one line
+std::string formatDepthRoiStats(const DepthRoiStats &stats, float percentile);
@@ -0,0 +1,363 @@
+#include "stdafx.h"
+#include "DepthRecording.h"
+#include "DepthEncoding.h"
+#include "DepthKernels.h"
+#include <string.h>
+using namespace std;
+
+static const char RECORDING_MAGIC[8] = "ZTSREC2";
+static const unsigned int RECORDING_VERSION = 2; // 2 : RECORD_DEPTH_RVL
+static const unsigned int FRAME_MAGIC = 0x4D52465A; // "ZFRM"
+static const size_t BLOCK_ALIGN = 16;
+
+static size_t alignBlock(size_t size)
+{
+	return (size + BLOCK_ALIGN - 1) & ~(BLOCK_ALIGN - 1);
+}
+
+static int depthType(unsigned int depthFormat)
+{
+	return depthFormat == RECORD_DEPTH_F32 ? CV_32FC1 : CV_16UC1;
+}
+
+// Entries must point at whole frames inside the file, with raw blocks of the exact image size
+static bool entryFits(const RecordingIndexEntry &entry, size_t fileSize, const size_t* rawSize)
+{
+	if (entry.offset > fileSize)
+		return false;
+	size_t end = (size_t)entry.offset + alignBlock(sizeof(RecordingFrameHeader));
+	for (int s = 0; s < STREAM_COUNT; s++)
+	{
+		bool compressed = (entry.compressedMask & (1 << s)) != 0;
+		if (entry.blockSize[s] && !compressed && entry.blockSize[s] != rawSize[s])
+			return false;
+		end += alignBlock(entry.blockSize[s]);
+	}
+	return end <= fileSize;
+}
+
+//
+// RecordingWriter
+//
+
+RecordingWriter::RecordingWriter()
+{
+	m_file = NULL;
+	m_offset = 0;
+	memset(&m_header, 0, sizeof(m_header));
+}
+
+RecordingWriter::~RecordingWriter()
+{
+	close();
+}
+
+bool RecordingWriter::open(const char* path, int width, int height, const RecordingOptions &options)
+{
+	close();
+	m_file = fopen(path, "wb");
+	if (!m_file)
+		return false;
+	memset(&m_header, 0, sizeof(m_header));
+	memcpy(m_header.magic, RECORDING_MAGIC, sizeof(m_header.magic));
+	m_header.version = RECORDING_VERSION;
+	m_header.width = width;
+	m_header.height = height;
+	m_header.streams = options.streams;
+	m_header.depthFormat = options.depthFormat;
+	m_header.compressed = options.compress ? 1 : 0;
+	depthCodecDefaults(&m_depthParams);
+	if (options.rvlStepMm > 0)
+	{
+		m_depthParams.mode = DEPTH_CODEC_QUANTIZED;
+		m_depthParams.stepMm = options.rvlStepMm;
+	}
+	m_index.clear();
+	m_offset = 0;
+	if (!writePadded(&m_header, sizeof(m_header)))
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool RecordingWriter::writePadded(const void* data, size_t size)
+{
+	static const unsigned char zeros[BLOCK_ALIGN] = { 0 };
+	size_t padding = alignBlock(size) - size;
+	if (fwrite(data, 1, size, m_file) != size || fwrite(zeros, 1, padding, m_file) != padding)
+		return false;
+	m_offset += size + padding;
+	return true;
+}
+
+const unsigned char* RecordingWriter::encodeBlock(int stream, const cv::Mat &image, BlockFilter filter, RecordingIndexEntry &entry)
+{
+	const cv::Mat* data = &image;
+	if (!image.isContinuous())
+	{
+		image.copyTo(m_continuous[stream]);
+		data = &m_continuous[stream];
+	}
+	size_t rawSize = data->total() * data->elemSize();
+	size_t stored = 0;
+	if (stream == STREAM_DEPTH && m_header.depthFormat == RECORD_DEPTH_RVL)
+	{
+		m_compressed[stream].resize(depthCodecBound(data->cols, data->rows));
+		stored = depthCodecEncode((const unsigned short*)data->data, data->cols, data->rows, data->step,
+			&m_depthParams, m_compressed[stream].data(), m_compressed[stream].size());
+		// Only a step too fine for 16-bit codes fails, and it fails every frame
+		if (!stored)
+			return NULL;
+	}
+	else if (m_header.compressed)
+		stored = m_codec.compress(filter, data->data, rawSize, m_compressed[stream]);
+	if (stored)
+	{
+		entry.blockSize[stream] = (unsigned int)stored;
+		entry.compressedMask |= 1 << stream;
+		return m_compressed[stream].data();
+	}
+	entry.blockSize[stream] = (unsigned int)rawSize;
+	return data->data;
+}
+
+bool RecordingWriter::write(const DepthFrame &frame)
+{
+	if (!m_file)
+		return false;
+	const cv::Size size(m_header.width, m_header.height);
+
+	// Streams missing from this frame are recorded as empty blocks
+	const cv::Mat* images[STREAM_COUNT] = { &frame.left, &frame.depth, &frame.confidence };
+	const int types[STREAM_COUNT] = { CV_8UC4, CV_32FC1, CV_32FC1 };
+	const BlockFilter filters[STREAM_COUNT] = { FILTER_BGRA,
+		m_header.depthFormat == RECORD_DEPTH_F32 ? FILTER_F32 : FILTER_U16, FILTER_F32 };
+	for (int s = 0; s < STREAM_COUNT; s++)
+	{
+		const cv::Mat &image = *images[s];
+		if (!(m_header.streams & (1 << s)) || image.empty())
+			images[s] = NULL;
+		else if (image.type() != types[s] || image.size() != size)
+			return false;
+	}
+	if (images[STREAM_DEPTH] && m_header.depthFormat != RECORD_DEPTH_F32)
+	{
+		encodeDepth(frame.depth, m_depth16, DEPTH_R16_MM, false);
+		images[STREAM_DEPTH] = &m_depth16;
+	}
+
+	// Encode everything first so the frame is written in one pass, header included
+	RecordingIndexEntry entry;
+	memset(&entry, 0, sizeof(entry));
+	entry.timestamp = frame.timestamp;
+	entry.offset = m_offset;
+	const unsigned char* blocks[STREAM_COUNT] = { NULL, NULL, NULL };
+	for (int s = 0; s < STREAM_COUNT; s++)
+		if (images[s] && !(blocks[s] = encodeBlock(s, *images[s], filters[s], entry)))
+			return false;
+
+	RecordingFrameHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = FRAME_MAGIC;
+	header.frameIndex = (unsigned int)m_index.size();
+	header.timestamp = entry.timestamp;
+	memcpy(header.blockSize, entry.blockSize, sizeof(header.blockSize));
+	header.compressedMask = entry.compressedMask;
+	if (!writePadded(&header, sizeof(header)))
+		return false;
+	for (int s = 0; s < STREAM_COUNT; s++)
+		if (blocks[s] && !writePadded(blocks[s], entry.blockSize[s]))
+			return false;
+
+	m_index.push_back(entry);
+	return true;
+}
+
+bool RecordingWriter::close()
+{
+	if (!m_file)
+		return true;
+	m_header.frameCount = (unsigned int)m_index.size();
+	m_header.indexOffset = m_offset;
+	// The index goes first, the header only points at it once it is all there
+	bool ok = m_index.empty() ||
+		fwrite(m_index.data(), sizeof(RecordingIndexEntry), m_index.size(), m_file) == m_index.size();
+	ok = ok && fseek(m_file, 0, SEEK_SET) == 0 && fwrite(&m_header, sizeof(m_header), 1, m_file) == 1;
+	ok = fclose(m_file) == 0 && ok;
+	m_file = NULL;
+	m_index.clear();
+	return ok;
+}
+
+//
+// RecordedFrameSource
+//
+
+RecordedFrameSource::RecordedFrameSource(double fps, bool loop)
+	: m_frameIndex(0), m_pendingSeek(-1), m_bLoop(loop), m_pacer(fps)
+{
+	memset(&m_header, 0, sizeof(m_header));
+}
+
+bool RecordedFrameSource::open(const char* path)
+{
+	close();
+	if (!m_file.open(path) || m_file.size() < sizeof(RecordingHeader))
+		return false;
+	memcpy(&m_header, m_file.data(), sizeof(m_header));
+	if (memcmp(m_header.magic, RECORDING_MAGIC, sizeof(RECORDING_MAGIC)) != 0 ||
+		m_header.version == 0 || m_header.version > RECORDING_VERSION || m_header.depthFormat > RECORD_DEPTH_RVL || m_header.width == 0 || m_header.height == 0 || !buildIndex())
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+void RecordedFrameSource::close()
+{
+	m_file.close();
+	m_index.clear();
+	m_frameIndex = 0;
+	m_pendingSeek = -1;
+	memset(&m_header, 0, sizeof(m_header));
+}
+
+bool RecordedFrameSource::buildIndex()
+{
+	const size_t fileSize = m_file.size();
+	const size_t pixels = (size_t)m_header.width * m_header.height;
+	const size_t rawSize[STREAM_COUNT] = { pixels * 4, pixels * CV_ELEM_SIZE(depthType(m_header.depthFormat)), pixels * sizeof(float) };
+
+	m_index.clear();
+	if (m_header.indexOffset && m_header.indexOffset + (unsigned long long)m_header.frameCount * sizeof(RecordingIndexEntry) <= fileSize)
+	{
+		const RecordingIndexEntry* entries = (const RecordingIndexEntry*)(m_file.data() + m_header.indexOffset);
+		m_index.assign(entries, entries + m_header.frameCount);
+	}
+	else
+	{
+		// Never closed : walk the frame records up to the first incomplete one
+		size_t offset = alignBlock(sizeof(RecordingHeader));
+		while (offset + sizeof(RecordingFrameHeader) <= fileSize)
+		{
+			const RecordingFrameHeader* header = (const RecordingFrameHeader*)(m_file.data() + offset);
+			if (header->magic != FRAME_MAGIC || header->frameIndex != m_index.size())
+				break;
+			RecordingIndexEntry entry;
+			entry.timestamp = header->timestamp;
+			entry.offset = offset;
+			memcpy(entry.blockSize, header->blockSize, sizeof(entry.blockSize));
+			entry.compressedMask = header->compressedMask;
+			if (!entryFits(entry, fileSize, rawSize))
+				break;
+			m_index.push_back(entry);
+			offset += alignBlock(sizeof(RecordingFrameHeader));
+			for (int s = 0; s < STREAM_COUNT; s++)
+				offset += alignBlock(entry.blockSize[s]);
+		}
+	}
+
+	for (size_t i = 0; i < m_index.size(); i++)
+		if (!entryFits(m_index[i], fileSize, rawSize))
+			return false;
+	m_header.frameCount = (unsigned int)m_index.size();
+	return !m_index.empty();
+}
+
+unsigned int RecordedFrameSource::frameAtTime(unsigned long long timestamp) const
+{
+	const unsigned int last = (unsigned int)m_index.size() - 1;
+	const unsigned long long first = m_index[0].timestamp, end = m_index[last].timestamp;
+	if (timestamp <= first || end <= first)
+		return 0;
+	if (timestamp >= end)
+		return last;
+
+	// Guess from the average frame period, then step to the exact frame
+	unsigned int i = (unsigned int)((double)(timestamp - first) / (double)(end - first) * last);
+	while (i > 0 && m_index[i - 1].timestamp >= timestamp)
+		i--;
+	while (i < last && m_index[i].timestamp < timestamp)
+		i++;
+	return i;
+}
+
+bool RecordedFrameSource::seek(unsigned int frameIndex)
+{
+	if (frameIndex >= m_index.size())
+		return false;
+	m_pendingSeek = (int)frameIndex;
+	return true;
+}
+
+bool RecordedFrameSource::readBlock(const RecordingIndexEntry &entry, int stream, bool wanted, const unsigned char* &p, int type, BlockFilter filter, cv::Mat &out)
+{
+	const int width = m_header.width, height = m_header.height;
+	const size_t size = entry.blockSize[stream];
+	unsigned char* block = const_cast<unsigned char*>(p);
+	p += alignBlock(size);
+	if (size == 0 || !wanted)
+	{
+		out.release();
+		return true;
+	}
+
+	if (!(entry.compressedMask & (1 << stream)))
+	{
+		// Wrap the mapped pages, no copy
+		out = cv::Mat(height, width, type, block);
+		return true;
+	}
+
+	// Never decode into a Mat still wrapping the file
+	if (isMapped(out))
+		out.release();
+	out.create(height, width, type);
+	if (stream == STREAM_DEPTH && m_header.depthFormat == RECORD_DEPTH_RVL)
+		return depthCodecDecode(block, size, (unsigned short*)out.data, width, height, out.step, KERNEL_AUTO) != 0;
+	return m_codec.decompress(filter, block, size, out.data, out.total() * out.elemSize());
+}
+
+bool RecordedFrameSource::grab(DepthFrame &frame, unsigned int streams)
+{
+	if (!m_file.isOpen())
+		return false;
+
+	int pending = m_pendingSeek.exchange(-1);
+	if (pending >= 0)
+		m_frameIndex = pending;
+	if (m_frameIndex >= m_index.size())
+	{
+		if (!m_bLoop)
+			return false;
+		m_frameIndex = 0;
+	}
+
+	m_pacer.wait();
+
+	const RecordingIndexEntry &entry = m_index[m_frameIndex];
+	const unsigned char* p = m_file.data() + entry.offset + alignBlock(sizeof(RecordingFrameHeader));
+	frame.timestamp = entry.timestamp;
+
+	bool ok = readBlock(entry, STREAM_COLOR, (streams & (FRAME_LEFT | FRAME_VIEW)) != 0, p, CV_8UC4, FILTER_BGRA, frame.left);
+	const bool wantDepth = (streams & FRAME_DEPTH) != 0;
+	if (m_header.depthFormat != RECORD_DEPTH_F32)
+	{
+		ok = ok && readBlock(entry, STREAM_DEPTH, wantDepth, p, CV_16UC1, FILTER_U16, m_depth16);
+		if (isMapped(frame.depth))
+			frame.depth.release();
+		if (ok && !m_depth16.empty())
+			decodeDepth(m_depth16, DEPTH_R16_MM, frame.depth, false);
+		else
+			frame.depth.release();
+	}
+	else
+		ok = ok && readBlock(entry, STREAM_DEPTH, wantDepth, p, CV_32FC1, FILTER_F32, frame.depth);
+	ok = ok && readBlock(entry, STREAM_CONFIDENCE, (streams & FRAME_CONFIDENCE) != 0, p, CV_32FC1, FILTER_F32, frame.confidence);
+
+	m_frameIndex++;
+	return ok;
+}
@@ -0,0 +1,130 @@
+#pragma once
+#include <atomic>
+#include <stdio.h>
+#include <vector>
+#include "opencv2/core.hpp"
+#include "FrameSource.h"
+#include "MappedFile.h"
+#include "BlockCodec.h"
+#include "DepthCodec.h"
+
+// Depth recording container
+//
+//   RecordingHeader                 64 bytes
+//   frame records                   RecordingFrameHeader, then one block per stream
+//   RecordingIndexEntry[frameCount] written on close, located by header.indexOffset
+//
+// Every block starts on a 16 byte boundary. Uncompressed blocks are the rows of
+// the image back to back and are wrapped straight from the mapped file; compressed
+// blocks go through BlockCodec, or DepthCodec for RVL depth. A recording that was never closed has no index and
+// is recovered by walking the frame records.
+
+enum RecordingStream { STREAM_COLOR, STREAM_DEPTH, STREAM_CONFIDENCE, STREAM_COUNT };
+// RVL is U16 always compressed with DepthCodec, the other streams as compress says
+enum RecordingDepthFormat { RECORD_DEPTH_F32, RECORD_DEPTH_U16, RECORD_DEPTH_RVL };
+
+struct RecordingHeader
+{
+	char magic[8];                 // "ZTSREC2"
+	unsigned long long indexOffset; // 0 until the recording is closed
+	unsigned int version;
+	unsigned int width, height;
+	unsigned int frameCount;
+	unsigned int streams;          // 1 << RecordingStream for each recorded stream
+	unsigned int depthFormat;      // RecordingDepthFormat
+	unsigned int compressed;       // blocks may be compressed
+	unsigned int reserved[5];
+};
+
+struct RecordingFrameHeader
+{
+	unsigned int magic;            // 'ZFRM'
+	unsigned int frameIndex;
+	unsigned long long timestamp;
+	unsigned int blockSize[STREAM_COUNT]; // stored size, 0 when the stream is missing from this frame
+	unsigned int compressedMask;          // 1 << RecordingStream for compressed blocks
+};
+
+struct RecordingIndexEntry
+{
+	unsigned long long timestamp;
+	unsigned long long offset;     // of the RecordingFrameHeader
+	unsigned int blockSize[STREAM_COUNT];
+	unsigned int compressedMask;
+};
+
+struct RecordingOptions
+{
+	unsigned int streams;
+	RecordingDepthFormat depthFormat;
+	bool compress;
+	float rvlStepMm;               // RVL : 0 lossless, else the quantization step at 1 m
+
+	RecordingOptions() : streams((1 << STREAM_COLOR) | (1 << STREAM_DEPTH) | (1 << STREAM_CONFIDENCE)),
+		depthFormat(RECORD_DEPTH_F32), compress(false), rvlStepMm(0) {}
+};
+
+class RecordingWriter
+{
+public:
+	RecordingWriter();
+	~RecordingWriter();
+	bool open(const char* path, int width, int height, const RecordingOptions &options = RecordingOptions());
+	bool write(const DepthFrame &frame);
+	// Writes the index, a recording is still readable without it. Returns
+	// false when the index, the header or the buffered frames couldn't be written.
+	bool close();
+	bool isOpen() const { return m_file != NULL; }
+private:
+	// Returns the bytes to store for the stream and fills in its size in the entry
+	const unsigned char* encodeBlock(int stream, const cv::Mat &image, BlockFilter filter, RecordingIndexEntry &entry);
+	bool writePadded(const void* data, size_t size);
+
+	FILE* m_file;
+	RecordingHeader m_header;
+	unsigned long long m_offset;
+	std::vector<RecordingIndexEntry> m_index;
+	BlockCodec m_codec;
+	DepthCodecParams m_depthParams;
+	std::vector<unsigned char> m_compressed[STREAM_COUNT];
+	cv::Mat m_depth16, m_continuous[STREAM_COUNT];
+};
+
+// Replays a recording. Seeking is O(1) by frame number, and by time for
+// recordings with a steady frame rate (the guess from the first and last
+// timestamps is then exact or one step off). Seeks may come from any thread;
+// they take effect on the next grab.
+class RecordedFrameSource : public FrameSource
+{
+public:
+	// fps 0 replays as fast as possible
+	RecordedFrameSource(double fps = 0, bool loop = true);
+	bool open(const char* path);
+	void close();
+	cv::Size size() const { return cv::Size(m_header.width, m_header.height); }
+	bool grab(DepthFrame &frame, unsigned int streams = FRAME_ALL);
+
+	unsigned int frameCount() const { return (unsigned int)m_index.size(); }
+	unsigned int frameIndex() const { return m_frameIndex; }
+	unsigned long long timestamp(unsigned int frameIndex) const { return m_index[frameIndex].timestamp; }
+	// First frame at or after the timestamp
+	unsigned int frameAtTime(unsigned long long timestamp) const;
+	bool seek(unsigned int frameIndex);
+	bool seekTime(unsigned long long timestamp) { return !m_index.empty() && seek(frameAtTime(timestamp)); }
+	void setRate(double fps) { m_pacer.setRate(fps); }
+private:
+	bool buildIndex();
+	// Skips the block and leaves out empty when the stream isn't wanted
+	bool readBlock(const RecordingIndexEntry &entry, int stream, bool wanted, const unsigned char* &p, int type, BlockFilter filter, cv::Mat &out);
+	bool isMapped(const cv::Mat &m) const { return m.data >= m_file.data() && m.data < m_file.data() + m_file.size(); }
+
+	MappedFile m_file;
+	RecordingHeader m_header;
+	std::vector<RecordingIndexEntry> m_index;
+	std::atomic<unsigned int> m_frameIndex;
+	std::atomic<int> m_pendingSeek;
+	bool m_bLoop;
+	SourcePacer m_pacer;
+	BlockCodec m_codec;
+	cv::Mat m_depth16;
+};
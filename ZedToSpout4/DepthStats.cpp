@@ -0,0 +1,498 @@
+#include "stdafx.h"
+#include "DepthStats.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+using namespace std;
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DEPTH_STATS_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define KERNEL_AVX2_TARGET
+#else
+#define KERNEL_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+static const int STATS_TILE_ROWS = 32;
+// A power of two, so multiplying is exactly dividing by the bin width
+static const float BIN_SCALE = 1.0f / DEPTH_STATS_BIN_MM;
+// Depths are clamped to this before the conversion, the last bin
+static const float BIN_LIMIT = (float)(DEPTH_STATS_BINS * DEPTH_STATS_BIN_MM - 1);
+// Where the rows count what isn't measured, past the histogram proper
+static const int DISCARD_BIN = DEPTH_STATS_BINS;
+// Frames with fewer valid pixels than this share leave the percentile bounds as they were
+static const float MIN_VALID_RATIO = 0.01f;
+
+struct StatsAccum
+{
+	unsigned int pixels, valid, occluded, tooClose, tooFar;
+	float minDepth, maxDepth;
+	double sum;
+};
+
+static inline int bitCount(unsigned int bits)
+{
+	bits = bits - ((bits >> 1) & 0x55555555);
+	bits = (bits & 0x33333333) + ((bits >> 2) & 0x33333333);
+	return (int)((((bits + (bits >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24);
+}
+
+//
+// Row kernels : counts by kind, min, max and sum of the measured depths, and
+// their bins. The vector paths clamp and convert like the scalar one, so the
+// bins are the same; what isn't measured goes to DISCARD_BIN rather than
+// being branched around.
+//
+
+static void statsRowScalar(const float* src, int n, unsigned int* hist, StatsAccum &acc)
+{
+	unsigned int valid = 0;
+	float sum = 0.0f;
+	for (int x = 0; x < n; x++)
+	{
+		float z = src[x];
+		if (z != z)
+			acc.occluded++;
+		else if (z == INFINITY)
+			acc.tooFar++;
+		else if (z == -INFINITY)
+			acc.tooClose++;
+		else
+		{
+			valid++;
+			if (z < acc.minDepth) acc.minDepth = z;
+			if (z > acc.maxDepth) acc.maxDepth = z;
+			sum += z;
+			// Written like MAXPS / MINPS
+			float c = z > 0.0f ? z : 0.0f;
+			c = c < BIN_LIMIT ? c : BIN_LIMIT;
+			hist[(int)(c * BIN_SCALE)]++;
+		}
+	}
+	acc.pixels += n;
+	acc.valid += valid;
+	acc.sum += sum;
+}
+
+#ifdef DEPTH_STATS_X86
+static void statsRowSSE2(const float* src, int n, unsigned int* hist, StatsAccum &acc)
+{
+	const __m128 inf = _mm_set1_ps(INFINITY), negInf = _mm_set1_ps(-INFINITY);
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	const __m128 zero = _mm_setzero_ps(), limit = _mm_set1_ps(BIN_LIMIT), scale = _mm_set1_ps(BIN_SCALE);
+	const __m128i discard = _mm_set1_epi32(DISCARD_BIN);
+	__m128 vmin = inf, vmax = negInf, vsum = _mm_setzero_ps();
+	unsigned int valid = 0;
+	int bins[4];
+	int x = 0;
+	for (; x + 4 <= n; x += 4)
+	{
+		__m128 v = _mm_loadu_ps(src + x);
+		// NAN compares false, so only finite depths are under infinity
+		__m128 keep = _mm_cmplt_ps(_mm_and_ps(v, absMask), inf);
+		int keepBits = _mm_movemask_ps(keep);
+		valid += bitCount(keepBits);
+		if (keepBits != 0xF)
+		{
+			acc.occluded += bitCount(_mm_movemask_ps(_mm_cmpunord_ps(v, v)));
+			acc.tooFar += bitCount(_mm_movemask_ps(_mm_cmpeq_ps(v, inf)));
+			acc.tooClose += bitCount(_mm_movemask_ps(_mm_cmpeq_ps(v, negInf)));
+		}
+		vmin = _mm_min_ps(vmin, _mm_or_ps(_mm_and_ps(keep, v), _mm_andnot_ps(keep, inf)));
+		vmax = _mm_max_ps(vmax, _mm_or_ps(_mm_and_ps(keep, v), _mm_andnot_ps(keep, negInf)));
+		vsum = _mm_add_ps(vsum, _mm_and_ps(keep, v));
+		__m128i bin = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(v, zero), limit), scale));
+		__m128i keepInt = _mm_castps_si128(keep);
+		bin = _mm_or_si128(_mm_and_si128(keepInt, bin), _mm_andnot_si128(keepInt, discard));
+		_mm_storeu_si128((__m128i*)bins, bin);
+		hist[bins[0]]++;
+		hist[bins[1]]++;
+		hist[bins[2]]++;
+		hist[bins[3]]++;
+	}
+	float lanes[4];
+	_mm_storeu_ps(lanes, vmin);
+	for (int i = 0; i < 4; i++)
+		if (lanes[i] < acc.minDepth) acc.minDepth = lanes[i];
+	_mm_storeu_ps(lanes, vmax);
+	for (int i = 0; i < 4; i++)
+		if (lanes[i] > acc.maxDepth) acc.maxDepth = lanes[i];
+	_mm_storeu_ps(lanes, vsum);
+	acc.sum += (double)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	acc.pixels += x;
+	acc.valid += valid;
+	statsRowScalar(src + x, n - x, hist, acc);
+}
+
+KERNEL_AVX2_TARGET
+static void statsRowAVX2(const float* src, int n, unsigned int* hist, StatsAccum &acc)
+{
+	const __m256 inf = _mm256_set1_ps(INFINITY), negInf = _mm256_set1_ps(-INFINITY);
+	const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+	const __m256 zero = _mm256_setzero_ps(), limit = _mm256_set1_ps(BIN_LIMIT), scale = _mm256_set1_ps(BIN_SCALE);
+	const __m256 discard = _mm256_castsi256_ps(_mm256_set1_epi32(DISCARD_BIN));
+	__m256 vmin = inf, vmax = negInf, vsum = _mm256_setzero_ps();
+	unsigned int valid = 0;
+	int bins[8];
+	int x = 0;
+	for (; x + 8 <= n; x += 8)
+	{
+		__m256 v = _mm256_loadu_ps(src + x);
+		__m256 keep = _mm256_cmp_ps(_mm256_and_ps(v, absMask), inf, _CMP_LT_OQ);
+		int keepBits = _mm256_movemask_ps(keep);
+		valid += bitCount(keepBits);
+		if (keepBits != 0xFF)
+		{
+			acc.occluded += bitCount(_mm256_movemask_ps(_mm256_cmp_ps(v, v, _CMP_UNORD_Q)));
+			acc.tooFar += bitCount(_mm256_movemask_ps(_mm256_cmp_ps(v, inf, _CMP_EQ_OQ)));
+			acc.tooClose += bitCount(_mm256_movemask_ps(_mm256_cmp_ps(v, negInf, _CMP_EQ_OQ)));
+		}
+		vmin = _mm256_min_ps(vmin, _mm256_blendv_ps(inf, v, keep));
+		vmax = _mm256_max_ps(vmax, _mm256_blendv_ps(negInf, v, keep));
+		vsum = _mm256_add_ps(vsum, _mm256_and_ps(keep, v));
+		__m256i bin = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(v, zero), limit), scale));
+		bin = _mm256_castps_si256(_mm256_blendv_ps(discard, _mm256_castsi256_ps(bin), keep));
+		_mm256_storeu_si256((__m256i*)bins, bin);
+		for (int i = 0; i < 8; i++)
+			hist[bins[i]]++;
+	}
+	float lanes[8];
+	_mm256_storeu_ps(lanes, vmin);
+	for (int i = 0; i < 8; i++)
+		if (lanes[i] < acc.minDepth) acc.minDepth = lanes[i];
+	_mm256_storeu_ps(lanes, vmax);
+	for (int i = 0; i < 8; i++)
+		if (lanes[i] > acc.maxDepth) acc.maxDepth = lanes[i];
+	_mm256_storeu_ps(lanes, vsum);
+	double sum = 0;
+	for (int i = 0; i < 8; i++)
+		sum += lanes[i];
+	acc.sum += sum;
+	acc.pixels += x;
+	acc.valid += valid;
+	statsRowSSE2(src + x, n - x, hist, acc);
+}
+#endif
+
+typedef void (*StatsRowFunc)(const float*, int, unsigned int*, StatsAccum&);
+
+static StatsRowFunc statsRowFunc(KernelIsa isa)
+{
+	KernelIsa best = bestKernelIsa();
+	if (isa == KERNEL_AUTO || isa > best)
+		isa = best;
+#ifdef DEPTH_STATS_X86
+	if (isa == KERNEL_AVX2)
+		return statsRowAVX2;
+	if (isa == KERNEL_SSE2)
+		return statsRowSSE2;
+#endif
+	return statsRowScalar;
+}
+
+static void clearAccum(StatsAccum &acc)
+{
+	memset(&acc, 0, sizeof(acc));
+	acc.minDepth = INFINITY;
+	acc.maxDepth = -INFINITY;
+}
+
+// One tile of rows per call into a histogram of its own, added to the
+// frame's under the lock once the tile is done
+class DepthStatsBody : public cv::ParallelLoopBody
+{
+public:
+	DepthStatsBody(const cv::Mat &depth, StatsRowFunc row, StatsAccum &total, vector<unsigned int> &histogram, mutex &lock)
+		: m_depth(depth), m_row(row), m_total(total), m_histogram(histogram), m_mutex(lock) {}
+
+	void operator()(const cv::Range &rows) const
+	{
+		StatsAccum acc;
+		clearAccum(acc);
+		unsigned int hist[DEPTH_STATS_BINS + 1];
+		memset(hist, 0, sizeof(hist));
+		for (int y = rows.start; y < rows.end; y++)
+			m_row(m_depth.ptr<float>(y), m_depth.cols, hist, acc);
+
+		lock_guard<mutex> lock(m_mutex);
+		m_total.pixels += acc.pixels;
+		m_total.valid += acc.valid;
+		m_total.occluded += acc.occluded;
+		m_total.tooClose += acc.tooClose;
+		m_total.tooFar += acc.tooFar;
+		if (acc.minDepth < m_total.minDepth) m_total.minDepth = acc.minDepth;
+		if (acc.maxDepth > m_total.maxDepth) m_total.maxDepth = acc.maxDepth;
+		m_total.sum += acc.sum;
+		for (int i = 0; i < DEPTH_STATS_BINS; i++)
+			m_histogram[i] += hist[i];
+	}
+private:
+	const cv::Mat &m_depth;
+	StatsRowFunc m_row;
+	StatsAccum &m_total;
+	vector<unsigned int> &m_histogram;
+	mutex &m_mutex;
+};
+
+void depthStats(const cv::Mat &depth, DepthFrameStats &stats, KernelIsa isa)
+{
+	CV_Assert(depth.empty() || depth.type() == CV_32FC1);
+	StatsAccum acc;
+	clearAccum(acc);
+	stats.histogram.assign(DEPTH_STATS_BINS, 0);
+	if (!depth.empty())
+	{
+		mutex lock;
+		DepthStatsBody body(depth, statsRowFunc(isa), acc, stats.histogram, lock);
+		cv::parallel_for_(cv::Range(0, depth.rows), body, (depth.rows + STATS_TILE_ROWS - 1) / STATS_TILE_ROWS);
+	}
+
+	stats.pixels = acc.pixels;
+	stats.valid = acc.valid;
+	stats.occluded = acc.occluded;
+	stats.tooClose = acc.tooClose;
+	stats.tooFar = acc.tooFar;
+	stats.validRatio = acc.pixels ? (float)acc.valid / acc.pixels : 0.0f;
+	if (acc.valid == 0)
+	{
+		stats.minDepth = stats.maxDepth = stats.p5 = stats.median = stats.p95 = NAN;
+		stats.mean = NAN;
+		return;
+	}
+	stats.minDepth = acc.minDepth;
+	stats.maxDepth = acc.maxDepth;
+	stats.mean = acc.sum / acc.valid;
+	stats.p5 = depthStatsPercentile(stats, 5.0f);
+	stats.median = depthStatsPercentile(stats, 50.0f);
+	stats.p95 = depthStatsPercentile(stats, 95.0f);
+}
+
+float depthStatsPercentile(const DepthFrameStats &stats, float percentile)
+{
+	if (stats.valid == 0 || stats.histogram.size() != (size_t)DEPTH_STATS_BINS)
+		return NAN;
+	const double p = percentile < 0.0f ? 0.0 : percentile > 100.0f ? 100.0 : percentile;
+	const double target = p / 100.0 * stats.valid;
+	double below = 0;
+	for (int i = 0; i < DEPTH_STATS_BINS; i++)
+	{
+		unsigned int count = stats.histogram[i];
+		if (count && below + count >= target)
+		{
+			// Spread evenly over the bin, which is what the histogram knows
+			float depth = (float)((i + (target - below) / count) * DEPTH_STATS_BIN_MM);
+			if (depth < stats.minDepth) depth = stats.minDepth;
+			if (depth > stats.maxDepth) depth = stats.maxDepth;
+			return depth;
+		}
+		below += count;
+	}
+	return stats.maxDepth;
+}
+
+//
+// Auto range
+//
+
+static bool parseFloats(const char* p, float** fields, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		char* end;
+		double value = strtod(p, &end);
+		if (end == p)
+			return false;
+		*fields[i] = (float)value;
+		if (*end == '\0')
+			return i > 0; // fields come two at least
+		if (*end != ':' || i == count - 1)
+			return false;
+		p = end + 1;
+	}
+	return true;
+}
+
+bool parseAutoRange(const string &text, AutoRangeParams &params)
+{
+	AutoRangeParams parsed = params;
+	if (text == "frame")
+		parsed.mode = AUTO_RANGE_FRAME;
+	else if (text.compare(0, 6, "fixed:") == 0)
+	{
+		float* fields[] = { &parsed.nearMm, &parsed.farMm };
+		if (!parseFloats(text.c_str() + 6, fields, 2))
+			return false;
+		parsed.mode = AUTO_RANGE_FIXED;
+	}
+	else if (text.compare(0, 10, "percentile") == 0)
+	{
+		float* fields[] = { &parsed.lowPercentile, &parsed.highPercentile, &parsed.smoothing, &parsed.hysteresis };
+		if (text.size() > 10 && (text[10] != ':' || !parseFloats(text.c_str() + 11, fields, 4)))
+			return false;
+		parsed.mode = AUTO_RANGE_PERCENTILE;
+	}
+	else
+		return false;
+	if (!(parsed.nearMm >= 0.0f && parsed.farMm > parsed.nearMm) ||
+		!(parsed.lowPercentile >= 0.0f && parsed.highPercentile > parsed.lowPercentile && parsed.highPercentile <= 100.0f) ||
+		!(parsed.smoothing > 0.0f && parsed.smoothing <= 1.0f) || !(parsed.hysteresis >= 0.0f && parsed.hysteresis < 1.0f))
+		return false;
+	params = parsed;
+	return true;
+}
+
+string formatAutoRange(const AutoRangeParams &params)
+{
+	char text[96];
+	if (params.mode == AUTO_RANGE_FRAME)
+		return "frame";
+	if (params.mode == AUTO_RANGE_FIXED)
+		sprintf(text, "fixed:%g:%g", params.nearMm, params.farMm);
+	else
+		sprintf(text, "percentile:%g:%g:%g:%g", params.lowPercentile, params.highPercentile, params.smoothing, params.hysteresis);
+	return text;
+}
+
+AutoRangeController::AutoRangeController()
+{
+	reset();
+}
+
+void AutoRangeController::setParams(const AutoRangeParams &params)
+{
+	m_params = params;
+	reset();
+}
+
+void AutoRangeController::reset()
+{
+	m_bStarted = false;
+	m_smoothNear = m_near = m_params.nearMm;
+	m_smoothFar = m_far = m_params.farMm;
+}
+
+// The bound follows the smoothed value at the hysteresis distance : noise
+// inside it never moves the bound, a trend drags it along without steps
+static inline void follow(float smoothed, float band, float &bound)
+{
+	if (smoothed > bound + band)
+		bound = smoothed - band;
+	else if (smoothed < bound - band)
+		bound = smoothed + band;
+}
+
+void AutoRangeController::update(DepthFrameStats &stats)
+{
+	const AutoRangeParams &p = m_params;
+	if (p.mode == AUTO_RANGE_FIXED)
+	{
+		stats.nearMm = p.nearMm;
+		stats.farMm = p.farMm;
+		return;
+	}
+	if (p.mode == AUTO_RANGE_FRAME)
+	{
+		// As depthToPlane's own auto range, every frame on its own
+		if (stats.valid > 0)
+		{
+			m_near = stats.minDepth;
+			m_far = stats.maxDepth;
+		}
+		stats.nearMm = m_near;
+		stats.farMm = m_far;
+		return;
+	}
+
+	if (stats.valid > 0 && stats.validRatio >= MIN_VALID_RATIO)
+	{
+		float low = depthStatsPercentile(stats, p.lowPercentile);
+		float high = depthStatsPercentile(stats, p.highPercentile);
+		if (!m_bStarted)
+		{
+			m_smoothNear = m_near = low;
+			m_smoothFar = m_far = high;
+			m_bStarted = true;
+		}
+		else
+		{
+			m_smoothNear += p.smoothing * (low - m_smoothNear);
+			m_smoothFar += p.smoothing * (high - m_smoothFar);
+			float span = m_far - m_near;
+			float band = p.hysteresis * (span > p.minSpanMm ? span : p.minSpanMm);
+			follow(m_smoothNear, band, m_near);
+			follow(m_smoothFar, band, m_far);
+		}
+	}
+
+	// Within the limits, and never so narrow the noise of a flat scene fills the plane
+	float nearMm = m_near < p.nearMm ? p.nearMm : m_near;
+	float farMm = m_far > p.farMm ? p.farMm : m_far;
+	if (farMm - nearMm < p.minSpanMm)
+	{
+		farMm = nearMm + p.minSpanMm;
+		if (farMm > p.farMm)
+		{
+			farMm = p.farMm;
+			nearMm = farMm - p.minSpanMm < p.nearMm ? p.nearMm : farMm - p.minSpanMm;
+		}
+	}
+	stats.nearMm = nearMm;
+	stats.farMm = farMm;
+}
+
+//
+// Text forms for the console and the control channel
+//
+
+string formatDepthFrameStats(const DepthFrameStats &stats)
+{
+	char text[256];
+	sprintf(text, "valid %.1f%% min %.0f p5 %.0f median %.0f p95 %.0f max %.0f mean %.0f range %.0f - %.0f mm",
+		stats.validRatio * 100.0f, stats.minDepth, stats.p5, stats.median, stats.p95, stats.maxDepth, stats.mean,
+		stats.nearMm, stats.farMm);
+	return text;
+}
+
+// JSON has no NAN
+static void jsonNumber(ostringstream &out, double value)
+{
+	if (value != value)
+		out << "null";
+	else
+		out << value;
+}
+
+string depthFrameStatsJSON(const DepthFrameStats &stats, unsigned long long frameId, bool histogram)
+{
+	ostringstream out;
+	out.setf(ios::fixed);
+	out.precision(1);
+	out << "{\"frame\":" << frameId << ",\"pixels\":" << stats.pixels << ",\"valid\":" << stats.valid
+		<< ",\"occluded\":" << stats.occluded << ",\"too_close\":" << stats.tooClose << ",\"too_far\":" << stats.tooFar
+		<< ",\"valid_ratio\":" << setprecision(4) << stats.validRatio << setprecision(1);
+	const char* names[] = { "min_mm", "p5_mm", "median_mm", "p95_mm", "max_mm", "mean_mm", "near_mm", "far_mm" };
+	const double values[] = { stats.minDepth, stats.p5, stats.median, stats.p95, stats.maxDepth, stats.mean, stats.nearMm, stats.farMm };
+	for (int i = 0; i < 8; i++)
+	{
+		out << ",\"" << names[i] << "\":";
+		jsonNumber(out, values[i]);
+	}
+	if (histogram)
+	{
+		size_t used = stats.histogram.size();
+		while (used > 0 && stats.histogram[used - 1] == 0)
+			used--;
+		out << ",\"bin_mm\":" << DEPTH_STATS_BIN_MM << ",\"histogram\":[";
+		for (size_t i = 0; i < used; i++)
+			out << (i ? "," : "") << stats.histogram[i];
+		out << "]";
+	}
+	out << "}";
+	return out.str();
+}
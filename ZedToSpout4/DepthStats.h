@@ -0,0 +1,87 @@
+#pragma once
+#include <math.h>
+#include <string>
+#include <vector>
+#include "opencv2/core.hpp"
+#include "DepthKernels.h"
+
+// Histogram of the measured depths, bins of 16 mm up to 20.48 m, the depth
+// clamp of the camera. Depths further than that count in the last bin.
+static const int DEPTH_STATS_BIN_MM = 16;
+static const int DEPTH_STATS_BINS = 1280;
+
+// Statistics of a whole CV_32FC1 millimeter depth frame, made once a frame
+// by the processing thread and carried with it
+struct DepthFrameStats
+{
+	unsigned int pixels, valid;                // valid : with a measured depth
+	unsigned int occluded, tooClose, tooFar;   // NAN, -INFINITY, +INFINITY
+	float validRatio;                          // valid / pixels
+	float minDepth, maxDepth;                  // NAN when nothing is valid, as the percentiles
+	float p5, median, p95;                     // from the histogram, within a bin
+	double mean;
+	std::vector<unsigned int> histogram;       // DEPTH_STATS_BINS counts of the valid depths
+	float nearMm, farMm;                       // the bounds the plane was normalized to, see AutoRangeController
+
+	DepthFrameStats() : pixels(0), valid(0), occluded(0), tooClose(0), tooFar(0), validRatio(0.0f), minDepth(NAN),
+		maxDepth(NAN), p5(NAN), median(NAN), p95(NAN), mean(NAN), nearMm(0.0f), farMm(0.0f) {}
+};
+
+// Counts, min, max, sum and histogram of depth in one pass. The bins are
+// worked out with SIMD compares and conversions, tiles of rows run on the
+// OpenCV thread pool, each with a histogram of its own. Every instruction set
+// gives the same counts, histogram, min and max, the mean agrees to float
+// rounding. nearMm and farMm are left as they were.
+void depthStats(const cv::Mat &depth, DepthFrameStats &stats, KernelIsa isa = KERNEL_AUTO);
+// The depth under which percentile % of the valid depths are, interpolated
+// in its bin and kept within min - max. NAN when nothing is valid.
+float depthStatsPercentile(const DepthFrameStats &stats, float percentile);
+
+// How the bounds of the 8-bit plane follow the scene
+enum AutoRangeMode
+{
+	AUTO_RANGE_FRAME,      // min - max of every frame, the plane breathes with whatever comes closest
+	AUTO_RANGE_PERCENTILE, // smoothed percentiles, moving only past the hysteresis
+	AUTO_RANGE_FIXED,      // nearMm - farMm
+};
+
+struct AutoRangeParams
+{
+	int mode;                             // AutoRangeMode
+	float lowPercentile, highPercentile;  // of the valid depths, give near and far
+	float smoothing;                      // weight of each new frame's percentiles, 1 follows every frame
+	float hysteresis;                     // share of the span the smoothed bounds move before the plane follows
+	float nearMm, farMm;                  // the fixed bounds, and the limits of the others
+	float minSpanMm;                      // far stays at least this much past near
+
+	AutoRangeParams() : mode(AUTO_RANGE_PERCENTILE), lowPercentile(2.0f), highPercentile(98.0f), smoothing(0.1f),
+		hysteresis(0.05f), nearMm(300.0f), farMm(20000.0f), minSpanMm(500.0f) {}
+};
+
+// "frame", "fixed:near:far" or "percentile[:low:high[:smoothing[:hysteresis]]]"
+bool parseAutoRange(const std::string &text, AutoRangeParams &params);
+std::string formatAutoRange(const AutoRangeParams &params);
+
+// Picks the bounds of the plane from the statistics of each frame. Frames
+// with too few valid depths to go by keep the bounds of the last one.
+class AutoRangeController
+{
+public:
+	AutoRangeController();
+	// Takes effect on the next frame, which starts the smoothing over
+	void setParams(const AutoRangeParams &params);
+	const AutoRangeParams& params() const { return m_params; }
+	void reset();
+	// Sets stats.nearMm and stats.farMm for the frame the statistics are of
+	void update(DepthFrameStats &stats);
+private:
+	AutoRangeParams m_params;
+	bool m_bStarted;
+	float m_smoothNear, m_smoothFar; // percentiles after smoothing
+	float m_near, m_far;             // the bounds handed out
+};
+
+// Counts, ratio, min, percentiles, max, mean and bounds on one line
+std::string formatDepthFrameStats(const DepthFrameStats &stats);
+// The same as JSON, with the histogram up to its last bin used when asked
+std::string depthFrameStatsJSON(const DepthFrameStats &stats, unsigned long long frameId, bool histogram);
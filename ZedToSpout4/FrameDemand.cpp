@@ -0,0 +1,95 @@
+#include "stdafx.h"
+#include "FrameDemand.h"
+using namespace std;
+
+const char* frameStreamNames(unsigned int streams, string &names)
+{
+	static const char* NAMES[] = { "left", "depth", "confidence", "view" };
+	names.clear();
+	for (int i = 0; i < 4; i++)
+	{
+		if (streams & (1 << i))
+		{
+			if (!names.empty())
+				names += "+";
+			names += NAMES[i];
+		}
+	}
+	if (names.empty())
+		names = "none";
+	return names.c_str();
+}
+
+CameraPasses cameraPasses(unsigned int streams)
+{
+	CameraPasses passes;
+	passes.measure = (streams & FRAME_DEPTH) != 0;
+	passes.disparity = passes.measure || (streams & FRAME_CONFIDENCE) != 0;
+	return passes;
+}
+
+FrameDemand::FrameDemand() : m_nextId(0), m_frameStreams(0), m_previewStreams(0)
+{
+}
+
+int FrameDemand::add(const string &name, unsigned int streams, bool previewOnly)
+{
+	lock_guard<mutex> lock(m_mutex);
+	Consumer consumer;
+	consumer.id = m_nextId++;
+	consumer.name = name;
+	consumer.streams = streams;
+	consumer.previewOnly = previewOnly;
+	m_consumers.push_back(consumer);
+	refresh();
+	return consumer.id;
+}
+
+void FrameDemand::update(int id, unsigned int streams)
+{
+	lock_guard<mutex> lock(m_mutex);
+	for (size_t i = 0; i < m_consumers.size(); i++)
+		if (m_consumers[i].id == id)
+			m_consumers[i].streams = streams;
+	refresh();
+}
+
+void FrameDemand::remove(int id)
+{
+	lock_guard<mutex> lock(m_mutex);
+	for (size_t i = 0; i < m_consumers.size(); i++)
+	{
+		if (m_consumers[i].id == id)
+		{
+			m_consumers.erase(m_consumers.begin() + i);
+			break;
+		}
+	}
+	refresh();
+}
+
+void FrameDemand::refresh()
+{
+	unsigned int every = 0, preview = 0;
+	for (size_t i = 0; i < m_consumers.size(); i++)
+	{
+		preview |= m_consumers[i].streams;
+		if (!m_consumers[i].previewOnly)
+			every |= m_consumers[i].streams;
+	}
+	m_frameStreams = every;
+	m_previewStreams = preview;
+}
+
+void FrameDemand::print(ostream &out) const
+{
+	lock_guard<mutex> lock(m_mutex);
+	string names;
+	for (size_t i = 0; i < m_consumers.size(); i++)
+	{
+		const Consumer &c = m_consumers[i];
+		out << "  " << c.name << " : " << frameStreamNames(c.streams, names) << (c.previewOnly ? " (preview)" : "") << endl;
+	}
+	out << "  every frame : " << frameStreamNames(m_frameStreams, names) << ", preview frames : "
+		<< frameStreamNames(m_previewStreams, names) << endl;
+}
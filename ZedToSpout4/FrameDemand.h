@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "FrameSource.h"
+
+// "left+depth" style list of a FrameStream mask, written to names
+const char* frameStreamNames(unsigned int streams, std::string &names);
+
+// What a stereo camera computes for a FrameStream mask : confidence comes out
+// of the disparity pass, depth out of the measure pass on top of it. The
+// point cloud is never needed. ZedFrameSource::grabParams is made of it.
+struct CameraPasses
+{
+	bool disparity;
+	bool measure;
+};
+CameraPasses cameraPasses(unsigned int streams);
+
+// Which streams the outputs consume. Each output registers the FrameStream
+// mask it reads, and the capture stage asks the source for the union only,
+// so a measure nobody reads is neither computed nor copied. Outputs that only
+// feed the preview windows don't count for frames the preview skips.
+// Registration may change from any thread; the capture stage reads two atomics.
+class FrameDemand
+{
+public:
+	FrameDemand();
+	// Returns the id to update or remove the consumer with
+	int add(const std::string &name, unsigned int streams, bool previewOnly = false);
+	void update(int id, unsigned int streams);
+	void remove(int id);
+
+	// Streams to grab for a frame, depending on whether the preview takes it
+	unsigned int streams(bool preview) const { return preview ? m_previewStreams : m_frameStreams; }
+	void print(std::ostream &out) const;
+private:
+	struct Consumer
+	{
+		int id;
+		std::string name;
+		unsigned int streams;
+		bool previewOnly;
+	};
+	// Caller holds the lock
+	void refresh();
+
+	mutable std::mutex m_mutex;
+	std::vector<Consumer> m_consumers;
+	int m_nextId;
+	std::atomic<unsigned int> m_frameStreams, m_previewStreams;
+};
@@ -0,0 +1,262 @@
+#include "stdafx.h"
+#include "FramePipeline.h"
+using namespace std;
+
+static void swapPreview(PipelinePreview &a, PipelinePreview &b)
+{
+	swap(a.frameId, b.frameId);
+	cv::swap(a.plane, b.plane);
+	cv::swap(a.view, b.view);
+	cv::swap(a.confidence, b.confidence);
+}
+
+FramePipeline::FramePipeline(int slots, DropPolicy policy)
+	: m_pool(slots * 8), m_frames(slots), m_policy(policy),
+	m_captured(slots), m_processed(slots), m_free(slots), m_dropped(slots), m_previewed(1), m_previewDone(slots),
+	m_bRunning(false), m_nextFrameId(0), m_previewInterval(0),
+	m_bPreviewFresh(false), m_bTrackFrameAge(false)
+{
+	for (size_t i = 0; i < m_frames.size(); i++)
+	{
+		PipelineFrame &frame = m_frames[i];
+		frame.frameId = 0;
+		frame.preview = false;
+		frame.outputsDue = 0;
+		m_pool.attach(frame.source.left);
+		m_pool.attach(frame.source.depth);
+		m_pool.attach(frame.source.confidence);
+		m_pool.attach(frame.filtered);
+		m_pool.attach(frame.plane);
+		m_pool.attach(frame.view);
+		for (int j = 0; j < MAX_PIPELINE_OUTPUTS; j++)
+			m_pool.attach(frame.outputs[j]);
+		m_free.push(&frame);
+	}
+	m_preview.frameId = 0;
+	m_pool.attach(m_preview.plane);
+	m_pool.attach(m_preview.view);
+	m_pool.attach(m_preview.confidence);
+	m_pool.attach(m_previewNext.plane);
+	m_pool.attach(m_previewNext.view);
+	m_pool.attach(m_previewNext.confidence);
+}
+
+FramePipeline::~FramePipeline()
+{
+	stop();
+}
+
+void FramePipeline::setCapture(CaptureFunc capture)
+{
+	m_capture = capture;
+}
+
+void FramePipeline::setProcess(StageFunc process)
+{
+	m_process = process;
+}
+
+void FramePipeline::setPublish(StageFunc publish, InitFunc init)
+{
+	m_publish = publish;
+	m_publishInit = init;
+}
+
+void FramePipeline::setPreview(PreviewFunc preview)
+{
+	m_previewFunc = preview;
+}
+
+void FramePipeline::setPreviewInterval(int msec)
+{
+	m_previewInterval = chrono::milliseconds(msec);
+}
+
+void FramePipeline::start()
+{
+	if (m_bRunning)
+		return;
+	m_bRunning = true;
+	m_lastPreview = chrono::steady_clock::now();
+	m_previewThread = thread(&FramePipeline::previewLoop, this);
+	m_publishThread = thread(&FramePipeline::publishLoop, this);
+	m_processThread = thread(&FramePipeline::processLoop, this);
+	m_captureThread = thread(&FramePipeline::captureLoop, this);
+}
+
+void FramePipeline::stop()
+{
+	m_bRunning = false;
+	if (m_captureThread.joinable())
+		m_captureThread.join();
+	if (m_processThread.joinable())
+		m_processThread.join();
+	if (m_publishThread.joinable())
+		m_publishThread.join();
+	if (m_previewThread.joinable())
+		m_previewThread.join();
+}
+
+bool FramePipeline::previewDue()
+{
+	if (m_previewInterval.count() == 0)
+		return false;
+	PipelineTime now = chrono::steady_clock::now();
+	if (now - m_lastPreview < m_previewInterval)
+		return false;
+	m_lastPreview = now;
+	return true;
+}
+
+PipelineFrame* FramePipeline::acquireCaptureSlot()
+{
+	PipelineFrame* frame = NULL;
+	while (m_bRunning)
+	{
+		if (m_free.pop(frame) || m_dropped.pop(frame) || m_previewDone.pop(frame))
+			return frame;
+		// Every slot is queued or in use downstream: reclaim the oldest captured frame
+		if (m_policy == DROP_OLDEST && m_captured.pop(frame))
+		{
+			m_telemetry.addDrop();
+			return frame;
+		}
+		if (m_free.popWait(frame, 1))
+			return frame;
+	}
+	return NULL;
+}
+
+void FramePipeline::captureLoop()
+{
+	PipelineFrame* frame = NULL;
+	while (m_bRunning)
+	{
+		if (!frame && !(frame = acquireCaptureSlot()))
+			break;
+
+		frame->preview = previewDue();
+		frame->captureStart = TELEMETRY_NOW();
+		if (!m_capture(*frame))
+		{
+			// No new frame : keep the slot for the next attempt
+			this_thread::sleep_for(chrono::milliseconds(1));
+			continue;
+		}
+		m_telemetry.add(METRIC_CAPTURE, frame->captureStart, TELEMETRY_NOW());
+		frame->frameId = m_nextFrameId++;
+
+		// Cannot fail : there are never more frames than queue entries
+		m_captured.push(frame);
+		frame = NULL;
+	}
+}
+
+void FramePipeline::processLoop()
+{
+	PipelineFrame* frame;
+	while (m_bRunning)
+	{
+		if (!m_captured.popWait(frame, 50))
+			continue;
+
+		{
+			TELEMETRY_SCOPE(m_telemetry, METRIC_PROCESS);
+			if (m_process)
+				m_process(*frame);
+		}
+
+		while (!m_processed.push(frame) && m_bRunning)
+		{
+			PipelineFrame* oldest;
+			if (m_policy == DROP_OLDEST && m_processed.pop(oldest))
+			{
+				m_dropped.push(oldest);
+				m_telemetry.addDrop();
+			}
+			else
+				this_thread::yield();
+		}
+	}
+}
+
+void FramePipeline::publishLoop()
+{
+	if (m_publishInit)
+		m_publishInit();
+
+	PipelineFrame* frame;
+	while (m_bRunning)
+	{
+		if (!m_processed.popWait(frame, 50))
+			continue;
+
+		PipelineTime start = TELEMETRY_NOW();
+		if (m_publish)
+			m_publish(*frame);
+		PipelineTime end = TELEMETRY_NOW();
+		m_telemetry.add(METRIC_PUBLISH, start, end);
+		m_telemetry.add(METRIC_LATENCY, frame->captureStart, end);
+		m_telemetry.addFrame();
+#if ZTS_TELEMETRY
+		if (m_bTrackFrameAge)
+		{
+			long long now = chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+			if (now > (long long)frame->source.timestamp)
+				m_telemetry.addNs(METRIC_FRAME_AGE, now - frame->source.timestamp);
+		}
+#endif
+
+		// The preview thread gives the slot back once the observer images are made
+		if (frame->preview && m_previewed.push(frame))
+			continue;
+		m_free.push(frame);
+	}
+}
+
+void FramePipeline::previewLoop()
+{
+	PipelineFrame* frame;
+	while (m_bRunning)
+	{
+		if (!m_previewed.popWait(frame, 50))
+			continue;
+
+		{
+			TELEMETRY_SCOPE(m_telemetry, METRIC_PREVIEW);
+			m_previewNext.frameId = frame->frameId;
+			if (m_previewFunc)
+				m_previewFunc(*frame, m_previewNext);
+			else
+			{
+				frame->plane.copyTo(m_previewNext.plane);
+				frame->view.copyTo(m_previewNext.view);
+				frame->source.confidence.copyTo(m_previewNext.confidence);
+			}
+		}
+		m_previewDone.push(frame);
+
+		lock_guard<mutex> lock(m_previewMutex);
+		swapPreview(m_preview, m_previewNext);
+		m_bPreviewFresh = true;
+	}
+}
+
+bool FramePipeline::latestPreview(PipelinePreview &preview)
+{
+	lock_guard<mutex> lock(m_previewMutex);
+	if (!m_bPreviewFresh)
+		return false;
+	// The observer's previous buffers are the ones the preview thread fills next
+	swapPreview(preview, m_preview);
+	m_bPreviewFresh = false;
+	return true;
+}
+
+void FramePipeline::printStats(ostream &out)
+{
+	TelemetrySnapshot current;
+	m_telemetry.snapshot(current);
+	current.since(m_printed).writeText(out);
+	m_printed = current;
+}
@@ -0,0 +1,139 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+#include "opencv2/core.hpp"
+#include "SpscQueue.h"
+#include "FrameSource.h"
+#include "Telemetry.h"
+#include "FramePool.h"
+#include "DepthStats.h"
+
+typedef std::chrono::steady_clock::time_point PipelineTime;
+
+static const int MAX_PIPELINE_OUTPUTS = 8;
+
+// One preallocated slot travelling capture -> process -> publish and back.
+// Mats are allocated from the pipeline's FramePool on first use and then
+// reused for every later frame.
+struct PipelineFrame
+{
+	unsigned long long frameId;
+	PipelineTime captureStart;
+	bool preview;       // set before capture when the observer wants this frame
+
+	DepthFrame source;  // as delivered by the FrameSource
+	cv::Mat filtered;   // temporally filtered depth, empty while the filter is off
+	cv::Mat plane;      // single channel frame handed to Spout
+	cv::Mat view;       // preview only : left / right / view mode image
+	DepthFrameStats depthStats; // of depth(), with the bounds the plane was normalized to
+
+	// Extra images published next to the plane, see StreamFanout. Bit i of
+	// outputsDue is set when outputs[i] goes out with this frame.
+	unsigned int outputsDue;
+	cv::Mat outputs[MAX_PIPELINE_OUTPUTS];
+
+	// Depth the outputs are made from
+	const cv::Mat& depth() const { return filtered.empty() ? source.depth : filtered; }
+};
+
+// Latest images handed to the UI observer, as the preview function made them
+// (full size copies of the plane, view and confidence without one)
+struct PipelinePreview
+{
+	unsigned long long frameId;
+	cv::Mat plane, view, confidence;
+};
+
+// Capture, processing and publishing each run on their own thread, connected
+// by bounded lock-free queues over a fixed set of frame slots. With
+// DROP_OLDEST a stage that finds its output queue full discards the oldest
+// queued frame so the newest always gets through; with BLOCK it waits,
+// which is what replays want when no frame may be lost.
+class FramePipeline
+{
+public:
+	enum DropPolicy { DROP_OLDEST, BLOCK };
+	typedef std::function<bool(PipelineFrame&)> CaptureFunc;
+	typedef std::function<void(PipelineFrame&)> StageFunc;
+	typedef std::function<void()> InitFunc;
+	typedef std::function<void(PipelineFrame&, PipelinePreview&)> PreviewFunc;
+
+	FramePipeline(int slots = 4, DropPolicy policy = DROP_OLDEST);
+	~FramePipeline();
+
+	// Capture returns false when there is no new frame
+	void setCapture(CaptureFunc capture);
+	void setProcess(StageFunc process);
+	// init runs on the publish thread before the first frame, so GL contexts can be made there
+	void setPublish(StageFunc publish, InitFunc init = InitFunc());
+	// Minimum time between frames copied out for the observer, 0 disables it
+	void setPreviewInterval(int msec);
+	// Makes the observer images from a published frame, on a thread of its
+	// own : the slot only returns to capture once it is done, and a frame
+	// published while the previous one is still being previewed isn't
+	// previewed at all, so the preview never holds up publishing
+	void setPreview(PreviewFunc preview);
+	// Track the age of published frames against the system clock, for sources
+	// whose timestamps come from it (the live camera, not SVO or recordings)
+	void setTrackFrameAge(bool track) { m_bTrackFrameAge = track; }
+
+	void start();
+	void stop();
+	bool isRunning() const { return m_bRunning; }
+
+	// Copies the latest preview, returns false if nothing new since the last call
+	bool latestPreview(PipelinePreview &preview);
+
+	// Prints per-stage latency and throughput since the last call
+	void printStats(std::ostream &out);
+	// Stage timings, stages may add their own metrics from their thread
+	Telemetry& telemetry() { return m_telemetry; }
+	// Buffers of the frame slots, for stages that keep Mats of their own
+	FramePool& pool() { return m_pool; }
+
+private:
+	FramePipeline(const FramePipeline&);
+	FramePipeline& operator=(const FramePipeline&);
+
+	void captureLoop();
+	void processLoop();
+	void publishLoop();
+	void previewLoop();
+	PipelineFrame* acquireCaptureSlot();
+	bool previewDue();
+
+	FramePool m_pool; // before the frames, it must outlive their Mats
+	std::vector<PipelineFrame> m_frames;
+	DropPolicy m_policy;
+	SpscQueue<PipelineFrame*> m_captured;  // capture -> process
+	SpscQueue<PipelineFrame*> m_processed; // process -> publish
+	SpscQueue<PipelineFrame*> m_free;      // publish -> capture
+	SpscQueue<PipelineFrame*> m_dropped;   // process -> capture, frames dropped by the process stage
+	SpscQueue<PipelineFrame*> m_previewed; // publish -> preview, one frame at most
+	SpscQueue<PipelineFrame*> m_previewDone; // preview -> capture
+
+	CaptureFunc m_capture;
+	StageFunc m_process, m_publish;
+	InitFunc m_publishInit;
+	PreviewFunc m_previewFunc;
+
+	std::atomic<bool> m_bRunning;
+	std::thread m_captureThread, m_processThread, m_publishThread, m_previewThread;
+	unsigned long long m_nextFrameId;
+
+	std::chrono::milliseconds m_previewInterval;
+	PipelineTime m_lastPreview;
+	std::mutex m_previewMutex;
+	PipelinePreview m_preview;     // latest finished, swapped out to the observer
+	PipelinePreview m_previewNext; // preview thread only
+	bool m_bPreviewFresh;
+
+	Telemetry m_telemetry;
+	TelemetrySnapshot m_printed;
+	bool m_bTrackFrameAge;
+};
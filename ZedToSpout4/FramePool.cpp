@@ -0,0 +1,150 @@
+#include "stdafx.h"
+#include "FramePool.h"
+#include <stdlib.h>
+using namespace std;
+
+FramePool::FramePool(int slotsPerClass) : m_slotsPerClass(slotsPerClass)
+{
+	m_stats.hits = m_stats.misses = m_stats.heapAllocations = 0;
+	m_stats.inUse = 0;
+	m_slots.resize(CLASS_COUNT * slotsPerClass);
+	for (int c = 0; c < CLASS_COUNT; c++)
+	{
+		m_free[c].reserve(slotsPerClass);
+		// Lowest index on top
+		for (int i = slotsPerClass - 1; i >= 0; i--)
+		{
+			int index = c * slotsPerClass + i;
+			Slot &slot = m_slots[index];
+			slot.u = new cv::UMatData(this);
+			slot.memory = NULL;
+			slot.sizeClass = c;
+			m_free[c].push_back(index);
+		}
+	}
+}
+
+FramePool::~FramePool()
+{
+	for (size_t i = 0; i < m_slots.size(); i++)
+	{
+		free(m_slots[i].memory);
+		delete m_slots[i].u;
+	}
+}
+
+int FramePool::classOf(size_t bytes)
+{
+	int log = MIN_CLASS_LOG;
+	while (log <= MAX_CLASS_LOG && ((size_t)1 << log) < bytes)
+		log++;
+	return log <= MAX_CLASS_LOG ? log - MIN_CLASS_LOG : -1;
+}
+
+bool FramePool::fill(Slot &slot) const
+{
+	if (!slot.memory)
+	{
+		slot.memory = (unsigned char*)malloc(((size_t)1 << (MIN_CLASS_LOG + slot.sizeClass)) + ALIGNMENT);
+		if (!slot.memory)
+			return false;
+		m_stats.heapAllocations++;
+	}
+	return true;
+}
+
+int FramePool::acquire(int sizeClass) const
+{
+	vector<int> &freeSlots = m_free[sizeClass];
+	if (freeSlots.empty() || !fill(m_slots[freeSlots.back()]))
+		return -1;
+	int index = freeSlots.back();
+	freeSlots.pop_back();
+	m_stats.inUse++;
+	return index;
+}
+
+void FramePool::reserve(size_t bytes, int count)
+{
+	int sizeClass = classOf(bytes);
+	if (sizeClass < 0)
+		return;
+	lock_guard<mutex> lock(m_mutex);
+	// The slots handed out next are the ones on top
+	const vector<int> &freeSlots = m_free[sizeClass];
+	for (int i = 0; i < count && i < (int)freeSlots.size(); i++)
+		if (!fill(m_slots[freeSlots[freeSlots.size() - 1 - i]]))
+			break;
+}
+
+FramePool::Stats FramePool::stats() const
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_stats;
+}
+
+cv::UMatData* FramePool::allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+	int flags, cv::UMatUsageFlags usageFlags) const
+{
+	cv::MatAllocator* heap = cv::Mat::getStdAllocator();
+	size_t total = CV_ELEM_SIZE(type);
+	for (int i = dims - 1; i >= 0; i--)
+	{
+		if (step)
+			step[i] = total;
+		total *= sizes[i];
+	}
+	int sizeClass = classOf(total);
+	if (data || sizeClass < 0)
+	{
+		// User data is only wrapped, nothing to pool
+		if (!data)
+		{
+			lock_guard<mutex> lock(m_mutex);
+			m_stats.misses++;
+		}
+		return heap->allocate(dims, sizes, type, data, step, flags, usageFlags);
+	}
+
+	int index;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		index = acquire(sizeClass);
+		if (index < 0)
+			m_stats.misses++;
+		else
+			m_stats.hits++;
+	}
+	if (index < 0)
+		return heap->allocate(dims, sizes, type, data, step, flags, usageFlags);
+
+	// Same state as a freshly constructed UMatData
+	const Slot &slot = m_slots[index];
+	cv::UMatData* u = slot.u;
+	u->prevAllocator = u->currAllocator = this;
+	u->urefcount = u->refcount = u->mapcount = 0;
+	u->origdata = slot.memory;
+	u->data = (unsigned char*)(((size_t)slot.memory + ALIGNMENT - 1) & ~(ALIGNMENT - 1));
+	u->size = total;
+	u->flags = 0;
+	u->handle = u->userdata = NULL;
+	u->allocatorFlags_ = index;
+	u->originalUMatData = NULL;
+	return u;
+}
+
+bool FramePool::allocate(cv::UMatData* u, int, cv::UMatUsageFlags) const
+{
+	return u != NULL;
+}
+
+void FramePool::deallocate(cv::UMatData* u) const
+{
+	if (!u)
+		return;
+	CV_Assert(u->urefcount == 0 && u->refcount == 0);
+	int index = u->allocatorFlags_;
+	lock_guard<mutex> lock(m_mutex);
+	m_free[m_slots[index].sizeClass].push_back(index);
+	m_stats.inUse--;
+}
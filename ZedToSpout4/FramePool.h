@@ -0,0 +1,71 @@
+#pragma once
+#include <mutex>
+#include <vector>
+#include "opencv2/core.hpp"
+
+// Mat buffers recycled through power of two size classes. A Mat whose
+// allocator is the pool takes its data from a free slot of the smallest class
+// that fits, and the slot comes back when the last Mat sharing it is released
+// (OpenCV does the reference counting). Once every slot in use has been
+// filled once, or reserve() was called, allocating and releasing frames only
+// takes a lock : no heap. Buffers are 64-byte aligned.
+//
+// Requests larger than the biggest class, or for a class with every slot in
+// use, go to the standard OpenCV allocator and are counted as misses. The pool
+// must outlive every Mat it allocated.
+class FramePool : public cv::MatAllocator
+{
+public:
+	static const size_t ALIGNMENT = 64;
+	static const int MIN_CLASS_LOG = 12; // 4 KB
+	static const int MAX_CLASS_LOG = 26; // 64 MB
+	static const int CLASS_COUNT = MAX_CLASS_LOG - MIN_CLASS_LOG + 1;
+
+	struct Stats
+	{
+		unsigned long long hits;            // served from a slot
+		unsigned long long misses;          // sent to the standard allocator
+		unsigned long long heapAllocations; // slot buffers allocated, each slot only once
+		int inUse;
+	};
+
+	explicit FramePool(int slotsPerClass = 8);
+	~FramePool();
+
+	// Fills count slots of the class holding bytes ahead of time
+	void reserve(size_t bytes, int count);
+	// m allocates from the pool from its next create() on
+	void attach(cv::Mat &m) { m.allocator = this; }
+	Stats stats() const;
+
+	// cv::MatAllocator
+	cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+		int flags, cv::UMatUsageFlags usageFlags) const;
+	bool allocate(cv::UMatData* u, int accessFlags, cv::UMatUsageFlags usageFlags) const;
+	void deallocate(cv::UMatData* u) const;
+
+private:
+	struct Slot
+	{
+		cv::UMatData* u;
+		unsigned char* memory; // as returned by malloc, NULL until first used
+		int sizeClass;
+	};
+
+	FramePool(const FramePool&);
+	FramePool& operator=(const FramePool&);
+	static int classOf(size_t bytes);
+	// Allocates the slot's buffer on first use
+	bool fill(Slot &slot) const;
+	// Pops a slot of the class, filling its buffer if needed; -1 when all are in use
+	int acquire(int sizeClass) const;
+
+	int m_slotsPerClass;
+	mutable std::mutex m_mutex;
+	mutable std::vector<Slot> m_slots;
+	// Free slot indices per class. Returned slots go on top, so slots with a
+	// buffer are reused before empty ones are filled. Capacity is reserved up
+	// front and never grows.
+	mutable std::vector<int> m_free[CLASS_COUNT];
+	mutable Stats m_stats;
+};
@@ -0,0 +1,200 @@
+#include "stdafx.h"
+#include "FrameSource.h"
+#include <math.h>
+#include <limits>
+#include <thread>
+using namespace std;
+
+CameraIntrinsics defaultIntrinsics(cv::Size size)
+{
+	CameraIntrinsics k;
+	k.fx = k.fy = 700.0f * size.width / 1280.0f;
+	k.cx = size.width * 0.5f;
+	k.cy = size.height * 0.5f;
+	return k;
+}
+
+//
+// SourcePacer
+//
+
+SourcePacer::SourcePacer(double fps)
+{
+	setRate(fps);
+}
+
+void SourcePacer::setRate(double fps)
+{
+	m_period = (fps > 0) ? chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(1.0 / fps))
+		: chrono::steady_clock::duration::zero();
+	m_bStarted = false;
+}
+
+void SourcePacer::wait()
+{
+	if (m_period == chrono::steady_clock::duration::zero())
+		return;
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	// Restart the schedule when we fell more than a frame behind instead of bursting to catch up
+	if (!m_bStarted || now - m_next > m_period)
+	{
+		m_next = now;
+		m_bStarted = true;
+	}
+	else
+		this_thread::sleep_until(m_next);
+	m_next += m_period;
+}
+
+//
+// SyntheticFrameSource
+//
+
+SyntheticFrameSource::SyntheticFrameSource(int width, int height, double fps)
+	: m_width(width), m_height(height), m_frameIndex(0), m_pacer(fps)
+{
+	CameraIntrinsics k = defaultIntrinsics(cv::Size(width, height));
+	m_fx = k.fx;
+	m_fy = k.fy;
+	m_cx = k.cx;
+	m_cy = k.cy;
+
+	m_rayX.resize(width);
+	m_rayY.resize(height);
+	for (int x = 0; x < width; x++)
+		m_rayX[x] = (x - m_cx) / m_fx;
+	for (int y = 0; y < height; y++)
+		m_rayY[y] = (y - m_cy) / m_fy;
+}
+
+// Scene objects, in camera coordinates (mm, y down, z forward)
+enum { OBJ_NONE, OBJ_WALL, OBJ_FLOOR, OBJ_SPHERE, OBJ_PANEL };
+static const float WALL_Z = 6000.0f;
+static const float FLOOR_Y = 1200.0f;
+static const float SPHERE_RADIUS = 500.0f;
+static const double PI = 3.14159265358979;
+
+// Returns the depth (z) of the first surface hit by the ray (dx, dy, 1)
+float SyntheticFrameSource::trace(float dx, float dy, unsigned long long frameIndex, int &object) const
+{
+	float depth = WALL_Z;
+	object = OBJ_WALL;
+
+	// A doorway in the wall opens onto nothing, which the camera reports as too far
+	float wx = dx * WALL_Z, wy = dy * WALL_Z;
+	if (wx > 1500.0f && wx < 2500.0f && wy > -1200.0f && wy < FLOOR_Y)
+	{
+		depth = numeric_limits<float>::infinity();
+		object = OBJ_NONE;
+	}
+
+	if (dy > 0)
+	{
+		float t = FLOOR_Y / dy;
+		if (t < depth)
+		{
+			depth = t;
+			object = OBJ_FLOOR;
+		}
+	}
+
+	// Panel moving back and forth in depth on the left
+	float panelZ = (float)(3500.0 + 1500.0 * sin(2.0 * PI * frameIndex / 90.0));
+	float px = dx * panelZ, py = dy * panelZ;
+	if (px > -2200.0f && px < -1000.0f && py > -1000.0f && py < 800.0f && panelZ < depth)
+	{
+		depth = panelZ;
+		object = OBJ_PANEL;
+	}
+
+	// Sphere moving sideways
+	float sx = (float)(1200.0 * sin(2.0 * PI * frameIndex / 120.0)), sy = 200.0f, sz = 2500.0f;
+	float a = dx * dx + dy * dy + 1.0f;
+	float b = -2.0f * (dx * sx + dy * sy + sz);
+	float c = sx * sx + sy * sy + sz * sz - SPHERE_RADIUS * SPHERE_RADIUS;
+	float disc = b * b - 4.0f * a * c;
+	if (disc >= 0)
+	{
+		float t = (-b - sqrtf(disc)) / (2.0f * a);
+		if (t > 0 && t < depth)
+		{
+			depth = t;
+			object = OBJ_SPHERE;
+		}
+	}
+	return depth;
+}
+
+float SyntheticFrameSource::depthAt(int x, int y, unsigned long long frameIndex) const
+{
+	int object;
+	return trace(m_rayX[x], m_rayY[y], frameIndex, object);
+}
+
+CameraIntrinsics SyntheticFrameSource::intrinsics() const
+{
+	CameraIntrinsics k = { m_fx, m_fy, m_cx, m_cy };
+	return k;
+}
+
+bool SyntheticFrameSource::grab(DepthFrame &frame, unsigned int streams)
+{
+	m_pacer.wait();
+
+	// Tracing gives everything at once, only the writes are skipped
+	const bool wantLeft = (streams & (FRAME_LEFT | FRAME_VIEW)) != 0;
+	const bool wantConfidence = (streams & FRAME_CONFIDENCE) != 0;
+	frame.depth.create(m_height, m_width, CV_32FC1);
+	if (wantLeft)
+		frame.left.create(m_height, m_width, CV_8UC4);
+	else
+		frame.left.release();
+	if (wantConfidence)
+		frame.confidence.create(m_height, m_width, CV_32FC1);
+	else
+		frame.confidence.release();
+
+	for (int y = 0; y < m_height; y++)
+	{
+		cv::Vec4b* left = wantLeft ? frame.left.ptr<cv::Vec4b>(y) : NULL;
+		float* depth = frame.depth.ptr<float>(y);
+		float* confidence = wantConfidence ? frame.confidence.ptr<float>(y) : NULL;
+		float dy = m_rayY[y];
+		for (int x = 0; x < m_width; x++)
+		{
+			int object;
+			float dx = m_rayX[x];
+			float z = trace(dx, dy, m_frameIndex, object);
+			depth[x] = z;
+
+			if (left)
+			{
+				// Simple texture so the left image is recognizable, darker with distance
+				int shade = 0;
+				cv::Vec4b colour(0, 0, 0, 255);
+				if (object != OBJ_NONE)
+				{
+					bool checker = (((int)floorf(dx * z / 250.0f) + (int)floorf(dy * z / 250.0f)) & 1) != 0;
+					shade = 255 - (int)(z * 0.03f);
+					if (checker)
+						shade = shade * 3 / 4;
+				}
+				switch (object)
+				{
+				case OBJ_WALL:   colour = cv::Vec4b(shade, shade, shade, 255); break;
+				case OBJ_FLOOR:  colour = cv::Vec4b(shade / 2, shade, shade / 2, 255); break;
+				case OBJ_SPHERE: colour = cv::Vec4b(shade / 3, shade / 3, shade, 255); break;
+				case OBJ_PANEL:  colour = cv::Vec4b(shade, shade / 2, shade / 3, 255); break;
+				}
+				left[x] = colour;
+			}
+			if (confidence)
+				confidence[x] = (object == OBJ_NONE) ? 0.0f : 95.0f;
+		}
+	}
+
+	// Fixed 60 Hz clock when running free, so timestamps never depend on the machine
+	frame.timestamp = m_frameIndex * 1000000000ULL / 60ULL;
+	m_frameIndex++;
+	return true;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <chrono>
+#include <vector>
+#include "opencv2/core.hpp"
+
+// Streams a source can deliver, combined as a bit mask
+enum FrameStream
+{
+	FRAME_LEFT = 1 << 0,
+	FRAME_DEPTH = 1 << 1,
+	FRAME_CONFIDENCE = 1 << 2,
+	FRAME_VIEW = 1 << 3, // retrieveView; sources without view modes deliver the left image for it
+	FRAME_ALL = FRAME_LEFT | FRAME_DEPTH | FRAME_CONFIDENCE | FRAME_VIEW
+};
+
+// Pinhole model of the left image, in pixels
+struct CameraIntrinsics
+{
+	float fx, fy, cx, cy;
+};
+// Roughly the ZED HD720 left camera, scaled with the image size
+CameraIntrinsics defaultIntrinsics(cv::Size size);
+
+// One frame as delivered by a FrameSource. Depth follows the ZED SDK
+// conventions : millimeters, +INFINITY for too far, -INFINITY for too close
+// and NAN where no measure exists. Streams that were not asked for are empty.
+struct DepthFrame
+{
+	unsigned long long timestamp; // ns
+	cv::Mat left;       // CV_8UC4 BGRA
+	cv::Mat depth;      // CV_32FC1
+	cv::Mat confidence; // CV_32FC1, 0-100
+
+	DepthFrame() : timestamp(0) {}
+};
+
+// Where frames come from : the camera, a recording or a generated scene
+class FrameSource
+{
+public:
+	virtual ~FrameSource() {}
+	virtual cv::Size size() const = 0;
+	// Blocks until the next frame is due, returns false when none is available.
+	// streams is a FrameStream mask, sources skip the work for the others.
+	virtual bool grab(DepthFrame &frame, unsigned int streams = FRAME_ALL) = 0;
+	// Image for the VIEW window, returns false for sources without view modes
+	virtual bool retrieveView(int viewID, cv::Mat &view) { return false; }
+	virtual void setConfidenceThreshold(int threshold) {}
+	// Recordings don't keep the calibration and fall back to defaultIntrinsics
+	virtual CameraIntrinsics intrinsics() const { return defaultIntrinsics(size()); }
+};
+
+// Keeps a source at a fixed rate; a rate of 0 means as fast as possible
+class SourcePacer
+{
+public:
+	explicit SourcePacer(double fps = 0);
+	void setRate(double fps);
+	void wait();
+private:
+	std::chrono::steady_clock::duration m_period;
+	std::chrono::steady_clock::time_point m_next;
+	bool m_bStarted;
+};
+
+// Deterministic scene with a back wall, a floor, a sphere moving sideways and
+// a panel moving in depth, seen through a pinhole camera close to the ZED HD720
+// left camera. Depth values are exact so the output can be checked per pixel.
+class SyntheticFrameSource : public FrameSource
+{
+public:
+	SyntheticFrameSource(int width = 1280, int height = 720, double fps = 0);
+	cv::Size size() const { return cv::Size(m_width, m_height); }
+	bool grab(DepthFrame &frame, unsigned int streams = FRAME_ALL);
+	CameraIntrinsics intrinsics() const;
+
+	// Analytic depth of a pixel for a given frame index, used to check downstream stages
+	float depthAt(int x, int y, unsigned long long frameIndex) const;
+private:
+	float trace(float dx, float dy, unsigned long long frameIndex, int &object) const;
+
+	int m_width, m_height;
+	float m_fx, m_fy, m_cx, m_cy;
+	unsigned long long m_frameIndex;
+	SourcePacer m_pacer;
+	std::vector<float> m_rayX, m_rayY; // per column / row ray slopes
+};
@@ -0,0 +1,160 @@
+#include "stdafx.h"
+#include "HeapCount.h"
+#ifndef ZTS_HEAP_COUNT
+#error HeapCount.cpp replaces the global allocators, build it with ZTS_HEAP_COUNT and never into the application
+#endif
+#include <stdlib.h>
+#include <errno.h>
+#include <atomic>
+#include <new>
+#ifdef _WIN32
+#include <crtdbg.h>
+#endif
+
+// Zero before any static constructor runs, so allocations made while the
+// program starts are safe to count
+static std::atomic<bool> s_counting;
+static std::atomic<unsigned long long> s_allocations;
+
+static inline void countAllocation()
+{
+	if (s_counting.load(std::memory_order_relaxed))
+		s_allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+#if defined(__GLIBC__)
+// Every malloc of the process comes through here, operator new included
+#define HEAP_COUNT_MALLOC 1
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* p, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+
+void* malloc(size_t size)
+{
+	countAllocation();
+	return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+	countAllocation();
+	return __libc_calloc(count, size);
+}
+
+void* realloc(void* p, size_t size)
+{
+	countAllocation();
+	return __libc_realloc(p, size);
+}
+
+void* memalign(size_t alignment, size_t size)
+{
+	countAllocation();
+	return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+	countAllocation();
+	return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** p, size_t alignment, size_t size)
+{
+	if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0)
+		return EINVAL;
+	countAllocation();
+	*p = __libc_memalign(alignment, size);
+	return *p || size == 0 ? 0 : ENOMEM;
+}
+}
+#elif defined(_WIN32) && defined(_DEBUG)
+// The debug CRT reports every heap operation, operator new included
+#define HEAP_COUNT_MALLOC 1
+static int __cdecl allocHook(int allocType, void*, size_t, int, long, const unsigned char*, int)
+{
+	if (allocType == _HOOK_ALLOC || allocType == _HOOK_REALLOC)
+		countAllocation();
+	return TRUE;
+}
+#endif
+
+// operator new only counts itself when malloc isn't counted already
+static inline void* allocate(size_t size)
+{
+#ifndef HEAP_COUNT_MALLOC
+	countAllocation();
+#endif
+	return malloc(size ? size : 1);
+}
+
+void* operator new(size_t size)
+{
+	void* p = allocate(size);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	void* p = allocate(size);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) throw()
+{
+	return allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) throw()
+{
+	return allocate(size);
+}
+
+void operator delete(void* p) throw()
+{
+	free(p);
+}
+
+void operator delete[](void* p) throw()
+{
+	free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) throw()
+{
+	free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) throw()
+{
+	free(p);
+}
+
+void setHeapCounting(bool bCounting)
+{
+#if defined(_WIN32) && defined(_DEBUG)
+	if (bCounting)
+		_CrtSetAllocHook(allocHook);
+#endif
+	s_counting = bCounting;
+}
+
+unsigned long long heapAllocations()
+{
+	return s_allocations;
+}
+
+bool heapCountsMalloc()
+{
+#ifdef HEAP_COUNT_MALLOC
+	return true;
+#else
+	return false;
+#endif
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+// Counts the global heap allocations of the whole process, every thread,
+// while counting is on. Linking HeapCount.cpp replaces the global operator
+// new and delete. malloc, calloc, realloc and the aligned versions, which
+// OpenCV allocates through, are counted too with glibc and with the debug
+// CRT on Windows. With the release CRT only operator new is seen.
+// For the steady state checks of the benchmarks and tests, not for the
+// application proper : HeapCount.cpp is only built with ZTS_HEAP_COUNT, in
+// FramePoolTest and the Bench configuration. Elsewhere nothing is counted.
+#ifdef ZTS_HEAP_COUNT
+void setHeapCounting(bool bCounting);
+unsigned long long heapAllocations();
+// True when malloc is counted, not only operator new
+bool heapCountsMalloc();
+inline bool heapCounted() { return true; }
+#else
+inline void setHeapCounting(bool) {}
+inline unsigned long long heapAllocations() { return 0; }
+inline bool heapCountsMalloc() { return false; }
+inline bool heapCounted() { return false; }
+#endif
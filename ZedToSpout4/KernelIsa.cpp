@@ -0,0 +1,81 @@
+#include "stdafx.h"
+#include "KernelIsa.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define KERNEL_ISA_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+//
+// Run time dispatch, same idea as spoutCopy::CheckSSE
+//
+
+#ifdef KERNEL_ISA_X86
+static void cpuid(int info[4], int leaf, int subleaf)
+{
+#ifdef _MSC_VER
+	__cpuidex(info, leaf, subleaf);
+#else
+	__cpuid_count(leaf, subleaf, info[0], info[1], info[2], info[3]);
+#endif
+}
+
+static unsigned long long xgetbv0()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+
+static KernelIsa detectKernelIsa()
+{
+	int info[4] = { 0 };
+	cpuid(info, 0, 0);
+	int nIds = info[0];
+	if (nIds < 1)
+		return KERNEL_SCALAR;
+
+	cpuid(info, 1, 0);
+	bool sse2 = (info[3] & (1 << 26)) != 0;
+	// AVX needs the OS to save the YMM registers : OSXSAVE [bit 27] and AVX [bit 28] in ECX, then XCR0
+	bool avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (xgetbv0() & 6) == 6;
+	bool avx2 = false;
+	if (avx && nIds >= 7)
+	{
+		// AVX2 | [bit 5] EBX of leaf 7
+		cpuid(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+	}
+	return avx2 ? KERNEL_AVX2 : sse2 ? KERNEL_SSE2 : KERNEL_SCALAR;
+}
+#else
+static KernelIsa detectKernelIsa()
+{
+	return KERNEL_SCALAR;
+}
+#endif
+
+KernelIsa bestKernelIsa()
+{
+	static const KernelIsa isa = detectKernelIsa();
+	return isa;
+}
+
+const char* kernelIsaName(KernelIsa isa)
+{
+	switch (isa)
+	{
+	case KERNEL_SCALAR: return "scalar";
+	case KERNEL_SSE2:   return "SSE2";
+	case KERNEL_AVX2:   return "AVX2";
+	default:            return "auto";
+	}
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+// Instruction sets the kernels are written for, picked at run time
+enum KernelIsa { KERNEL_AUTO, KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2 };
+KernelIsa bestKernelIsa();
+const char* kernelIsaName(KernelIsa isa);
@@ -0,0 +1,114 @@
+#include "stdafx.h"
+#include "MappedFile.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+{
+	m_pData = NULL;
+	m_size = 0;
+#ifdef _WIN32
+	m_hFile = INVALID_HANDLE_VALUE;
+	m_hMap = NULL;
+#else
+	m_fd = -1;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char* path)
+{
+	close();
+	m_hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (m_hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_hFile, &size) || size.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+
+	m_hMap = CreateFileMappingA(m_hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	if (!m_hMap)
+	{
+		close();
+		return false;
+	}
+
+	m_pData = (unsigned char*)MapViewOfFile(m_hMap, FILE_MAP_COPY, 0, 0, 0);
+	if (!m_pData)
+	{
+		close();
+		return false;
+	}
+	m_size = (size_t)size.QuadPart;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_pData)
+		UnmapViewOfFile(m_pData);
+	if (m_hMap)
+		CloseHandle(m_hMap);
+	if (m_hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(m_hFile);
+	m_pData = NULL;
+	m_hMap = NULL;
+	m_hFile = INVALID_HANDLE_VALUE;
+	m_size = 0;
+}
+
+#else
+
+bool MappedFile::open(const char* path)
+{
+	close();
+	m_fd = ::open(path, O_RDONLY);
+	if (m_fd == -1)
+		return false;
+
+	struct stat st;
+	if (fstat(m_fd, &st) != 0 || st.st_size == 0)
+	{
+		close();
+		return false;
+	}
+
+	void* pMap = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, m_fd, 0);
+	if (pMap == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+	m_pData = (unsigned char*)pMap;
+	m_size = (size_t)st.st_size;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_pData)
+		munmap(m_pData, m_size);
+	if (m_fd != -1)
+		::close(m_fd);
+	m_pData = NULL;
+	m_fd = -1;
+	m_size = 0;
+}
+
+#endif
@@ -0,0 +1,28 @@
+#pragma once
+#include <stddef.h>
+
+// Read-only view of a whole file mapped into memory. Pages are mapped copy on
+// write, so callers may scribble on the data without touching the file.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+	bool open(const char* path);
+	void close();
+	bool isOpen() const { return m_pData != NULL; }
+	unsigned char* data() const { return m_pData; }
+	size_t size() const { return m_size; }
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	unsigned char* m_pData;
+	size_t m_size;
+#ifdef _WIN32
+	void* m_hFile;
+	void* m_hMap;
+#else
+	int m_fd;
+#endif
+};
@@ -0,0 +1,646 @@
+#include "stdafx.h"
+#include "SocketUtil.h"
+#include "NetworkDepth.h"
+#include "DepthEncoding.h"
+#include "DepthKernels.h"
+#include <stdlib.h>
+#include <string.h>
+using namespace std;
+
+static const unsigned int NETWORK_MAGIC = 0x4E53545A; // "ZTSN"
+static const unsigned int NETWORK_MAX_FRAME = 1 << 26;
+static const int MAX_DATAGRAM = 65507;            // UDP over IPv4
+static const int SOCKET_BUFFER_BYTES = 8 << 20;   // a few uncompressed 720p frames
+static const int RECEIVE_TIMEOUT_MSEC = 100;      // how often the thread checks for close
+static const int CONNECT_TIMEOUT_MSEC = 200;
+static const size_t PARTIAL_FRAMES = 4;           // frames put together at once over UDP
+
+// Wraps around : a is newer when it is less than half the range ahead of b
+static inline bool sequenceNewer(unsigned int a, unsigned int b)
+{
+	return (int)(a - b) > 0;
+}
+
+// XORs size bytes of src into dst
+static void xorBytes(unsigned char* dst, const unsigned char* src, size_t size)
+{
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8)
+	{
+		unsigned long long a, b;
+		memcpy(&a, dst + i, 8);
+		memcpy(&b, src + i, 8);
+		a ^= b;
+		memcpy(dst + i, &a, 8);
+	}
+	for (; i < size; i++)
+		dst[i] ^= src[i];
+}
+
+static bool networkType(int type)
+{
+	return type == CV_8UC1 || type == CV_8UC4 || type == CV_16UC1 || type == CV_32FC1;
+}
+
+bool parseNetworkAddress(const string &text, NetworkTransport &transport, string &host, unsigned short &port)
+{
+	string rest = text;
+	transport = NETWORK_UDP;
+	if (rest.compare(0, 4, "udp:") == 0)
+		rest.erase(0, 4);
+	else if (rest.compare(0, 4, "tcp:") == 0)
+	{
+		transport = NETWORK_TCP;
+		rest.erase(0, 4);
+	}
+	size_t colon = rest.rfind(':');
+	host = colon == string::npos ? string() : rest.substr(0, colon);
+	string number = colon == string::npos ? rest : rest.substr(colon + 1);
+	char* end = NULL;
+	long value = strtol(number.c_str(), &end, 10);
+	if (number.empty() || *end || value <= 0 || value > 65535)
+		return false;
+	port = (unsigned short)value;
+	return true;
+}
+
+//
+// NetworkDepthSender
+//
+
+NetworkDepthSender::NetworkDepthSender() : m_socket(NO_SOCKET), m_address(0), m_port(0), m_transport(NETWORK_UDP),
+	m_bCompress(false), m_bDelta(false), m_datagramBytes(NETWORK_DATAGRAM_BYTES), m_parityGroup(NETWORK_PARITY_GROUP), m_sequence(0), m_dropRate(0), m_dropState(1), m_bytesSent(0)
+{
+	static_assert(sizeof(NetworkPacketHeader) == 40, "the header goes over the network");
+	depthCodecDefaults(&m_params);
+}
+
+NetworkDepthSender::~NetworkDepthSender()
+{
+	close();
+}
+
+bool NetworkDepthSender::open(const char* host, unsigned short port, NetworkTransport transport, bool compress,
+	const DepthCodecParams* params, int datagramBytes)
+{
+	close();
+	unsigned int address = 0;
+	if (!resolveHost(host, address) || address == 0 || datagramBytes <= 0 ||
+		datagramBytes > MAX_DATAGRAM - (int)sizeof(NetworkPacketHeader) || datagramBytes > 65535)
+		return false;
+	if (transport == NETWORK_UDP)
+	{
+		// Bound to any port of any interface, only for sending
+		m_socket = openUdpSocket(0, true);
+		if (m_socket == NO_SOCKET)
+			return false;
+		setSocketBuffers(m_socket, SOCKET_BUFFER_BYTES);
+	}
+	m_address = address;
+	m_port = port;
+	m_transport = transport;
+	m_bCompress = compress;
+	depthCodecDefaults(&m_params);
+	if (params)
+		m_params = *params;
+	m_datagramBytes = datagramBytes;
+	m_datagram.resize(sizeof(NetworkPacketHeader) + datagramBytes);
+	m_parity.resize(datagramBytes);
+	// Connect on the first frame
+	m_lastConnect = chrono::steady_clock::now() - chrono::seconds(1);
+	return true;
+}
+
+void NetworkDepthSender::setDelta(const TileDeltaParams* params)
+{
+	m_bDelta = params != NULL;
+	if (params)
+		m_delta.setParams(*params);
+	// Whatever the receiver had is out of date
+	m_delta.requestKeyframe();
+}
+
+void NetworkDepthSender::close()
+{
+	closeSocket(m_socket);
+	m_socket = NO_SOCKET;
+	m_address = 0;
+}
+
+bool NetworkDepthSender::send(const cv::Mat &image, unsigned long long timestamp)
+{
+	if (!isOpen() || image.empty() || image.cols > 65535 || image.rows > 65535 || !networkType(image.type()))
+		return false;
+
+	NetworkPacketHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = NETWORK_MAGIC;
+	header.sequence = m_sequence++;
+	header.timestamp = timestamp;
+	header.width = (unsigned short)image.cols;
+	header.height = (unsigned short)image.rows;
+	header.type = (unsigned char)image.type();
+
+	const unsigned char* payload = image.data;
+	size_t bytes = image.total() * image.elemSize();
+	if (m_bDelta && image.type() == CV_16UC1)
+	{
+		// A receiver connecting now has nothing to build on
+		if (m_transport == NETWORK_TCP && m_socket == NO_SOCKET)
+			m_delta.requestKeyframe();
+		bytes = m_delta.encode(image, m_payload);
+		if (bytes == 0)
+			return false;
+		payload = m_payload.data();
+		header.flags = NETWORK_DELTA;
+	}
+	else if (m_bCompress && image.type() == CV_16UC1)
+	{
+		m_payload.resize(depthCodecBound(image.cols, image.rows));
+		bytes = depthCodecEncode((const unsigned short*)image.data, image.cols, image.rows, image.step,
+			&m_params, m_payload.data(), m_payload.size());
+		if (bytes == 0)
+			return false;
+		payload = m_payload.data();
+		header.flags = NETWORK_RVL;
+	}
+	else if (!image.isContinuous())
+	{
+		m_payload.resize(bytes);
+		const size_t row = image.cols * image.elemSize();
+		for (int y = 0; y < image.rows; y++)
+			memcpy(&m_payload[y * row], image.ptr(y), row);
+		payload = m_payload.data();
+	}
+	if (bytes > NETWORK_MAX_FRAME)
+		return false;
+	header.frameBytes = (unsigned int)bytes;
+
+	return m_transport == NETWORK_UDP ? sendDatagrams(header, payload) : sendStream(header, payload);
+}
+
+bool NetworkDepthSender::sendDatagram(const NetworkPacketHeader &header, const unsigned char* piece, unsigned int size)
+{
+	if (m_dropRate > 0)
+	{
+		m_dropState = m_dropState * 1664525u + 1013904223u;
+		if ((m_dropState >> 8) < m_dropRate * (1 << 24))
+			return true;
+	}
+	sockaddr_in to;
+	memset(&to, 0, sizeof(to));
+	to.sin_family = AF_INET;
+	to.sin_port = htons(m_port);
+	to.sin_addr.s_addr = m_address;
+	memcpy(m_datagram.data(), &header, sizeof(header));
+	memcpy(m_datagram.data() + sizeof(header), piece, size);
+	int bytes = (int)(sizeof(header) + size);
+	if (sendto((SOCKET)m_socket, (const char*)m_datagram.data(), bytes, 0, (const sockaddr*)&to, sizeof(to)) != bytes)
+		return false;
+	m_bytesSent += bytes;
+	return true;
+}
+
+bool NetworkDepthSender::sendDatagrams(NetworkPacketHeader &header, const unsigned char* payload)
+{
+	const unsigned int chunk = m_datagramBytes;
+	header.chunkBytes = (unsigned short)chunk;
+	header.parityGroup = (unsigned char)m_parityGroup;
+	bool ok = true;
+	unsigned int groupStart = 0;
+	int grouped = 0;
+	for (unsigned int offset = 0; offset < header.frameBytes; offset += chunk)
+	{
+		unsigned int piece = header.frameBytes - offset < chunk ? header.frameBytes - offset : chunk;
+		header.offset = offset;
+		ok = sendDatagram(header, payload + offset, piece) && ok;
+		if (m_parityGroup == 0)
+			continue;
+
+		// Only the last piece is short, and it is zero padded
+		if (grouped == 0)
+		{
+			groupStart = offset;
+			memcpy(m_parity.data(), payload + offset, piece);
+			memset(m_parity.data() + piece, 0, chunk - piece);
+		}
+		else
+			xorBytes(m_parity.data(), payload + offset, piece);
+		if (++grouped == m_parityGroup || offset + piece == header.frameBytes)
+		{
+			NetworkPacketHeader parity = header;
+			parity.flags |= NETWORK_PARITY;
+			parity.offset = groupStart;
+			ok = sendDatagram(parity, m_parity.data(), header.frameBytes - groupStart < chunk ? header.frameBytes - groupStart : chunk) && ok;
+			grouped = 0;
+		}
+	}
+	return ok;
+}
+
+bool NetworkDepthSender::sendStream(const NetworkPacketHeader &header, const unsigned char* payload)
+{
+	if (m_socket == NO_SOCKET)
+	{
+		// Nobody listening : don't try every frame
+		chrono::steady_clock::time_point now = chrono::steady_clock::now();
+		if (now - m_lastConnect < chrono::seconds(1))
+			return false;
+		m_lastConnect = now;
+		m_socket = connectTcpSocket(m_address, m_port, CONNECT_TIMEOUT_MSEC);
+		if (m_socket == NO_SOCKET)
+			return false;
+	}
+	if (!sendAll(m_socket, &header, sizeof(header)) || !sendAll(m_socket, payload, header.frameBytes))
+	{
+		closeSocket(m_socket);
+		m_socket = NO_SOCKET;
+		return false;
+	}
+	m_bytesSent += sizeof(header) + header.frameBytes;
+	return true;
+}
+
+//
+// NetworkDepthReceiver
+//
+
+NetworkDepthReceiver::NetworkDepthReceiver() : m_socket(NO_SOCKET), m_port(0), m_transport(NETWORK_UDP), m_bRunning(false),
+	m_bDelivered(false), m_lastSequence(0), m_bFresh(false)
+{
+	memset(&m_info, 0, sizeof(m_info));
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+NetworkDepthReceiver::~NetworkDepthReceiver()
+{
+	close();
+}
+
+bool NetworkDepthReceiver::open(unsigned short port, NetworkTransport transport, bool anyInterface)
+{
+	close();
+	m_socket = transport == NETWORK_UDP ? openUdpSocket(port, anyInterface) : openTcpListener(port, anyInterface);
+	if (m_socket == NO_SOCKET)
+		return false;
+	if (transport == NETWORK_UDP)
+	{
+		setSocketBuffers(m_socket, SOCKET_BUFFER_BYTES);
+		setReceiveTimeout(m_socket, RECEIVE_TIMEOUT_MSEC);
+	}
+	m_port = socketPort(m_socket);
+	m_transport = transport;
+	m_partials.resize(PARTIAL_FRAMES);
+	for (size_t i = 0; i < m_partials.size(); i++)
+		m_partials[i].used = false;
+	m_bDelivered = false;
+	m_delta.reset();
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_bFresh = false;
+		memset(&m_stats, 0, sizeof(m_stats));
+	}
+	m_bRunning = true;
+	m_thread = thread(transport == NETWORK_UDP ? &NetworkDepthReceiver::udpLoop : &NetworkDepthReceiver::tcpLoop, this);
+	return true;
+}
+
+void NetworkDepthReceiver::close()
+{
+	m_bRunning = false;
+	if (m_thread.joinable())
+		m_thread.join();
+	closeSocket(m_socket);
+	m_socket = NO_SOCKET;
+	m_port = 0;
+}
+
+bool NetworkDepthReceiver::receive(cv::Mat &image, NetworkFrameInfo &info, int timeoutMsec)
+{
+	unique_lock<mutex> lock(m_mutex);
+	if (!m_frameReady.wait_for(lock, chrono::milliseconds(timeoutMsec), [this]() { return m_bFresh; }))
+		return false;
+	// The receiving thread gets the caller's buffer back for a later frame
+	cv::swap(image, m_frame);
+	info = m_info;
+	m_bFresh = false;
+	return true;
+}
+
+NetworkReceiverStats NetworkDepthReceiver::stats() const
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_stats;
+}
+
+void NetworkDepthReceiver::udpLoop()
+{
+	const SOCKET s = (SOCKET)m_socket;
+	vector<unsigned char> buffer(MAX_DATAGRAM);
+	while (m_bRunning)
+	{
+		int n = recvfrom(s, (char*)buffer.data(), (int)buffer.size(), 0, NULL, NULL);
+		if (n > 0)
+			datagram(buffer.data(), n);
+	}
+}
+
+void NetworkDepthReceiver::datagram(const unsigned char* data, size_t size)
+{
+	NetworkPacketHeader header;
+	if (size < sizeof(header))
+		return;
+	memcpy(&header, data, sizeof(header));
+	const unsigned char* piece = data + sizeof(header);
+	const size_t pieceBytes = size - sizeof(header);
+	// Whole pieces at their place in the frame, only the last one shorter; parity at the start of a group
+	const unsigned int chunk = header.chunkBytes;
+	bool valid = header.magic == NETWORK_MAGIC && header.frameBytes > 0 && header.frameBytes <= NETWORK_MAX_FRAME &&
+		chunk > 0 && header.offset < header.frameBytes && header.offset % chunk == 0 &&
+		pieceBytes == (header.frameBytes - header.offset < chunk ? header.frameBytes - header.offset : chunk) &&
+		(!(header.flags & NETWORK_PARITY) || (header.parityGroup > 0 && header.offset / chunk % header.parityGroup == 0));
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_stats.datagrams++;
+		m_stats.bytes += size;
+		if (valid && m_bDelivered && !sequenceNewer(header.sequence, m_lastSequence))
+		{
+			// The parity of a frame complete without it is no news
+			if (!(header.flags & NETWORK_PARITY))
+				m_stats.late++;
+			return;
+		}
+	}
+	if (!valid)
+		return;
+
+	// The frame's slot, else a free one, else the oldest frame gives up its slot
+	Partial* partial = NULL;
+	Partial* slot = NULL;
+	for (size_t i = 0; i < m_partials.size(); i++)
+	{
+		Partial &p = m_partials[i];
+		if (p.used && p.header.sequence == header.sequence)
+		{
+			partial = &p;
+			break;
+		}
+		if (!p.used)
+		{
+			if (!slot || slot->used)
+				slot = &p;
+		}
+		else if (!slot || (slot->used && sequenceNewer(slot->header.sequence, p.header.sequence)))
+			slot = &p;
+	}
+	if (!partial)
+	{
+		partial = slot;
+		if (partial->used)
+		{
+			lock_guard<mutex> lock(m_mutex);
+			m_stats.dropped++;
+		}
+		partial->used = true;
+		partial->header = header;
+		partial->header.flags &= ~NETWORK_PARITY;
+		partial->data.resize(header.frameBytes);
+		partial->pieces = (header.frameBytes + chunk - 1) / chunk;
+		partial->received.assign(partial->pieces, false);
+		partial->piecesReceived = 0;
+		unsigned int groups = header.parityGroup ? (partial->pieces + header.parityGroup - 1) / header.parityGroup : 0;
+		partial->parity.resize((size_t)groups * chunk);
+		partial->parityReceived.assign(groups, false);
+		partial->groupReceived.assign(groups, 0);
+	}
+	else if (partial->header.frameBytes != header.frameBytes || partial->header.chunkBytes != chunk ||
+		partial->header.parityGroup != header.parityGroup)
+		return;
+
+	if (header.flags & NETWORK_PARITY)
+	{
+		unsigned int group = header.offset / chunk / header.parityGroup;
+		if (partial->parityReceived[group])
+			return;
+		unsigned char* parity = &partial->parity[(size_t)group * chunk];
+		memcpy(parity, piece, pieceBytes);
+		memset(parity + pieceBytes, 0, chunk - pieceBytes);
+		partial->parityReceived[group] = true;
+		recover(*partial, group);
+	}
+	else
+	{
+		unsigned int index = header.offset / chunk;
+		if (partial->received[index])
+			return;
+		memcpy(&partial->data[header.offset], piece, pieceBytes);
+		partial->received[index] = true;
+		partial->piecesReceived++;
+		if (header.parityGroup)
+		{
+			unsigned int group = index / header.parityGroup;
+			partial->groupReceived[group]++;
+			recover(*partial, group);
+		}
+	}
+	if (partial->piecesReceived < partial->pieces)
+		return;
+
+	deliver(partial->header, partial->data.data());
+	m_bDelivered = true;
+	m_lastSequence = header.sequence;
+	// Older frames can't be delivered any more
+	unsigned long long dropped = 0;
+	for (size_t i = 0; i < m_partials.size(); i++)
+	{
+		Partial &p = m_partials[i];
+		if (p.used && &p != partial && !sequenceNewer(p.header.sequence, m_lastSequence))
+			dropped++;
+		if (p.used && !sequenceNewer(p.header.sequence, m_lastSequence))
+			p.used = false;
+	}
+	lock_guard<mutex> lock(m_mutex);
+	m_stats.dropped += dropped;
+}
+
+bool NetworkDepthReceiver::recover(Partial &partial, unsigned int group)
+{
+	const unsigned int chunk = partial.header.chunkBytes, frameBytes = partial.header.frameBytes;
+	const unsigned int first = group * partial.header.parityGroup;
+	const unsigned int end = first + partial.header.parityGroup < partial.pieces ? first + partial.header.parityGroup : partial.pieces;
+	if (!partial.parityReceived[group] || (unsigned int)partial.groupReceived[group] + 1 != end - first)
+		return false;
+
+	unsigned int missing = first;
+	while (partial.received[missing])
+		missing++;
+	const unsigned int offset = missing * chunk;
+	const unsigned int size = frameBytes - offset < chunk ? frameBytes - offset : chunk;
+	unsigned char* out = &partial.data[offset];
+	memcpy(out, &partial.parity[(size_t)group * chunk], size);
+	for (unsigned int i = first; i < end; i++)
+	{
+		if (i == missing)
+			continue;
+		// The last piece may be shorter, the parity has zeros past it
+		unsigned int length = frameBytes - i * chunk < size ? frameBytes - i * chunk : size;
+		xorBytes(out, &partial.data[i * chunk], length);
+	}
+	partial.received[missing] = true;
+	partial.piecesReceived++;
+	partial.groupReceived[group]++;
+	lock_guard<mutex> lock(m_mutex);
+	m_stats.recovered++;
+	return true;
+}
+
+void NetworkDepthReceiver::tcpLoop()
+{
+	vector<unsigned char> payload;
+	while (m_bRunning)
+	{
+		if (!waitReadable(m_socket, RECEIVE_TIMEOUT_MSEC))
+			continue;
+		SOCKET client = accept((SOCKET)m_socket, NULL, NULL);
+		if (client == INVALID_SOCKET)
+			continue;
+		setReceiveTimeout((intptr_t)client, RECEIVE_TIMEOUT_MSEC);
+		setSocketBuffers((intptr_t)client, SOCKET_BUFFER_BYTES);
+
+		// One sender at a time, until it goes away or sends something else. It
+		// starts its delta frames over with a keyframe.
+		m_delta.reset();
+		NetworkPacketHeader header;
+		while (recvAll((intptr_t)client, &header, sizeof(header), &m_bRunning))
+		{
+			if (header.magic != NETWORK_MAGIC || header.frameBytes == 0 || header.frameBytes > NETWORK_MAX_FRAME)
+				break;
+			payload.resize(header.frameBytes);
+			if (!recvAll((intptr_t)client, payload.data(), payload.size(), &m_bRunning))
+				break;
+			{
+				lock_guard<mutex> lock(m_mutex);
+				m_stats.bytes += sizeof(header) + header.frameBytes;
+			}
+			deliver(header, payload.data());
+		}
+		closeSocket((intptr_t)client);
+	}
+}
+
+void NetworkDepthReceiver::deliver(const NetworkPacketHeader &header, const unsigned char* payload)
+{
+	const int width = header.width, height = header.height;
+	bool ok = width > 0 && height > 0 && networkType(header.type);
+	if (ok && (header.flags & NETWORK_DELTA))
+	{
+		TileDeltaHeader delta;
+		ok = header.type == CV_16UC1 && tileDeltaInfo(payload, header.frameBytes, delta) &&
+			delta.width == width && delta.height == height;
+		if (ok && !m_delta.apply(payload, header.frameBytes))
+		{
+			// A delta frame whose base was lost, or a corrupt one : wait for a keyframe
+			bool refused = !(delta.flags & TILE_DELTA_KEY);
+			m_delta.reset();
+			lock_guard<mutex> lock(m_mutex);
+			if (refused)
+				m_stats.refused++;
+			else
+				m_stats.corrupt++;
+			return;
+		}
+		if (ok)
+			m_delta.frame().copyTo(m_decoded);
+	}
+	else if (ok && (header.flags & NETWORK_RVL))
+	{
+		ok = header.type == CV_16UC1;
+		if (ok)
+		{
+			m_decoded.create(height, width, CV_16UC1);
+			ok = depthCodecDecode(payload, header.frameBytes, (unsigned short*)m_decoded.data, width, height,
+				m_decoded.step, KERNEL_AUTO) != 0;
+		}
+	}
+	else if (ok)
+	{
+		ok = header.frameBytes == (size_t)width * height * CV_ELEM_SIZE(header.type);
+		if (ok)
+		{
+			m_decoded.create(height, width, header.type);
+			memcpy(m_decoded.data, payload, header.frameBytes);
+		}
+	}
+
+	lock_guard<mutex> lock(m_mutex);
+	if (!ok)
+	{
+		m_stats.corrupt++;
+		return;
+	}
+	m_stats.frames++;
+	cv::swap(m_frame, m_decoded);
+	m_info.sequence = header.sequence;
+	m_info.timestamp = header.timestamp;
+	m_info.bytes = header.frameBytes;
+	m_info.compressed = (header.flags & NETWORK_RVL) != 0;
+	m_info.delta = (header.flags & NETWORK_DELTA) != 0;
+	m_bFresh = true;
+	m_frameReady.notify_all();
+}
+
+//
+// NetworkFrameSource
+//
+
+NetworkFrameSource::NetworkFrameSource() : m_size(0, 0), m_bHaveFirst(false)
+{
+	memset(&m_firstInfo, 0, sizeof(m_firstInfo));
+}
+
+bool NetworkFrameSource::open(unsigned short port, NetworkTransport transport, bool anyInterface, int timeoutMsec)
+{
+	m_bHaveFirst = false;
+	if (!m_receiver.open(port, transport, anyInterface))
+		return false;
+	if (!m_receiver.receive(m_first, m_firstInfo, timeoutMsec))
+	{
+		m_receiver.close();
+		return false;
+	}
+	m_size = m_first.size();
+	m_bHaveFirst = true;
+	return true;
+}
+
+bool NetworkFrameSource::grab(DepthFrame &frame, unsigned int streams)
+{
+	NetworkFrameInfo info;
+	if (m_bHaveFirst)
+	{
+		cv::swap(m_image, m_first);
+		info = m_firstInfo;
+		m_bHaveFirst = false;
+	}
+	else if (!m_receiver.receive(m_image, info, RECEIVE_TIMEOUT_MSEC))
+		return false;
+	if (m_image.size() != m_size)
+		return false;
+
+	frame.timestamp = info.timestamp;
+	frame.left.release();
+	frame.confidence.release();
+	if (!(streams & FRAME_DEPTH))
+	{
+		frame.depth.release();
+		return true;
+	}
+	// Copied out : the receiver writes the next frame into this buffer
+	if (m_image.type() == CV_16UC1)
+		decodeDepth(m_image, DEPTH_R16_MM, frame.depth, false);
+	else if (m_image.type() == CV_32FC1)
+		m_image.copyTo(frame.depth);
+	else
+		return false;
+	return true;
+}
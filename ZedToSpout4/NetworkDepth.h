@@ -0,0 +1,208 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "opencv2/core.hpp"
+#include "DepthCodec.h"
+#include "FrameSource.h"
+#include "TileDelta.h"
+
+// Depth to another machine, where Spout can't go. Every frame carries a
+// NetworkPacketHeader : its sequence number, its timestamp and its size.
+// Over UDP a frame is cut into datagrams of at most datagramBytes, each with
+// the header and the offset of its piece, and the receiver puts the pieces
+// back together. After every parityGroup pieces comes a parity datagram, the
+// pieces XORed, so one datagram lost in a group is rebuilt. A frame still
+// missing a datagram is dropped once a newer frame is complete, and datagrams of frames older than the last one delivered are
+// late and ignored, so a loss costs one frame and never stalls the stream.
+// Over TCP the header and the frame go out as they are, for links that lose
+// too much for UDP. 16-bit millimeter depth can go through DepthCodec, every
+// frame on its own, so losses don't spread to later frames either. Or it can
+// go as TileDelta frames, only the tiles that changed : a frame lost then
+// costs every frame up to the next keyframe.
+
+enum NetworkTransport { NETWORK_UDP, NETWORK_TCP };
+
+// Payload of one datagram, the header comes on top : fits an Ethernet frame
+static const int NETWORK_DATAGRAM_BYTES = 1400;
+// Pieces per parity datagram, a sixteenth more to send
+static const int NETWORK_PARITY_GROUP = 16;
+
+struct NetworkPacketHeader
+{
+	unsigned int magic;            // "ZTSN"
+	unsigned int sequence;         // frame number, wraps around
+	unsigned long long timestamp;  // as given to send, ns
+	unsigned int frameBytes;       // the whole frame as sent
+	unsigned int offset;           // UDP : of this datagram's piece in the frame
+	unsigned short chunkBytes;     // UDP : piece of every datagram but the last
+	unsigned short width, height;
+	unsigned char type;            // OpenCV type of the image
+	unsigned char flags;           // NETWORK_RVL, NETWORK_PARITY, NETWORK_DELTA
+	unsigned char parityGroup;     // UDP : pieces per parity datagram, 0 for none
+	unsigned char reserved[5];
+};
+
+static const unsigned char NETWORK_RVL = 1;    // the frame is a DepthCodec frame of CV_16UC1
+static const unsigned char NETWORK_PARITY = 2; // the parity of the group starting at offset
+static const unsigned char NETWORK_DELTA = 4;  // the frame is a TileDelta frame of CV_16UC1
+
+// "[udp:|tcp:]host:port" for senders, "[udp:|tcp:]port" for receivers
+bool parseNetworkAddress(const std::string &text, NetworkTransport &transport, std::string &host, unsigned short &port);
+
+class NetworkDepthSender
+{
+public:
+	NetworkDepthSender();
+	~NetworkDepthSender();
+	// Over TCP the connection is made on the first send, and made again after
+	// a failure at most once a second. compress sends CV_16UC1 frames through
+	// DepthCodec with these params, lossless when NULL.
+	bool open(const char* host, unsigned short port, NetworkTransport transport, bool compress,
+		const DepthCodecParams* params = NULL, int datagramBytes = NETWORK_DATAGRAM_BYTES);
+	void close();
+	bool isOpen() const { return m_address != 0; }
+	// CV_8UC1, CV_8UC4, CV_16UC1 or CV_32FC1, false when the frame could not go out
+	bool send(const cv::Mat &image, unsigned long long timestamp);
+
+	// CV_16UC1 frames go as TileDelta frames with these params, ahead of
+	// compression; NULL sends whole frames again
+	void setDelta(const TileDeltaParams* params);
+	const TileDeltaEncoder* delta() const { return m_bDelta ? &m_delta : NULL; }
+
+	// UDP : pieces per parity datagram up to 255, 0 sends none
+	void setParityGroup(int pieces) { m_parityGroup = pieces < 0 ? 0 : pieces > 255 ? 255 : pieces; }
+	// For tests : drops this share of the datagrams instead of sending them
+	void setDropRate(double share) { m_dropRate = share; }
+	unsigned long long bytesSent() const { return m_bytesSent; }
+	unsigned int sequence() const { return m_sequence; }
+private:
+	NetworkDepthSender(const NetworkDepthSender&);
+	NetworkDepthSender& operator=(const NetworkDepthSender&);
+	bool sendDatagrams(NetworkPacketHeader &header, const unsigned char* payload);
+	bool sendDatagram(const NetworkPacketHeader &header, const unsigned char* piece, unsigned int size);
+	bool sendStream(const NetworkPacketHeader &header, const unsigned char* payload);
+
+	intptr_t m_socket;
+	unsigned int m_address; // network order, 0 when closed
+	unsigned short m_port;
+	NetworkTransport m_transport;
+	bool m_bCompress;
+	DepthCodecParams m_params;
+	bool m_bDelta;
+	TileDeltaEncoder m_delta;
+	int m_datagramBytes;
+	int m_parityGroup;
+	unsigned int m_sequence;
+	std::vector<unsigned char> m_payload, m_datagram, m_parity;
+	std::chrono::steady_clock::time_point m_lastConnect;
+	double m_dropRate;
+	unsigned int m_dropState;
+	unsigned long long m_bytesSent;
+};
+
+struct NetworkFrameInfo
+{
+	unsigned int sequence;
+	unsigned long long timestamp; // the sender's
+	unsigned int bytes;           // as sent
+	bool compressed;
+	bool delta;                   // the changed tiles only
+};
+
+struct NetworkReceiverStats
+{
+	unsigned long long frames;    // complete, delivered or replaced by a newer one
+	unsigned long long dropped;   // incomplete when a newer frame was complete
+	unsigned long long late;      // datagrams of frames older than the last complete one
+	unsigned long long corrupt;   // frames that failed to decode
+	unsigned long long refused;   // delta frames building on a frame that never came
+	unsigned long long recovered; // datagrams rebuilt from parity
+	unsigned long long datagrams, bytes;
+};
+
+class NetworkDepthReceiver
+{
+public:
+	NetworkDepthReceiver();
+	~NetworkDepthReceiver();
+	// Port 0 takes a free one, see port(). Listens on localhost unless anyInterface is set.
+	bool open(unsigned short port, NetworkTransport transport, bool anyInterface = false);
+	void close();
+	bool isOpen() const { return m_bRunning; }
+	unsigned short port() const { return m_port; }
+	// Newest complete frame not received yet, false after timeoutMsec. image
+	// may be swapped with a buffer of the receiver, don't keep references to it.
+	bool receive(cv::Mat &image, NetworkFrameInfo &info, int timeoutMsec);
+	NetworkReceiverStats stats() const;
+private:
+	NetworkDepthReceiver(const NetworkDepthReceiver&);
+	NetworkDepthReceiver& operator=(const NetworkDepthReceiver&);
+
+	// A frame being put together from datagrams
+	struct Partial
+	{
+		bool used;
+		NetworkPacketHeader header;
+		std::vector<unsigned char> data;
+		std::vector<bool> received; // by piece
+		unsigned int pieces, piecesReceived;
+		std::vector<unsigned char> parity;      // by group
+		std::vector<bool> parityReceived;
+		std::vector<unsigned char> groupReceived; // pieces of each group
+	};
+	void udpLoop();
+	void tcpLoop();
+	void datagram(const unsigned char* data, size_t size);
+	// Rebuilds the one piece missing from the group when its parity is there
+	bool recover(Partial &partial, unsigned int group);
+	// Decodes the payload and hands it to receive()
+	void deliver(const NetworkPacketHeader &header, const unsigned char* payload);
+
+	intptr_t m_socket;
+	unsigned short m_port;
+	NetworkTransport m_transport;
+	std::atomic<bool> m_bRunning;
+	std::thread m_thread;
+
+	// Receiving thread only
+	std::vector<Partial> m_partials;
+	bool m_bDelivered;
+	unsigned int m_lastSequence; // of the last complete frame
+	cv::Mat m_decoded;
+	TileDeltaDecoder m_delta;
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_frameReady;
+	cv::Mat m_frame;
+	NetworkFrameInfo m_info;
+	bool m_bFresh;
+	NetworkReceiverStats m_stats;
+};
+
+// Depth frames from a NetworkDepthSender as a FrameSource, for a render
+// machine publishing to its own Spout receivers. 16-bit frames are
+// millimeters with the DEPTH16_* codes, float frames depth as it is.
+// Frames have depth only.
+class NetworkFrameSource : public FrameSource
+{
+public:
+	NetworkFrameSource();
+	// Waits up to timeoutMsec for the first frame, which gives the size
+	bool open(unsigned short port, NetworkTransport transport, bool anyInterface, int timeoutMsec);
+	cv::Size size() const { return m_size; }
+	// False when no frame came within a tenth of a second
+	bool grab(DepthFrame &frame, unsigned int streams = FRAME_ALL);
+	NetworkReceiverStats stats() const { return m_receiver.stats(); }
+private:
+	NetworkDepthReceiver m_receiver;
+	cv::Size m_size;
+	cv::Mat m_image, m_first;
+	NetworkFrameInfo m_firstInfo;
+	bool m_bHaveFirst;
+};
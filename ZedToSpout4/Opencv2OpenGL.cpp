@@ -5,24 +5,60 @@
 using namespace std;
 using namespace cv;
 
+bool Opencv2Spout::s_bContextCreated = false;
+bool Opencv2Spout::s_bHiddenWindow = false;
+unsigned int Opencv2Spout::s_memoryRingSlots = 0;
 
-Opencv2Spout::Opencv2Spout(int argc, char **argv, unsigned int width, unsigned int height, bool forceDX9)
+Opencv2Spout::Opencv2Spout(int argc, char **argv, unsigned int width, unsigned int height, bool forceDX9, bool memoryShare,
+	unsigned int dxFormat, const char* senderName)
+	: m_pool(4)
 {
 	m_iWidth = width;
 	m_iHeight = height;
-	glutInit(&argc, argv);
-	glutInitDisplayMode(GLUT_DEPTH | GLUT_DOUBLE | GLUT_RGBA);
-	glutInitWindowPosition(100, 100);
-	glutInitWindowSize(1, 1);
-	glutCreateWindow("OpenGL First Window");
+	m_bMemoryShare = memoryShare;
+	m_bReceiverCreated = false;
+	m_bWindowShown = false;
+	spout = NULL;
+	spoutReceiver = NULL;
+	m_receiverSequence = 0;
+
+	if (m_bMemoryShare)
+	{
+		// Register the name so Spout receivers can find us; a NULL share handle marks a memoryshare sender
+		if (!m_memorySender.create(senderName, width, height, s_memoryRingSlots) ||
+			!m_senderNames.CreateSender(senderName, width, height, NULL))
+		{
+			cout << "Error creating memoryshare sender";
+			int a;
+			cin >> a;
+			exit(0);
+		}
+		cout << "spout memoryshare sender created successfully";
+		return;
+	}
 
-	glewInit();
+	if (!s_bContextCreated)
+	{
+		glutInit(&argc, argv);
+		glutInitDisplayMode(GLUT_DEPTH | GLUT_DOUBLE | GLUT_RGBA);
+		glutInitWindowPosition(100, 100);
+		glutInitWindowSize(1, 1);
+		glutCreateWindow("OpenGL First Window");
+		if (s_bHiddenWindow)
+		{
+			// freeglut applies it on its next pass over the events
+			glutHideWindow();
+			glutMainLoopEvent();
+		}
 
-	printf("OpenGL version supported by this platform (%s): \n", glGetString(GL_VERSION));
-	m_bReceiverCreated = false;
+		glewInit();
+
+		printf("OpenGL version supported by this platform (%s): \n", glGetString(GL_VERSION));
+		s_bContextCreated = true;
+	}
 	spout = new SpoutSender();
 	spout->SetDX9(forceDX9);
-	if (!spout->CreateSender("opencv2Spout", width, height, forceDX9))
+	if (!spout->CreateSender(senderName, width, height, dxFormat))
 	{
 		int lastError = GetLastError();
 		switch (lastError)
@@ -43,6 +79,9 @@ Opencv2Spout::Opencv2Spout(int argc, char **argv, unsigned int width, unsigned i
 	else{
 		cout << "spout sender created successfully";
 	}
+	// The memoryshare sender signals its own frames
+	if (!m_frameEvent.create(senderName))
+		cout << "Error creating the frame event for " << senderName << endl;
 }
 
 //Opencv2Spout::~Opencv2Spout()
@@ -59,14 +98,22 @@ bool Opencv2Spout::initReceiver(char* name)
 	if (spoutReceiver->CreateReceiver(m_receiverName, m_iWidth, m_iHeight))
 	{
 		m_bReceiverCreated = true;
+		if (m_receiverEvent.open(m_receiverName))
+			m_receiverSequence = m_receiverEvent.sequence();
 		return true;
 	}
 	return false;
 }
 
-cv::Mat Opencv2Spout::receiveTexture()
+cv::Mat Opencv2Spout::receiveTexture(int timeoutMsec)
 {
+	// The buffer goes back to the pool when the caller releases the image
 	Mat img;
+	m_pool.attach(img);
+	if (m_receiverEvent.isOpen() && m_receiverEvent.senderClosed() && m_receiverEvent.open(m_receiverName))
+		m_receiverSequence = 0;
+	if (m_receiverEvent.isOpen() && !m_receiverEvent.wait(m_receiverSequence, timeoutMsec))
+		return img;
 	img.create(m_iHeight, m_iWidth, CV_8UC3);
 	if (spoutReceiver->ReceiveImage(m_receiverName, m_iWidth, m_iHeight, img.data, GL_BGR))
 		return img;
@@ -74,23 +121,71 @@ cv::Mat Opencv2Spout::receiveTexture()
 	return img;
 }
 
-void Opencv2Spout::draw(cv::Mat &camFrame, bool drawImage)
+void Opencv2Spout::draw(cv::Mat &camFrame, bool drawImage, bool bFlipped)
 {
 	// Convert image and depth data to OpenGL textures
 	if (drawImage)
 	{
 		namedWindow("OpencvSpout");
 		imshow("OpencvSpout", camFrame);
+		m_bWindowShown = true;
 	}
-	else
+	else if (m_bWindowShown)
+	{
+		// Only touch HighGUI when there is a window to remove, draw may run off the UI thread
 		destroyWindow("OpencvSpout");
-	Mat temp;
-	cv::flip(camFrame, temp, 0);
-	GLuint imageTex = matToTexture(temp, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_CLAMP);
+		m_bWindowShown = false;
+	}
+
+	if (m_bMemoryShare)
+	{
+		m_memorySender.send(camFrame, !bFlipped);
+		return;
+	}
+
+	uploadTexture(camFrame, bFlipped);
 
-	//spout->SendTexture(imageTex, GL_TEXTURE_2D, m_iWidth, m_iHeight);
-	spout->SendTexture(imageTex, GL_TEXTURE_2D, 1280, 720);
-	glDeleteTextures(1, &imageTex);
+	spout->SendTexture(m_streamer.texture(), GL_TEXTURE_2D, m_iWidth, m_iHeight);
+	m_frameEvent.signal();
+}
+
+void Opencv2Spout::setHiddenWindow(bool bHidden)
+{
+	s_bHiddenWindow = bHidden;
+}
+
+void Opencv2Spout::setMemoryRing(unsigned int slots)
+{
+	s_memoryRingSlots = slots;
+}
+
+void Opencv2Spout::setMipmaps(bool bMipmaps)
+{
+	m_streamer.setMipmaps(bMipmaps);
+}
+
+void Opencv2Spout::uploadTexture(const cv::Mat &image, bool bFlipped)
+{
+	// Same format mapping as matToTexture for 8-bit images
+	GLenum inputColourFormat = (image.channels() == 1) ? GL_LUMINANCE : (image.channels() == 4) ? GL_BGRA : GL_BGR;
+	GLenum inputType = GL_UNSIGNED_BYTE;
+	if (image.type() == CV_16UC1)
+	{
+		inputColourFormat = GL_RED;
+		inputType = GL_UNSIGNED_SHORT;
+	}
+	else if (image.type() == CV_32FC1)
+	{
+		inputColourFormat = GL_RED;
+		inputType = GL_FLOAT;
+	}
+	else if (image.type() == CV_32FC4)
+	{
+		// Point cloud positions
+		inputColourFormat = GL_RGBA;
+		inputType = GL_FLOAT;
+	}
+	m_streamer.upload(image.ptr(), image.step, image.cols, image.rows, inputColourFormat, inputType, bFlipped);
 }
 
 GLuint Opencv2Spout::matToTexture(cv::Mat &image, GLenum minFilter, GLenum magFilter, GLenum wrapFilter)
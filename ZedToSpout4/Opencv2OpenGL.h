@@ -3,19 +3,61 @@
 #include "Glew\glew.h"
 #include "GL\freeglut.h"
 #include "Spout\Spout.h"
+#include "SpoutMemorySender.h"
+#include "SpoutFrameEvent.h"
+#include "FramePool.h"
+#include "TextureStreamer.h"
 class Opencv2Spout
 {
 public:
-	Opencv2Spout(int argc, char **argv, unsigned int width, unsigned int height, bool forceDX9 = false);
+	// memoryShare publishes through the CPU shared memory map only, no GL context or GLUT window is created.
+	// dxFormat is the DX11 format of the shared texture, 0 for the Spout default (BGRA8).
+	// Senders made on the same thread after the first share its GLUT window and GL context.
+	Opencv2Spout(int argc, char **argv, unsigned int width, unsigned int height, bool forceDX9 = false, bool memoryShare = false,
+		unsigned int dxFormat = 0, const char* senderName = "opencv2Spout");
 	//~Opencv2Spout();
 	static GLuint matToTexture(cv::Mat &mat, GLenum minFilter, GLenum magFilter, GLenum wrapFilter);
-	void draw(cv::Mat &camFrame, bool drawImage);
+	// bFlipped : camFrame already holds its rows bottom-up, as depthToPlane writes them with params.flip
+	// camFrame may be CV_8UC1, CV_8UC3, CV_8UC4, one of the single channel depth encodings (CV_16UC1, CV_32FC1)
+	// or CV_32FC4 point cloud positions
+	void draw(cv::Mat &camFrame, bool drawImage, bool bFlipped = false);
 	bool initReceiver(char* name);
-	cv::Mat receiveTexture();
+	// Senders that signal their frames are only read once a new one is out,
+	// waiting up to timeoutMsec for it, otherwise the image is empty. Others
+	// are read on every call.
+	cv::Mat receiveTexture(int timeoutMsec = 0);
+
+	// Mipmaps are only generated for the sent texture when asked for
+	void setMipmaps(bool bMipmaps);
+	// The GLUT window holding the GL context is hidden once created, for running headless.
+	// Only senders made after the call are affected.
+	static void setHiddenWindow(bool bHidden);
+	// memoryShare senders made after the call publish through a frame ring of that many slots, 0 for the map
+	static void setMemoryRing(unsigned int slots);
 private:
+	// Set once the GLUT window holding the GL context exists
+	static bool s_bContextCreated;
+	static bool s_bHiddenWindow;
+	static unsigned int s_memoryRingSlots;
+
+	void uploadTexture(const cv::Mat &image, bool bFlipped);
+
 	bool m_bReceiverCreated;
+	bool m_bMemoryShare;
+	bool m_bWindowShown;
 	unsigned int m_iWidth, m_iHeight;
+
+	// The sent texture and the pixel buffers that stream frames into it
+	TextureStreamer m_streamer;
+	// Received images come from here, so they don't go to the heap every frame
+	FramePool m_pool;
+
 	char* m_receiverName;
 	SpoutSender* spout;
+	SpoutMemorySender m_memorySender;
+	spoutSenderNames m_senderNames;
 	SpoutReceiver* spoutReceiver;
+	SpoutFrameEvent m_frameEvent;    // GL sender
+	SpoutFrameEvent m_receiverEvent; // the sender received from
+	unsigned int m_receiverSequence;
 };
@@ -0,0 +1,416 @@
+#include "stdafx.h"
+#include "PointCloud.h"
+#include <math.h>
+#include <string.h>
+using namespace std;
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define POINTCLOUD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define KERNEL_AVX2_TARGET
+#else
+#define KERNEL_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+// Points the vector kernels may store past the last one
+static const size_t STORE_SLACK = 8;
+
+void PointCloud::reserve(size_t points)
+{
+	size_t length = points + STORE_SLACK;
+	if (x.size() >= length)
+		return;
+	x.resize(length);
+	y.resize(length);
+	z.resize(length);
+	color.resize(length);
+}
+
+//
+// Back-projection
+//
+
+struct ProjectRow
+{
+	const float* depth;
+	const float* confidence;  // NULL to keep every confidence
+	const unsigned int* left; // NULL without color
+	const float* rayX;
+	float rayY;
+	int width;
+};
+
+struct ProjectLimits
+{
+	float nearMm, farMm, maxConfidence;
+};
+
+// Ordered compares are false for NAN, and the infinities fall outside any finite range
+static int projectRowScalar(const ProjectRow &row, const ProjectLimits &limits, PointCloud &cloud, size_t n)
+{
+	float* ox = &cloud.x[n];
+	float* oy = &cloud.y[n];
+	float* oz = &cloud.z[n];
+	unsigned int* oc = &cloud.color[n];
+	int count = 0;
+	for (int x = 0; x < row.width; x++)
+	{
+		float z = row.depth[x];
+		if (!(z >= limits.nearMm && z <= limits.farMm))
+			continue;
+		if (row.confidence && !(row.confidence[x] <= limits.maxConfidence))
+			continue;
+		ox[count] = row.rayX[x] * z;
+		oy[count] = row.rayY * z;
+		oz[count] = z;
+		if (row.left)
+			oc[count] = row.left[x];
+		count++;
+	}
+	return count;
+}
+
+#ifdef POINTCLOUD_X86
+// Lane indices moving the kept lanes of each 8-bit mask to the front, and how many there are
+struct CompactTable
+{
+	unsigned char lanes[256][8];
+	unsigned char count[256];
+
+	CompactTable()
+	{
+		for (int mask = 0; mask < 256; mask++)
+		{
+			int n = 0;
+			for (int lane = 0; lane < 8; lane++)
+				if (mask & (1 << lane))
+					lanes[mask][n++] = (unsigned char)lane;
+			count[mask] = (unsigned char)n;
+			for (int lane = n; lane < 8; lane++)
+				lanes[mask][lane] = 0;
+		}
+	}
+};
+// Built before main, function statics aren't thread safe with VS2013
+static const CompactTable s_compact;
+
+KERNEL_AVX2_TARGET
+static int projectRowAVX2(const ProjectRow &row, const ProjectLimits &limits, PointCloud &cloud, size_t n)
+{
+	float* ox = &cloud.x[n];
+	float* oy = &cloud.y[n];
+	float* oz = &cloud.z[n];
+	unsigned int* oc = &cloud.color[n];
+	const __m256 nearMm = _mm256_set1_ps(limits.nearMm), farMm = _mm256_set1_ps(limits.farMm);
+	const __m256 maxConfidence = _mm256_set1_ps(limits.maxConfidence);
+	const __m256 rayY = _mm256_set1_ps(row.rayY);
+	int count = 0;
+	int x = 0;
+	for (; x + 8 <= row.width; x += 8)
+	{
+		__m256 z = _mm256_loadu_ps(row.depth + x);
+		__m256 keep = _mm256_and_ps(_mm256_cmp_ps(z, nearMm, _CMP_GE_OQ), _mm256_cmp_ps(z, farMm, _CMP_LE_OQ));
+		if (row.confidence)
+			keep = _mm256_and_ps(keep, _mm256_cmp_ps(_mm256_loadu_ps(row.confidence + x), maxConfidence, _CMP_LE_OQ));
+		int mask = _mm256_movemask_ps(keep);
+		if (mask == 0)
+			continue;
+
+		// Every lane is stored, the ones past the kept count are overwritten by the next block
+		__m256i lanes = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)s_compact.lanes[mask]));
+		_mm256_storeu_ps(ox + count, _mm256_permutevar8x32_ps(_mm256_mul_ps(_mm256_loadu_ps(row.rayX + x), z), lanes));
+		_mm256_storeu_ps(oy + count, _mm256_permutevar8x32_ps(_mm256_mul_ps(rayY, z), lanes));
+		_mm256_storeu_ps(oz + count, _mm256_permutevar8x32_ps(z, lanes));
+		if (row.left)
+		{
+			__m256i bgra = _mm256_loadu_si256((const __m256i*)(row.left + x));
+			_mm256_storeu_si256((__m256i*)(oc + count), _mm256_permutevar8x32_epi32(bgra, lanes));
+		}
+		count += s_compact.count[mask];
+	}
+
+	ProjectRow tail = row;
+	tail.depth += x;
+	tail.confidence = row.confidence ? row.confidence + x : NULL;
+	tail.left = row.left ? row.left + x : NULL;
+	tail.rayX += x;
+	tail.width -= x;
+	return count + projectRowScalar(tail, limits, cloud, n + count);
+}
+#endif
+
+PointCloudProjector::PointCloudProjector()
+{
+	m_intrinsics = defaultIntrinsics(cv::Size(1280, 720));
+}
+
+void PointCloudProjector::setIntrinsics(const CameraIntrinsics &intrinsics)
+{
+	m_intrinsics = intrinsics;
+	m_raySize = cv::Size();
+}
+
+void PointCloudProjector::updateRays(cv::Size size)
+{
+	if (size == m_raySize)
+		return;
+	m_rayX.resize(size.width);
+	m_rayY.resize(size.height);
+	for (int x = 0; x < size.width; x++)
+		m_rayX[x] = (x - m_intrinsics.cx) / m_intrinsics.fx;
+	for (int y = 0; y < size.height; y++)
+		m_rayY[y] = (y - m_intrinsics.cy) / m_intrinsics.fy;
+	m_raySize = size;
+}
+
+void PointCloudProjector::project(const cv::Mat &depth, const cv::Mat &left, const cv::Mat &confidence,
+	const PointCloudParams &params, PointCloud &cloud, KernelIsa isa)
+{
+	CV_Assert(depth.type() == CV_32FC1);
+	isa = bestKernelIsa() == KERNEL_AVX2 && (isa == KERNEL_AUTO || isa == KERNEL_AVX2) ? KERNEL_AVX2 : KERNEL_SCALAR;
+	updateRays(depth.size());
+
+	const bool bColor = params.color && left.type() == CV_8UC4 && left.size() == depth.size();
+	const bool bConfidence = params.confidenceThreshold < 100 && confidence.type() == CV_32FC1 && confidence.size() == depth.size();
+	cloud.reserve(depth.total());
+	cloud.count = 0;
+	cloud.hasColor = bColor;
+
+	ProjectLimits limits;
+	limits.nearMm = params.nearMm;
+	limits.farMm = params.farMm;
+	limits.maxConfidence = (float)params.confidenceThreshold;
+
+	ProjectRow row;
+	row.rayX = &m_rayX[0];
+	row.width = depth.cols;
+	for (int y = 0; y < depth.rows; y++)
+	{
+		row.depth = depth.ptr<float>(y);
+		row.confidence = bConfidence ? confidence.ptr<float>(y) : NULL;
+		row.left = bColor ? left.ptr<unsigned int>(y) : NULL;
+		row.rayY = m_rayY[y];
+#ifdef POINTCLOUD_X86
+		if (isa == KERNEL_AVX2)
+		{
+			cloud.count += projectRowAVX2(row, limits, cloud, cloud.count);
+			continue;
+		}
+#endif
+		cloud.count += projectRowScalar(row, limits, cloud, cloud.count);
+	}
+}
+
+//
+// VoxelGrid
+//
+
+static const int VOXEL_INDEX_BITS = 21;
+static const int VOXEL_INDEX_BIAS = 1 << (VOXEL_INDEX_BITS - 1);
+
+static inline unsigned long long voxelIndex(float v, float inverseLeaf)
+{
+	// Clamped first so the conversion is defined, then floored without the library call
+	float f = v * inverseLeaf;
+	if (f < (float)-VOXEL_INDEX_BIAS)
+		f = (float)-VOXEL_INDEX_BIAS;
+	else if (f > (float)(VOXEL_INDEX_BIAS - 1))
+		f = (float)(VOXEL_INDEX_BIAS - 1);
+	int i = (int)f;
+	if (f < (float)i)
+		i--;
+	return (unsigned long long)(i + VOXEL_INDEX_BIAS);
+}
+
+VoxelGrid::VoxelGrid() : m_stamp(0), m_bits(0)
+{
+}
+
+size_t VoxelGrid::find(unsigned long long key) const
+{
+	const size_t mask = m_table.size() - 1;
+	size_t slot = (size_t)((key * 0x9E3779B97F4A7C15ULL) >> (64 - m_bits));
+	while (m_table[slot].stamp == m_stamp && m_table[slot].key != key)
+		slot = (slot + 1) & mask;
+	return slot;
+}
+
+void VoxelGrid::resize(int bits)
+{
+	// Moves the voxels of the current frame, the table then stays this size
+	vector<Voxel> old;
+	old.swap(m_table);
+	m_bits = bits;
+	m_table.assign((size_t)1 << bits, Voxel()); // stamps 0
+	m_used.reserve(m_table.size() / 2);
+	for (size_t i = 0; i < m_used.size(); i++)
+	{
+		size_t slot = find(old[m_used[i]].key);
+		m_table[slot] = old[m_used[i]];
+		m_used[i] = (unsigned int)slot;
+	}
+}
+
+void VoxelGrid::filter(const PointCloud &in, float leafMm, PointCloud &out)
+{
+	out.reserve(in.count);
+	out.count = 0;
+	out.hasColor = in.hasColor;
+	if (in.count == 0 || !(leafMm > 0.0f))
+		return;
+
+	if (m_table.empty())
+		resize(12);
+	if (++m_stamp == 0)
+	{
+		// Wrapped : older stamps could come back
+		for (size_t i = 0; i < m_table.size(); i++)
+			m_table[i].stamp = 0;
+		m_stamp = 1;
+	}
+	m_used.clear();
+
+	const float inverseLeaf = 1.0f / leafMm;
+	unsigned long long lastKey = 0;
+	size_t slot = 0;
+	for (size_t p = 0; p < in.count; p++)
+	{
+		unsigned long long key = (voxelIndex(in.x[p], inverseLeaf) << (2 * VOXEL_INDEX_BITS)) |
+			(voxelIndex(in.y[p], inverseLeaf) << VOXEL_INDEX_BITS) | voxelIndex(in.z[p], inverseLeaf);
+		// Neighbouring pixels mostly land in the same voxel, skip the lookup for them
+		if (p == 0 || key != lastKey)
+		{
+			slot = find(key);
+			if (m_table[slot].stamp != m_stamp && m_used.size() * 2 >= m_table.size())
+			{
+				// Kept at most half full
+				resize(m_bits + 1);
+				slot = find(key);
+			}
+			lastKey = key;
+		}
+		Voxel &v = m_table[slot];
+		if (v.stamp != m_stamp)
+		{
+			v.key = key;
+			v.stamp = m_stamp;
+			v.count = 0;
+			v.sx = v.sy = v.sz = 0.0f;
+			v.sb = v.sg = v.sr = v.sa = 0;
+			m_used.push_back((unsigned int)slot);
+		}
+		v.count++;
+		v.sx += in.x[p];
+		v.sy += in.y[p];
+		v.sz += in.z[p];
+		if (in.hasColor)
+		{
+			unsigned int c = in.color[p];
+			v.sb += c & 0xFF;
+			v.sg += (c >> 8) & 0xFF;
+			v.sr += (c >> 16) & 0xFF;
+			v.sa += c >> 24;
+		}
+	}
+
+	for (size_t i = 0; i < m_used.size(); i++)
+	{
+		const Voxel &v = m_table[m_used[i]];
+		float inverseCount = 1.0f / v.count;
+		out.x[i] = v.sx * inverseCount;
+		out.y[i] = v.sy * inverseCount;
+		out.z[i] = v.sz * inverseCount;
+		if (in.hasColor)
+		{
+			unsigned int half = v.count / 2;
+			out.color[i] = ((v.sb + half) / v.count) | (((v.sg + half) / v.count) << 8) |
+				(((v.sr + half) / v.count) << 16) | (((v.sa + half) / v.count) << 24);
+		}
+	}
+	out.count = m_used.size();
+}
+
+//
+// Outputs
+//
+
+void pointCloudToTexture(const PointCloud &cloud, cv::Size size, cv::Mat &texture)
+{
+	texture.create(size, CV_32FC4);
+	const size_t texels = (size_t)size.area();
+	const size_t count = cloud.count < texels ? cloud.count : texels;
+	float* out = texture.ptr<float>(0);
+	CV_Assert(texture.isContinuous());
+	for (size_t i = 0; i < count; i++)
+	{
+		out[4 * i] = cloud.x[i] * 0.001f;
+		out[4 * i + 1] = cloud.y[i] * 0.001f;
+		out[4 * i + 2] = cloud.z[i] * 0.001f;
+		if (cloud.hasColor)
+		{
+			unsigned int c = cloud.color[i];
+			out[4 * i + 3] = (float)(((c >> 16) & 0xFF) * 65536 + ((c >> 8) & 0xFF) * 256 + (c & 0xFF));
+		}
+		else
+			out[4 * i + 3] = 1.0f;
+	}
+	for (size_t i = count; i < texels; i++)
+	{
+		out[4 * i] = out[4 * i + 1] = out[4 * i + 2] = NAN;
+		out[4 * i + 3] = 0.0f;
+	}
+}
+
+size_t packPointCloud(const PointCloud &cloud, vector<unsigned char> &buffer)
+{
+	PointCloudHeader header;
+	memcpy(header.magic, "ZPC1", 4);
+	header.count = (unsigned int)cloud.count;
+	header.flags = cloud.hasColor ? POINTCLOUD_COLOR : 0;
+	header.reserved = 0;
+
+	const size_t plane = cloud.count * sizeof(float);
+	const size_t size = sizeof(header) + 3 * plane + (cloud.hasColor ? cloud.count * sizeof(unsigned int) : 0);
+	if (buffer.size() < size)
+		buffer.resize(size);
+	unsigned char* p = &buffer[0];
+	memcpy(p, &header, sizeof(header));
+	p += sizeof(header);
+	if (cloud.count)
+	{
+		memcpy(p, &cloud.x[0], plane);
+		memcpy(p + plane, &cloud.y[0], plane);
+		memcpy(p + 2 * plane, &cloud.z[0], plane);
+		if (cloud.hasColor)
+			memcpy(p + 3 * plane, &cloud.color[0], cloud.count * sizeof(unsigned int));
+	}
+	return size;
+}
+
+bool unpackPointCloud(const unsigned char* data, size_t size, PointCloud &cloud)
+{
+	PointCloudHeader header;
+	if (size < sizeof(header))
+		return false;
+	memcpy(&header, data, sizeof(header));
+	const bool bColor = (header.flags & POINTCLOUD_COLOR) != 0;
+	const size_t plane = (size_t)header.count * sizeof(float);
+	if (memcmp(header.magic, "ZPC1", 4) != 0 || size < sizeof(header) + 3 * plane + (bColor ? plane : 0))
+		return false;
+
+	cloud.reserve(header.count);
+	cloud.count = header.count;
+	cloud.hasColor = bColor;
+	const unsigned char* p = data + sizeof(header);
+	if (header.count)
+	{
+		memcpy(&cloud.x[0], p, plane);
+		memcpy(&cloud.y[0], p + plane, plane);
+		memcpy(&cloud.z[0], p + 2 * plane, plane);
+		if (bColor)
+			memcpy(&cloud.color[0], p + 3 * plane, plane);
+	}
+	return true;
+}
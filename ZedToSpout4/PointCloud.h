@@ -0,0 +1,100 @@
+#pragma once
+#include <vector>
+#include "opencv2/core.hpp"
+#include "FrameSource.h"
+#include "DepthKernels.h"
+
+// What back-projection keeps
+struct PointCloudParams
+{
+	float nearMm, farMm;     // depth range kept, the sentinels never are
+	int confidenceThreshold; // as the ZED one : 100 keeps every point, lower drops the least confident
+	bool color;              // take the left image color of each point when there is one
+	float voxelMm;           // voxel grid leaf size, 0 keeps every point
+
+	PointCloudParams() : nearMm(0.0f), farMm(20000.0f), confidenceThreshold(100), color(true), voxelMm(0.0f) {}
+};
+
+// Points as structure of arrays, in millimeters in the frame of the left
+// camera : x right, y down, z forward. The vectors are longer than count and
+// never shrink, so a cloud rebuilt every frame stays off the heap.
+struct PointCloud
+{
+	std::vector<float> x, y, z;
+	std::vector<unsigned int> color; // BGRA bytes of the left image, filled when hasColor
+	size_t count;
+	bool hasColor;
+
+	PointCloud() : count(0), hasColor(false) {}
+	// Room for points, plus the slack the vector kernels store past the last one
+	void reserve(size_t points);
+};
+
+// Depth to points through the pinhole model. Pixels outside the depth range,
+// sentinels and pixels over the confidence threshold are culled. The AVX2 path
+// compacts eight pixels at a time and gives exactly the scalar result; SSE2
+// has no lane permute and runs the scalar one.
+class PointCloudProjector
+{
+public:
+	PointCloudProjector();
+	void setIntrinsics(const CameraIntrinsics &intrinsics);
+	// left (CV_8UC4) and confidence (CV_32FC1) may be empty
+	void project(const cv::Mat &depth, const cv::Mat &left, const cv::Mat &confidence,
+		const PointCloudParams &params, PointCloud &cloud, KernelIsa isa = KERNEL_AUTO);
+private:
+	// Per column and per row ray slopes, rebuilt when the size or the intrinsics change
+	void updateRays(cv::Size size);
+
+	CameraIntrinsics m_intrinsics;
+	cv::Size m_raySize;
+	std::vector<float> m_rayX, m_rayY;
+};
+
+// Replaces the points falling in each leafMm cube by their centroid and mean
+// color. Voxels live in an open addressing hash table kept between frames and
+// come out in the order they were first hit. The table grows to twice the
+// most voxels seen in a frame and stays that size.
+class VoxelGrid
+{
+public:
+	VoxelGrid();
+	void filter(const PointCloud &in, float leafMm, PointCloud &out);
+private:
+	struct Voxel
+	{
+		unsigned long long key;
+		unsigned int stamp; // the voxel is empty unless stamp is the current one
+		unsigned int count;
+		float sx, sy, sz;
+		unsigned int sb, sg, sr, sa;
+	};
+	// Slot holding key, or the empty slot where it goes
+	size_t find(unsigned long long key) const;
+	// Rehashes the voxels of the current frame into 2^bits slots
+	void resize(int bits);
+
+	std::vector<Voxel> m_table;
+	std::vector<unsigned int> m_used; // slots in first hit order
+	unsigned int m_stamp;
+	int m_bits;
+};
+
+// Packs the points into a CV_32FC4 texture row after row : x, y, z in meters
+// and w the color as R * 65536 + G * 256 + B, exact in a float (1 without
+// color). Texels past the last point are NAN, NAN, NAN, 0.
+void pointCloudToTexture(const PointCloud &cloud, cv::Size size, cv::Mat &texture);
+
+// Binary form : PointCloudHeader, then x[count], y[count] and z[count] floats
+// in millimeters and, with POINTCLOUD_COLOR, color[count] BGRA words.
+static const unsigned int POINTCLOUD_COLOR = 1;
+struct PointCloudHeader
+{
+	char magic[4]; // "ZPC1"
+	unsigned int count;
+	unsigned int flags;
+	unsigned int reserved;
+};
+// Returns the size written to buffer, which keeps its capacity between calls
+size_t packPointCloud(const PointCloud &cloud, std::vector<unsigned char> &buffer);
+bool unpackPointCloud(const unsigned char* data, size_t size, PointCloud &cloud);
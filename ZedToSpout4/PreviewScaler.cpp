@@ -0,0 +1,228 @@
+#include "stdafx.h"
+#include "PreviewScaler.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+using namespace std;
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PREVIEW_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define KERNEL_AVX2_TARGET
+#else
+#define KERNEL_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+void PreviewScaler::Axis::build(int source, int target)
+{
+	first.resize(target);
+	count.resize(target);
+	offset.resize(target);
+	weights.clear();
+	const double ratio = (double)source / target;
+	for (int i = 0; i < target; i++)
+	{
+		double start = i * ratio, end = (i + 1) * ratio;
+		int j = (int)floor(start);
+		int last = (int)ceil(end);
+		if (last > source)
+			last = source;
+		first[i] = j;
+		offset[i] = (int)weights.size();
+		for (; j < last; j++)
+		{
+			// Share of the output pixel this source pixel covers
+			double covered = (end < j + 1 ? end : j + 1) - (start > j ? start : j);
+			weights.push_back((float)(covered / ratio));
+		}
+		count[i] = (int)weights.size() - offset[i];
+	}
+}
+
+//
+// Row sums : sum += weight * row
+//
+
+static void sumScalar(const unsigned char* row, float* sum, int n, float weight)
+{
+	for (int i = 0; i < n; i++)
+		sum[i] = sum[i] + weight * row[i];
+}
+
+static void sumScalar(const float* row, float* sum, int n, float weight)
+{
+	for (int i = 0; i < n; i++)
+		sum[i] = sum[i] + weight * row[i];
+}
+
+#ifdef PREVIEW_X86
+static void sumSSE2(const unsigned char* row, float* sum, int n, float weight)
+{
+	const __m128 w = _mm_set1_ps(weight);
+	const __m128i zero = _mm_setzero_si128();
+	int i = 0;
+	for (; i + 16 <= n; i += 16)
+	{
+		__m128i bytes = _mm_loadu_si128((const __m128i*)(row + i));
+		__m128i lo = _mm_unpacklo_epi8(bytes, zero), hi = _mm_unpackhi_epi8(bytes, zero);
+		__m128i words[4] = { _mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero), _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero) };
+		for (int k = 0; k < 4; k++)
+		{
+			float* s = sum + i + 4 * k;
+			_mm_storeu_ps(s, _mm_add_ps(_mm_loadu_ps(s), _mm_mul_ps(w, _mm_cvtepi32_ps(words[k]))));
+		}
+	}
+	sumScalar(row + i, sum + i, n - i, weight);
+}
+
+static void sumSSE2(const float* row, float* sum, int n, float weight)
+{
+	const __m128 w = _mm_set1_ps(weight);
+	int i = 0;
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_ps(sum + i, _mm_add_ps(_mm_loadu_ps(sum + i), _mm_mul_ps(w, _mm_loadu_ps(row + i))));
+	sumScalar(row + i, sum + i, n - i, weight);
+}
+
+KERNEL_AVX2_TARGET
+static void sumAVX2(const unsigned char* row, float* sum, int n, float weight)
+{
+	const __m256 w = _mm256_set1_ps(weight);
+	int i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256 v = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(row + i))));
+		_mm256_storeu_ps(sum + i, _mm256_add_ps(_mm256_loadu_ps(sum + i), _mm256_mul_ps(w, v)));
+	}
+	sumScalar(row + i, sum + i, n - i, weight);
+}
+
+KERNEL_AVX2_TARGET
+static void sumAVX2(const float* row, float* sum, int n, float weight)
+{
+	const __m256 w = _mm256_set1_ps(weight);
+	int i = 0;
+	for (; i + 8 <= n; i += 8)
+		_mm256_storeu_ps(sum + i, _mm256_add_ps(_mm256_loadu_ps(sum + i), _mm256_mul_ps(w, _mm256_loadu_ps(row + i))));
+	sumScalar(row + i, sum + i, n - i, weight);
+}
+#endif
+
+template <typename T>
+static void sumRow(const T* row, float* sum, int n, float weight, KernelIsa isa)
+{
+#ifdef PREVIEW_X86
+	if (isa == KERNEL_AVX2)
+		return sumAVX2(row, sum, n, weight);
+	if (isa == KERNEL_SSE2)
+		return sumSSE2(row, sum, n, weight);
+#endif
+	sumScalar(row, sum, n, weight);
+}
+
+// Written like MAXPS / MINPS, so the vector path narrows the same way
+static inline unsigned char narrow(float value, float scale)
+{
+	float t = value * scale;
+	t = t > 0.0f ? t : 0.0f;
+	t = t < 255.0f ? t : 255.0f;
+	return (unsigned char)(int)(t + 0.5f);
+}
+
+//
+// PreviewScaler
+//
+
+PreviewScaler::PreviewScaler()
+{
+}
+
+void PreviewScaler::resize(const cv::Mat &src, cv::Mat &dst, cv::Size size, float scale, bool flip, KernelIsa isa)
+{
+	const int type = src.type();
+	CV_Assert(type == CV_8UC1 || type == CV_8UC4 || type == CV_32FC1);
+	CV_Assert(size.width > 0 && size.height > 0 && !src.empty());
+	KernelIsa best = bestKernelIsa();
+	if (isa == KERNEL_AUTO || isa > best)
+		isa = best;
+
+	if (src.size() != m_source || size != m_target)
+	{
+		m_source = src.size();
+		m_target = size;
+		m_rows.build(m_source.height, m_target.height);
+		m_cols.build(m_source.width, m_target.width);
+	}
+	const int channels = src.channels();
+	const int n = src.cols * channels;
+	m_sum.resize(n);
+	dst.create(size, CV_MAKETYPE(CV_8U, channels));
+
+	for (int y = 0; y < size.height; y++)
+	{
+		// Vertical : weighted sum of the source rows under the output row
+		fill(m_sum.begin(), m_sum.end(), 0.0f);
+		float* sum = &m_sum[0];
+		const float* rowWeights = &m_rows.weights[m_rows.offset[y]];
+		for (int k = 0; k < m_rows.count[y]; k++)
+		{
+			int sy = m_rows.first[y] + k;
+			if (type == CV_32FC1)
+				sumRow(src.ptr<float>(sy), sum, n, rowWeights[k], isa);
+			else
+				sumRow(src.ptr(sy), sum, n, rowWeights[k], isa);
+		}
+
+		// Horizontal : the columns under each output pixel, then to 8 bits
+		unsigned char* out = dst.ptr(flip ? size.height - 1 - y : y);
+		if (channels == 1)
+		{
+			for (int x = 0; x < size.width; x++)
+			{
+				const float* w = &m_cols.weights[m_cols.offset[x]];
+				const float* s = sum + m_cols.first[x];
+				float value = 0.0f;
+				for (int k = 0; k < m_cols.count[x]; k++)
+					value = value + w[k] * s[k];
+				out[x] = narrow(value, scale);
+			}
+			continue;
+		}
+#ifdef PREVIEW_X86
+		if (isa != KERNEL_SCALAR)
+		{
+			// A pixel's four channels fill a vector
+			const __m128 scales = _mm_set1_ps(scale), zero = _mm_setzero_ps(), max = _mm_set1_ps(255.0f), half = _mm_set1_ps(0.5f);
+			for (int x = 0; x < size.width; x++)
+			{
+				const float* w = &m_cols.weights[m_cols.offset[x]];
+				const float* s = sum + 4 * m_cols.first[x];
+				__m128 value = _mm_setzero_ps();
+				for (int k = 0; k < m_cols.count[x]; k++)
+					value = _mm_add_ps(value, _mm_mul_ps(_mm_set1_ps(w[k]), _mm_loadu_ps(s + 4 * k)));
+				__m128 t = _mm_min_ps(_mm_max_ps(_mm_mul_ps(value, scales), zero), max);
+				__m128i words = _mm_cvttps_epi32(_mm_add_ps(t, half));
+				words = _mm_packs_epi32(words, words);
+				int packed = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+				memcpy(out + 4 * x, &packed, 4);
+			}
+			continue;
+		}
+#endif
+		for (int x = 0; x < size.width; x++)
+		{
+			const float* w = &m_cols.weights[m_cols.offset[x]];
+			const float* s = sum + 4 * m_cols.first[x];
+			for (int c = 0; c < 4; c++)
+			{
+				float value = 0.0f;
+				for (int k = 0; k < m_cols.count[x]; k++)
+					value = value + w[k] * s[4 * k + c];
+				out[4 * x + c] = narrow(value, scale);
+			}
+		}
+	}
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <vector>
+#include "opencv2/core.hpp"
+#include "DepthKernels.h"
+
+// Area (box filter) downscaling to the preview window size in one pass over
+// the source, with the value scaling, the narrowing to 8 bits and the flip
+// folded in. The coverage of every output row and column is worked out once
+// for a pair of sizes and reused while they stay the same. The source rows are
+// summed with SSE2 or AVX2, and every instruction set gives the same bytes.
+class PreviewScaler
+{
+public:
+	PreviewScaler();
+	// src is CV_8UC1, CV_8UC4 or CV_32FC1 and dst becomes 8-bit with as many
+	// channels, each value times scale. Rows come out bottom-up when flip is set.
+	void resize(const cv::Mat &src, cv::Mat &dst, cv::Size size, float scale = 1.0f, bool flip = false,
+		KernelIsa isa = KERNEL_AUTO);
+private:
+	// Source pixels covering each output pixel along one axis, with their share
+	struct Axis
+	{
+		std::vector<int> first, count, offset; // per output pixel, offset into weights
+		std::vector<float> weights;
+		void build(int source, int target);
+	};
+
+	cv::Size m_source, m_target;
+	Axis m_rows, m_cols;
+	std::vector<float> m_sum; // weighted sum of the source rows of one output row
+};
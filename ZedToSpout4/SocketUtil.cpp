@@ -0,0 +1,231 @@
+#include "stdafx.h"
+#include "SocketUtil.h"
+#include <string.h>
+
+bool socketStartup()
+{
+#ifdef _WIN32
+	static const bool started = []() {
+		WSADATA data;
+		return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}();
+	return started;
+#else
+	return true;
+#endif
+}
+
+void closeSocket(intptr_t s)
+{
+	if (s == NO_SOCKET)
+		return;
+#ifdef _WIN32
+	closesocket((SOCKET)s);
+#else
+	close((SOCKET)s);
+#endif
+}
+
+bool setReceiveTimeout(intptr_t s, int msec)
+{
+#ifdef _WIN32
+	DWORD timeout = msec;
+#else
+	timeval timeout;
+	timeout.tv_sec = msec / 1000;
+	timeout.tv_usec = (msec % 1000) * 1000;
+#endif
+	return setsockopt((SOCKET)s, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout)) == 0;
+}
+
+intptr_t openUdpSocket(unsigned short port, bool anyInterface)
+{
+	if (!socketStartup())
+		return NO_SOCKET;
+	SOCKET s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (s == INVALID_SOCKET)
+		return NO_SOCKET;
+
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(anyInterface ? INADDR_ANY : INADDR_LOOPBACK);
+	if (bind(s, (const sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR)
+	{
+		closeSocket((intptr_t)s);
+		return NO_SOCKET;
+	}
+	return (intptr_t)s;
+}
+
+unsigned short socketPort(intptr_t s)
+{
+	sockaddr_in addr;
+	socklen_t length = sizeof(addr);
+	if (getsockname((SOCKET)s, (sockaddr*)&addr, &length) == SOCKET_ERROR)
+		return 0;
+	return ntohs(addr.sin_port);
+}
+
+void setSocketBuffers(intptr_t s, int bytes)
+{
+	// Only a request, the system may cap it
+	setsockopt((SOCKET)s, SOL_SOCKET, SO_SNDBUF, (const char*)&bytes, sizeof(bytes));
+	setsockopt((SOCKET)s, SOL_SOCKET, SO_RCVBUF, (const char*)&bytes, sizeof(bytes));
+}
+
+bool waitReadable(intptr_t s, int msec)
+{
+	fd_set readable;
+	FD_ZERO(&readable);
+	FD_SET((SOCKET)s, &readable);
+	timeval timeout;
+	timeout.tv_sec = msec / 1000;
+	timeout.tv_usec = (msec % 1000) * 1000;
+	// The first argument is ignored on Windows
+	return select((int)s + 1, &readable, NULL, NULL, &timeout) > 0;
+}
+
+bool socketTimedOut()
+{
+#ifdef _WIN32
+	int error = WSAGetLastError();
+	return error == WSAETIMEDOUT || error == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+bool resolveHost(const char* host, unsigned int &address)
+{
+	if (!socketStartup())
+		return false;
+	in_addr parsed;
+	if (inet_pton(AF_INET, host, &parsed) == 1)
+	{
+		address = parsed.s_addr;
+		return true;
+	}
+	addrinfo hints, *found = NULL;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	if (getaddrinfo(host, NULL, &hints, &found) != 0 || !found)
+		return false;
+	address = ((const sockaddr_in*)found->ai_addr)->sin_addr.s_addr;
+	freeaddrinfo(found);
+	return true;
+}
+
+static bool setBlocking(SOCKET s, bool blocking)
+{
+#ifdef _WIN32
+	u_long nonBlocking = blocking ? 0 : 1;
+	return ioctlsocket(s, FIONBIO, &nonBlocking) == 0;
+#else
+	int flags = fcntl(s, F_GETFL, 0);
+	return flags >= 0 && fcntl(s, F_SETFL, blocking ? flags & ~O_NONBLOCK : flags | O_NONBLOCK) == 0;
+#endif
+}
+
+intptr_t connectTcpSocket(unsigned int address, unsigned short port, int timeoutMsec)
+{
+	if (!socketStartup())
+		return NO_SOCKET;
+	SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (s == INVALID_SOCKET)
+		return NO_SOCKET;
+
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = address;
+	// Non-blocking so an unreachable host can't hold up the caller for the system timeout
+	bool connected = false;
+	if (setBlocking(s, false))
+	{
+		if (connect(s, (const sockaddr*)&addr, sizeof(addr)) == 0)
+			connected = true;
+		else
+		{
+			fd_set writable;
+			FD_ZERO(&writable);
+			FD_SET(s, &writable);
+			timeval timeout;
+			timeout.tv_sec = timeoutMsec / 1000;
+			timeout.tv_usec = (timeoutMsec % 1000) * 1000;
+			int error = 0;
+			socklen_t length = sizeof(error);
+			connected = select((int)s + 1, NULL, &writable, NULL, &timeout) > 0 &&
+				getsockopt(s, SOL_SOCKET, SO_ERROR, (char*)&error, &length) == 0 && error == 0;
+		}
+	}
+	if (!connected || !setBlocking(s, true))
+	{
+		closeSocket((intptr_t)s);
+		return NO_SOCKET;
+	}
+	int noDelay = 1;
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+	return (intptr_t)s;
+}
+
+intptr_t openTcpListener(unsigned short port, bool anyInterface)
+{
+	if (!socketStartup())
+		return NO_SOCKET;
+	SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (s == INVALID_SOCKET)
+		return NO_SOCKET;
+	int reuse = 1;
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(anyInterface ? INADDR_ANY : INADDR_LOOPBACK);
+	if (bind(s, (const sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR || listen(s, 1) == SOCKET_ERROR)
+	{
+		closeSocket((intptr_t)s);
+		return NO_SOCKET;
+	}
+	return (intptr_t)s;
+}
+
+bool sendAll(intptr_t s, const void* data, size_t size)
+{
+	const char* p = (const char*)data;
+	while (size > 0)
+	{
+		int chunk = size > 0x40000000 ? 0x40000000 : (int)size;
+		int n = send((SOCKET)s, p, chunk, MSG_NOSIGNAL);
+		if (n <= 0)
+			return false;
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+bool recvAll(intptr_t s, void* data, size_t size, const std::atomic<bool>* keepGoing)
+{
+	char* p = (char*)data;
+	while (size > 0)
+	{
+		int chunk = size > 0x40000000 ? 0x40000000 : (int)size;
+		int n = recv((SOCKET)s, p, chunk, 0);
+		if (n == 0)
+			return false;
+		if (n < 0)
+		{
+			if (socketTimedOut() && keepGoing && *keepGoing)
+				continue;
+			return false;
+		}
+		p += n;
+		size -= n;
+	}
+	return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+// Socket headers for the .cpp files that need them. Include right after
+// stdafx.h : winsock2.h has to come before anything pulling in windows.h,
+// so headers keep sockets as plain intptr_t handles instead.
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+typedef int socklen_t;
+// Windows never raises SIGPIPE
+#define MSG_NOSIGNAL 0
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+typedef int SOCKET;
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+#endif
+#include <stdint.h>
+#include <atomic>
+
+static const intptr_t NO_SOCKET = (intptr_t)INVALID_SOCKET;
+
+// WSAStartup once per process, nothing to do elsewhere
+bool socketStartup();
+void closeSocket(intptr_t s);
+bool setReceiveTimeout(intptr_t s, int msec);
+// UDP socket bound to the port, on the loopback interface only unless anyInterface is set
+intptr_t openUdpSocket(unsigned short port, bool anyInterface);
+
+// Port the socket is bound to, for sockets opened on port 0
+unsigned short socketPort(intptr_t s);
+// Asks for larger kernel buffers, a whole frame of datagrams has to fit
+void setSocketBuffers(intptr_t s, int bytes);
+// Waits until the socket can be read or accepted from, false on timeout
+bool waitReadable(intptr_t s, int msec);
+// True when the last failed call only timed out or was interrupted
+bool socketTimedOut();
+// IPv4 address of a dotted address or a host name, in network order
+bool resolveHost(const char* host, unsigned int &address);
+// Connected TCP socket with Nagle off, NO_SOCKET when nobody accepts within timeoutMsec
+intptr_t connectTcpSocket(unsigned int address, unsigned short port, int timeoutMsec);
+// Listening TCP socket, on the loopback interface only unless anyInterface is set
+intptr_t openTcpListener(unsigned short port, bool anyInterface);
+// Sends or receives all the bytes, false when the connection failed or closed.
+// A receive timeout set on the socket only makes recvAll check keepGoing.
+bool sendAll(intptr_t s, const void* data, size_t size);
+bool recvAll(intptr_t s, void* data, size_t size, const std::atomic<bool>* keepGoing = NULL);
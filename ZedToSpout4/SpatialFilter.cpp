@@ -0,0 +1,606 @@
+#include "stdafx.h"
+#include "SpatialFilter.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+using namespace std;
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SPATIAL_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define KERNEL_AVX2_TARGET
+#else
+#define KERNEL_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+// Rows per parallel_for_ stripe, as the band masks
+static const int SPATIAL_TILE_ROWS = 32;
+// Columns per vertical pass stripe, a whole number of AVX2 vectors
+static const int SPATIAL_STRIPE_COLS = 256;
+// Share of measured neighbourhood a hole needs to be filled by the smoothing
+static const float SPATIAL_MIN_WEIGHT = 0.1f;
+// Largest sum of B, G and R differences
+static const int SPATIAL_MAX_EDGE = 3 * 255;
+
+bool parseSpatialFilter(const string &text, SpatialFilterParams &params)
+{
+	SpatialFilterParams parsed;
+	double values[4] = { parsed.sigmaSpatial, parsed.sigmaColor, (double)parsed.holeRadius, (double)parsed.iterations };
+	const char* p = text.c_str();
+	for (int i = 0; i < 4; i++)
+	{
+		char* end;
+		values[i] = strtod(p, &end);
+		if (end == p)
+			return false;
+		if (*end == '\0')
+			break;
+		if (*end != ':' || i == 3)
+			return false;
+		p = end + 1;
+	}
+	parsed.sigmaSpatial = (float)values[0];
+	parsed.sigmaColor = (float)values[1];
+	parsed.holeRadius = (int)values[2];
+	parsed.iterations = (int)values[3];
+	if (!(parsed.sigmaSpatial > 0.0f) || !(parsed.sigmaColor > 0.0f) || parsed.holeRadius < 0 || parsed.holeRadius > 1000 ||
+		parsed.iterations < 1 || parsed.iterations > 4)
+		return false;
+	params = parsed;
+	return true;
+}
+
+string formatSpatialFilter(const SpatialFilterParams &params)
+{
+	char text[96];
+	sprintf(text, "%g:%g:%d:%d%s", params.sigmaSpatial, params.sigmaColor, params.holeRadius, params.iterations,
+		params.smooth ? "" : " holes only");
+	return text;
+}
+
+static inline bool isFinite(float z)
+{
+	return fabsf(z) < INFINITY;
+}
+
+//
+// Kernels
+//
+
+// Forward then backward recursion down the columns [start, cols) of a stripe
+static void columnScalar(float* num, float* den, const float* weight, size_t stride, int rows, int start, int cols)
+{
+	for (int y = 1; y < rows; y++)
+	{
+		float* n = num + y * stride;
+		float* d = den + y * stride;
+		const float* pn = n - stride;
+		const float* pd = d - stride;
+		const float* w = weight + y * stride;
+		for (int x = start; x < cols; x++)
+		{
+			n[x] = n[x] + w[x] * (pn[x] - n[x]);
+			d[x] = d[x] + w[x] * (pd[x] - d[x]);
+		}
+	}
+	for (int y = rows - 2; y >= 0; y--)
+	{
+		float* n = num + y * stride;
+		float* d = den + y * stride;
+		const float* pn = n + stride;
+		const float* pd = d + stride;
+		const float* w = weight + (y + 1) * stride;
+		for (int x = start; x < cols; x++)
+		{
+			n[x] = n[x] + w[x] * (pn[x] - n[x]);
+			d[x] = d[x] + w[x] * (pd[x] - d[x]);
+		}
+	}
+}
+
+struct SpatialMapping
+{
+	float minWeight;
+	bool smooth;
+};
+
+static void outputScalar(const float* depth, const float* num, const float* den, float* out, int start, int n, const SpatialMapping &m)
+{
+	for (int x = start; x < n; x++)
+	{
+		float z = depth[x];
+		if (isFinite(z) ? m.smooth : (z != z && den[x] >= m.minWeight))
+			z = num[x] / den[x];
+		out[x] = z;
+	}
+}
+
+#ifdef SPATIAL_X86
+static void columnSSE2(float* num, float* den, const float* weight, size_t stride, int rows, int cols)
+{
+	int last = cols & ~3;
+	for (int y = 1; y < rows; y++)
+	{
+		float* n = num + y * stride;
+		float* d = den + y * stride;
+		const float* pn = n - stride;
+		const float* pd = d - stride;
+		const float* w = weight + y * stride;
+		for (int x = 0; x < last; x += 4)
+		{
+			__m128 wx = _mm_loadu_ps(w + x);
+			__m128 nx = _mm_loadu_ps(n + x), dx = _mm_loadu_ps(d + x);
+			_mm_storeu_ps(n + x, _mm_add_ps(nx, _mm_mul_ps(wx, _mm_sub_ps(_mm_loadu_ps(pn + x), nx))));
+			_mm_storeu_ps(d + x, _mm_add_ps(dx, _mm_mul_ps(wx, _mm_sub_ps(_mm_loadu_ps(pd + x), dx))));
+		}
+	}
+	for (int y = rows - 2; y >= 0; y--)
+	{
+		float* n = num + y * stride;
+		float* d = den + y * stride;
+		const float* pn = n + stride;
+		const float* pd = d + stride;
+		const float* w = weight + (y + 1) * stride;
+		for (int x = 0; x < last; x += 4)
+		{
+			__m128 wx = _mm_loadu_ps(w + x);
+			__m128 nx = _mm_loadu_ps(n + x), dx = _mm_loadu_ps(d + x);
+			_mm_storeu_ps(n + x, _mm_add_ps(nx, _mm_mul_ps(wx, _mm_sub_ps(_mm_loadu_ps(pn + x), nx))));
+			_mm_storeu_ps(d + x, _mm_add_ps(dx, _mm_mul_ps(wx, _mm_sub_ps(_mm_loadu_ps(pd + x), dx))));
+		}
+	}
+	columnScalar(num, den, weight, stride, rows, last, cols);
+}
+
+static void outputSSE2(const float* depth, const float* num, const float* den, float* out, int n, const SpatialMapping &m)
+{
+	const __m128 sign = _mm_set1_ps(-0.0f), inf = _mm_set1_ps(INFINITY), minWeight = _mm_set1_ps(m.minWeight);
+	const __m128 smooth = _mm_castsi128_ps(_mm_set1_epi32(m.smooth ? -1 : 0));
+	int x = 0;
+	for (; x + 4 <= n; x += 4)
+	{
+		__m128 z = _mm_loadu_ps(depth + x), d = _mm_loadu_ps(den + x);
+		__m128 measured = _mm_and_ps(_mm_cmplt_ps(_mm_andnot_ps(sign, z), inf), smooth);
+		__m128 filled = _mm_and_ps(_mm_cmpunord_ps(z, z), _mm_cmpge_ps(d, minWeight));
+		__m128 take = _mm_or_ps(measured, filled);
+		__m128 q = _mm_div_ps(_mm_loadu_ps(num + x), d);
+		_mm_storeu_ps(out + x, _mm_or_ps(_mm_and_ps(take, q), _mm_andnot_ps(take, z)));
+	}
+	outputScalar(depth, num, den, out, x, n, m);
+}
+
+KERNEL_AVX2_TARGET
+static void columnAVX2(float* num, float* den, const float* weight, size_t stride, int rows, int cols)
+{
+	int last = cols & ~7;
+	for (int y = 1; y < rows; y++)
+	{
+		float* n = num + y * stride;
+		float* d = den + y * stride;
+		const float* pn = n - stride;
+		const float* pd = d - stride;
+		const float* w = weight + y * stride;
+		for (int x = 0; x < last; x += 8)
+		{
+			__m256 wx = _mm256_loadu_ps(w + x);
+			__m256 nx = _mm256_loadu_ps(n + x), dx = _mm256_loadu_ps(d + x);
+			_mm256_storeu_ps(n + x, _mm256_add_ps(nx, _mm256_mul_ps(wx, _mm256_sub_ps(_mm256_loadu_ps(pn + x), nx))));
+			_mm256_storeu_ps(d + x, _mm256_add_ps(dx, _mm256_mul_ps(wx, _mm256_sub_ps(_mm256_loadu_ps(pd + x), dx))));
+		}
+	}
+	for (int y = rows - 2; y >= 0; y--)
+	{
+		float* n = num + y * stride;
+		float* d = den + y * stride;
+		const float* pn = n + stride;
+		const float* pd = d + stride;
+		const float* w = weight + (y + 1) * stride;
+		for (int x = 0; x < last; x += 8)
+		{
+			__m256 wx = _mm256_loadu_ps(w + x);
+			__m256 nx = _mm256_loadu_ps(n + x), dx = _mm256_loadu_ps(d + x);
+			_mm256_storeu_ps(n + x, _mm256_add_ps(nx, _mm256_mul_ps(wx, _mm256_sub_ps(_mm256_loadu_ps(pn + x), nx))));
+			_mm256_storeu_ps(d + x, _mm256_add_ps(dx, _mm256_mul_ps(wx, _mm256_sub_ps(_mm256_loadu_ps(pd + x), dx))));
+		}
+	}
+	columnScalar(num, den, weight, stride, rows, last, cols);
+}
+
+KERNEL_AVX2_TARGET
+static void outputAVX2(const float* depth, const float* num, const float* den, float* out, int n, const SpatialMapping &m)
+{
+	const __m256 sign = _mm256_set1_ps(-0.0f), inf = _mm256_set1_ps(INFINITY), minWeight = _mm256_set1_ps(m.minWeight);
+	const __m256 smooth = _mm256_castsi256_ps(_mm256_set1_epi32(m.smooth ? -1 : 0));
+	int x = 0;
+	for (; x + 8 <= n; x += 8)
+	{
+		__m256 z = _mm256_loadu_ps(depth + x), d = _mm256_loadu_ps(den + x);
+		__m256 measured = _mm256_and_ps(_mm256_cmp_ps(_mm256_andnot_ps(sign, z), inf, _CMP_LT_OQ), smooth);
+		__m256 filled = _mm256_and_ps(_mm256_cmp_ps(z, z, _CMP_UNORD_Q), _mm256_cmp_ps(d, minWeight, _CMP_GE_OQ));
+		__m256 q = _mm256_div_ps(_mm256_loadu_ps(num + x), d);
+		_mm256_storeu_ps(out + x, _mm256_blendv_ps(z, q, _mm256_or_ps(measured, filled)));
+	}
+	outputScalar(depth, num, den, out, x, n, m);
+}
+#endif
+
+typedef void (*ColumnFunc)(float*, float*, const float*, size_t, int, int);
+typedef void (*OutputFunc)(const float*, const float*, const float*, float*, int, const SpatialMapping&);
+
+static void columnScalarAll(float* num, float* den, const float* weight, size_t stride, int rows, int cols)
+{
+	columnScalar(num, den, weight, stride, rows, 0, cols);
+}
+
+static void outputScalarAll(const float* depth, const float* num, const float* den, float* out, int n, const SpatialMapping &m)
+{
+	outputScalar(depth, num, den, out, 0, n, m);
+}
+
+//
+// Passes
+//
+
+// Seeds the weighted depth and measures the left image edges
+class SpatialPrepareBody : public cv::ParallelLoopBody
+{
+public:
+	SpatialPrepareBody(const cv::Mat &depth, const cv::Mat &left, float* num, float* den, unsigned short* edgeX, unsigned short* edgeY)
+		: m_depth(depth), m_left(left), m_num(num), m_den(den), m_edgeX(edgeX), m_edgeY(edgeY) {}
+
+	void operator()(const cv::Range &rows) const
+	{
+		const int width = m_depth.cols;
+		for (int y = rows.start; y < rows.end; y++)
+		{
+			const float* z = m_depth.ptr<float>(y);
+			size_t offset = (size_t)y * width;
+			float* n = m_num + offset;
+			float* d = m_den + offset;
+			for (int x = 0; x < width; x++)
+			{
+				bool measured = isFinite(z[x]);
+				n[x] = measured ? z[x] : 0.0f;
+				d[x] = measured ? 1.0f : 0.0f;
+			}
+
+			unsigned short* ex = m_edgeX + offset;
+			unsigned short* ey = m_edgeY + offset;
+			if (m_left.empty())
+			{
+				for (int x = 0; x < width; x++)
+					ex[x] = ey[x] = 0;
+				continue;
+			}
+			const unsigned char* c = m_left.ptr(y);
+			const unsigned char* above = m_left.ptr(y > 0 ? y - 1 : 0);
+			ex[0] = 0;
+			for (int x = 0; x < width; x++)
+			{
+				const unsigned char* p = c + 4 * x;
+				if (x > 0)
+					ex[x] = (unsigned short)(abs(p[0] - p[-4]) + abs(p[1] - p[-3]) + abs(p[2] - p[-2]));
+				const unsigned char* u = above + 4 * x;
+				ey[x] = (unsigned short)(abs(p[0] - u[0]) + abs(p[1] - u[1]) + abs(p[2] - u[2]));
+			}
+		}
+	}
+private:
+	const cv::Mat &m_depth;
+	const cv::Mat &m_left;
+	float* m_num;
+	float* m_den;
+	unsigned short* m_edgeX;
+	unsigned short* m_edgeY;
+};
+
+// Horizontal recursion of one iteration, a serial dependency along each row,
+// and the weights the vertical one will use
+class SpatialRowBody : public cv::ParallelLoopBody
+{
+public:
+	SpatialRowBody(int width, float* num, float* den, const unsigned short* edgeX, const unsigned short* edgeY,
+		const float* lut, float* weightY)
+		: m_width(width), m_num(num), m_den(den), m_edgeX(edgeX), m_edgeY(edgeY), m_lut(lut), m_weightY(weightY) {}
+
+	void operator()(const cv::Range &rows) const
+	{
+		for (int y = rows.start; y < rows.end; y++)
+		{
+			size_t offset = (size_t)y * m_width;
+			float* n = m_num + offset;
+			float* d = m_den + offset;
+			const unsigned short* e = m_edgeX + offset;
+			for (int x = 1; x < m_width; x++)
+			{
+				float w = m_lut[e[x]];
+				n[x] = n[x] + w * (n[x - 1] - n[x]);
+				d[x] = d[x] + w * (d[x - 1] - d[x]);
+			}
+			for (int x = m_width - 2; x >= 0; x--)
+			{
+				float w = m_lut[e[x + 1]];
+				n[x] = n[x] + w * (n[x + 1] - n[x]);
+				d[x] = d[x] + w * (d[x + 1] - d[x]);
+			}
+			const unsigned short* ey = m_edgeY + offset;
+			float* wy = m_weightY + offset;
+			for (int x = 0; x < m_width; x++)
+				wy[x] = m_lut[ey[x]];
+		}
+	}
+private:
+	int m_width;
+	float* m_num;
+	float* m_den;
+	const unsigned short* m_edgeX;
+	const unsigned short* m_edgeY;
+	const float* m_lut;
+	float* m_weightY;
+};
+
+// Vertical recursion over stripes of columns, each running down then up the whole height
+class SpatialColumnBody : public cv::ParallelLoopBody
+{
+public:
+	SpatialColumnBody(cv::Size size, float* num, float* den, const float* weightY, ColumnFunc column)
+		: m_size(size), m_num(num), m_den(den), m_weightY(weightY), m_column(column) {}
+
+	void operator()(const cv::Range &stripes) const
+	{
+		for (int s = stripes.start; s < stripes.end; s++)
+		{
+			int x = s * SPATIAL_STRIPE_COLS;
+			int cols = m_size.width - x < SPATIAL_STRIPE_COLS ? m_size.width - x : SPATIAL_STRIPE_COLS;
+			m_column(m_num + x, m_den + x, m_weightY + x, m_size.width, m_size.height, cols);
+		}
+	}
+private:
+	cv::Size m_size;
+	float* m_num;
+	float* m_den;
+	const float* m_weightY;
+	ColumnFunc m_column;
+};
+
+class SpatialOutputBody : public cv::ParallelLoopBody
+{
+public:
+	SpatialOutputBody(const cv::Mat &depth, const float* num, const float* den, cv::Mat &filtered, const SpatialMapping &m, OutputFunc output)
+		: m_depth(depth), m_num(num), m_den(den), m_filtered(filtered), m_mapping(m), m_output(output) {}
+
+	void operator()(const cv::Range &rows) const
+	{
+		for (int y = rows.start; y < rows.end; y++)
+		{
+			size_t offset = (size_t)y * m_depth.cols;
+			m_output(m_depth.ptr<float>(y), m_num + offset, m_den + offset, m_filtered.ptr<float>(y), m_depth.cols, m_mapping);
+		}
+	}
+private:
+	const cv::Mat &m_depth;
+	const float* m_num;
+	const float* m_den;
+	cv::Mat &m_filtered;
+	const SpatialMapping &m_mapping;
+	OutputFunc m_output;
+};
+
+// The farther of two candidates, since holes are mostly occluded background; NAN when neither is set
+static inline float inpaintValue(float a, float b)
+{
+	if (a != a)
+		return b;
+	if (b != b)
+		return a;
+	return a > b ? a : b;
+}
+
+// Fills each run of NAN from the measures at its ends
+class SpatialInpaintRowBody : public cv::ParallelLoopBody
+{
+public:
+	SpatialInpaintRowBody(cv::Mat &filtered, int radius) : m_filtered(filtered), m_radius(radius) {}
+
+	void operator()(const cv::Range &rows) const
+	{
+		const int width = m_filtered.cols;
+		for (int y = rows.start; y < rows.end; y++)
+		{
+			float* z = m_filtered.ptr<float>(y);
+			int x = 0;
+			while (x < width)
+			{
+				if (z[x] == z[x])
+				{
+					x++;
+					continue;
+				}
+				int start = x;
+				while (x < width && z[x] != z[x])
+					x++;
+				float before = start > 0 && isFinite(z[start - 1]) ? z[start - 1] : NAN;
+				float after = x < width && isFinite(z[x]) ? z[x] : NAN;
+				for (int h = start; h < x; h++)
+					z[h] = inpaintValue(h - start < m_radius ? before : NAN, x - h <= m_radius ? after : NAN);
+			}
+		}
+	}
+private:
+	cv::Mat &m_filtered;
+	int m_radius;
+};
+
+// Same along the columns, in row order : the way down keeps the candidate from
+// above in scratch, the way up combines it with the one from below
+class SpatialInpaintColumnBody : public cv::ParallelLoopBody
+{
+public:
+	SpatialInpaintColumnBody(cv::Mat &filtered, float* scratch, float* nearValue, int* nearDistance, int radius)
+		: m_filtered(filtered), m_scratch(scratch), m_nearValue(nearValue), m_nearDistance(nearDistance), m_radius(radius) {}
+
+	void operator()(const cv::Range &stripes) const
+	{
+		const int width = m_filtered.cols, height = m_filtered.rows;
+		for (int s = stripes.start; s < stripes.end; s++)
+		{
+			int first = s * SPATIAL_STRIPE_COLS;
+			int last = width - first < SPATIAL_STRIPE_COLS ? width : first + SPATIAL_STRIPE_COLS;
+			float* value = m_nearValue;
+			int* distance = m_nearDistance;
+			for (int x = first; x < last; x++)
+			{
+				value[x] = NAN;
+				distance[x] = 0;
+			}
+			for (int y = 0; y < height; y++)
+			{
+				const float* z = m_filtered.ptr<float>(y);
+				float* above = m_scratch + (size_t)y * width;
+				for (int x = first; x < last; x++)
+					track(z[x], value[x], distance[x], above[x]);
+			}
+			for (int x = first; x < last; x++)
+			{
+				value[x] = NAN;
+				distance[x] = 0;
+			}
+			for (int y = height - 1; y >= 0; y--)
+			{
+				float* z = m_filtered.ptr<float>(y);
+				const float* above = m_scratch + (size_t)y * width;
+				for (int x = first; x < last; x++)
+				{
+					float below;
+					bool hole = track(z[x], value[x], distance[x], below);
+					if (hole)
+						z[x] = inpaintValue(above[x], below);
+				}
+			}
+		}
+	}
+private:
+	// Follows the last measure of a column, returns true on a hole with its candidate in fill
+	bool track(float z, float &value, int &distance, float &fill) const
+	{
+		if (isFinite(z))
+		{
+			value = z;
+			distance = 0;
+			return false;
+		}
+		distance++;
+		if (z == z)
+		{
+			// The infinities are no measure to fill from
+			value = NAN;
+			return false;
+		}
+		fill = distance <= m_radius ? value : NAN;
+		return true;
+	}
+
+	cv::Mat &m_filtered;
+	float* m_scratch;
+	float* m_nearValue;
+	int* m_nearDistance;
+	int m_radius;
+};
+
+//
+// SpatialFilter
+//
+
+SpatialFilter::SpatialFilter()
+{
+}
+
+void SpatialFilter::setParams(const SpatialFilterParams &params)
+{
+	m_params = params;
+}
+
+void SpatialFilter::apply(const cv::Mat &depth, const cv::Mat &left, cv::Mat &filtered, KernelIsa isa)
+{
+	CV_Assert(depth.type() == CV_32FC1);
+	KernelIsa best = bestKernelIsa();
+	if (isa == KERNEL_AUTO || isa > best)
+		isa = best;
+
+	const cv::Size size = depth.size();
+	if (size != m_size)
+	{
+		m_size = size;
+		size_t area = (size_t)size.area();
+		m_num.resize(area);
+		m_den.resize(area);
+		m_weightY.resize(area);
+		m_edgeX.resize(area);
+		m_edgeY.resize(area);
+		m_nearValue.resize(size.width);
+		m_nearDistance.resize(size.width);
+	}
+	if (size.area() == 0)
+	{
+		depth.copyTo(filtered);
+		return;
+	}
+	const int tiles = (size.height + SPATIAL_TILE_ROWS - 1) / SPATIAL_TILE_ROWS;
+	const int stripes = (size.width + SPATIAL_STRIPE_COLS - 1) / SPATIAL_STRIPE_COLS;
+
+	// A guide of another size can't line up with the depth
+	const cv::Mat guide = (left.type() == CV_8UC4 && left.size() == size) ? left : cv::Mat();
+	SpatialPrepareBody prepare(depth, guide, &m_num[0], &m_den[0], &m_edgeX[0], &m_edgeY[0]);
+	cv::parallel_for_(cv::Range(0, size.height), prepare, tiles);
+
+	ColumnFunc column = columnScalarAll;
+	OutputFunc output = outputScalarAll;
+#ifdef SPATIAL_X86
+	if (isa == KERNEL_AVX2)
+	{
+		column = columnAVX2;
+		output = outputAVX2;
+	}
+	else if (isa == KERNEL_SSE2)
+	{
+		column = columnSSE2;
+		output = outputSSE2;
+	}
+#endif
+
+	// Each iteration halves the reach of the one before, as in the paper
+	const int iterations = m_params.iterations;
+	const double ratio = m_params.sigmaSpatial / m_params.sigmaColor;
+	m_lut.resize(SPATIAL_MAX_EDGE + 1);
+	for (int i = 0; i < iterations; i++)
+	{
+		double sigma = m_params.sigmaSpatial * sqrt(3.0) * pow(2.0, iterations - i - 1) / sqrt(pow(4.0, iterations) - 1.0);
+		double a = exp(-sqrt(2.0) / sigma);
+		for (int e = 0; e <= SPATIAL_MAX_EDGE; e++)
+			m_lut[e] = (float)pow(a, 1.0 + ratio * e);
+
+		SpatialRowBody rows(size.width, &m_num[0], &m_den[0], &m_edgeX[0], &m_edgeY[0], &m_lut[0], &m_weightY[0]);
+		cv::parallel_for_(cv::Range(0, size.height), rows, tiles);
+		SpatialColumnBody columns(size, &m_num[0], &m_den[0], &m_weightY[0], column);
+		cv::parallel_for_(cv::Range(0, stripes), columns, stripes);
+	}
+
+	filtered.create(size, CV_32FC1);
+	SpatialMapping m;
+	m.minWeight = SPATIAL_MIN_WEIGHT;
+	m.smooth = m_params.smooth;
+	SpatialOutputBody out(depth, &m_num[0], &m_den[0], filtered, m, output);
+	cv::parallel_for_(cv::Range(0, size.height), out, tiles);
+
+	if (m_params.holeRadius > 0)
+	{
+		SpatialInpaintRowBody inpaintRows(filtered, m_params.holeRadius);
+		cv::parallel_for_(cv::Range(0, size.height), inpaintRows, tiles);
+		// The weighted depth is spent, its plane holds the candidates from above
+		SpatialInpaintColumnBody inpaintColumns(filtered, &m_num[0], &m_nearValue[0], &m_nearDistance[0], m_params.holeRadius);
+		cv::parallel_for_(cv::Range(0, stripes), inpaintColumns, stripes);
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "opencv2/core.hpp"
+#include "DepthKernels.h"
+
+// How the spatial filter smooths and fills the depth
+struct SpatialFilterParams
+{
+	float sigmaSpatial; // pixels the smoothing reaches along a uniform surface
+	float sigmaColor;   // left image difference, summed over B, G and R, that stops it
+	int iterations;     // domain transform passes, more give cleaner edges
+	int holeRadius;     // pixels a hole still open after the smoothing is inpainted from, 0 disables
+	bool smooth;        // false only fills holes, measured depths go through unchanged
+
+	SpatialFilterParams() : sigmaSpatial(20.0f), sigmaColor(30.0f), iterations(2), holeRadius(16), smooth(true) {}
+};
+
+// "spatial[:color[:radius[:iterations]]]"
+bool parseSpatialFilter(const std::string &text, SpatialFilterParams &params);
+std::string formatSpatialFilter(const SpatialFilterParams &params);
+
+// Edge preserving smoothing and hole filling of CV_32FC1 depth guided by the
+// left image, a CPU stand-in for the ZED FILL mode. A recursive domain
+// transform filter (Gastal and Oliveira) runs over the measured depths and
+// their weights, so the holes (NAN) fill from measures on the same side of a
+// color edge. Holes that stay open are then inpainted along rows and columns
+// from the nearest measures within holeRadius, the farther one when there
+// are two, since holes in stereo depth are mostly occluded background. The
+// infinities are neither smoothed nor filled.
+// Rows and column stripes run on the OpenCV thread pool, the vertical passes
+// and the output are vectorized and every instruction set produces exactly
+// the same floats.
+class SpatialFilter
+{
+public:
+	SpatialFilter();
+	void setParams(const SpatialFilterParams &params);
+	const SpatialFilterParams& params() const { return m_params; }
+	// left (CV_8UC4) may be empty, the depth then smooths without edges. filtered may be depth itself.
+	void apply(const cv::Mat &depth, const cv::Mat &left, cv::Mat &filtered, KernelIsa isa = KERNEL_AUTO);
+private:
+	SpatialFilterParams m_params;
+	cv::Size m_size;
+	// Planes of the frame size, kept between frames
+	std::vector<float> m_num, m_den, m_weightY;
+	std::vector<unsigned short> m_edgeX, m_edgeY; // color difference to the pixel on the left / above
+	std::vector<float> m_lut;                     // edge to recursive weight, for the current iteration
+	std::vector<float> m_nearValue;               // per column, inpainting
+	std::vector<int> m_nearDistance;
+};
@@ -0,0 +1,234 @@
+#include "stdafx.h"
+#include "SpoutFrameEvent.h"
+#include <chrono>
+#ifndef _WIN32
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+static const unsigned int EVENT_MAGIC = 0x54564553; // "SEVT"
+static const int LISTEN_TIMEOUT_MSEC = 100; // how often the listener checks for stop
+
+// The whole segment
+struct SpoutFrameEvent::Shared
+{
+	unsigned int magic;
+	atomic<unsigned int> sequence; // the futex word on Linux
+	atomic<unsigned int> waiters;  // receivers blocked or about to block
+	atomic<unsigned int> closed;
+	atomic<unsigned long long> timestamp;
+	unsigned int reserved[10];
+};
+
+#ifdef _WIN32
+static string semaphoreName(const char* name)
+{
+	return SpoutFrameEvent::segmentName(name) + "_semaphore";
+}
+#else
+static long futex(atomic<unsigned int> &word, int op, unsigned int value, const struct timespec* timeout)
+{
+	// Not FUTEX_PRIVATE_FLAG, the word is shared between processes
+	return syscall(SYS_futex, (unsigned int*)&word, op, value, timeout, NULL, 0);
+}
+#endif
+
+static unsigned long long steadyNanoseconds()
+{
+	return (unsigned long long)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+SpoutFrameEvent::SpoutFrameEvent() : m_shared(NULL), m_bSender(false), m_wakeups(0), m_bListening(false)
+{
+	static_assert(sizeof(Shared) == 64, "the segment is shared between processes");
+#ifdef _WIN32
+	m_hSemaphore = NULL;
+#endif
+}
+
+SpoutFrameEvent::~SpoutFrameEvent()
+{
+	close();
+}
+
+bool SpoutFrameEvent::create(const char* name)
+{
+	close();
+	if (m_memory.Create(segmentName(name).c_str(), sizeof(Shared)) == SPOUT_CREATE_FAILED)
+		return false;
+	m_shared = (Shared*)m_memory.Buffer();
+#ifdef _WIN32
+	m_hSemaphore = CreateSemaphoreA(NULL, 0, 0x7FFFFFFF, semaphoreName(name).c_str());
+	if (!m_hSemaphore)
+	{
+		close();
+		return false;
+	}
+#endif
+	// An earlier sender of the same name leaves its sequence, receivers only look for a change
+	m_shared->closed.store(0);
+	m_shared->magic = EVENT_MAGIC;
+	m_bSender = true;
+	return true;
+}
+
+bool SpoutFrameEvent::open(const char* name)
+{
+	close();
+	if (!m_memory.Open(segmentName(name).c_str()))
+		return false;
+	m_shared = (Shared*)m_memory.Buffer();
+	if (m_shared->magic != EVENT_MAGIC)
+	{
+		close();
+		return false;
+	}
+#ifdef _WIN32
+	m_hSemaphore = OpenSemaphoreA(SEMAPHORE_ALL_ACCESS, FALSE, semaphoreName(name).c_str());
+	if (!m_hSemaphore)
+	{
+		close();
+		return false;
+	}
+#endif
+	return true;
+}
+
+void SpoutFrameEvent::close()
+{
+	stopListening();
+	if (m_shared && m_bSender)
+	{
+		m_shared->closed.store(1);
+		signal();
+	}
+	m_bSender = false;
+#ifdef _WIN32
+	if (m_hSemaphore)
+	{
+		CloseHandle(m_hSemaphore);
+		m_hSemaphore = NULL;
+	}
+#endif
+	m_memory.Close();
+	m_shared = NULL;
+}
+
+void SpoutFrameEvent::signal()
+{
+	if (!m_shared)
+		return;
+	m_shared->timestamp.store(steadyNanoseconds(), memory_order_relaxed);
+	m_shared->sequence.fetch_add(1);
+	// Nobody to wake most of the time : no system call
+	if (m_shared->waiters.load() == 0)
+		return;
+#ifdef _WIN32
+	unsigned int waiters = m_shared->waiters.exchange(0);
+	if (waiters > 0)
+		ReleaseSemaphore(m_hSemaphore, (LONG)waiters, NULL);
+#else
+	futex(m_shared->sequence, FUTEX_WAKE, 0x7FFFFFFF, NULL);
+#endif
+}
+
+unsigned int SpoutFrameEvent::sequence() const
+{
+	return m_shared ? m_shared->sequence.load(memory_order_acquire) : 0;
+}
+
+bool SpoutFrameEvent::senderClosed() const
+{
+	return m_shared ? m_shared->closed.load() != 0 : true;
+}
+
+unsigned int SpoutFrameEvent::waiters() const
+{
+	return m_shared ? m_shared->waiters.load() : 0;
+}
+
+unsigned long long SpoutFrameEvent::timestamp() const
+{
+	return m_shared ? m_shared->timestamp.load(memory_order_relaxed) : 0;
+}
+
+void SpoutFrameEvent::block(unsigned int last, int timeoutMsec)
+{
+	// Counted before the sequence is compared again, so either the sender sees
+	// the waiter or the waiter sees the new sequence
+	m_shared->waiters.fetch_add(1);
+#ifdef _WIN32
+	bool bReleased = m_shared->sequence.load() == last &&
+		WaitForSingleObject(m_hSemaphore, (DWORD)timeoutMsec) == WAIT_OBJECT_0;
+	if (!bReleased)
+	{
+		// Timed out or never waited : off the count again, never below 0. When the
+		// sender already took the count its release includes this waiter, taken
+		// here so it doesn't wake the next wait. One still on its way does once,
+		// and wait() blocks again.
+		unsigned int waiters = m_shared->waiters.load();
+		while (waiters > 0 && !m_shared->waiters.compare_exchange_weak(waiters, waiters - 1))
+			;
+		if (waiters == 0)
+			WaitForSingleObject(m_hSemaphore, 0);
+	}
+#else
+	struct timespec timeout;
+	timeout.tv_sec = timeoutMsec / 1000;
+	timeout.tv_nsec = (timeoutMsec % 1000) * 1000000L;
+	futex(m_shared->sequence, FUTEX_WAIT, last, &timeout);
+	m_shared->waiters.fetch_sub(1);
+#endif
+	m_wakeups.fetch_add(1, memory_order_relaxed);
+}
+
+bool SpoutFrameEvent::wait(unsigned int &last, int timeoutMsec)
+{
+	if (!m_shared)
+		return false;
+	chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::milliseconds(timeoutMsec);
+	for (;;)
+	{
+		unsigned int current = m_shared->sequence.load(memory_order_acquire);
+		if (current != last)
+		{
+			last = current;
+			return true;
+		}
+		int remaining = (int)chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+		if (remaining <= 0)
+			return false;
+		block(last, remaining);
+	}
+}
+
+bool SpoutFrameEvent::listen(Callback callback)
+{
+	stopListening();
+	if (!m_shared)
+		return false;
+	m_callback = callback;
+	m_bListening = true;
+	m_listener = thread(&SpoutFrameEvent::listenLoop, this);
+	return true;
+}
+
+void SpoutFrameEvent::stopListening()
+{
+	m_bListening = false;
+	if (m_listener.joinable())
+		m_listener.join();
+}
+
+void SpoutFrameEvent::listenLoop()
+{
+	unsigned int last = sequence();
+	while (m_bListening)
+	{
+		if (wait(last, LISTEN_TIMEOUT_MSEC))
+			m_callback(last);
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include "Spout/SpoutSharedMemory.h"
+
+// Tells receivers in other processes that a sender published a frame, so
+// they block until there is one instead of checking the sender every render
+// tick. A small shared segment, "<sender>_frame", holds the sequence number
+// of the last frame and when it was sent. On Linux receivers sleep on the
+// sequence itself with a futex; on Windows on a named semaphore the sender
+// releases once per waiting receiver. Frames published while a receiver is
+// busy are coalesced, it wakes once and sees the newest sequence. Closing
+// the sender wakes every receiver too.
+class SpoutFrameEvent
+{
+public:
+	typedef std::function<void(unsigned int sequence)> Callback;
+
+	SpoutFrameEvent();
+	~SpoutFrameEvent();
+
+	// Sender
+	bool create(const char* name);
+	// Receiver, fails while the sender doesn't exist or publishes without events
+	bool open(const char* name);
+	void close();
+	bool isOpen() const { return m_shared != NULL; }
+
+	// Sender : a frame is out
+	void signal();
+
+	// Latest sequence, 0 before the first frame
+	unsigned int sequence() const;
+	// The sender closed, a new one may come : open again
+	bool senderClosed() const;
+	// Steady clock nanoseconds of the latest signal
+	unsigned long long timestamp() const;
+	// Returns true as soon as the sequence differs from last and updates it,
+	// false when timeoutMsec went by without a frame
+	bool wait(unsigned int &last, int timeoutMsec);
+	// Receivers blocked or about to block, of every process
+	unsigned int waiters() const;
+	// Times wait() blocked and came back, woken or timed out
+	unsigned long long wakeups() const { return m_wakeups.load(std::memory_order_relaxed); }
+
+	// Calls back from a thread of its own for every new sequence
+	bool listen(Callback callback);
+	void stopListening();
+
+	static std::string segmentName(const char* name) { return std::string(name) + "_frame"; }
+
+private:
+	SpoutFrameEvent(const SpoutFrameEvent&);
+	SpoutFrameEvent& operator=(const SpoutFrameEvent&);
+
+	struct Shared;
+	void block(unsigned int last, int timeoutMsec);
+	void listenLoop();
+
+	SpoutSharedMemory m_memory;
+	Shared* m_shared;
+	bool m_bSender;
+	std::atomic<unsigned long long> m_wakeups;
+#ifdef _WIN32
+	HANDLE m_hSemaphore;
+#endif
+	Callback m_callback;
+	std::atomic<bool> m_bListening;
+	std::thread m_listener;
+};
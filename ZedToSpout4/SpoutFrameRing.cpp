@@ -0,0 +1,229 @@
+#include "stdafx.h"
+#include "SpoutFrameRing.h"
+#include <string.h>
+#include <iostream>
+using namespace std;
+
+static const unsigned int RING_MAGIC = 0x474E5253; // "SRNG"
+static const unsigned int RING_VERSION = 1;
+static const size_t RING_HEADER = 64;
+static const int READ_ATTEMPTS = 4;
+
+// The first 64 bytes of the segment
+struct SpoutFrameRing::Header
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned int slotCount;
+	unsigned int capacity;
+	unsigned long long slotStride;
+	atomic<unsigned long long> latest; // newest complete frame, 0 before the first
+	atomic<unsigned int> closed;       // set while the writer initializes the ring and once it is gone
+	unsigned int reserved[7];
+};
+
+// Ahead of each payload
+struct SpoutFrameRing::Slot
+{
+	atomic<unsigned long long> sequence; // odd while the writer is in the slot
+	unsigned long long frameId;
+	unsigned long long timestamp;
+	unsigned int size, format, width, height;
+	unsigned int reserved[6];
+};
+
+SpoutFrameRing::SpoutFrameRing()
+	: m_header(NULL), m_slotCount(0), m_capacity(0), m_slotStride(0), m_bWriter(false),
+	m_nextId(1), m_writing(NULL), m_lastId(0)
+{
+	static_assert(sizeof(Header) == RING_HEADER && sizeof(Slot) == SLOT_HEADER, "ring layout is shared between processes");
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+SpoutFrameRing::~SpoutFrameRing()
+{
+	close();
+}
+
+bool SpoutFrameRing::create(const char* name, unsigned int slotCount, unsigned int capacity)
+{
+	close();
+	if (slotCount < 2 || capacity == 0)
+		return false;
+	// Payloads stay 64-byte aligned
+	const size_t stride = SLOT_HEADER + ((size_t)capacity + 63) / 64 * 64;
+	const size_t size = RING_HEADER + stride * slotCount;
+	SpoutCreateResult result = m_memory.Create(segmentName(name).c_str(), (int)size);
+	if (result == SPOUT_CREATE_FAILED)
+		return false;
+	Header* header = (Header*)m_memory.Buffer();
+	if (result == SPOUT_ALREADY_EXISTS)
+	{
+		// Left by an earlier writer : a map keeps the size it was created with
+		if (header->magic != RING_MAGIC || RING_HEADER + header->slotStride * header->slotCount < size)
+		{
+			cout << "Frame ring " << name << " exists with a smaller size" << endl;
+			m_memory.Close();
+			return false;
+		}
+	}
+
+	// Readers keep off until the layout is written
+	header->closed.store(1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	header->version = RING_VERSION;
+	header->slotCount = slotCount;
+	header->capacity = capacity;
+	header->slotStride = stride;
+	header->latest.store(0, memory_order_relaxed);
+	for (unsigned int i = 0; i < slotCount; i++)
+	{
+		Slot* s = (Slot*)((char*)header + RING_HEADER + stride * i);
+		s->sequence.store(0, memory_order_relaxed);
+		s->frameId = 0;
+	}
+	header->magic = RING_MAGIC;
+	header->closed.store(0, memory_order_release);
+
+	m_header = header;
+	m_slotCount = slotCount;
+	m_capacity = capacity;
+	m_slotStride = stride;
+	m_bWriter = true;
+	m_nextId = 1;
+	return true;
+}
+
+bool SpoutFrameRing::open(const char* name)
+{
+	close();
+	if (!m_memory.Open(segmentName(name).c_str()))
+		return false;
+	Header* header = (Header*)m_memory.Buffer();
+	if (header->closed.load(memory_order_acquire) != 0 || header->magic != RING_MAGIC || header->version != RING_VERSION)
+	{
+		m_memory.Close();
+		return false;
+	}
+	m_header = header;
+	m_slotCount = header->slotCount;
+	m_capacity = header->capacity;
+	m_slotStride = (size_t)header->slotStride;
+	m_bWriter = false;
+	m_lastId = 0;
+	memset(&m_stats, 0, sizeof(m_stats));
+	return true;
+}
+
+void SpoutFrameRing::close()
+{
+	if (m_header && m_bWriter)
+		m_header->closed.store(1, memory_order_release);
+	m_memory.Close();
+	m_header = NULL;
+	m_slotCount = 0;
+	m_capacity = 0;
+	m_slotStride = 0;
+	m_bWriter = false;
+	m_writing = NULL;
+}
+
+SpoutFrameRing::Slot* SpoutFrameRing::slot(unsigned long long frameId) const
+{
+	return (Slot*)((char*)m_header + RING_HEADER + m_slotStride * (size_t)(frameId % m_slotCount));
+}
+
+unsigned char* SpoutFrameRing::beginWrite(unsigned int size)
+{
+	if (!m_header || !m_bWriter || size > m_capacity)
+		return NULL;
+	// The sequence goes odd before anything in the slot changes
+	m_writing = slot(m_nextId);
+	m_writing->sequence.store(m_writing->sequence.load(memory_order_relaxed) + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	return payload(m_writing);
+}
+
+void SpoutFrameRing::endWrite(SpoutFrameInfo &info)
+{
+	if (!m_writing)
+		return;
+	info.frameId = m_nextId++;
+	m_writing->frameId = info.frameId;
+	m_writing->timestamp = info.timestamp;
+	m_writing->size = info.size;
+	m_writing->format = info.format;
+	m_writing->width = info.width;
+	m_writing->height = info.height;
+	// Even again once the frame is complete, then it becomes the newest
+	m_writing->sequence.store(m_writing->sequence.load(memory_order_relaxed) + 1, memory_order_release);
+	m_header->latest.store(info.frameId, memory_order_release);
+	m_writing = NULL;
+}
+
+bool SpoutFrameRing::write(const void* data, SpoutFrameInfo &info)
+{
+	unsigned char* p = beginWrite(info.size);
+	if (!p)
+		return false;
+	memcpy(p, data, info.size);
+	endWrite(info);
+	return true;
+}
+
+SpoutFrameRing::ReadResult SpoutFrameRing::read(unsigned char* data, SpoutFrameInfo &info)
+{
+	return readFrame(data, info, false);
+}
+
+SpoutFrameRing::ReadResult SpoutFrameRing::readNext(unsigned char* data, SpoutFrameInfo &info)
+{
+	return readFrame(data, info, true);
+}
+
+SpoutFrameRing::ReadResult SpoutFrameRing::readFrame(unsigned char* data, SpoutFrameInfo &info, bool next)
+{
+	if (!m_header)
+		return RING_CLOSED;
+	for (int attempt = 0; attempt < READ_ATTEMPTS; attempt++)
+	{
+		if (m_header->closed.load(memory_order_acquire) != 0)
+			return RING_CLOSED;
+		unsigned long long id = m_header->latest.load(memory_order_acquire);
+		if (id == 0 || id == m_lastId)
+			return RING_NO_NEW_FRAME;
+		// The slot of the frame after the last one read is only written again
+		// once the writer is a whole ring further
+		if (next && m_lastId != 0 && id > m_lastId && id - m_lastId < m_slotCount)
+			id = m_lastId + 1;
+
+		Slot* s = slot(id);
+		unsigned long long sequence = s->sequence.load(memory_order_acquire);
+		// Odd : the writer has come round to this slot already, the newest is further on
+		if ((sequence & 1) == 0 && s->frameId == id && s->size <= m_capacity)
+		{
+			SpoutFrameInfo copy;
+			copy.frameId = id;
+			copy.timestamp = s->timestamp;
+			copy.size = s->size;
+			copy.format = s->format;
+			copy.width = s->width;
+			copy.height = s->height;
+			memcpy(data, payload(s), copy.size);
+			// Nothing copied may be newer than the sequence read again here
+			atomic_thread_fence(memory_order_acquire);
+			if (s->sequence.load(memory_order_relaxed) == sequence)
+			{
+				if (m_lastId != 0 && id > m_lastId)
+					m_stats.missed += id - m_lastId - 1;
+				m_stats.frames++;
+				m_lastId = id;
+				info = copy;
+				return RING_FRAME;
+			}
+		}
+		m_stats.retries++;
+	}
+	m_stats.overruns++;
+	return RING_OVERRUN;
+}
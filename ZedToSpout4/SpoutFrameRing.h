@@ -0,0 +1,96 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include "Spout/SpoutSharedMemory.h"
+
+// What the writer says about a frame, stored next to it in its slot
+struct SpoutFrameInfo
+{
+	unsigned long long frameId;   // set by the ring, counts from 1
+	unsigned long long timestamp; // the writer's, nanoseconds
+	unsigned int size;            // payload bytes
+	unsigned int format;          // the writer's, for SpoutMemorySender the OpenCV type before packing
+	unsigned int width, height;
+
+	SpoutFrameInfo() : frameId(0), timestamp(0), size(0), format(0), width(0), height(0) {}
+};
+
+// A shared memory segment holding the last few frames of one writer, for
+// readers in other processes. Where the memoryshare map is a single buffer
+// behind a named mutex, here every slot has a sequence number that is odd
+// while the writer is in it (a seqlock) : the writer never waits for a
+// reader, and a reader copies the newest complete frame and then checks the
+// sequence to know the writer didn't come round to that slot meanwhile. A
+// reader too slow to finish a copy before the writer laps the ring tries the
+// new newest frame, and reports an overrun after a few tries.
+//
+// One writer per ring. Closing the writer marks the ring closed, readers then
+// reopen it by name, which is also how a writer changes the slot size.
+class SpoutFrameRing
+{
+public:
+	enum ReadResult
+	{
+		RING_FRAME,        // data and info hold a frame newer than the last one read
+		RING_NO_NEW_FRAME, // nothing published since the last read
+		RING_OVERRUN,      // the writer kept overwriting the frame being copied
+		RING_CLOSED,       // the writer closed the ring, open it again
+	};
+
+	// Counts for a reader
+	struct ReaderStats
+	{
+		unsigned long long frames;  // read
+		unsigned long long missed;  // published between two reads, never read
+		unsigned long long retries; // copies the writer overwrote, read again
+		unsigned long long overruns;
+	};
+
+	SpoutFrameRing();
+	~SpoutFrameRing();
+
+	// Writer : slotCount frames of up to capacity bytes
+	bool create(const char* name, unsigned int slotCount, unsigned int capacity);
+	// Reader, fails until the writer has created the ring
+	bool open(const char* name);
+	void close();
+	bool isOpen() const { return m_header != NULL; }
+	unsigned int capacity() const { return m_capacity; }
+	unsigned int slotCount() const { return m_slotCount; }
+
+	// Writer : the payload of the next slot, at least size bytes, filled in
+	// place and then published by endWrite. info.frameId is set there.
+	unsigned char* beginWrite(unsigned int size);
+	void endWrite(SpoutFrameInfo &info);
+	bool write(const void* data, SpoutFrameInfo &info);
+
+	// Reader : copies the newest frame into data, capacity() bytes
+	ReadResult read(unsigned char* data, SpoutFrameInfo &info);
+	// Reader : the frame after the last one read while the ring still has it,
+	// else the newest, for readers that need every frame
+	ReadResult readNext(unsigned char* data, SpoutFrameInfo &info);
+	const ReaderStats& readerStats() const { return m_stats; }
+
+	static std::string segmentName(const char* name) { return std::string(name) + "_ring"; }
+
+private:
+	SpoutFrameRing(const SpoutFrameRing&);
+	SpoutFrameRing& operator=(const SpoutFrameRing&);
+
+	struct Header;
+	struct Slot;
+	Slot* slot(unsigned long long frameId) const;
+	ReadResult readFrame(unsigned char* data, SpoutFrameInfo &info, bool next);
+	static unsigned char* payload(Slot* s) { return (unsigned char*)s + SLOT_HEADER; }
+	static const size_t SLOT_HEADER = 64;
+
+	SpoutSharedMemory m_memory;
+	Header* m_header;
+	unsigned int m_slotCount, m_capacity;
+	size_t m_slotStride;
+	bool m_bWriter;
+	unsigned long long m_nextId; // writer
+	Slot* m_writing;             // writer, between beginWrite and endWrite
+	unsigned long long m_lastId; // reader
+	ReaderStats m_stats;
+};
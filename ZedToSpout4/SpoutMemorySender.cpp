@@ -0,0 +1,258 @@
+#include "stdafx.h"
+#include "SpoutMemorySender.h"
+#include <string.h>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#ifdef _WIN32
+#include "Spout/SpoutCopy.h"
+
+// The AVX2 and row band conversions of the SpoutCopy compiled into the application
+static spoutCopy s_copy;
+#endif
+using namespace std;
+
+SpoutMemorySender::SpoutMemorySender()
+{
+	m_ringSlots = 0;
+	m_iWidth = 0;
+	m_iHeight = 0;
+}
+
+SpoutMemorySender::~SpoutMemorySender()
+{
+	release();
+}
+
+bool SpoutMemorySender::create(const char* name, unsigned int width, unsigned int height, unsigned int ringSlots)
+{
+	m_name = name;
+	m_ringSlots = ringSlots;
+	if (ringSlots > 0)
+	{
+		if (!m_ring.create(name, ringSlots, width * height * 4))
+		{
+			cout << "Error creating the frame ring for " << name << endl;
+			return false;
+		}
+		m_iWidth = width;
+		m_iHeight = height;
+	}
+	else if (!m_memory.CreateSenderMemory(name, width, height))
+	{
+		cout << "Error creating shared memory for " << name << endl;
+		return false;
+	}
+	// Receivers fall back to polling without it
+	if (!m_event.create(name))
+		cout << "Error creating the frame event for " << name << endl;
+	m_iWidth = width;
+	m_iHeight = height;
+	return true;
+}
+
+void SpoutMemorySender::release()
+{
+	m_event.close();
+	m_ring.close();
+	m_memory.ReleaseSenderMemory();
+	m_iWidth = 0;
+	m_iHeight = 0;
+}
+
+bool SpoutMemorySender::send(const cv::Mat &image, bool bInvert)
+{
+	// Four float channels go out as a float map four times as wide
+	const cv::Mat camFrame = image.type() == CV_32FC4 ? image.reshape(1) : image;
+	int type = camFrame.type();
+	if (camFrame.empty() || (camFrame.depth() != CV_8U && type != CV_16UC1 && type != CV_32FC1))
+		return false;
+
+	if (m_ringSlots > 0)
+	{
+		SpoutFrameInfo info;
+		info.size = camFrame.cols * camFrame.rows * 4;
+		if (info.size > m_ring.capacity() && !m_ring.create(m_name.c_str(), m_ringSlots, info.size))
+			return false;
+		unsigned char* pSlot = m_ring.beginWrite(info.size);
+		if (!pSlot)
+			return false;
+		writeRGBA(camFrame, pSlot, bInvert);
+		info.timestamp = (unsigned long long)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+		info.format = image.type();
+		info.width = camFrame.cols;
+		info.height = camFrame.rows;
+		m_ring.endWrite(info);
+		m_event.signal();
+		return true;
+	}
+
+	// Only the sender can resize the map
+	if ((unsigned int)camFrame.cols != m_iWidth || (unsigned int)camFrame.rows != m_iHeight)
+	{
+		if (!m_memory.UpdateSenderMemorySize(m_name.c_str(), camFrame.cols, camFrame.rows))
+			return false;
+		m_iWidth = camFrame.cols;
+		m_iHeight = camFrame.rows;
+	}
+
+	unsigned char* pBuffer = m_memory.LockSenderMemory();
+	if (!pBuffer)
+		return false;
+	writeRGBA(camFrame, pBuffer, bInvert);
+	m_memory.UnlockSenderMemory();
+	m_event.signal();
+	return true;
+}
+
+void SpoutMemorySender::writeRGBA(const cv::Mat &src, unsigned char* dst, bool bInvert)
+{
+	const int width = src.cols;
+	const int type = src.type();
+#ifdef _WIN32
+	// The SSE fallbacks load whole aligned vectors
+	if (src.isContinuous() && (((size_t)src.data | (size_t)dst) & 15) == 0)
+	{
+		// Same words as the loops below
+		void* data = (void*)src.data;
+		if (type == CV_8UC3)
+		{
+			s_copy.bgr2rgba(data, dst, width, src.rows, bInvert);
+			return;
+		}
+		if (type == CV_8UC4)
+		{
+			s_copy.bgra2rgba(data, dst, width, src.rows, bInvert);
+			return;
+		}
+		if (type == CV_32FC1)
+		{
+			s_copy.CopyPixels(src.data, dst, width, src.rows, GL_RGBA, bInvert);
+			return;
+		}
+	}
+#endif
+	for (int y = 0; y < src.rows; y++)
+	{
+		const unsigned char* in = src.ptr(bInvert ? src.rows - 1 - y : y);
+		unsigned int* out = (unsigned int*)(dst + (size_t)y * width * 4);
+		if (type == CV_16UC1)
+		{
+			// Low byte in R, high byte in G
+			const unsigned short* in16 = (const unsigned short*)in;
+			for (int x = 0; x < width; x++)
+				out[x] = in16[x] | 0xFF000000u;
+			continue;
+		}
+		if (type == CV_32FC1)
+		{
+			// The float bits as they are
+			memcpy(out, in, (size_t)width * 4);
+			continue;
+		}
+		// Pixels are written as whole words, RGBA in memory order on little endian
+		switch (src.channels())
+		{
+		case 1:
+			for (int x = 0; x < width; x++)
+				out[x] = in[x] * 0x00010101u | 0xFF000000u;
+			break;
+		case 3:
+			for (int x = 0; x < width; x++, in += 3)
+				out[x] = in[2] | (in[1] << 8) | (in[0] << 16) | 0xFF000000u;
+			break;
+		case 4:
+			for (int x = 0; x < width; x++, in += 4)
+				out[x] = in[2] | (in[1] << 8) | (in[0] << 16) | ((unsigned int)in[3] << 24);
+			break;
+		}
+	}
+}
+
+SpoutMemoryReceiver::SpoutMemoryReceiver()
+{
+	m_sequence = 0;
+	m_iWidth = 0;
+	m_iHeight = 0;
+}
+
+bool SpoutMemoryReceiver::open(const char* name, unsigned int width, unsigned int height)
+{
+	// The memoryshare map carries no size header, so the caller provides it
+	if (!m_memory.OpenSenderMemory(name))
+		return false;
+	m_name = name;
+	if (m_event.open(name))
+		m_sequence = m_event.sequence();
+	m_iWidth = width;
+	m_iHeight = height;
+	return true;
+}
+
+bool SpoutMemoryReceiver::openRing(const char* name)
+{
+	if (!m_ring.open(name))
+		return false;
+	m_ringName = name;
+	m_name = name;
+	if (m_event.open(name))
+		m_sequence = m_event.sequence();
+	m_frame.create(1, m_ring.capacity(), CV_8UC1);
+	return true;
+}
+
+bool SpoutMemoryReceiver::receive(cv::Mat &img)
+{
+	if (!m_ringName.empty())
+	{
+		SpoutFrameInfo info;
+		SpoutFrameRing::ReadResult result = m_ring.read(m_frame.data, info);
+		if (result == SpoutFrameRing::RING_CLOSED)
+		{
+			// The sender went away or resized, the stats start again with the new ring
+			if (m_ring.open(m_ringName.c_str()) && (int)m_ring.capacity() > m_frame.cols)
+				m_frame.create(1, m_ring.capacity(), CV_8UC1);
+			return false;
+		}
+		if (result != SpoutFrameRing::RING_FRAME || info.size < info.width * info.height * 4)
+			return false;
+		img = cv::Mat(info.height, info.width, CV_8UC4, m_frame.data);
+		return true;
+	}
+	if (m_iWidth == 0 || m_iHeight == 0)
+		return false;
+	unsigned char* pBuffer = m_memory.LockSenderMemory();
+	if (!pBuffer)
+		return false;
+	img.create(m_iHeight, m_iWidth, CV_8UC4);
+	memcpy(img.data, pBuffer, (size_t)m_iWidth * m_iHeight * 4);
+	m_memory.UnlockSenderMemory();
+	return true;
+}
+
+bool SpoutMemoryReceiver::waitFrame(int timeoutMsec)
+{
+	if (!m_event.isOpen() || m_event.senderClosed())
+	{
+		// A sender restarting makes a new event, one that never had any is polled
+		if (m_name.empty() || !m_event.open(m_name.c_str()))
+		{
+			this_thread::sleep_for(chrono::milliseconds(timeoutMsec));
+			return true;
+		}
+		// Whatever it sent before the receiver came back counts as new
+		m_sequence = 0;
+	}
+	return m_event.wait(m_sequence, timeoutMsec);
+}
+
+void SpoutMemoryReceiver::release()
+{
+	m_event.close();
+	m_name.clear();
+	m_ring.close();
+	m_ringName.clear();
+	m_memory.ReleaseSenderMemory();
+	m_iWidth = 0;
+	m_iHeight = 0;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <string>
+#include "opencv2/core.hpp"
+#include "Spout/SpoutMemoryShare.h"
+#include "SpoutFrameRing.h"
+#include "SpoutFrameEvent.h"
+
+// Publishes frames through the Spout memoryshare map without any OpenGL.
+// The map holds width*height RGBA pixels; the vertical flip and the
+// expansion from gray / BGR / BGRA to RGBA are done in a single pass
+// straight into the shared buffer. 16-bit and float frames are packed
+// into the four bytes of each pixel as described in DepthEncoding.h.
+//
+// With ringSlots the frames go to a SpoutFrameRing of that many slots
+// instead of the map, so receivers never hold up the sender. A frame larger
+// than the slots makes a new ring, which fails on Windows while a reader
+// still has the old one open. Either way every frame sent is signaled
+// through a SpoutFrameEvent of the same name.
+class SpoutMemorySender
+{
+public:
+	SpoutMemorySender();
+	~SpoutMemorySender();
+	bool create(const char* name, unsigned int width, unsigned int height, unsigned int ringSlots = 0);
+	// image must be CV_8UC1, CV_8UC3 (BGR), CV_8UC4 (BGRA), CV_16UC1, CV_32FC1 or
+	// CV_32FC4, sent as CV_32FC1 four times as wide. bInvert false for frames
+	// whose rows are already bottom-up.
+	bool send(const cv::Mat &image, bool bInvert = true);
+	void release();
+
+	// Fused flip + channel expansion / packing into an RGBA destination of the same size
+	static void writeRGBA(const cv::Mat &src, unsigned char* dst, bool bInvert);
+private:
+	spoutMemoryShare m_memory;
+	SpoutFrameRing m_ring;
+	unsigned int m_ringSlots;
+	SpoutFrameEvent m_event;
+	std::string m_name;
+	unsigned int m_iWidth, m_iHeight;
+};
+
+// Reads back a memoryshare sender, mostly for checking the sender side without Spout apps
+class SpoutMemoryReceiver
+{
+public:
+	SpoutMemoryReceiver();
+	bool open(const char* name, unsigned int width, unsigned int height);
+	// The frame ring of a sender created with ringSlots, frames carry their size
+	bool openRing(const char* name);
+	// Fills img with the current RGBA frame, returns false if the map is not available.
+	// From a ring img is the newest frame, valid until the next call, and false
+	// means no new frame or a ring being replaced.
+	bool receive(cv::Mat &img);
+	// Blocks until the sender signals a frame not received yet, false after
+	// timeoutMsec. Senders without events are polled : true after timeoutMsec.
+	bool waitFrame(int timeoutMsec);
+	// Steady clock nanoseconds when the sender signaled its latest frame, 0 without events
+	unsigned long long frameTimestamp() const { return m_event.timestamp(); }
+	void release();
+	const SpoutFrameRing::ReaderStats* ringStats() const { return m_ring.isOpen() ? &m_ring.readerStats() : NULL; }
+private:
+	spoutMemoryShare m_memory;
+	SpoutFrameRing m_ring;
+	std::string m_ringName;
+	std::string m_name;
+	SpoutFrameEvent m_event;
+	unsigned int m_sequence; // last frame waited for
+	cv::Mat m_frame; // ring frames are read into it
+	unsigned int m_iWidth, m_iHeight;
+};
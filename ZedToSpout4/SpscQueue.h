@@ -0,0 +1,80 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+// Bounded lock-free queue for one producer thread and one consumer thread.
+// Elements must be cheap to copy (frame pointers, indices). The head moves
+// with a compare-exchange, so besides the consumer the producer may also
+// pop the oldest element, which is what the drop-oldest policy relies on.
+template <typename T>
+class SpscQueue
+{
+public:
+	explicit SpscQueue(size_t capacity)
+		: m_slots(capacity + 1), m_head(0), m_tail(0)
+	{
+	}
+
+	size_t capacity() const { return m_slots.size() - 1; }
+
+	size_t size() const
+	{
+		return (size_t)(m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire));
+	}
+
+	// Producer only
+	bool push(const T &value)
+	{
+		unsigned long long tail = m_tail.load(std::memory_order_relaxed);
+		if (tail - m_head.load(std::memory_order_acquire) >= capacity())
+			return false;
+		m_slots[tail % m_slots.size()].store(value, std::memory_order_relaxed);
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer, or the producer when discarding the oldest element
+	bool pop(T &value)
+	{
+		unsigned long long head = m_head.load(std::memory_order_acquire);
+		for (;;)
+		{
+			if (head == m_tail.load(std::memory_order_acquire))
+				return false;
+			value = m_slots[head % m_slots.size()].load(std::memory_order_relaxed);
+			if (m_head.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+				return true;
+		}
+	}
+
+	// Spins briefly, then backs off to 1 msec sleeps until timeoutMs has passed
+	bool popWait(T &value, int timeoutMs)
+	{
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+		for (int spin = 0;; spin++)
+		{
+			if (pop(value))
+				return true;
+			if (std::chrono::steady_clock::now() >= deadline)
+				return false;
+			if (spin < 64)
+				std::this_thread::yield();
+			else
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+private:
+	SpscQueue(const SpscQueue&);
+	SpscQueue& operator=(const SpscQueue&);
+
+	std::vector<std::atomic<T> > m_slots;
+	// Kept on separate cache lines so producer and consumer don't false share
+	char m_pad0[64];
+	std::atomic<unsigned long long> m_head;
+	char m_pad1[64];
+	std::atomic<unsigned long long> m_tail;
+	char m_pad2[64];
+};
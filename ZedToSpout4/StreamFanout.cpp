@@ -0,0 +1,313 @@
+#include "stdafx.h"
+#include "StreamFanout.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include "opencv2/imgproc.hpp"
+#include "Opencv2Opengl.h"
+#include "DepthEncoding.h"
+using namespace std;
+
+static const char* FANOUT_NAMES[FANOUT_KIND_COUNT] = {
+	"left", "right", "confidence", "overlay", "difference", "sbs", "anaglyph", "cloud"
+};
+
+// retrieveView ids, the ZED SIDE values then LAST_SIDE + VIEW_MODE as the view window numbers them
+static const int FANOUT_VIEW_IDS[FANOUT_KIND_COUNT] = { 0, 1, -1, 11, 9, 10, 8, -1 };
+
+// Kinds the process stage converts rather than the capture stage copying them
+static bool isConverted(FanoutKind kind)
+{
+	return kind == FANOUT_CONFIDENCE || kind == FANOUT_DIFFERENCE || kind == FANOUT_CLOUD;
+}
+
+static string lowerCase(const string &text)
+{
+	string lower;
+	for (size_t i = 0; i < text.size(); i++)
+		lower += (char)tolower((unsigned char)text[i]);
+	return lower;
+}
+
+const char* fanoutKindName(FanoutKind kind)
+{
+	return FANOUT_NAMES[kind];
+}
+
+bool parseFanoutStream(const string &text, FanoutStreamSpec &spec)
+{
+	size_t equals = text.find('=');
+	string kind = lowerCase(text.substr(0, equals));
+	spec.sender = equals == string::npos ? string() : text.substr(equals + 1);
+	if (equals != string::npos && spec.sender.empty())
+		return false;
+
+	spec.divisor = 1;
+	size_t colon = kind.find(':');
+	if (colon != string::npos)
+	{
+		const char* p = kind.c_str() + colon + 1;
+		char* end;
+		long divisor = strtol(p, &end, 10);
+		if (end == p || *end != '\0' || divisor < 1)
+			return false;
+		spec.divisor = (int)divisor;
+		kind.erase(colon);
+	}
+
+	for (int i = 0; i < FANOUT_KIND_COUNT; i++)
+	{
+		if (kind == FANOUT_NAMES[i])
+		{
+			spec.kind = (FanoutKind)i;
+			if (spec.sender.empty())
+				spec.sender = string("opencv2Spout_") + FANOUT_NAMES[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+StreamFanout::StreamFanout() : m_frameCount(0), m_bMemoryShare(false)
+{
+}
+
+StreamFanout::~StreamFanout()
+{
+	for (size_t i = 0; i < m_streams.size(); i++)
+		delete m_streams[i].sender;
+}
+
+bool StreamFanout::add(const FanoutStreamSpec &spec)
+{
+	if (m_streams.size() >= MAX_PIPELINE_OUTPUTS || spec.sender == "opencv2Spout")
+		return false;
+	for (size_t i = 0; i < m_streams.size(); i++)
+		if (m_streams[i].spec.sender == spec.sender)
+			return false;
+	Stream stream;
+	stream.spec = spec;
+	stream.viewID = FANOUT_VIEW_IDS[spec.kind];
+	stream.sender = NULL;
+	m_streams.push_back(stream);
+	return true;
+}
+
+void StreamFanout::setPointCloud(const CameraIntrinsics &intrinsics, const PointCloudParams &params)
+{
+	m_projector.setIntrinsics(intrinsics);
+	m_cloudParams = params;
+}
+
+void StreamFanout::print(ostream &out) const
+{
+	for (size_t i = 0; i < m_streams.size(); i++)
+	{
+		const FanoutStreamSpec &spec = m_streams[i].spec;
+		out << "  " << spec.sender << " : " << FANOUT_NAMES[spec.kind];
+		if (spec.divisor > 1)
+			out << ", 1 frame in " << spec.divisor;
+		out << endl;
+	}
+}
+
+int StreamFanout::dueTwin(unsigned int due, size_t index) const
+{
+	for (size_t j = 0; j < index; j++)
+		if ((due & (1 << j)) && m_streams[j].spec.kind == m_streams[index].spec.kind)
+			return (int)j;
+	return -1;
+}
+
+unsigned int StreamFanout::beginFrame(PipelineFrame &frame)
+{
+	unsigned int streams = 0;
+	frame.outputsDue = 0;
+	for (size_t i = 0; i < m_streams.size(); i++)
+	{
+		// Outputs may share buffers with the frame, never write into them in place
+		frame.outputs[i].release();
+		if (m_frameCount % m_streams[i].spec.divisor != 0)
+			continue;
+		frame.outputsDue |= 1 << i;
+		if (m_streams[i].spec.kind == FANOUT_LEFT)
+			streams |= FRAME_LEFT;
+		else if (m_streams[i].spec.kind == FANOUT_CONFIDENCE)
+			streams |= FRAME_CONFIDENCE;
+		else if (m_streams[i].spec.kind == FANOUT_CLOUD)
+		{
+			streams |= FRAME_DEPTH;
+			if (m_cloudParams.color)
+				streams |= FRAME_LEFT;
+			if (m_cloudParams.confidenceThreshold < 100)
+				streams |= FRAME_CONFIDENCE;
+		}
+	}
+	return streams;
+}
+
+void StreamFanout::capture(PipelineFrame &frame, FrameSource &source)
+{
+	m_frameCount++;
+	for (size_t i = 0; i < m_streams.size(); i++)
+	{
+		if (!(frame.outputsDue & (1 << i)))
+			continue;
+		FanoutKind kind = m_streams[i].spec.kind;
+		cv::Mat &out = frame.outputs[i];
+		int twin = dueTwin(frame.outputsDue, i);
+		bool bCaptured = true;
+		// Converted by process
+		if (kind == FANOUT_CONFIDENCE)
+			bCaptured = !frame.source.confidence.empty();
+		else if (kind == FANOUT_CLOUD)
+			bCaptured = !frame.source.depth.empty();
+		else if (twin >= 0)
+		{
+			// Difference twins take the converted image in process
+			if (kind != FANOUT_DIFFERENCE)
+				out = frame.outputs[twin];
+		}
+		else if (kind == FANOUT_LEFT && !frame.source.left.empty())
+			out = frame.source.left;
+		else
+			bCaptured = source.retrieveView(m_streams[i].viewID, out);
+		// Sources without view modes have nothing to send for the other kinds
+		if (!bCaptured)
+			frame.outputsDue &= ~(1 << i);
+	}
+}
+
+bool StreamFanout::sharedView(const PipelineFrame &frame, int viewID, cv::Mat &view) const
+{
+	for (size_t i = 0; i < m_streams.size(); i++)
+	{
+		// Difference is replaced by its gray conversion, but the BGRA capture stays valid
+		if ((frame.outputsDue & (1 << i)) && m_streams[i].viewID == viewID && !frame.outputs[i].empty())
+		{
+			view = frame.outputs[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+void StreamFanout::convert(PipelineFrame &frame, int index)
+{
+	cv::Mat &out = frame.outputs[index];
+	switch (m_streams[index].spec.kind)
+	{
+	case FANOUT_CONFIDENCE:
+		frame.source.confidence.convertTo(out, CV_8U, 2.55);
+		break;
+	case FANOUT_DIFFERENCE:
+		// New buffer, the view window may share the BGRA capture
+		cv::cvtColor(out, out, cv::COLOR_BGRA2GRAY);
+		break;
+	case FANOUT_CLOUD:
+		m_projector.project(frame.depth(), frame.source.left, frame.source.confidence, m_cloudParams, m_cloud);
+		if (m_cloudParams.voxelMm > 0.0f)
+		{
+			m_voxels.filter(m_cloud, m_cloudParams.voxelMm, m_decimated);
+			pointCloudToTexture(m_decimated, frame.source.depth.size(), out);
+		}
+		else
+			pointCloudToTexture(m_cloud, frame.source.depth.size(), out);
+		break;
+	default:
+		break;
+	}
+}
+
+// One stream per call, OpenCV hands the streams to its worker threads
+class FanoutConvertBody : public cv::ParallelLoopBody
+{
+public:
+	FanoutConvertBody(StreamFanout &fanout, PipelineFrame &frame, const int* jobs)
+		: m_fanout(fanout), m_frame(frame), m_jobs(jobs) {}
+
+	void operator()(const cv::Range &range) const
+	{
+		for (int j = range.start; j < range.end; j++)
+			m_fanout.convert(m_frame, m_jobs[j]);
+	}
+private:
+	StreamFanout &m_fanout;
+	PipelineFrame &m_frame;
+	const int* m_jobs;
+};
+
+void StreamFanout::process(PipelineFrame &frame)
+{
+	int jobs[MAX_PIPELINE_OUTPUTS], twins[MAX_PIPELINE_OUTPUTS];
+	int jobCount = 0, twinCount = 0;
+	for (size_t i = 0; i < m_streams.size(); i++)
+	{
+		if (!(frame.outputsDue & (1 << i)) || !isConverted(m_streams[i].spec.kind))
+			continue;
+		if (dueTwin(frame.outputsDue, i) >= 0)
+			twins[twinCount++] = (int)i;
+		else
+			jobs[jobCount++] = (int)i;
+	}
+	if (jobCount > 0)
+	{
+		FanoutConvertBody body(*this, frame, jobs);
+		cv::parallel_for_(cv::Range(0, jobCount), body, jobCount);
+	}
+	// A second sender of the same kind sends the same converted image
+	for (int t = 0; t < twinCount; t++)
+		frame.outputs[twins[t]] = frame.outputs[dueTwin(frame.outputsDue, twins[t])];
+}
+
+void StreamFanout::createSenders(int argc, char **argv, cv::Size size, bool memoryShare)
+{
+	m_bMemoryShare = memoryShare;
+	for (size_t i = 0; i < m_streams.size(); i++)
+	{
+		// Positions keep their float precision in the shared texture, like the r32f_m depth
+		unsigned int dxFormat = m_streams[i].spec.kind == FANOUT_CLOUD ? depthEncodingDXFormat(DEPTH_R32F_M) : 0;
+		m_streams[i].sender = new Opencv2Spout(argc, argv, size.width, size.height, false, memoryShare, dxFormat, m_streams[i].spec.sender.c_str());
+	}
+}
+
+// One sender per call; only used for memoryshare senders, GL ones share the publish thread's context
+class FanoutPublishBody : public cv::ParallelLoopBody
+{
+public:
+	FanoutPublishBody(PipelineFrame &frame, Opencv2Spout* const* senders, const int* due)
+		: m_frame(frame), m_senders(senders), m_due(due) {}
+
+	void operator()(const cv::Range &range) const
+	{
+		for (int j = range.start; j < range.end; j++)
+			m_senders[m_due[j]]->draw(m_frame.outputs[m_due[j]], false, false);
+	}
+private:
+	PipelineFrame &m_frame;
+	Opencv2Spout* const* m_senders;
+	const int* m_due;
+};
+
+void StreamFanout::publish(PipelineFrame &frame)
+{
+	Opencv2Spout* senders[MAX_PIPELINE_OUTPUTS];
+	int due[MAX_PIPELINE_OUTPUTS];
+	int dueCount = 0;
+	for (size_t i = 0; i < m_streams.size(); i++)
+	{
+		senders[i] = m_streams[i].sender;
+		if ((frame.outputsDue & (1 << i)) && senders[i] && !frame.outputs[i].empty())
+			due[dueCount++] = (int)i;
+	}
+	if (dueCount == 0)
+		return;
+	if (m_bMemoryShare)
+	{
+		FanoutPublishBody body(frame, senders, due);
+		cv::parallel_for_(cv::Range(0, dueCount), body, dueCount);
+		return;
+	}
+	// Captured images are top-down, the upload flips them on the way
+	for (int j = 0; j < dueCount; j++)
+		senders[due[j]]->draw(frame.outputs[due[j]], false, false);
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include <vector>
+#include "opencv2/core.hpp"
+#include "FrameSource.h"
+#include "FramePipeline.h"
+#include "PointCloud.h"
+
+class Opencv2Spout;
+
+// Images that can be published next to the depth, each under its own sender
+enum FanoutKind
+{
+	FANOUT_LEFT,
+	FANOUT_RIGHT,
+	FANOUT_CONFIDENCE, // 0-255 gray
+	FANOUT_OVERLAY,
+	FANOUT_DIFFERENCE, // gray, sent single channel
+	FANOUT_SIDE_BY_SIDE,
+	FANOUT_ANAGLYPH,
+	FANOUT_CLOUD,      // point cloud positions, CV_32FC4 (see pointCloudToTexture)
+	FANOUT_KIND_COUNT
+};
+
+struct FanoutStreamSpec
+{
+	FanoutKind kind;
+	int divisor;        // published every divisor-th captured frame
+	std::string sender; // Spout sender name
+};
+
+const char* fanoutKindName(FanoutKind kind);
+// "kind[:divisor][=sender]", the sender defaults to opencv2Spout_<kind>
+bool parseFanoutStream(const std::string &text, FanoutStreamSpec &spec);
+
+// Publishes extra streams from the grab that produced the depth frame. The
+// capture stage picks the streams due on each frame and copies out what the
+// next grab would replace; images already in the frame (the left image, the
+// view window image) are shared, not copied. The process stage runs the
+// conversions of all due streams at once on OpenCV's worker threads, and the
+// publish stage sends them, in parallel too in memoryshare mode where no GL
+// context is involved.
+class StreamFanout
+{
+public:
+	StreamFanout();
+	~StreamFanout();
+	// false when the sender name is taken or there are MAX_PIPELINE_OUTPUTS streams already
+	bool add(const FanoutStreamSpec &spec);
+	bool empty() const { return m_streams.empty(); }
+	// How cloud streams are built, set before the pipeline starts
+	void setPointCloud(const CameraIntrinsics &intrinsics, const PointCloudParams &params);
+	void print(std::ostream &out) const;
+
+	// Capture thread, before the grab : picks the streams due on this frame
+	// and returns the FrameStream mask they need from the source
+	unsigned int beginFrame(PipelineFrame &frame);
+	// Capture thread, after the grab
+	void capture(PipelineFrame &frame, FrameSource &source);
+	// Shares the image captured for a view mode, false when no due stream has it
+	bool sharedView(const PipelineFrame &frame, int viewID, cv::Mat &view) const;
+
+	// Process thread
+	void process(PipelineFrame &frame);
+
+	// Publish thread : the senders are created here, after the main sender made the GL context
+	void createSenders(int argc, char **argv, cv::Size size, bool memoryShare);
+	void publish(PipelineFrame &frame);
+private:
+	struct Stream
+	{
+		FanoutStreamSpec spec;
+		int viewID; // FrameSource::retrieveView id, -1 when not a view
+		Opencv2Spout* sender;
+	};
+	StreamFanout(const StreamFanout&);
+	StreamFanout& operator=(const StreamFanout&);
+	// Earlier stream of the same kind due on the frame, whose image is shared; -1 if none
+	int dueTwin(unsigned int due, size_t index) const;
+	// Process thread, may run for several streams at once
+	void convert(PipelineFrame &frame, int index);
+	friend class FanoutConvertBody;
+
+	std::vector<Stream> m_streams;
+	unsigned long long m_frameCount; // capture thread only
+	bool m_bMemoryShare;
+
+	// Only the first due cloud stream converts, the others share its texture
+	PointCloudProjector m_projector;
+	PointCloudParams m_cloudParams;
+	PointCloud m_cloud, m_decimated;
+	VoxelGrid m_voxels;
+};
@@ -0,0 +1,248 @@
+#include "stdafx.h"
+#include "Telemetry.h"
+#include <iomanip>
+#include <string.h>
+using namespace std;
+
+static const char* METRIC_NAMES[METRIC_COUNT] = {
+	"capture", "grab", "record", "process", "publish", "latency", "frame_age", "preview"
+};
+
+const char* telemetryMetricName(TelemetryMetric metric)
+{
+	return METRIC_NAMES[metric];
+}
+
+static double wallClockSeconds()
+{
+	return chrono::duration<double>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+//
+// Histograms
+//
+
+HistogramSnapshot::HistogramSnapshot() : count(0), totalNs(0)
+{
+	memset(buckets, 0, sizeof(buckets));
+}
+
+HistogramSnapshot HistogramSnapshot::since(const HistogramSnapshot &prev) const
+{
+	HistogramSnapshot s;
+	s.count = count - prev.count;
+	s.totalNs = totalNs - prev.totalNs;
+	for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+		s.buckets[i] = buckets[i] - prev.buckets[i];
+	return s;
+}
+
+double HistogramSnapshot::percentileMs(double p) const
+{
+	if (count == 0)
+		return 0.0;
+	// Bucket counts are read one by one while samples arrive, so they may not add up to count exactly
+	unsigned long long total = 0;
+	for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+		total += buckets[i];
+	unsigned long long rank = (unsigned long long)(p * total + 0.5);
+	if (rank < 1)
+		rank = 1;
+	unsigned long long seen = 0;
+	for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		seen += buckets[i];
+		if (seen >= rank)
+			return LatencyHistogram::bucketUpperUs(i) / 1e3;
+	}
+	return LatencyHistogram::bucketUpperUs(HISTOGRAM_BUCKETS - 1) / 1e3;
+}
+
+LatencyHistogram::LatencyHistogram() : m_count(0), m_totalNs(0)
+{
+	for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+		m_buckets[i] = 0;
+}
+
+int LatencyHistogram::bucketOf(unsigned long long us)
+{
+	if (us < HISTOGRAM_SUB_BUCKETS)
+		return (int)us;
+	int exponent = 3;
+	while ((us >> exponent) >= 2)
+		exponent++;
+	int bucket = (exponent - 2) * HISTOGRAM_SUB_BUCKETS + (int)((us >> (exponent - 3)) & 7);
+	return bucket < HISTOGRAM_BUCKETS ? bucket : HISTOGRAM_BUCKETS - 1;
+}
+
+unsigned long long LatencyHistogram::bucketUpperUs(int bucket)
+{
+	if (bucket < HISTOGRAM_SUB_BUCKETS)
+		return bucket + 1;
+	int exponent = bucket / HISTOGRAM_SUB_BUCKETS + 2;
+	unsigned long long lower = (unsigned long long)(HISTOGRAM_SUB_BUCKETS + bucket % HISTOGRAM_SUB_BUCKETS) << (exponent - 3);
+	return lower + (1ULL << (exponent - 3));
+}
+
+void LatencyHistogram::add(unsigned long long ns)
+{
+	m_buckets[bucketOf(ns / 1000)].fetch_add(1, memory_order_relaxed);
+	m_totalNs.fetch_add(ns, memory_order_relaxed);
+	m_count.fetch_add(1, memory_order_relaxed);
+}
+
+void LatencyHistogram::snapshot(HistogramSnapshot &s) const
+{
+	s.count = m_count.load(memory_order_relaxed);
+	s.totalNs = m_totalNs.load(memory_order_relaxed);
+	for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+		s.buckets[i] = m_buckets[i].load(memory_order_relaxed);
+}
+
+//
+// Telemetry
+//
+
+Telemetry::Telemetry() : m_start(Clock::now()), m_frames(0), m_drops(0)
+{
+}
+
+#if ZTS_TELEMETRY
+void Telemetry::add(TelemetryMetric metric, Clock::time_point start, Clock::time_point end)
+{
+	m_metrics[metric].add((unsigned long long)chrono::duration_cast<chrono::nanoseconds>(end - start).count());
+}
+#endif
+
+void Telemetry::snapshot(TelemetrySnapshot &s) const
+{
+	s.seconds = chrono::duration<double>(Clock::now() - m_start).count();
+	s.frames = m_frames.load(memory_order_relaxed);
+	s.drops = m_drops.load(memory_order_relaxed);
+	for (int i = 0; i < METRIC_COUNT; i++)
+		m_metrics[i].snapshot(s.metrics[i]);
+}
+
+TelemetrySnapshot TelemetrySnapshot::since(const TelemetrySnapshot &prev) const
+{
+	TelemetrySnapshot s;
+	s.seconds = seconds - prev.seconds;
+	s.frames = frames - prev.frames;
+	s.drops = drops - prev.drops;
+	for (int i = 0; i < METRIC_COUNT; i++)
+		s.metrics[i] = metrics[i].since(prev.metrics[i]);
+	return s;
+}
+
+void TelemetrySnapshot::writeCSVHeader(ostream &out) const
+{
+	out << "time,seconds,metric,count,per_second,mean_ms,p50_ms,p95_ms,p99_ms,max_ms,frames,drops" << endl;
+}
+
+void TelemetrySnapshot::writeCSV(ostream &out, double wallTime) const
+{
+	out << fixed;
+	for (int i = 0; i < METRIC_COUNT; i++)
+	{
+		const HistogramSnapshot &m = metrics[i];
+		out << setprecision(3) << wallTime << "," << seconds << "," << METRIC_NAMES[i] << "," << m.count << ","
+			<< (seconds > 0 ? m.count / seconds : 0.0) << "," << m.meanMs() << "," << m.percentileMs(0.5) << ","
+			<< m.percentileMs(0.95) << "," << m.percentileMs(0.99) << "," << m.percentileMs(1.0) << ","
+			<< frames << "," << drops << endl;
+	}
+}
+
+void TelemetrySnapshot::writeJSON(ostream &out, double wallTime) const
+{
+	out << fixed << setprecision(3) << "{\"time\":" << wallTime << ",\"seconds\":" << seconds
+		<< ",\"frames\":" << frames << ",\"drops\":" << drops << ",\"metrics\":{";
+	for (int i = 0; i < METRIC_COUNT; i++)
+	{
+		const HistogramSnapshot &m = metrics[i];
+		out << (i ? "," : "") << "\"" << METRIC_NAMES[i] << "\":{\"count\":" << m.count
+			<< ",\"mean_ms\":" << m.meanMs() << ",\"p50_ms\":" << m.percentileMs(0.5)
+			<< ",\"p95_ms\":" << m.percentileMs(0.95) << ",\"p99_ms\":" << m.percentileMs(0.99)
+			<< ",\"max_ms\":" << m.percentileMs(1.0) << "}";
+	}
+	out << "}}" << endl;
+}
+
+void TelemetrySnapshot::writeText(ostream &out) const
+{
+	out << fixed << setprecision(2);
+	for (int i = 0; i < METRIC_COUNT; i++)
+	{
+		const HistogramSnapshot &m = metrics[i];
+		if (m.count == 0)
+			continue;
+		out << setw(10) << METRIC_NAMES[i] << " : "
+			<< setw(7) << (seconds > 0 ? m.count / seconds : 0.0) << " /s, mean "
+			<< setw(6) << m.meanMs() << " ms, p50 "
+			<< setw(6) << m.percentileMs(0.5) << ", p99 "
+			<< setw(6) << m.percentileMs(0.99) << ", max "
+			<< setw(6) << m.percentileMs(1.0) << endl;
+	}
+	out << setw(10) << "published" << " : " << frames << ", dropped " << drops << endl;
+}
+
+//
+// TelemetryExporter
+//
+
+TelemetryExporter::TelemetryExporter() : m_telemetry(NULL), m_bJSON(false), m_intervalSeconds(5), m_bRunning(false)
+{
+}
+
+TelemetryExporter::~TelemetryExporter()
+{
+	stop();
+}
+
+bool TelemetryExporter::start(const Telemetry &telemetry, const string &path, int intervalSeconds)
+{
+	stop();
+	m_file.open(path.c_str(), ios::out | ios::app);
+	if (!m_file)
+		return false;
+	m_telemetry = &telemetry;
+	m_bJSON = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+	m_intervalSeconds = intervalSeconds > 0 ? intervalSeconds : 1;
+	m_bRunning = true;
+	m_thread = thread(&TelemetryExporter::exportLoop, this);
+	return true;
+}
+
+void TelemetryExporter::stop()
+{
+	m_bRunning = false;
+	if (m_thread.joinable())
+		m_thread.join();
+	if (m_file.is_open())
+		m_file.close();
+}
+
+void TelemetryExporter::exportLoop()
+{
+	TelemetrySnapshot previous, current;
+	m_telemetry->snapshot(previous);
+	if (!m_bJSON && m_file.tellp() == 0)
+		previous.writeCSVHeader(m_file);
+
+	Telemetry::Clock::time_point next = Telemetry::Clock::now();
+	while (m_bRunning)
+	{
+		// Short sleeps so stop never waits a whole interval
+		next += chrono::seconds(m_intervalSeconds);
+		while (m_bRunning && Telemetry::Clock::now() < next)
+			this_thread::sleep_for(chrono::milliseconds(50));
+
+		m_telemetry->snapshot(current);
+		TelemetrySnapshot interval = current.since(previous);
+		if (m_bJSON)
+			interval.writeJSON(m_file, wallClockSeconds());
+		else
+			interval.writeCSV(m_file, wallClockSeconds());
+		m_file.flush();
+		previous = current;
+	}
+}
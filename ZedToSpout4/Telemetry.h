@@ -0,0 +1,151 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <thread>
+
+// Build with ZTS_TELEMETRY=0 to compile every timer out. The classes stay so
+// callers need no #if, they just never see a sample.
+#ifndef ZTS_TELEMETRY
+#define ZTS_TELEMETRY 1
+#endif
+
+// What is timed on the way from grab to Spout. Each metric is written by a
+// single pipeline thread.
+enum TelemetryMetric
+{
+	METRIC_CAPTURE,   // whole capture stage
+	METRIC_GRAB,      // FrameSource::grab alone
+	METRIC_RECORD,    // writing the frame to a recording
+	METRIC_PROCESS,   // whole process stage
+	METRIC_PUBLISH,   // whole publish stage : upload and Spout send
+	METRIC_LATENCY,   // capture start to publish end
+	METRIC_FRAME_AGE, // camera timestamp to publish end, live cameras only
+	METRIC_PREVIEW,   // observer images, on the preview thread
+	METRIC_COUNT
+};
+
+const char* telemetryMetricName(TelemetryMetric metric);
+
+// Log-linear buckets over microseconds : exact below 8 us, then 8 buckets
+// per power of two, so any percentile is within 12.5 % up to an hour.
+static const int HISTOGRAM_SUB_BUCKETS = 8;
+static const int HISTOGRAM_BUCKETS = 240;
+
+struct HistogramSnapshot
+{
+	unsigned long long count, totalNs;
+	unsigned int buckets[HISTOGRAM_BUCKETS];
+
+	HistogramSnapshot();
+	// Samples added after prev was taken
+	HistogramSnapshot since(const HistogramSnapshot &prev) const;
+	double meanMs() const { return count ? totalNs / 1e6 / count : 0.0; }
+	// Upper edge of the bucket holding the p-th sample, p in [0, 1]
+	double percentileMs(double p) const;
+};
+
+// Lock free : relaxed atomic adds from the owning thread, snapshots from any other
+class LatencyHistogram
+{
+public:
+	LatencyHistogram();
+	void add(unsigned long long ns);
+	void snapshot(HistogramSnapshot &s) const;
+
+	static int bucketOf(unsigned long long us);
+	static unsigned long long bucketUpperUs(int bucket);
+private:
+	std::atomic<unsigned long long> m_count, m_totalNs;
+	std::atomic<unsigned int> m_buckets[HISTOGRAM_BUCKETS];
+};
+
+struct TelemetrySnapshot
+{
+	double seconds;              // covered by the snapshot
+	unsigned long long frames;   // published
+	unsigned long long drops;
+	HistogramSnapshot metrics[METRIC_COUNT];
+
+	TelemetrySnapshot() : seconds(0), frames(0), drops(0) {}
+	TelemetrySnapshot since(const TelemetrySnapshot &prev) const;
+
+	void writeCSVHeader(std::ostream &out) const;
+	// One row per metric, prefixed by the wall clock time in seconds
+	void writeCSV(std::ostream &out, double wallTime) const;
+	void writeJSON(std::ostream &out, double wallTime) const;
+	// The console summary printed by the UI loop
+	void writeText(std::ostream &out) const;
+};
+
+// Counters only ever grow; readers keep the previous snapshot and subtract
+// it, so the console, the exporter and the control endpoint never reset
+// each other's numbers.
+class Telemetry
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	Telemetry();
+#if ZTS_TELEMETRY
+	void add(TelemetryMetric metric, Clock::time_point start, Clock::time_point end);
+	void addNs(TelemetryMetric metric, unsigned long long ns) { m_metrics[metric].add(ns); }
+#else
+	void add(TelemetryMetric, Clock::time_point, Clock::time_point) {}
+	void addNs(TelemetryMetric, unsigned long long) {}
+#endif
+	void addFrame() { m_frames.fetch_add(1, std::memory_order_relaxed); }
+	void addDrop() { m_drops.fetch_add(1, std::memory_order_relaxed); }
+	void snapshot(TelemetrySnapshot &s) const;
+private:
+	Clock::time_point m_start;
+	std::atomic<unsigned long long> m_frames, m_drops;
+	LatencyHistogram m_metrics[METRIC_COUNT];
+};
+
+#if ZTS_TELEMETRY
+// Times the rest of the enclosing scope
+class ScopedStageTimer
+{
+public:
+	ScopedStageTimer(Telemetry &telemetry, TelemetryMetric metric)
+		: m_telemetry(telemetry), m_metric(metric), m_start(Telemetry::Clock::now()) {}
+	~ScopedStageTimer() { m_telemetry.add(m_metric, m_start, Telemetry::Clock::now()); }
+private:
+	ScopedStageTimer& operator=(const ScopedStageTimer&);
+	Telemetry &m_telemetry;
+	TelemetryMetric m_metric;
+	Telemetry::Clock::time_point m_start;
+};
+#define TELEMETRY_CONCAT2(a, b) a##b
+#define TELEMETRY_CONCAT(a, b) TELEMETRY_CONCAT2(a, b)
+#define TELEMETRY_SCOPE(telemetry, metric) ScopedStageTimer TELEMETRY_CONCAT(stageTimer, __LINE__)(telemetry, metric)
+#define TELEMETRY_NOW() Telemetry::Clock::now()
+#else
+#define TELEMETRY_SCOPE(telemetry, metric)
+#define TELEMETRY_NOW() Telemetry::Clock::time_point()
+#endif
+
+// Appends a snapshot of the last interval to a file every few seconds : CSV
+// rows, or one JSON object per line when the name ends in .json
+class TelemetryExporter
+{
+public:
+	TelemetryExporter();
+	~TelemetryExporter();
+	bool start(const Telemetry &telemetry, const std::string &path, int intervalSeconds);
+	void stop();
+private:
+	TelemetryExporter(const TelemetryExporter&);
+	TelemetryExporter& operator=(const TelemetryExporter&);
+	void exportLoop();
+
+	const Telemetry* m_telemetry;
+	std::ofstream m_file;
+	bool m_bJSON;
+	int m_intervalSeconds;
+	std::atomic<bool> m_bRunning;
+	std::thread m_thread;
+};
@@ -0,0 +1,313 @@
+#include "stdafx.h"
+#include "TemporalFilter.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+using namespace std;
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TEMPORAL_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define KERNEL_AVX2_TARGET
+#else
+#define KERNEL_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+// Rows per parallel_for_ stripe, as the band masks
+static const int TEMPORAL_TILE_ROWS = 32;
+
+bool parseTemporalFilter(const string &text, TemporalFilterParams &params)
+{
+	TemporalFilterParams parsed;
+	float* fields[] = { &parsed.alpha, &parsed.motionRatio, NULL, &parsed.confidenceWeight };
+	const char* p = text.c_str();
+	for (int i = 0; i < 4; i++)
+	{
+		char* end;
+		double value = strtod(p, &end);
+		if (end == p)
+			return false;
+		if (fields[i])
+			*fields[i] = (float)value;
+		else
+			parsed.holdFrames = (int)value;
+		if (*end == '\0')
+			break;
+		if (*end != ':' || i == 3)
+			return false;
+		p = end + 1;
+	}
+	if (!(parsed.alpha > 0.0f && parsed.alpha <= 1.0f) || !(parsed.motionRatio > 0.0f) ||
+		parsed.holdFrames < 0 || parsed.holdFrames > 255 || !(parsed.confidenceWeight >= 0.0f && parsed.confidenceWeight <= 1.0f))
+		return false;
+	params = parsed;
+	return true;
+}
+
+string formatTemporalFilter(const TemporalFilterParams &params)
+{
+	char text[96];
+	sprintf(text, "%g:%g:%d:%g", params.alpha, params.motionRatio, params.holdFrames, params.confidenceWeight);
+	return text;
+}
+
+//
+// Row kernels
+//
+
+struct TemporalRow
+{
+	const float* depth;
+	const float* confidence; // NULL without confidence
+	float* state;
+	unsigned char* hold;
+	float* out;
+	int width;
+};
+
+struct TemporalMapping
+{
+	float alpha, span;       // the weight goes from alpha to alpha + span = 1, before the confidence
+	float inverseMotion;
+	float confidenceScale;   // confidenceWeight / 100
+	int hold;
+};
+
+// Written like MINPS and the vector selects, so every path rounds the same way
+static void temporalRowScalar(const TemporalRow &row, const TemporalMapping &m, int start)
+{
+	for (int x = start; x < row.width; x++)
+	{
+		float z = row.depth[x];
+		float f = row.state[x];
+		int hold = row.hold[x];
+		float out;
+		if (fabsf(z) < INFINITY)
+		{
+			if (f == f)
+			{
+				float r = fabsf(z - f) * m.inverseMotion / f;
+				r = r < 1.0f ? r : 1.0f;
+				// The confidence only slows still pixels down, motion still takes the weight to 1
+				float still = m.alpha, moving = m.span;
+				if (row.confidence)
+				{
+					still = m.alpha * (1.0f - row.confidence[x] * m.confidenceScale);
+					moving = 1.0f - still;
+				}
+				float a = r * moving + still;
+				f = f + a * (z - f);
+			}
+			else
+				f = z;
+			hold = m.hold;
+			out = f;
+		}
+		else if (hold > 0 && f == f)
+		{
+			// Invalid for a few frames only, keep showing the last depth
+			hold--;
+			out = f;
+		}
+		else
+		{
+			f = NAN;
+			hold = 0;
+			out = z;
+		}
+		row.state[x] = f;
+		row.hold[x] = (unsigned char)hold;
+		row.out[x] = out;
+	}
+}
+
+#ifdef TEMPORAL_X86
+static inline __m128 selectSSE2(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline __m128i selectSSE2(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static void temporalRowSSE2(const TemporalRow &row, const TemporalMapping &m, int)
+{
+	const __m128 alpha = _mm_set1_ps(m.alpha), span = _mm_set1_ps(m.span), inverseMotion = _mm_set1_ps(m.inverseMotion);
+	const __m128 confidenceScale = _mm_set1_ps(m.confidenceScale), one = _mm_set1_ps(1.0f);
+	const __m128 inf = _mm_set1_ps(INFINITY), nan = _mm_set1_ps(NAN);
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	const __m128i holdFrames = _mm_set1_epi32(m.hold), zero = _mm_setzero_si128(), ones = _mm_set1_epi32(1);
+	int x = 0;
+	for (; x + 4 <= row.width; x += 4)
+	{
+		__m128 z = _mm_loadu_ps(row.depth + x);
+		__m128 f = _mm_loadu_ps(row.state + x);
+		int packed;
+		memcpy(&packed, row.hold + x, 4);
+		__m128i hold = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+
+		__m128 valid = _mm_cmplt_ps(_mm_andnot_ps(sign, z), inf);
+		__m128 known = _mm_cmpeq_ps(f, f);
+		__m128 diff = _mm_sub_ps(z, f);
+		__m128 r = _mm_div_ps(_mm_mul_ps(_mm_andnot_ps(sign, diff), inverseMotion), f);
+		__m128 still = alpha, moving = span;
+		if (row.confidence)
+		{
+			still = _mm_mul_ps(alpha, _mm_sub_ps(one, _mm_mul_ps(_mm_loadu_ps(row.confidence + x), confidenceScale)));
+			moving = _mm_sub_ps(one, still);
+		}
+		__m128 a = _mm_add_ps(_mm_mul_ps(_mm_min_ps(r, one), moving), still);
+		__m128 updated = selectSSE2(known, _mm_add_ps(f, _mm_mul_ps(a, diff)), z);
+
+		__m128 held = _mm_andnot_ps(valid, _mm_and_ps(known, _mm_castsi128_ps(_mm_cmpgt_epi32(hold, zero))));
+		__m128 state = selectSSE2(valid, updated, selectSSE2(held, f, nan));
+		__m128 out = selectSSE2(valid, updated, selectSSE2(held, f, z));
+		hold = selectSSE2(_mm_castps_si128(valid), holdFrames,
+			_mm_and_si128(_mm_castps_si128(held), _mm_sub_epi32(hold, ones)));
+
+		_mm_storeu_ps(row.state + x, state);
+		_mm_storeu_ps(row.out + x, out);
+		hold = _mm_packs_epi32(hold, hold);
+		packed = _mm_cvtsi128_si32(_mm_packus_epi16(hold, hold));
+		memcpy(row.hold + x, &packed, 4);
+	}
+	temporalRowScalar(row, m, x);
+}
+
+KERNEL_AVX2_TARGET
+static void temporalRowAVX2(const TemporalRow &row, const TemporalMapping &m, int)
+{
+	const __m256 alpha = _mm256_set1_ps(m.alpha), span = _mm256_set1_ps(m.span), inverseMotion = _mm256_set1_ps(m.inverseMotion);
+	const __m256 confidenceScale = _mm256_set1_ps(m.confidenceScale), one = _mm256_set1_ps(1.0f);
+	const __m256 inf = _mm256_set1_ps(INFINITY), nan = _mm256_set1_ps(NAN);
+	const __m256 sign = _mm256_set1_ps(-0.0f);
+	const __m256i holdFrames = _mm256_set1_epi32(m.hold), zero = _mm256_setzero_si256(), ones = _mm256_set1_epi32(1);
+	int x = 0;
+	for (; x + 8 <= row.width; x += 8)
+	{
+		__m256 z = _mm256_loadu_ps(row.depth + x);
+		__m256 f = _mm256_loadu_ps(row.state + x);
+		__m256i hold = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(row.hold + x)));
+
+		__m256 valid = _mm256_cmp_ps(_mm256_andnot_ps(sign, z), inf, _CMP_LT_OQ);
+		__m256 known = _mm256_cmp_ps(f, f, _CMP_EQ_OQ);
+		__m256 diff = _mm256_sub_ps(z, f);
+		__m256 r = _mm256_div_ps(_mm256_mul_ps(_mm256_andnot_ps(sign, diff), inverseMotion), f);
+		__m256 still = alpha, moving = span;
+		if (row.confidence)
+		{
+			still = _mm256_mul_ps(alpha, _mm256_sub_ps(one, _mm256_mul_ps(_mm256_loadu_ps(row.confidence + x), confidenceScale)));
+			moving = _mm256_sub_ps(one, still);
+		}
+		__m256 a = _mm256_add_ps(_mm256_mul_ps(_mm256_min_ps(r, one), moving), still);
+		__m256 updated = _mm256_blendv_ps(z, _mm256_add_ps(f, _mm256_mul_ps(a, diff)), known);
+
+		__m256 held = _mm256_andnot_ps(valid, _mm256_and_ps(known, _mm256_castsi256_ps(_mm256_cmpgt_epi32(hold, zero))));
+		__m256 state = _mm256_blendv_ps(_mm256_blendv_ps(nan, f, held), updated, valid);
+		__m256 out = _mm256_blendv_ps(_mm256_blendv_ps(z, f, held), updated, valid);
+		hold = _mm256_blendv_epi8(_mm256_and_si256(_mm256_castps_si256(held), _mm256_sub_epi32(hold, ones)),
+			holdFrames, _mm256_castps_si256(valid));
+
+		_mm256_storeu_ps(row.state + x, state);
+		_mm256_storeu_ps(row.out + x, out);
+		__m128i words = _mm_packs_epi32(_mm256_castsi256_si128(hold), _mm256_extracti128_si256(hold, 1));
+		_mm_storel_epi64((__m128i*)(row.hold + x), _mm_packus_epi16(words, words));
+	}
+	temporalRowScalar(row, m, x);
+}
+#endif
+
+typedef void (*TemporalRowFunc)(const TemporalRow&, const TemporalMapping&, int);
+
+static TemporalRowFunc temporalRowFunc(KernelIsa isa)
+{
+#ifdef TEMPORAL_X86
+	if (isa == KERNEL_AVX2)
+		return temporalRowAVX2;
+	if (isa == KERNEL_SSE2)
+		return temporalRowSSE2;
+#endif
+	return temporalRowScalar;
+}
+
+class TemporalFilterBody : public cv::ParallelLoopBody
+{
+public:
+	TemporalFilterBody(const cv::Mat &depth, const cv::Mat &confidence, cv::Mat &filtered,
+		float* state, unsigned char* hold, const TemporalMapping &m, TemporalRowFunc row)
+		: m_depth(depth), m_confidence(confidence), m_filtered(filtered), m_state(state), m_hold(hold), m_mapping(m), m_row(row) {}
+
+	void operator()(const cv::Range &rows) const
+	{
+		TemporalRow row;
+		row.width = m_depth.cols;
+		for (int y = rows.start; y < rows.end; y++)
+		{
+			row.depth = m_depth.ptr<float>(y);
+			row.confidence = m_confidence.empty() ? NULL : m_confidence.ptr<float>(y);
+			row.state = m_state + (size_t)y * row.width;
+			row.hold = m_hold + (size_t)y * row.width;
+			row.out = m_filtered.ptr<float>(y);
+			m_row(row, m_mapping, 0);
+		}
+	}
+private:
+	const cv::Mat &m_depth;
+	const cv::Mat &m_confidence;
+	cv::Mat &m_filtered;
+	float* m_state;
+	unsigned char* m_hold;
+	const TemporalMapping &m_mapping;
+	TemporalRowFunc m_row;
+};
+
+//
+// TemporalFilter
+//
+
+TemporalFilter::TemporalFilter()
+{
+}
+
+void TemporalFilter::setParams(const TemporalFilterParams &params)
+{
+	m_params = params;
+}
+
+void TemporalFilter::reset()
+{
+	m_size = cv::Size();
+}
+
+void TemporalFilter::apply(const cv::Mat &depth, const cv::Mat &confidence, cv::Mat &filtered, KernelIsa isa)
+{
+	CV_Assert(depth.type() == CV_32FC1);
+	CV_Assert(confidence.empty() || (confidence.type() == CV_32FC1 && confidence.size() == depth.size()));
+	KernelIsa best = bestKernelIsa();
+	if (isa == KERNEL_AUTO || isa > best)
+		isa = best;
+
+	if (depth.size() != m_size)
+	{
+		// No history : the first frame passes through and seeds the state
+		m_size = depth.size();
+		m_state.assign(m_size.area(), NAN);
+		m_hold.assign(m_size.area(), 0);
+	}
+	filtered.create(depth.size(), CV_32FC1);
+
+	TemporalMapping m;
+	m.alpha = m_params.alpha;
+	m.span = 1.0f - m_params.alpha;
+	m.inverseMotion = 1.0f / m_params.motionRatio;
+	m.confidenceScale = m_params.confidenceWeight / 100.0f;
+	m.hold = m_params.holdFrames;
+	TemporalFilterBody body(depth, confidence, filtered, &m_state[0], &m_hold[0], m, temporalRowFunc(isa));
+	cv::parallel_for_(cv::Range(0, depth.rows), body, (depth.rows + TEMPORAL_TILE_ROWS - 1) / TEMPORAL_TILE_ROWS);
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "opencv2/core.hpp"
+#include "DepthKernels.h"
+
+// How the temporal filter follows the depth
+struct TemporalFilterParams
+{
+	float alpha;            // weight of a new measure on a still pixel, 1 disables the smoothing
+	float motionRatio;      // relative depth change at which a pixel follows the measure at once
+	int holdFrames;         // frames an invalid pixel keeps its last depth before the sentinel shows
+	float confidenceWeight; // 0-1, how much a poor confidence (100) slows still pixels down
+
+	TemporalFilterParams() : alpha(0.2f), motionRatio(0.05f), holdFrames(4), confidenceWeight(0.5f) {}
+};
+
+// "alpha[:motion[:hold[:confidence]]]"
+bool parseTemporalFilter(const std::string &text, TemporalFilterParams &params);
+std::string formatTemporalFilter(const TemporalFilterParams &params);
+
+// Per pixel exponential smoothing of CV_32FC1 depth. The weight of a new
+// measure grows from alpha on still pixels to 1 when it moves by motionRatio
+// of the depth, so moving edges don't trail. The confidence measure, when
+// there is one, shrinks the still weight only : a poor pixel that moves
+// follows at once all the same. A pixel whose measure goes invalid keeps its last
+// depth for holdFrames frames, which stops the flicker at the clamp distance;
+// after that the sentinel goes through as measured.
+// The state is two planes, the filtered depth and a byte of hold count per
+// pixel. Tiles of rows run on the OpenCV thread pool and every instruction set
+// produces exactly the same floats.
+class TemporalFilter
+{
+public:
+	TemporalFilter();
+	void setParams(const TemporalFilterParams &params);
+	const TemporalFilterParams& params() const { return m_params; }
+	// Forgets the history, the next frame goes through as it is
+	void reset();
+	// confidence (CV_32FC1, 0-100) may be empty, filtered may be depth itself
+	void apply(const cv::Mat &depth, const cv::Mat &confidence, cv::Mat &filtered, KernelIsa isa = KERNEL_AUTO);
+private:
+	TemporalFilterParams m_params;
+	cv::Size m_size;
+	std::vector<float> m_state;        // filtered depth, NAN where there is none
+	std::vector<unsigned char> m_hold; // frames left before an invalid pixel shows its sentinel
+};
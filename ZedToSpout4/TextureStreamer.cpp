@@ -0,0 +1,268 @@
+#include "stdafx.h"
+#include "TextureStreamer.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include "Spout/SpoutCopy.h"
+
+// The AVX2 and row band copies of the SpoutCopy compiled into the application
+static spoutCopy s_copy;
+#endif
+
+// Longest a ring buffer is waited for before it is written anyway, ns
+static const GLuint64 FENCE_TIMEOUT_NS = 100000000;
+
+// GL version of the current context as major * 10 + minor
+static int contextVersion()
+{
+	const char* version = (const char*)glGetString(GL_VERSION);
+	if (!version)
+		return 0;
+	char* end = NULL;
+	long major = strtol(version, &end, 10);
+	long minor = (end && *end == '.') ? strtol(end + 1, NULL, 10) : 0;
+	return (int)(major * 10 + minor);
+}
+
+static bool hasExtension(const char* name)
+{
+	const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+	size_t length = strlen(name);
+	for (const char* found = extensions; found && (found = strstr(found, name)) != NULL; found += length)
+	{
+		if ((found == extensions || found[-1] == ' ') && (found[length] == ' ' || found[length] == 0))
+			return true;
+	}
+	return false;
+}
+
+// What AUTO comes to with the current context
+static TextureStreamMode contextMode()
+{
+	int version = contextVersion();
+	bool bBuffers = version >= 21 || hasExtension("GL_ARB_pixel_buffer_object");
+	bool bFences = (version >= 32 || hasExtension("GL_ARB_sync")) &&
+		(version >= 30 || hasExtension("GL_ARB_map_buffer_range"));
+	return !bBuffers ? TEXTURE_STREAM_DIRECT : bFences ? TEXTURE_STREAM_RING : TEXTURE_STREAM_ORPHAN;
+}
+
+TextureStreamer::TextureStreamer()
+{
+	m_mode = TEXTURE_STREAM_AUTO;
+	m_activeMode = TEXTURE_STREAM_DIRECT;
+	m_bMipmaps = false;
+	m_texture = 0;
+	m_width = 0;
+	m_height = 0;
+	m_format = GL_BGR;
+	m_type = GL_UNSIGNED_BYTE;
+	for (int i = 0; i < PBO_COUNT; i++)
+	{
+		m_pbo[i] = 0;
+		m_fence[i] = 0;
+	}
+	m_pboIndex = 0;
+	m_bufferBytes = 0;
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	// The context may be gone by now, release() is for the owner to call while it isn't
+}
+
+void TextureStreamer::setMode(TextureStreamMode mode)
+{
+	if (mode != m_mode)
+	{
+		m_mode = mode;
+		m_width = 0;
+	}
+}
+
+void TextureStreamer::setMipmaps(bool bMipmaps)
+{
+	// The minification filter follows with the next allocation
+	if (bMipmaps != m_bMipmaps)
+	{
+		m_bMipmaps = bMipmaps;
+		m_width = 0;
+	}
+}
+
+int TextureStreamer::bytesPerPixel(GLenum format, GLenum type)
+{
+	int channels = format == GL_RGBA || format == GL_BGRA ? 4 : format == GL_RGB || format == GL_BGR ? 3 : 1;
+	int bytes = type == GL_FLOAT ? 4 : type == GL_UNSIGNED_SHORT ? 2 : 1;
+	return channels * bytes;
+}
+
+void TextureStreamer::allocate(int width, int height, GLenum format, GLenum type)
+{
+	release();
+
+	glGenTextures(1, &m_texture);
+	glBindTexture(GL_TEXTURE_2D, m_texture);
+	// Encoded depth must never be blended between texels
+	bool bExact = type != GL_UNSIGNED_BYTE || format == GL_BGRA;
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, bExact ? GL_NEAREST : m_bMipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, bExact ? GL_NEAREST : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+
+	// Storage only, the pixels are streamed in by upload. Depth encodings
+	// keep their precision, the SendTexture blit converts to the shared format.
+	GLint internalFormat = GL_RGB;
+	if (type == GL_UNSIGNED_SHORT)
+		internalFormat = GL_R16;
+	else if (type == GL_FLOAT)
+		internalFormat = format == GL_RGBA ? GL_RGBA32F : GL_R32F;
+	else if (format == GL_BGRA)
+		internalFormat = GL_RGBA8;
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	m_activeMode = m_mode == TEXTURE_STREAM_AUTO ? contextMode() : m_mode;
+	m_bufferBytes = (size_t)width * height * bytesPerPixel(format, type);
+	if (m_activeMode != TEXTURE_STREAM_DIRECT)
+	{
+		int count = m_activeMode == TEXTURE_STREAM_RING ? PBO_COUNT : 1;
+		glGenBuffers(count, m_pbo);
+		for (int i = 0; i < count; i++)
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo[i]);
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)m_bufferBytes, NULL, GL_STREAM_DRAW);
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	m_pboIndex = 0;
+
+	m_width = width;
+	m_height = height;
+	m_format = format;
+	m_type = type;
+	m_stats.reallocations++;
+}
+
+void TextureStreamer::release()
+{
+	for (int i = 0; i < PBO_COUNT; i++)
+	{
+		if (m_fence[i])
+		{
+			glDeleteSync(m_fence[i]);
+			m_fence[i] = 0;
+		}
+		if (m_pbo[i])
+		{
+			glDeleteBuffers(1, &m_pbo[i]);
+			m_pbo[i] = 0;
+		}
+	}
+	if (m_texture)
+	{
+		glDeleteTextures(1, &m_texture);
+		m_texture = 0;
+	}
+	m_width = 0;
+	m_height = 0;
+}
+
+void TextureStreamer::fillRows(unsigned char* dst, const unsigned char* pixels, size_t pitch, size_t rowBytes, int height, bool bFlipped)
+{
+#ifdef _WIN32
+	// CopyPixels takes the frame as RGBA or RGB pixels, whatever the rows hold.
+	// Its SSE fallback loads whole aligned vectors.
+	if (pitch == rowBytes && (rowBytes % 4 == 0 || rowBytes % 3 == 0) && (((size_t)pixels | (size_t)dst) & 15) == 0)
+	{
+		bool bWords = rowBytes % 4 == 0;
+		s_copy.CopyPixels(pixels, dst, (unsigned int)(rowBytes / (bWords ? 4 : 3)), height, bWords ? GL_RGBA : GL_RGB, !bFlipped);
+		return;
+	}
+#endif
+	for (int y = 0; y < height; y++)
+		memcpy(dst + (bFlipped ? y : height - 1 - y) * rowBytes, pixels + y * pitch, rowBytes);
+}
+
+void TextureStreamer::uploadDirect(const unsigned char* pixels, size_t pitch, int width, int height, bool bFlipped)
+{
+	size_t rowBytes = (size_t)width * bytesPerPixel(m_format, m_type);
+	if (bFlipped && pitch == rowBytes)
+	{
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, m_format, m_type, pixels);
+		return;
+	}
+	// A row at a time, each to the texture row it ends up in
+	for (int y = 0; y < height; y++)
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, bFlipped ? y : height - 1 - y, width, 1, m_format, m_type, pixels + y * pitch);
+}
+
+bool TextureStreamer::upload(const unsigned char* pixels, size_t pitch, int width, int height, GLenum format, GLenum type, bool bFlipped)
+{
+	if (!pixels || width <= 0 || height <= 0)
+		return false;
+	if (m_texture == 0 || width != m_width || height != m_height || format != m_format || type != m_type)
+		allocate(width, height, format, type);
+
+	size_t rowBytes = (size_t)width * bytesPerPixel(format, type);
+	glBindTexture(GL_TEXTURE_2D, m_texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	bool bUploaded = true;
+	if (m_activeMode == TEXTURE_STREAM_RING)
+	{
+		// The buffer written PBO_COUNT frames ago : its upload has almost always
+		// passed its fence by now, the wait only catches a GPU that fell behind
+		GLsync &fence = m_fence[m_pboIndex];
+		if (fence)
+		{
+			GLenum status = glClientWaitSync(fence, 0, 0);
+			if (status == GL_TIMEOUT_EXPIRED)
+			{
+				m_stats.fenceWaits++;
+				glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+			}
+			glDeleteSync(fence);
+			fence = 0;
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo[m_pboIndex]);
+		unsigned char* dst = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)m_bufferBytes,
+			GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (dst)
+		{
+			fillRows(dst, pixels, pitch, rowBytes, height, bFlipped);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, type, 0);
+			fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		m_pboIndex = (m_pboIndex + 1) % PBO_COUNT;
+		bUploaded = dst != NULL;
+	}
+	else if (m_activeMode == TEXTURE_STREAM_ORPHAN)
+	{
+		// Without fences : new storage every frame so the map never waits on the last upload
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo[0]);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)m_bufferBytes, NULL, GL_STREAM_DRAW);
+		unsigned char* dst = (unsigned char*)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+		if (dst)
+		{
+			fillRows(dst, pixels, pitch, rowBytes, height, bFlipped);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, type, 0);
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		bUploaded = dst != NULL;
+	}
+	else
+		uploadDirect(pixels, pitch, width, height, bFlipped);
+
+	if (m_bMipmaps && bUploaded)
+		glGenerateMipmap(GL_TEXTURE_2D);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	if (bUploaded)
+		m_stats.frames++;
+	return bUploaded;
+}
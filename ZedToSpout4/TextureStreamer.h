@@ -0,0 +1,75 @@
+#pragma once
+#include <stddef.h>
+#ifdef _WIN32
+#include "Glew\glew.h"
+#else
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+
+// How frames reach the texture
+enum TextureStreamMode
+{
+	TEXTURE_STREAM_AUTO,   // the ring when the context has fences, else one orphaned buffer, else direct
+	TEXTURE_STREAM_RING,   // PBO_COUNT pixel buffers, each reused once the fence after its upload passed
+	TEXTURE_STREAM_ORPHAN, // one pixel buffer given new storage every frame
+	TEXTURE_STREAM_DIRECT, // glTexSubImage2D from the frame itself
+};
+
+// Streams frames into a persistent texture, reallocated only when the size
+// or the format changes. In the ring the texture update of one frame runs on
+// the GPU while the next frame is written into another buffer, mapped
+// unsynchronized : the fence its last upload left tells when it is free, so
+// nothing is allocated and the driver never waits for an upload to finish.
+// Rows are flipped on the way in, in the buffer or by uploading them in
+// reverse, never through a copy of the frame. Needs the GL context current.
+class TextureStreamer
+{
+public:
+	struct Stats
+	{
+		unsigned long long frames;
+		unsigned long long fenceWaits; // ring buffers still being read when their turn came
+		unsigned long long reallocations;
+	};
+
+	TextureStreamer();
+	~TextureStreamer();
+	// Takes effect with the next allocation, which it forces when it changes anything
+	void setMode(TextureStreamMode mode);
+	void setMipmaps(bool bMipmaps);
+	// pitch bytes apart, bottom-up already when bFlipped. format and type as
+	// for glTexSubImage2D : GL_LUMINANCE, GL_BGR or GL_BGRA bytes, GL_RED
+	// shorts or floats, GL_RGBA floats. False when nothing was uploaded.
+	bool upload(const unsigned char* pixels, size_t pitch, int width, int height, GLenum format, GLenum type, bool bFlipped);
+	GLuint texture() const { return m_texture; }
+	TextureStreamMode activeMode() const { return m_activeMode; }
+	const Stats& stats() const { return m_stats; }
+	// Deletes the texture and the buffers, with the context current
+	void release();
+
+	// Number of pixel buffers in the ring
+	static const int PBO_COUNT = 3;
+	static int bytesPerPixel(GLenum format, GLenum type);
+
+private:
+	TextureStreamer(const TextureStreamer&);
+	TextureStreamer& operator=(const TextureStreamer&);
+
+	void allocate(int width, int height, GLenum format, GLenum type);
+	// The rows into a mapped buffer, flipped unless already bottom-up
+	void fillRows(unsigned char* dst, const unsigned char* pixels, size_t pitch, size_t rowBytes, int height, bool bFlipped);
+	void uploadDirect(const unsigned char* pixels, size_t pitch, int width, int height, bool bFlipped);
+
+	TextureStreamMode m_mode, m_activeMode;
+	bool m_bMipmaps;
+	GLuint m_texture;
+	int m_width, m_height;
+	GLenum m_format, m_type;
+	GLuint m_pbo[PBO_COUNT];
+	GLsync m_fence[PBO_COUNT];
+	int m_pboIndex;
+	size_t m_bufferBytes;
+	Stats m_stats;
+};
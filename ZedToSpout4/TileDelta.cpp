@@ -0,0 +1,541 @@
+#include "stdafx.h"
+#include "TileDelta.h"
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+using namespace std;
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TILE_DELTA_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define KERNEL_AVX2_TARGET
+#else
+#define KERNEL_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+static const unsigned int TILE_DELTA_MAGIC = 0x4453545A; // "ZTSD"
+static const unsigned short TILE_DELTA_VERSION = 1;
+static const int TILE_DELTA_MAX_TILE = 256;
+
+bool parseTileDelta(const string &text, TileDeltaParams &params)
+{
+	TileDeltaParams parsed;
+	int* fields[] = { &parsed.tileSize, &parsed.toleranceMm, &parsed.keyframeInterval };
+	const char* p = text.c_str();
+	for (int i = 0; i < 3; i++)
+	{
+		char* end;
+		long value = strtol(p, &end, 10);
+		if (end == p)
+			return false;
+		*fields[i] = (int)value;
+		if (*end == '\0')
+			break;
+		if (*end != ':' || i == 2)
+			return false;
+		p = end + 1;
+	}
+	if (parsed.tileSize < 8 || parsed.tileSize > TILE_DELTA_MAX_TILE || parsed.tileSize % 8 != 0 ||
+		parsed.toleranceMm < 0 || parsed.toleranceMm > 65535 || parsed.keyframeInterval < 0)
+		return false;
+	params.tileSize = parsed.tileSize;
+	params.toleranceMm = parsed.toleranceMm;
+	params.keyframeInterval = parsed.keyframeInterval;
+	return true;
+}
+
+string formatTileDelta(const TileDeltaParams &params)
+{
+	char text[64];
+	sprintf(text, "%d:%d:%d", params.tileSize, params.toleranceMm, params.keyframeInterval);
+	return text;
+}
+
+static inline int tilesAcross(int pixels, int tileSize)
+{
+	return (pixels + tileSize - 1) / tileSize;
+}
+
+// One bit a tile, padded so the pixels start 4-byte aligned
+static inline size_t bitmapBytes(int tiles)
+{
+	return ((size_t)tiles + 31) / 32 * 4;
+}
+
+size_t tileDeltaBound(int width, int height, int tileSize)
+{
+	if (width <= 0 || height <= 0 || tileSize <= 0)
+		return 0;
+	return sizeof(TileDeltaHeader) + bitmapBytes(tilesAcross(width, tileSize) * tilesAcross(height, tileSize)) +
+		(size_t)width * height * sizeof(unsigned short);
+}
+
+bool tileDeltaInfo(const unsigned char* in, size_t size, TileDeltaHeader &header)
+{
+	if (!in || size < sizeof(TileDeltaHeader))
+		return false;
+	memcpy(&header, in, sizeof(header));
+	return header.magic == TILE_DELTA_MAGIC && header.version == TILE_DELTA_VERSION && header.width > 0 && header.height > 0 &&
+		header.tileSize >= 8 && header.tileSize <= TILE_DELTA_MAX_TILE &&
+		header.tilesX == tilesAcross(header.width, header.tileSize) && header.tilesY == tilesAcross(header.height, header.tileSize) &&
+		header.changedTiles <= (unsigned int)header.tilesX * header.tilesY;
+}
+
+//
+// Row comparison : a pixel changed when it moved by more than the tolerance,
+// or by anything at all from or to a sentinel, whose codes (0, 1 and 65535)
+// are one apart from each other or from valid depth
+//
+
+static inline bool isSentinel(unsigned int code)
+{
+	return (unsigned short)(code + 1) <= 2;
+}
+
+static bool rowChangedScalar(const unsigned short* a, const unsigned short* b, int n, unsigned short tolerance)
+{
+	for (int x = 0; x < n; x++)
+	{
+		unsigned int d = a[x] > b[x] ? a[x] - b[x] : b[x] - a[x];
+		if (d > tolerance || (d != 0 && (isSentinel(a[x]) || isSentinel(b[x]))))
+			return true;
+	}
+	return false;
+}
+
+#ifdef TILE_DELTA_X86
+// Non-zero lanes where a pixel changed, the same test as the scalar one :
+// |a - b| from the two saturated differences, past the tolerance when it
+// survives subtracting it, and sentinels where code + 1 saturates to 0 under 2
+static inline __m128i changedSSE2(__m128i a, __m128i b, __m128i tolerance, __m128i one, __m128i two)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i d = _mm_or_si128(_mm_subs_epu16(a, b), _mm_subs_epu16(b, a));
+	__m128i sentinel = _mm_or_si128(_mm_cmpeq_epi16(_mm_subs_epu16(_mm_add_epi16(a, one), two), zero),
+		_mm_cmpeq_epi16(_mm_subs_epu16(_mm_add_epi16(b, one), two), zero));
+	return _mm_or_si128(_mm_subs_epu16(d, tolerance), _mm_and_si128(sentinel, d));
+}
+
+static bool rowChangedSSE2(const unsigned short* a, const unsigned short* b, int n, unsigned short tolerance)
+{
+	const __m128i tol = _mm_set1_epi16((short)tolerance);
+	const __m128i one = _mm_set1_epi16(1), two = _mm_set1_epi16(2);
+	__m128i any = _mm_setzero_si128();
+	int x = 0;
+	for (; x + 8 <= n; x += 8)
+		any = _mm_or_si128(any, changedSSE2(_mm_loadu_si128((const __m128i*)(a + x)), _mm_loadu_si128((const __m128i*)(b + x)), tol, one, two));
+	if (_mm_movemask_epi8(_mm_cmpeq_epi16(any, _mm_setzero_si128())) != 0xFFFF)
+		return true;
+	return rowChangedScalar(a + x, b + x, n - x, tolerance);
+}
+
+KERNEL_AVX2_TARGET
+static bool rowChangedAVX2(const unsigned short* a, const unsigned short* b, int n, unsigned short tolerance)
+{
+	const __m256i tol = _mm256_set1_epi16((short)tolerance);
+	const __m256i one = _mm256_set1_epi16(1), two = _mm256_set1_epi16(2);
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i any = zero;
+	int x = 0;
+	for (; x + 16 <= n; x += 16)
+	{
+		__m256i va = _mm256_loadu_si256((const __m256i*)(a + x));
+		__m256i vb = _mm256_loadu_si256((const __m256i*)(b + x));
+		__m256i d = _mm256_or_si256(_mm256_subs_epu16(va, vb), _mm256_subs_epu16(vb, va));
+		__m256i sentinel = _mm256_or_si256(_mm256_cmpeq_epi16(_mm256_subs_epu16(_mm256_add_epi16(va, one), two), zero),
+			_mm256_cmpeq_epi16(_mm256_subs_epu16(_mm256_add_epi16(vb, one), two), zero));
+		any = _mm256_or_si256(any, _mm256_or_si256(_mm256_subs_epu16(d, tol), _mm256_and_si256(sentinel, d)));
+	}
+	if (_mm256_movemask_epi8(_mm256_cmpeq_epi16(any, zero)) != -1)
+		return true;
+	return rowChangedSSE2(a + x, b + x, n - x, tolerance);
+}
+#endif
+
+typedef bool (*RowChangedFunc)(const unsigned short*, const unsigned short*, int, unsigned short);
+
+static RowChangedFunc rowChangedFunc(int isa)
+{
+	KernelIsa best = bestKernelIsa();
+	KernelIsa resolved = (isa == KERNEL_AUTO || isa > best || isa < KERNEL_AUTO) ? best : (KernelIsa)isa;
+#ifdef TILE_DELTA_X86
+	if (resolved == KERNEL_AVX2)
+		return rowChangedAVX2;
+	if (resolved == KERNEL_SSE2)
+		return rowChangedSSE2;
+#endif
+	(void)resolved;
+	return rowChangedScalar;
+}
+
+//
+// Tile passes, a row of tiles per parallel_for_ stripe
+//
+
+class TileCompareBody : public cv::ParallelLoopBody
+{
+public:
+	TileCompareBody(const cv::Mat &depth, const cv::Mat &reference, int tileSize, int tilesX, unsigned short tolerance,
+		RowChangedFunc rowChanged, unsigned char* changed)
+		: m_depth(depth), m_reference(reference), m_tileSize(tileSize), m_tilesX(tilesX), m_tolerance(tolerance),
+		m_rowChanged(rowChanged), m_changed(changed) {}
+
+	void operator()(const cv::Range &tileRows) const
+	{
+		for (int ty = tileRows.start; ty < tileRows.end; ty++)
+		{
+			const int y0 = ty * m_tileSize, y1 = min(y0 + m_tileSize, m_depth.rows);
+			for (int tx = 0; tx < m_tilesX; tx++)
+			{
+				const int x0 = tx * m_tileSize, w = min(m_tileSize, m_depth.cols - x0);
+				unsigned char changed = 0;
+				for (int y = y0; y < y1 && !changed; y++)
+					changed = m_rowChanged(m_depth.ptr<unsigned short>(y) + x0, m_reference.ptr<unsigned short>(y) + x0, w, m_tolerance);
+				m_changed[ty * m_tilesX + tx] = changed;
+			}
+		}
+	}
+private:
+	const cv::Mat &m_depth;
+	const cv::Mat &m_reference;
+	int m_tileSize, m_tilesX;
+	unsigned short m_tolerance;
+	RowChangedFunc m_rowChanged;
+	unsigned char* m_changed;
+};
+
+// Copies the changed tiles of depth into the frame and into the reference
+class TileCopyBody : public cv::ParallelLoopBody
+{
+public:
+	TileCopyBody(const cv::Mat &depth, cv::Mat &reference, int tileSize, int tilesX, const unsigned char* changed,
+		const size_t* offsets, unsigned char* out)
+		: m_depth(depth), m_reference(reference), m_tileSize(tileSize), m_tilesX(tilesX), m_changed(changed), m_offsets(offsets), m_out(out) {}
+
+	void operator()(const cv::Range &tileRows) const
+	{
+		for (int ty = tileRows.start; ty < tileRows.end; ty++)
+		{
+			const int y0 = ty * m_tileSize, y1 = min(y0 + m_tileSize, m_depth.rows);
+			for (int tx = 0; tx < m_tilesX; tx++)
+			{
+				const int tile = ty * m_tilesX + tx;
+				if (!m_changed[tile])
+					continue;
+				const int x0 = tx * m_tileSize;
+				const size_t row = (size_t)min(m_tileSize, m_depth.cols - x0) * sizeof(unsigned short);
+				unsigned char* out = m_out + m_offsets[tile];
+				for (int y = y0; y < y1; y++, out += row)
+				{
+					const unsigned short* src = m_depth.ptr<unsigned short>(y) + x0;
+					memcpy(out, src, row);
+					memcpy(m_reference.ptr<unsigned short>(y) + x0, src, row);
+				}
+			}
+		}
+	}
+private:
+	const cv::Mat &m_depth;
+	cv::Mat &m_reference;
+	int m_tileSize, m_tilesX;
+	const unsigned char* m_changed;
+	const size_t* m_offsets;
+	unsigned char* m_out;
+};
+
+//
+// TileDeltaEncoder
+//
+
+TileDeltaEncoder::TileDeltaEncoder() : m_tilesX(0), m_tilesY(0), m_sequence(0), m_sinceKey(0), m_bKeyRequested(true),
+	m_changedTiles(0), m_bLastKey(false)
+{
+	static_assert(sizeof(TileDeltaHeader) == 28, "the header goes to other processes and machines");
+}
+
+void TileDeltaEncoder::setParams(const TileDeltaParams &params)
+{
+	if (params.tileSize != m_params.tileSize)
+		m_bKeyRequested = true;
+	m_params = params;
+}
+
+size_t TileDeltaEncoder::encode(const cv::Mat &depth, vector<unsigned char> &out)
+{
+	size_t bound = tileDeltaBound(depth.cols, depth.rows, m_params.tileSize);
+	if (out.size() < bound)
+		out.resize(bound);
+	return encode(depth, out.data(), out.size());
+}
+
+size_t TileDeltaEncoder::encode(const cv::Mat &depth, unsigned char* out, size_t capacity)
+{
+	const int tileSize = m_params.tileSize;
+	if (depth.type() != CV_16UC1 || depth.empty() || depth.cols > 65535 || depth.rows > 65535 ||
+		tileSize < 8 || tileSize > TILE_DELTA_MAX_TILE || capacity < tileDeltaBound(depth.cols, depth.rows, tileSize))
+		return 0;
+
+	const int tilesX = tilesAcross(depth.cols, tileSize), tilesY = tilesAcross(depth.rows, tileSize);
+	const bool key = m_bKeyRequested || depth.size() != m_reference.size() || tilesX != m_tilesX || tilesY != m_tilesY ||
+		(m_params.keyframeInterval > 0 && m_sinceKey + 1 >= (unsigned int)m_params.keyframeInterval);
+	if (depth.size() != m_reference.size())
+		m_reference.create(depth.size(), CV_16UC1);
+	m_tilesX = tilesX;
+	m_tilesY = tilesY;
+	const int tiles = tilesX * tilesY;
+	m_changed.resize(tiles);
+	m_offsets.resize(tiles);
+
+	if (key)
+		memset(m_changed.data(), 1, tiles);
+	else
+	{
+		TileCompareBody body(depth, m_reference, tileSize, tilesX, (unsigned short)m_params.toleranceMm,
+			rowChangedFunc(m_params.isa), m_changed.data());
+		cv::parallel_for_(cv::Range(0, tilesY), body, tilesY);
+	}
+
+	// Header, bitmap, then where each changed tile goes
+	const size_t bitmap = bitmapBytes(tiles);
+	memset(out + sizeof(TileDeltaHeader), 0, bitmap);
+	size_t offset = sizeof(TileDeltaHeader) + bitmap;
+	unsigned int changedTiles = 0;
+	for (int ty = 0; ty < tilesY; ty++)
+	{
+		const size_t tileRows = min(tileSize, depth.rows - ty * tileSize);
+		for (int tx = 0; tx < tilesX; tx++)
+		{
+			const int tile = ty * tilesX + tx;
+			if (!m_changed[tile])
+				continue;
+			out[sizeof(TileDeltaHeader) + tile / 8] |= (unsigned char)(1 << (tile & 7));
+			m_offsets[tile] = offset;
+			offset += tileRows * min(tileSize, depth.cols - tx * tileSize) * sizeof(unsigned short);
+			changedTiles++;
+		}
+	}
+	if (changedTiles > 0)
+	{
+		TileCopyBody body(depth, m_reference, tileSize, tilesX, m_changed.data(), m_offsets.data(), out);
+		cv::parallel_for_(cv::Range(0, tilesY), body, tilesY);
+	}
+
+	TileDeltaHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = TILE_DELTA_MAGIC;
+	header.version = TILE_DELTA_VERSION;
+	header.flags = key ? TILE_DELTA_KEY : 0;
+	header.width = (unsigned short)depth.cols;
+	header.height = (unsigned short)depth.rows;
+	header.tileSize = (unsigned short)tileSize;
+	header.tilesX = (unsigned short)tilesX;
+	header.tilesY = (unsigned short)tilesY;
+	header.sequence = m_sequence++;
+	header.changedTiles = changedTiles;
+	memcpy(out, &header, sizeof(header));
+
+	m_sinceKey = key ? 0 : m_sinceKey + 1;
+	m_bKeyRequested = false;
+	m_bLastKey = key;
+	m_changedTiles = changedTiles;
+	return offset;
+}
+
+//
+// TileDeltaDecoder
+//
+
+TileDeltaDecoder::TileDeltaDecoder() : m_bValid(false), m_sequence(0)
+{
+}
+
+void TileDeltaDecoder::reset()
+{
+	m_bValid = false;
+}
+
+bool TileDeltaDecoder::apply(const unsigned char* in, size_t size)
+{
+	TileDeltaHeader header;
+	if (!tileDeltaInfo(in, size, header))
+		return false;
+	const bool key = (header.flags & TILE_DELTA_KEY) != 0;
+	const int tileSize = header.tileSize, tilesX = header.tilesX, tilesY = header.tilesY;
+	const int tiles = tilesX * tilesY;
+	if (!key && (!m_bValid || header.sequence != m_sequence + 1 ||
+		m_frame.cols != header.width || m_frame.rows != header.height))
+		return false;
+
+	// The whole frame is checked before a pixel changes
+	const size_t bitmap = bitmapBytes(tiles);
+	if (size < sizeof(TileDeltaHeader) + bitmap)
+		return false;
+	const unsigned char* bits = in + sizeof(TileDeltaHeader);
+	size_t expected = sizeof(TileDeltaHeader) + bitmap;
+	unsigned int changedTiles = 0;
+	for (int tile = 0; tile < tiles; tile++)
+	{
+		if (!(bits[tile / 8] & (1 << (tile & 7))))
+			continue;
+		const int tx = tile % tilesX, ty = tile / tilesX;
+		expected += (size_t)min(tileSize, header.height - ty * tileSize) * min(tileSize, header.width - tx * tileSize) * sizeof(unsigned short);
+		changedTiles++;
+	}
+	if (expected != size || changedTiles != header.changedTiles || (key && changedTiles != (unsigned int)tiles))
+		return false;
+
+	if (key)
+		m_frame.create(header.height, header.width, CV_16UC1);
+	const unsigned char* pixels = bits + bitmap;
+	for (int tile = 0; tile < tiles; tile++)
+	{
+		if (!(bits[tile / 8] & (1 << (tile & 7))))
+			continue;
+		const int x0 = tile % tilesX * tileSize, y0 = tile / tilesX * tileSize;
+		const int y1 = min(y0 + tileSize, (int)header.height);
+		const size_t row = (size_t)min(tileSize, header.width - x0) * sizeof(unsigned short);
+		for (int y = y0; y < y1; y++, pixels += row)
+			memcpy(m_frame.ptr<unsigned short>(y) + x0, pixels, row);
+	}
+	m_bValid = true;
+	m_sequence = header.sequence;
+	return true;
+}
+
+//
+// TileDeltaPublisher
+//
+
+TileDeltaPublisher::TileDeltaPublisher() : m_bytesSent(0)
+{
+}
+
+TileDeltaPublisher::~TileDeltaPublisher()
+{
+	close();
+}
+
+bool TileDeltaPublisher::create(const char* name, int width, int height, const TileDeltaParams &params, unsigned int slots)
+{
+	close();
+	size_t capacity = tileDeltaBound(width, height, params.tileSize);
+	if (capacity == 0 || width > 65535 || height > 65535 || !m_ring.create(name, slots, (unsigned int)capacity))
+		return false;
+	if (!m_event.create(name))
+	{
+		m_ring.close();
+		return false;
+	}
+	m_encoder = TileDeltaEncoder();
+	m_encoder.setParams(params);
+	m_size = cv::Size(width, height);
+	m_bytesSent = 0;
+	return true;
+}
+
+void TileDeltaPublisher::close()
+{
+	m_event.close();
+	m_ring.close();
+}
+
+bool TileDeltaPublisher::send(const cv::Mat &depth, unsigned long long timestamp)
+{
+	// Nothing may fail once the slot is open
+	if (!isOpen() || depth.type() != CV_16UC1 || depth.size() != m_size)
+		return false;
+	unsigned char* slot = m_ring.beginWrite(m_ring.capacity());
+	if (!slot)
+		return false;
+	SpoutFrameInfo info;
+	info.timestamp = timestamp;
+	info.size = (unsigned int)m_encoder.encode(depth, slot, m_ring.capacity());
+	info.format = CV_16UC1;
+	info.width = depth.cols;
+	info.height = depth.rows;
+	m_ring.endWrite(info);
+	m_event.signal();
+	m_bytesSent += info.size;
+	return true;
+}
+
+//
+// TileDeltaSubscriber
+//
+
+TileDeltaSubscriber::TileDeltaSubscriber() : m_eventSequence(0), m_refused(0)
+{
+}
+
+bool TileDeltaSubscriber::open(const char* name)
+{
+	close();
+	if (!m_ring.open(name))
+		return false;
+	m_name = name;
+	m_buffer.resize(m_ring.capacity());
+	// Publishers always have an event, but it may come a moment after the ring
+	m_event.open(name);
+	m_eventSequence = 0;
+	m_decoder.reset();
+	m_refused = 0;
+	return true;
+}
+
+void TileDeltaSubscriber::close()
+{
+	m_event.close();
+	m_ring.close();
+	m_name.clear();
+}
+
+bool TileDeltaSubscriber::receive(cv::Mat &depth, unsigned long long &timestamp)
+{
+	if (m_name.empty())
+		return false;
+	bool applied = false;
+	for (;;)
+	{
+		SpoutFrameInfo info;
+		SpoutFrameRing::ReadResult result = m_ring.readNext(m_buffer.data(), info);
+		if (result == SpoutFrameRing::RING_CLOSED)
+		{
+			// A new publisher starts over with a keyframe
+			string name = m_name;
+			open(name.c_str());
+			m_name = name;
+			return false;
+		}
+		if (result != SpoutFrameRing::RING_FRAME)
+			break;
+		if (m_decoder.apply(m_buffer.data(), info.size))
+		{
+			applied = true;
+			timestamp = info.timestamp;
+		}
+		else
+			m_refused++;
+	}
+	if (!applied)
+		return false;
+	m_decoder.frame().copyTo(depth);
+	return true;
+}
+
+bool TileDeltaSubscriber::waitFrame(int timeoutMsec)
+{
+	if (!m_event.isOpen() || m_event.senderClosed())
+	{
+		if (m_name.empty() || !m_event.open(m_name.c_str()))
+		{
+			this_thread::sleep_for(chrono::milliseconds(timeoutMsec));
+			return true;
+		}
+		m_eventSequence = 0;
+	}
+	return m_event.wait(m_eventSequence, timeoutMsec);
+}
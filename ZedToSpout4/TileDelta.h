@@ -0,0 +1,159 @@
+#pragma once
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "opencv2/core.hpp"
+#include "DepthKernels.h"
+#include "SpoutFrameRing.h"
+#include "SpoutFrameEvent.h"
+
+// Publishing only what changed of 16-bit millimeter depth (the DEPTH16_*
+// codes of DepthEncoding.h). The frame is cut into square tiles and a tile
+// goes out when one of its pixels moved by more than the tolerance from the
+// frame the receivers have, or a sentinel appeared or went. A delta frame is
+// a TileDeltaHeader, one bit a tile in raster order, then the pixels of the
+// tiles set, tile after tile and row after row. The encoder keeps the frame
+// as the receivers rebuild it, so the error never grows past the tolerance
+// however long a pixel drifts.
+//
+// Every delta builds on the frame before it. A receiver that missed one
+// refuses the others until the next keyframe, which has every tile and comes
+// every keyframeInterval frames, after a size change and when asked for.
+
+static const unsigned short TILE_DELTA_KEY = 1; // every tile, builds on nothing
+
+struct TileDeltaHeader
+{
+	unsigned int magic;             // "ZTSD"
+	unsigned short version, flags;  // TILE_DELTA_KEY
+	unsigned short width, height;
+	unsigned short tileSize, tilesX, tilesY, reserved;
+	unsigned int sequence;          // the encoder's frame count, a delta builds on sequence - 1
+	unsigned int changedTiles;
+};
+
+struct TileDeltaParams
+{
+	int tileSize;         // pixels, a multiple of 8 up to 256
+	int toleranceMm;      // a tile with no pixel moving further is unchanged, 0 for exact
+	int keyframeInterval; // frames, 0 for keyframes only when needed
+	int isa;              // KernelIsa, 0 for the best the processor has
+
+	TileDeltaParams() : tileSize(32), toleranceMm(8), keyframeInterval(30), isa(KERNEL_AUTO) {}
+};
+
+// "tile[:tolerance[:keyframe]]"
+bool parseTileDelta(const std::string &text, TileDeltaParams &params);
+std::string formatTileDelta(const TileDeltaParams &params);
+
+// Largest delta frame of a size
+size_t tileDeltaBound(int width, int height, int tileSize);
+// Reads the header of a delta frame, false when it isn't one
+bool tileDeltaInfo(const unsigned char* in, size_t size, TileDeltaHeader &header);
+
+class TileDeltaEncoder
+{
+public:
+	TileDeltaEncoder();
+	// Takes effect on the next frame, a keyframe when the tiles change
+	void setParams(const TileDeltaParams &params);
+	const TileDeltaParams& params() const { return m_params; }
+	// The next frame is a keyframe, for a receiver that just came
+	void requestKeyframe() { m_bKeyRequested = true; }
+
+	// Encodes CV_16UC1 depth into out, which grows as needed, and returns the size
+	size_t encode(const cv::Mat &depth, std::vector<unsigned char> &out);
+	// Into a buffer of tileDeltaBound bytes at least, 0 when it's smaller
+	size_t encode(const cv::Mat &depth, unsigned char* out, size_t capacity);
+
+	// Of the last frame encoded
+	unsigned int changedTiles() const { return m_changedTiles; }
+	unsigned int tileCount() const { return (unsigned int)m_changed.size(); }
+	bool lastWasKeyframe() const { return m_bLastKey; }
+	unsigned int sequence() const { return m_sequence; }
+private:
+	TileDeltaParams m_params;
+	cv::Mat m_reference; // the frame as the receivers rebuild it
+	int m_tilesX, m_tilesY;
+	unsigned int m_sequence;
+	unsigned int m_sinceKey;
+	bool m_bKeyRequested;
+	std::vector<unsigned char> m_changed; // by tile
+	std::vector<size_t> m_offsets;        // of the changed tiles' pixels in the frame
+	unsigned int m_changedTiles;
+	bool m_bLastKey;
+};
+
+// Rebuilds the depth from delta frames, the receiving half of TileDeltaEncoder
+class TileDeltaDecoder
+{
+public:
+	TileDeltaDecoder();
+	// Waits for a keyframe again
+	void reset();
+	// Applies a delta frame. False when it is corrupt or builds on a frame
+	// this decoder didn't apply, which leaves the frame as it was.
+	bool apply(const unsigned char* in, size_t size);
+	// CV_16UC1, valid once a keyframe came
+	const cv::Mat& frame() const { return m_frame; }
+	bool hasFrame() const { return m_bValid; }
+	unsigned int sequence() const { return m_sequence; }
+private:
+	cv::Mat m_frame;
+	bool m_bValid;
+	unsigned int m_sequence; // of the last frame applied
+};
+
+// Delta frames of the depth through a SpoutFrameRing, for receivers on this
+// machine, with a SpoutFrameEvent of the same name. Frames are written
+// straight into the ring slots.
+class TileDeltaPublisher
+{
+public:
+	TileDeltaPublisher();
+	~TileDeltaPublisher();
+	bool create(const char* name, int width, int height, const TileDeltaParams &params, unsigned int slots = 4);
+	void close();
+	bool isOpen() const { return m_ring.isOpen(); }
+	// CV_16UC1 of the size given to create
+	bool send(const cv::Mat &depth, unsigned long long timestamp);
+	const TileDeltaEncoder& encoder() const { return m_encoder; }
+	unsigned long long bytesSent() const { return m_bytesSent; }
+private:
+	TileDeltaPublisher(const TileDeltaPublisher&);
+	TileDeltaPublisher& operator=(const TileDeltaPublisher&);
+	SpoutFrameRing m_ring;
+	SpoutFrameEvent m_event;
+	TileDeltaEncoder m_encoder;
+	cv::Size m_size;
+	unsigned long long m_bytesSent;
+};
+
+// Reads a TileDeltaPublisher. Frames are read in order while the ring still
+// has them, so a receiver keeps up with the deltas unless it falls a whole
+// ring behind, and then it waits for the next keyframe.
+class TileDeltaSubscriber
+{
+public:
+	TileDeltaSubscriber();
+	bool open(const char* name);
+	void close();
+	bool isOpen() const { return m_ring.isOpen(); }
+	// The depth rebuilt from every frame published since the last call, false
+	// when there was none or the decoder waits for a keyframe. depth is a
+	// copy the caller keeps.
+	bool receive(cv::Mat &depth, unsigned long long &timestamp);
+	// Blocks until the publisher signals a frame, false after timeoutMsec
+	bool waitFrame(int timeoutMsec);
+	const SpoutFrameRing::ReaderStats& ringStats() const { return m_ring.readerStats(); }
+	// Frames that came while the decoder waited for a keyframe
+	unsigned long long refused() const { return m_refused; }
+private:
+	std::string m_name;
+	SpoutFrameRing m_ring;
+	SpoutFrameEvent m_event;
+	unsigned int m_eventSequence;
+	TileDeltaDecoder m_decoder;
+	std::vector<unsigned char> m_buffer;
+	unsigned long long m_refused;
+};
@@ -0,0 +1,71 @@
+#include "stdafx.h"
+#include "ZedFrameSource.h"
+#include "FrameDemand.h"
+#include <iostream>
+#include <zed/utils/GlobalDefine.hpp>
+
+ZedFrameSource::ZedFrameSource(sl::zed::Camera* zed)
+	: m_zed(zed), m_confidenceThreshold(100), m_sensingMode(sl::zed::STANDARD),
+	m_selfCalibrationStatus(sl::zed::SELF_CALIBRATION_NOT_CALLED)
+{
+}
+
+cv::Size ZedFrameSource::size() const
+{
+	return cv::Size(m_zed->getImageSize().width, m_zed->getImageSize().height);
+}
+
+CameraIntrinsics ZedFrameSource::intrinsics() const
+{
+	// Rectified left camera, the one depth is aligned with
+	const sl::zed::CamParameters &left = m_zed->getParameters()->LeftCam;
+	CameraIntrinsics k = { left.fx, left.fy, left.cx, left.cy };
+	return k;
+}
+
+sl::zed::GrabParams ZedFrameSource::grabParams(unsigned int streams, sl::zed::SENSING_MODE mode)
+{
+	CameraPasses passes = cameraPasses(streams);
+	return sl::zed::GrabParams(mode, passes.measure, passes.disparity, false);
+}
+
+bool ZedFrameSource::grab(DepthFrame &frame, unsigned int streams)
+{
+	// Disparity Map filtering
+	m_zed->setConfidenceThreshold(m_confidenceThreshold);
+
+	// Get frames and launch the computation
+	if (m_zed->grab(grabParams(streams, sensingMode())))
+		return false;
+
+	if (m_selfCalibrationStatus != m_zed->getSelfCalibrationStatus()) {
+		m_selfCalibrationStatus = m_zed->getSelfCalibrationStatus();
+		std::cout << "Self Calibration Status : " << sl::zed::statuscode2str(m_selfCalibrationStatus) << std::endl;
+	}
+	frame.timestamp = m_zed->getCameraTimestamp();
+
+	// The SDK buffers are replaced by the next retrieve, so they are duplicated
+	if (streams & FRAME_LEFT)
+		slMat2cvMat(m_zed->retrieveImage(sl::zed::LEFT)).copyTo(frame.left);
+	else
+		frame.left.release();
+	if (streams & FRAME_DEPTH)
+		slMat2cvMat(m_zed->retrieveMeasure(sl::zed::MEASURE::DEPTH)).copyTo(frame.depth);
+	else
+		frame.depth.release();
+	if (streams & FRAME_CONFIDENCE)
+		slMat2cvMat(m_zed->retrieveMeasure(sl::zed::MEASURE::CONFIDENCE)).copyTo(frame.confidence);
+	else
+		frame.confidence.release();
+	return true;
+}
+
+bool ZedFrameSource::retrieveView(int viewID, cv::Mat &view)
+{
+	// 'viewID' can be 'SIDE mode' or 'VIEW mode'
+	if (viewID >= sl::zed::LEFT && viewID < sl::zed::LAST_SIDE)
+		slMat2cvMat(m_zed->retrieveImage(static_cast<sl::zed::SIDE> (viewID))).copyTo(view);
+	else
+		slMat2cvMat(m_zed->getView(static_cast<sl::zed::VIEW_MODE> (viewID - (int)sl::zed::LAST_SIDE))).copyTo(view);
+	return true;
+}
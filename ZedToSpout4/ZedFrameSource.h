@@ -0,0 +1,30 @@
+#pragma once
+#include <atomic>
+#include "FrameSource.h"
+#include <zed/Camera.hpp>
+
+// Live camera or SVO playback through the ZED SDK
+class ZedFrameSource : public FrameSource
+{
+public:
+	// The camera must already be initialized; it is not owned
+	explicit ZedFrameSource(sl::zed::Camera* zed);
+	cv::Size size() const;
+	bool grab(DepthFrame &frame, unsigned int streams = FRAME_ALL);
+	bool retrieveView(int viewID, cv::Mat &view);
+	CameraIntrinsics intrinsics() const;
+
+	// Least the SDK has to compute for a FrameStream mask. The point cloud is
+	// never asked for, and only depth needs the measure pass.
+	static sl::zed::GrabParams grabParams(unsigned int streams, sl::zed::SENSING_MODE mode);
+	void setConfidenceThreshold(int threshold) { m_confidenceThreshold = threshold; }
+
+	// Settings below may be changed from another thread, they apply from the next grab
+	void setSensingMode(sl::zed::SENSING_MODE mode) { m_sensingMode = mode; }
+	sl::zed::SENSING_MODE sensingMode() const { return static_cast<sl::zed::SENSING_MODE>(m_sensingMode.load()); }
+private:
+	sl::zed::Camera* m_zed;
+	std::atomic<int> m_confidenceThreshold;
+	std::atomic<int> m_sensingMode;
+	sl::zed::ZED_SELF_CALIBRATION_STATUS m_selfCalibrationStatus;
+};
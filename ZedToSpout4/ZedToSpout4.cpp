@@ -7,6 +7,32 @@
 #include "Glew\glew.h"
 #include "opencv2\opencv.hpp"
 #include "Opencv2Opengl.h"
+#include "FramePipeline.h"
+#include "FrameSource.h"
+#include "DepthRecording.h"
+#include "ZedFrameSource.h"
+#include "DepthKernels.h"
+#include "DepthEncoding.h"
+#include "DepthBands.h"
+#include "ControlChannel.h"
+#include "Telemetry.h"
+#include "FrameDemand.h"
+#include "StreamFanout.h"
+#include "PointCloud.h"
+#include "TemporalFilter.h"
+#include "SpatialFilter.h"
+#include "PreviewScaler.h"
+#include "Benchmark.h"
+#include "NetworkDepth.h"
+#include "TileDelta.h"
+#include "DepthQuery.h"
+#include "DepthStats.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <sstream>
 #include <zed/Camera.hpp>
 #include <zed/utils/GlobalDefine.hpp>
 
@@ -14,10 +40,11 @@ using namespace std;
 using namespace cv;
 
 typedef struct mouseOCVStruct {
-	float* data;
-	uint32_t step;
+	DepthQueryService* query;
 	cv::Size _image;
 	cv::Size _resize;
+	cv::Point pressed; // in image pixels
+	bool dragging;
 	std::string name;
 	std::string unit;
 } mouseOCV;
@@ -26,133 +53,576 @@ string toSpout;
 
 mouseOCV mouseStruct;
 
+// Percentile the depth window reports for a dragged rectangle
+static const float MOUSE_PERCENTILE = 90.0f;
+
+// A click prints the depth under it, a drag the depth statistics of the rectangle
 static void onMouseCallback(int32_t event, int32_t x, int32_t y, int32_t flag, void * param) {
+	mouseOCVStruct* data = (mouseOCVStruct*)param;
+	cv::Point image(x * data->_image.width / data->_resize.width, y * data->_image.height / data->_resize.height);
 	if (event == CV_EVENT_LBUTTONDOWN) {
-		mouseOCVStruct* data = (mouseOCVStruct*)param;
-
-		int y_int = (y * data->_image.height / data->_resize.height);
-		int x_int = (x * data->_image.width / data->_resize.width);
-
-		float* ptr_image_num = (float*)((int8_t*)data->data + y_int * data->step);
-		float dist = ptr_image_num[x_int];
+		data->pressed = image;
+		data->dragging = true;
+		return;
+	}
+	if (event != CV_EVENT_LBUTTONUP || !data->dragging)
+		return;
+	data->dragging = false;
 
+	if (std::abs(image.x - data->pressed.x) < 4 && std::abs(image.y - data->pressed.y) < 4) {
+		std::vector<cv::Point> points(1, data->pressed);
+		std::vector<float> depths;
+		if (!data->query->depthAt(points, depths))
+			return;
+		float dist = depths[0];
 		if (isValidMeasure(dist))
 			printf("\n%s : %2.2f %s\n", data->name.c_str(), dist, data->unit.c_str());
 		else {
 			if (dist == TOO_FAR)
-				printf("\n%s is too far.\n", data->name.c_str(), dist, data->unit.c_str());
+				printf("\n%s is too far.\n", data->name.c_str());
 			else if (dist == TOO_CLOSE)
-				printf("\n%s is too close.\n", data->name.c_str(), dist, data->unit.c_str());
+				printf("\n%s is too close.\n", data->name.c_str());
 			else
-				printf("\n%s not avaliable\n", data->name.c_str(), dist, data->unit.c_str());
+				printf("\n%s not avaliable\n", data->name.c_str());
 		}
+		return;
 	}
+
+	cv::Rect rect(data->pressed, image);
+	DepthRoiStats stats;
+	if (data->query->regionStats(rect, MOUSE_PERCENTILE, stats))
+		printf("\n%s %dx%d at %d,%d : %s\n", data->name.c_str(), rect.width, rect.height, rect.x, rect.y,
+			formatDepthRoiStats(stats, MOUSE_PERCENTILE).c_str());
 }
 
-int _tmain(int argc, char **argv)
+// Depth queries from the control channel : "depth x,y[;x,y...]" for the depth
+// at image pixels, "roi x,y,w,h [percentile]" and "polygon x,y;x,y;x,y
+// [percentile]" for the statistics of a region. Replies start with the frame
+// the answer comes from.
+static std::string depthCommand(const std::string &name, const std::string &value, const DepthQueryService &query)
+{
+	std::string shape = value.substr(0, value.find(' '));
+	float percentile = MOUSE_PERCENTILE;
+	if (shape.size() < value.size())
+		percentile = (float)atof(value.c_str() + shape.size() + 1);
+	std::vector<cv::Point> points;
+	if (name != "roi" && !parseDepthPoints(shape, points))
+		return "error bad points " + shape;
+
+	std::ostringstream reply;
+	unsigned long long frameId = 0;
+	if (name == "depth") {
+		std::vector<float> depths;
+		frameId = query.depthAt(points, depths);
+		reply << "depth frame " << frameId;
+		for (size_t i = 0; i < depths.size(); i++)
+			reply << " " << formatDepth(depths[i]);
+	}
+	else {
+		DepthRoiStats stats;
+		int x, y, w, h;
+		if (name == "roi") {
+			if (sscanf(shape.c_str(), "%d,%d,%d,%d", &x, &y, &w, &h) != 4 || w <= 0 || h <= 0)
+				return "error bad rectangle " + shape;
+			frameId = query.regionStats(cv::Rect(x, y, w, h), percentile, stats);
+		}
+		else {
+			if (points.size() < 3)
+				return "error a polygon needs 3 points";
+			frameId = query.regionStats(points, percentile, stats);
+		}
+		reply << name << " frame " << frameId << " " << formatDepthRoiStats(stats, percentile);
+	}
+	if (frameId == 0)
+		return "error no depth yet";
+	return reply.str();
+}
+
+// Commands from the control channel : "bands lo:hi[:label],...", "bands off",
+// "bandmode binary|labels|bits", "bands" alone to read them back, "stats"
+// for the timings since start as JSON ("stats csv" for CSV rows),
+// "depthstats" for the statistics of the latest frame as JSON ("depthstats
+// histogram" with its histogram), and the depth queries of depthCommand
+static std::string controlCommand(const std::string &command, DepthBandSet &bandSet, const Telemetry &telemetry,
+	const DepthQueryService &query)
+{
+	std::string name = command.substr(0, command.find(' '));
+	std::string value = name.size() < command.size() ? command.substr(name.size() + 1) : std::string();
+	std::vector<DepthBand> bands;
+	BandMaskMode mode;
+	if (name == "depth" || name == "roi" || name == "polygon")
+		return depthCommand(name, value, query);
+	if (name == "depthstats") {
+		std::shared_ptr<const DepthSnapshot> latest = query.snapshot();
+		if (!latest)
+			return "error no depth yet";
+		return depthFrameStatsJSON(latest->stats, latest->frameId, value == "histogram");
+	}
+	if (name == "stats") {
+		TelemetrySnapshot snapshot;
+		telemetry.snapshot(snapshot);
+		std::ostringstream out;
+		if (value == "csv") {
+			snapshot.writeCSVHeader(out);
+			snapshot.writeCSV(out, 0);
+		}
+		else
+			snapshot.writeJSON(out, 0);
+		std::string reply = out.str();
+		return reply.substr(0, reply.size() - 1);
+	}
+	if (name == "bands" && !value.empty()) {
+		if (!parseDepthBands(value, bands))
+			return "error bad bands " + value;
+		bandSet.set(bands);
+	}
+	else if (name == "bandmode") {
+		if (!parseBandMaskMode(value, mode))
+			return "error bad band mode " + value;
+		bandSet.setMode(mode);
+	}
+	else if (name != "bands") {
+		return "error unknown command " + name;
+	}
+	bandSet.get(bands, mode);
+	return "bands " + formatDepthBands(bands) + " mode " + bandMaskModeName(mode);
+}
+
+// Runtime commands with a keyboard shortcut, "key x" sends any other key
+static const struct { const char* command; int key; } s_commandKeys[] = {
+	{ "quit", 'q' }, { "cloud", 'p' }, { "temporal", 't' }, { "fill", 'f' }, { "confidence", 'c' },
+	{ "sensing", 's' }, { "disparity", 'd' }, { "threshold down", 'b' }, { "threshold up", 'n' },
+	{ "view left", '0' }, { "view right", '1' }, { "view sbs", '2' }, { "view overlay", '3' },
+	{ "view difference", '4' }, { "view anaglyph", '5' }, { "seek back", '[' }, { "seek forward", ']' },
+};
+
+static int commandKey(const std::string &command)
 {
+	if (command.size() == 5 && command.compare(0, 4, "key ") == 0)
+		return (unsigned char)command[4];
+	for (size_t i = 0; i < sizeof(s_commandKeys) / sizeof(s_commandKeys[0]); i++)
+		if (command == s_commandKeys[i].command)
+			return s_commandKeys[i].key;
+	return -1;
+}
 
-	if (argc > 3) {
-		std::cout << "Only the path of a SVO or a InitParams file can be passed in arg." << std::endl;
-		return -1;
+// Keys from the control port and the console, run by the main loop like typed ones
+class KeyQueue
+{
+public:
+	void push(int key)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_keys.push_back(key);
+		m_ready.notify_one();
 	}
+	// -1 when no key came before the deadline
+	int wait(std::chrono::steady_clock::time_point deadline)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (m_keys.empty())
+			if (m_ready.wait_until(lock, deadline) == std::cv_status::timeout && m_keys.empty())
+				return -1;
+		int key = m_keys.front();
+		m_keys.pop_front();
+		return key;
+	}
+private:
+	std::mutex m_mutex;
+	std::condition_variable m_ready;
+	std::deque<int> m_keys;
+};
+
+// Arguments from a file, separated by white space, '#' comments out the rest of a line
+static bool readConfigArguments(const std::string &name, std::vector<std::string> &args)
+{
+	std::ifstream file(name.c_str());
+	if (!file)
+		return false;
+	std::string line, arg;
+	while (std::getline(file, line)) {
+		std::istringstream words(line.substr(0, line.find('#')));
+		while (words >> arg)
+			args.push_back(arg);
+	}
+	return true;
+}
+
+int _tmain(int argc, char **argv)
+{
 
 	bool readSVO = false;
 	std::string SVOName;
 	bool loadParams = false;
 	std::string ParamsName;
-	if (argc > 1) {
+	bool memoryShare = false;
+	DepthEncoding encoding = DEPTH_PLANE8;
+	bool runBenchmark = false;
+	bool useSynthetic = false;
+	std::string replayName;
+	std::string recordName;
+	RecordingOptions recordOptions;
+	double replayFps = 0;
+	FramePipeline::DropPolicy dropPolicy = FramePipeline::DROP_OLDEST;
+	DepthBandSet bandSet;
+	int controlPort = 0;
+	std::string telemetryName;
+	int telemetryInterval = 5;
+	StreamFanout fanout;
+	PointCloudParams cloudParams;
+	bool useTemporal = false;
+	TemporalFilterParams temporalParams;
+	bool useSpatial = false;
+	SpatialFilterParams spatialParams;
+	// The windows only observe the pipeline at this rate, they never hold up a Spout frame
+	int previewInterval = 66;
+	bool headless = false;
+	int ringSlots = 0;
+	std::string netTarget;
+	bool netCompress = false;
+	std::string netReceive;
+	bool useDelta = false;
+	TileDeltaParams deltaParams;
+	bool deltaShare = false;
+	AutoRangeParams rangeParams;
+
+	// The arguments, with those of a --config file in its place
+	std::vector<std::string> args;
+	for (int i = 1; i < argc; i++) {
+		if (std::string(argv[i]) == "--config" && i + 1 < argc) {
+			if (!readConfigArguments(argv[++i], args)) {
+				std::cout << "Cannot read config " << argv[i] << std::endl;
+				return -1;
+			}
+		}
+		else
+			args.push_back(argv[i]);
+	}
+	if (!args.empty()) {
 		std::string _arg;
-		for (int i = 1; i < argc; i++) {
-			_arg = argv[i];
+		for (int i = 0; i < (int)args.size(); i++) {
+			_arg = args[i];
+			bool hasValue = i + 1 < (int)args.size();
 			if (_arg.find(".svo") != std::string::npos) {
 				// If a SVO is given we save its name
 				readSVO = true;
 				SVOName = _arg;
 			}
-			if (_arg.find(".ZEDinitParam") != std::string::npos) {
+			else if (_arg.find(".ZEDinitParam") != std::string::npos) {
 				// If a parameter file is given we save its name
 				loadParams = true;
 				ParamsName = _arg;
 			}
+			else if (_arg == "--encoding" && hasValue && parseDepthEncoding(args[i + 1].c_str(), encoding)) {
+				// What is sent : plane8, r16_mm, r32f_m or rg8_hilo
+				i++;
+			}
+			else if (_arg == "--memoryshare") {
+				// Publish through Spout shared memory instead of a GL texture
+				memoryShare = true;
+			}
+			else if (_arg == "--block") {
+				// Never drop frames between pipeline stages, wait instead
+				dropPolicy = FramePipeline::BLOCK;
+			}
+			else if (_arg == "--bench") {
+				// Run the pipeline without windows and report stage timings
+				runBenchmark = true;
+			}
+			else if (_arg == "--synthetic") {
+				// Generated scene instead of the camera
+				useSynthetic = true;
+			}
+			else if (_arg == "--replay" && hasValue) {
+				// Depth recording instead of the camera
+				replayName = args[++i];
+			}
+			else if (_arg == "--fps" && hasValue) {
+				// Rate for synthetic and replayed sources, a cap for the camera, 0 is as fast as possible
+				replayFps = atof(args[++i].c_str());
+			}
+			else if (_arg == "--record" && hasValue) {
+				// Save every captured frame to a depth recording
+				recordName = args[++i];
+			}
+			else if (_arg == "--record-u16") {
+				// Record depth as 16-bit millimeters
+				recordOptions.depthFormat = RECORD_DEPTH_U16;
+			}
+			else if (_arg == "--record-rvl") {
+				// Record depth as 16-bit millimeters, RVL compressed
+				recordOptions.depthFormat = RECORD_DEPTH_RVL;
+			}
+			else if (_arg == "--rvl-step" && hasValue) {
+				// Quantize RVL depth, steps of this many mm at 1 m growing with the square of the depth
+				recordOptions.depthFormat = RECORD_DEPTH_RVL;
+				recordOptions.rvlStepMm = (float)atof(args[++i].c_str());
+			}
+			else if (_arg == "--compress") {
+				// Compress recorded frames, replays then decode instead of mapping
+				recordOptions.compress = true;
+			}
+			else if (_arg == "--bands" && hasValue) {
+				// Publish a mask of these depth bands instead of the depth, lo:hi[:label],... in mm
+				std::vector<DepthBand> bands;
+				if (!parseDepthBands(args[++i], bands)) {
+					std::cout << "Bad depth bands " << args[i] << std::endl;
+					return -1;
+				}
+				bandSet.set(bands);
+			}
+			else if (_arg == "--band-mode" && hasValue) {
+				// binary, labels or bits
+				BandMaskMode mode;
+				if (!parseBandMaskMode(args[++i], mode)) {
+					std::cout << "Bad band mode " << args[i] << std::endl;
+					return -1;
+				}
+				bandSet.setMode(mode);
+			}
+			else if (_arg == "--control" && hasValue) {
+				// Localhost UDP port for text commands
+				controlPort = atoi(args[++i].c_str());
+			}
+			else if (_arg == "--telemetry" && hasValue) {
+				// Append stage timings to a .csv or .json file
+				telemetryName = args[++i];
+			}
+			else if (_arg == "--telemetry-interval" && hasValue) {
+				// Seconds between telemetry rows
+				telemetryInterval = atoi(args[++i].c_str());
+			}
+			else if (_arg == "--stream" && hasValue) {
+				// Extra sender from the same grab, kind[:divisor][=sender]
+				FanoutStreamSpec spec;
+				if (!parseFanoutStream(args[++i], spec) || !fanout.add(spec)) {
+					std::cout << "Bad stream " << args[i] << std::endl;
+					return -1;
+				}
+			}
+			else if (_arg == "--cloud-voxel" && hasValue) {
+				// Voxel grid leaf size in mm for point clouds, 0 keeps every point
+				cloudParams.voxelMm = (float)atof(args[++i].c_str());
+			}
+			else if (_arg == "--temporal" && hasValue) {
+				// Temporal depth filter, alpha[:motion[:hold[:confidence]]]
+				if (!parseTemporalFilter(args[++i], temporalParams)) {
+					std::cout << "Bad temporal filter " << args[i] << std::endl;
+					return -1;
+				}
+				useTemporal = true;
+			}
+			else if (_arg == "--fill" && hasValue) {
+				// CPU hole filling guided by the left image, spatial[:color[:radius[:iterations]]]
+				bool smooth = spatialParams.smooth;
+				if (!parseSpatialFilter(args[++i], spatialParams)) {
+					std::cout << "Bad fill filter " << args[i] << std::endl;
+					return -1;
+				}
+				spatialParams.smooth = smooth;
+				useSpatial = true;
+			}
+			else if (_arg == "--preview-fps" && hasValue) {
+				// Rate of the preview windows, 0 leaves them empty
+				double previewFps = atof(args[++i].c_str());
+				previewInterval = previewFps > 0 ? (int)(1000.0 / previewFps) : 0;
+			}
+			else if (_arg == "--fill-holes-only") {
+				// The fill filter leaves the measured depths as they are
+				spatialParams.smooth = false;
+			}
+			else if (_arg == "--ring" && hasValue) {
+				// Memoryshare through a frame ring of N slots, receivers never hold up the sender
+				ringSlots = atoi(args[++i].c_str());
+				if (ringSlots < 2) {
+					std::cout << "A frame ring needs at least 2 slots" << std::endl;
+					return -1;
+				}
+				memoryShare = true;
+			}
+			else if (_arg == "--net" && hasValue) {
+				// Also send the depth as 16-bit millimeters to [udp:|tcp:]host:port
+				netTarget = args[++i];
+			}
+			else if (_arg == "--net-compress") {
+				// Send the network depth RVL compressed
+				netCompress = true;
+			}
+			else if (_arg == "--net-receive" && hasValue) {
+				// Depth from a --net sender instead of the camera, on [udp:|tcp:]port
+				netReceive = args[++i];
+			}
+			else if (_arg == "--delta" && hasValue) {
+				// Only the changed tiles of the network depth, tile[:tolerance mm[:keyframe interval]]
+				if (!parseTileDelta(args[i + 1], deltaParams)) {
+					std::cout << "Bad tile delta " << args[i + 1] << std::endl;
+					return -1;
+				}
+				useDelta = true;
+				i++;
+			}
+			else if (_arg == "--delta-share") {
+				// The depth as tile deltas in a frame ring of its own too
+				deltaShare = true;
+			}
+			else if (_arg == "--range" && hasValue) {
+				// Bounds of the 8-bit plane, frame, fixed:near:far or percentile[:low:high[:smoothing[:hysteresis]]]
+				if (!parseAutoRange(args[++i], rangeParams)) {
+					std::cout << "Bad range " << args[i] << std::endl;
+					return -1;
+				}
+			}
+			else if (_arg == "--headless") {
+				// No windows at all, commands come from the console and the control port
+				headless = true;
+			}
+			else {
+				std::cout << "Usage : ZedToSpout4 [file.svo] [file.ZEDinitParam] [--synthetic | --replay file.ztsrec] [--fps N]" << std::endl;
+				std::cout << "                    [--record file.ztsrec [--record-u16 | --record-rvl [--rvl-step mm]] [--compress]] [--memoryshare] [--block] [--bench]" << std::endl;
+				std::cout << "                    [--encoding plane8 | r16_mm | r32f_m | rg8_hilo]" << std::endl;
+				std::cout << "                    [--bands lo:hi[:label],... [--band-mode binary | labels | bits]] [--control port]" << std::endl;
+				std::cout << "                    [--telemetry file.csv | file.json [--telemetry-interval s]]" << std::endl;
+				std::cout << "                    [--stream left | right | confidence | overlay | difference | sbs | anaglyph | cloud[:divisor][=sender]]..." << std::endl;
+				std::cout << "                    [--cloud-voxel mm] [--temporal alpha[:motion[:hold[:confidence]]]]" << std::endl;
+				std::cout << "                    [--fill spatial[:color[:radius[:iterations]]] [--fill-holes-only]] [--preview-fps N]" << std::endl;
+				std::cout << "                    [--headless] [--config file] [--ring N]" << std::endl;
+				std::cout << "                    [--net [udp:|tcp:]host:port [--net-compress]] [--net-receive [udp:|tcp:]port]" << std::endl;
+				std::cout << "                    [--delta tile[:tolerance[:keyframe]]] [--delta-share]" << std::endl;
+				std::cout << "                    [--range frame | fixed:near:far | percentile[:low:high[:smoothing[:hysteresis]]]]" << std::endl;
+				return -1;
+			}
 		}
 	}
 
-	sl::zed::Camera* zed;
-	
+	// Benchmarks never need the camera
+	if (runBenchmark && replayName.empty() && netReceive.empty())
+		useSynthetic = true;
 
-	if (!readSVO) // Live Mode
-		zed = new sl::zed::Camera(sl::zed::HD720);
-	else // SVO playback mode
-		zed = new sl::zed::Camera(SVOName);
-
-	// Define a struct of parameters for the initialization
+	FrameSource* source = NULL;
+	sl::zed::Camera* zed = NULL;
+	ZedFrameSource* zedSource = NULL;
+	RecordedFrameSource* recorded = NULL;
 	sl::zed::InitParams params;
 
-	if (loadParams) // A parameters file was given in argument, we load it
-		params.load(ParamsName);
+	if (useSynthetic) {
+		source = new SyntheticFrameSource(1280, 720, replayFps);
+	}
+	else if (!replayName.empty()) {
+		recorded = new RecordedFrameSource(replayFps);
+		if (!recorded->open(replayName.c_str())) {
+			std::cout << "Cannot open recording " << replayName << std::endl;
+			delete recorded;
+			return 1;
+		}
+		source = recorded;
+	}
+	else if (!netReceive.empty()) {
+		NetworkTransport transport;
+		std::string host;
+		unsigned short port = 0;
+		NetworkFrameSource* received = new NetworkFrameSource();
+		if (!parseNetworkAddress(netReceive, transport, host, port) || !host.empty()) {
+			std::cout << "Bad network port " << netReceive << std::endl;
+			delete received;
+			return -1;
+		}
+		std::cout << "Waiting for depth on " << (transport == NETWORK_TCP ? "TCP" : "UDP") << " port " << port << std::endl;
+		// From another machine : every interface
+		if (!received->open(port, transport, true, 30000)) {
+			std::cout << "No depth received on port " << port << std::endl;
+			delete received;
+			return 1;
+		}
+		source = received;
+	}
+	else {
+		if (!readSVO) // Live Mode
+			zed = new sl::zed::Camera(sl::zed::HD720);
+		else // SVO playback mode
+			zed = new sl::zed::Camera(SVOName);
 
-	// Enables verbosity in the console
-	params.verbose = true;
+		if (loadParams) // A parameters file was given in argument, we load it
+			params.load(ParamsName);
 
+		// Every stage after the grab works in millimeters, whatever the parameters file says
+		if (params.unit != sl::zed::MILLIMETER) {
+			std::cout << "Depth unit " << unit2str(params.unit) << " overridden, ZedToSpout works in " << unit2str(sl::zed::MILLIMETER) << std::endl;
+			params.unit = sl::zed::MILLIMETER;
+		}
 
-	sl::zed::ERRCODE err = zed->init(params);
-	std::cout << "Error code : " << sl::zed::errcode2str(err) << std::endl;
-	if (err != sl::zed::SUCCESS) {
-		// Exit if an error occurred
-		delete zed;
-		return 1;
-	}
+		// Enables verbosity in the console
+		params.verbose = true;
 
-	std::cout << "Finished errcode cout " << std::endl;
 
-	// Save the initialization parameters
-	// The file can be used later in any zed based application
-	//params.save("MyParam"); // CAUSES CRASH, MAYBE CAUSE
+		sl::zed::ERRCODE err = zed->init(params);
+		std::cout << "Error code : " << sl::zed::errcode2str(err) << std::endl;
+		if (err != sl::zed::SUCCESS) {
+			// Exit if an error occurred
+			delete zed;
+			return 1;
+		}
 
-	std::cout << "Finished param save " << std::endl;
+		std::cout << "Finished errcode cout " << std::endl;
 
-	char key = ' ';
-	int viewID = 0;
-	int confidenceThres = 100;
+		// Save the initialization parameters
+		// The file can be used later in any zed based application
+		//params.save("MyParam"); // CAUSES CRASH, MAYBE CAUSE
 
-	bool displayDisp = true;
-	bool displayConfidenceMap = false;
+		std::cout << "Finished param save " << std::endl;
+
+		zedSource = new ZedFrameSource(zed);
+		source = zedSource;
+	}
 
-	int width = zed->getImageSize().width;
-	int height = zed->getImageSize().height;
+	if (runBenchmark) {
+		int result = runDemandCheck(*source);
+		if (result == 0)
+			result = runKernelBenchmark(*source);
+		if (result == 0)
+			result = runTemporalFilterBenchmark(*source);
+		if (result == 0)
+			result = runSpatialFilterBenchmark();
+		if (result == 0)
+			result = runPipelineBenchmark(*source, 10, dropPolicy, memoryShare);
+		if (result == 0)
+			result = runHeadlessBenchmark(*source, 10);
+		if (result == 0)
+			result = runFrameEventBenchmark(5);
+		if (result == 0)
+			result = runDepthCodecBenchmark(*source);
+		if (result == 0)
+			result = runNetworkBenchmark(*source, 2);
+		if (result == 0)
+			result = runTileDeltaBenchmark(*source, 90, 2);
+		if (result == 0)
+			result = runDepthStatsBenchmark(*source);
+		delete source;
+		delete zed;
+		return result;
+	}
 
-	cv::Mat disp(height, width, CV_8UC4);
-	cv::Mat anaglyph(height, width, CV_8UC4);
-	cv::Mat confidencemap(height, width, CV_8UC4);
+	fanout.setPointCloud(source->intrinsics(), cloudParams);
 
-	cv::Size displaySize(720, 404);
-	cv::Mat dispDisplay(displaySize, CV_8UC4);
-	cv::Mat anaglyphDisplay(displaySize, CV_8UC4);
-	cv::Mat confidencemapDisplay(displaySize, CV_8UC4);
+	char key = ' ';
 
-	const char* nameOne = "testing";
-	Opencv2Spout converterOne(argc, argv, 1280, 720, false);
+	// Settings changed from the keyboard and read by the capture thread
+	std::atomic<int> viewID(0);
+	int confidenceThres = 100;
+	// Disparity-like 1 / depth stretch by default, 'd' switches to linear depth
+	std::atomic<bool> displayDisp(true);
+	bool displayConfidenceMap = false;
 
-	
+	int width = source->size().width;
+	int height = source->size().height;
 
+	cv::Size displaySize(720, 404);
 
-	sl::zed::SENSING_MODE dm_type = sl::zed::STANDARD;
+	const char* nameOne = "testing";
 
-	// Mouse callback initialization
-	sl::zed::Mat depth;
-	zed->grab(dm_type);
-	depth = zed->retrieveMeasure(sl::zed::MEASURE::DEPTH); // Get the pointer
-	// Set the structure
-	mouseStruct._image = cv::Size(width, height);
-	mouseStruct._resize = displaySize;
-	mouseStruct.data = (float*)depth.data;
-	mouseStruct.step = depth.step;
 	mouseStruct.name = "DEPTH";
-	mouseStruct.unit = unit2str(params.unit);
 
-	// The depth is limited to 20 METERS, as defined in zed::init()
-	zed->setDepthClampValue(10000);
+	// Depth for the mouse, control commands and scripts, published by the processing thread
+	DepthQueryService depthQuery;
 
 	// Create OpenCV Windows
 	// NOTE: You may encounter an issue with OpenGL support, to solve it either
@@ -160,155 +630,400 @@ int _tmain(int argc, char **argv)
 	//	or recompile OpenCV with OpenGL support (you may also need the gtk OpenGL Extension
 	//	on Linux, provided by the packages libgtkglext1 libgtkglext1-dev)
 	int wnd_flag = cv::WINDOW_AUTOSIZE /*| cv::WINDOW_OPENGL*/;
-	cv::namedWindow(mouseStruct.name, wnd_flag);
-	cv::setMouseCallback(mouseStruct.name, onMouseCallback, (void*)&mouseStruct);
-	cv::namedWindow("VIEW", wnd_flag);
+	if (!headless) {
+		cv::namedWindow(mouseStruct.name, wnd_flag);
+		cv::namedWindow("VIEW", wnd_flag);
 
-	std::cout << "Press 'q' to exit" << std::endl;
-	
+		// Mouse callback initialization : queries go to the latest published depth, never the SDK buffers
+		mouseStruct.query = &depthQuery;
+		mouseStruct._image = cv::Size(width, height);
+		mouseStruct._resize = displaySize;
+		mouseStruct.dragging = false;
+		mouseStruct.unit = unit2str(params.unit);
+		cv::setMouseCallback(mouseStruct.name, onMouseCallback, (void*)&mouseStruct);
+	}
+	else {
+		// Nothing to preview, and the Spout GL context lives in a hidden GLUT window
+		previewInterval = 0;
+		Opencv2Spout::setHiddenWindow(true);
+	}
 
+	if (zed) {
+		// The depth is limited to 20 METERS, as defined in zed::init()
+		zed->setDepthClampValue(10000);
 
-	// Jetson only. Execute the calling thread on core 2
-	sl::zed::Camera::sticktoCPUCore(2);
+		// Jetson only. Execute the calling thread on core 2
+		sl::zed::Camera::sticktoCPUCore(2);
+	}
 
-	sl::zed::ZED_SELF_CALIBRATION_STATUS old_self_calibration_status = sl::zed::SELF_CALIBRATION_NOT_CALLED;
-	
-	// Loop until 'q' is pressed
-	while (key != 'q') {
-		// Disparity Map filtering
-		zed->setConfidenceThreshold(confidenceThres);
+	if (headless) {
+		std::cout << "Type 'quit' to exit, 'cloud' to save a point cloud, 'temporal' / 'fill' to toggle the filters," << std::endl;
+		std::cout << "'key x' for any other key shortcut, 'bands ...', 'stats', 'depthstats', 'depth x,y' and 'roi x,y,w,h' as on the control port" << std::endl;
+	}
+	else {
+		std::cout << "Press 'q' to exit, 'p' to save a point cloud, 't' to toggle the temporal filter, 'f' the hole filling" << std::endl;
+		std::cout << "Click the depth window for the depth of a pixel, drag a rectangle for its statistics" << std::endl;
+	}
+	if (recorded)
+		std::cout << (headless ? "'seek back' / 'seek forward'" : "Press '[' / ']'") << " to scrub the recording by 5 s" << std::endl;
 
-		// Get frames and launch the computation
-		bool res = zed->grab(dm_type);
+	RecordingWriter recorder;
+	if (!recordName.empty() && !recorder.open(recordName.c_str(), width, height, recordOptions)) {
+		std::cout << "Cannot create recording " << recordName << std::endl;
+		recordName.clear();
+	}
 
-		if (!res) {
-			if (old_self_calibration_status != zed->getSelfCalibrationStatus()) {
-				std::cout << "Self Calibration Status : " << sl::zed::statuscode2str(zed->getSelfCalibrationStatus()) << std::endl;
-				old_self_calibration_status = zed->getSelfCalibrationStatus();
-			}
+	NetworkDepthSender netSender;
+	if (!netTarget.empty()) {
+		NetworkTransport transport;
+		std::string host;
+		unsigned short port = 0;
+		if (!parseNetworkAddress(netTarget, transport, host, port) || host.empty() ||
+			!netSender.open(host.c_str(), port, transport, netCompress))
+			std::cout << "Cannot send depth to " << netTarget << std::endl;
+		else {
+			if (useDelta)
+				netSender.setDelta(&deltaParams);
+			std::cout << "Sending depth to " << netTarget << (useDelta ? ", changed tiles " + formatTileDelta(deltaParams) :
+				netCompress ? ", compressed" : "") << std::endl;
+		}
+	}
+	// Receivers on this machine open the ring by this name, see TileDeltaSubscriber
+	const char* deltaShareName = "opencv2Spout_delta";
+	TileDeltaPublisher deltaPublisher;
+	if (deltaShare) {
+		if (deltaPublisher.create(deltaShareName, width, height, deltaParams))
+			std::cout << "Publishing changed depth tiles " << formatTileDelta(deltaParams) << " as " << deltaShareName << std::endl;
+		else
+			std::cout << "Cannot create the tile delta ring " << deltaShareName << std::endl;
+	}
 
-			depth = zed->retrieveMeasure(sl::zed::MEASURE::DEPTH); // Get the pointer
-			
+	// What each output reads, the source is only asked for that
+	FrameDemand demand;
+	demand.add("spout", FRAME_DEPTH);
+	if (!recordName.empty()) {
+		unsigned int recorded = 0;
+		if (recordOptions.streams & (1 << STREAM_COLOR)) recorded |= FRAME_LEFT;
+		if (recordOptions.streams & (1 << STREAM_DEPTH)) recorded |= FRAME_DEPTH;
+		if (recordOptions.streams & (1 << STREAM_CONFIDENCE)) recorded |= FRAME_CONFIDENCE;
+		demand.add("recorder", recorded);
+	}
+	demand.add("depth window", FRAME_DEPTH, true);
+	demand.add("view window", FRAME_VIEW, true);
+	demand.add("depth query", FRAME_DEPTH);
+	int confidenceWindow = demand.add("confidence window", 0, true);
+	// Confidence only weights the filter, it never has to be grabbed for it otherwise
+	const unsigned int temporalStreams = temporalParams.confidenceWeight > 0 ? FRAME_DEPTH | FRAME_CONFIDENCE : FRAME_DEPTH;
+	std::atomic<bool> temporalOn(useTemporal);
+	int temporalConsumer = demand.add("temporal filter", useTemporal ? temporalStreams : 0);
+	// The left image guides the hole filling
+	std::atomic<bool> spatialOn(useSpatial);
+	int spatialConsumer = demand.add("fill filter", useSpatial ? FRAME_DEPTH | FRAME_LEFT : 0);
+	std::cout << "Streams :" << std::endl;
+	demand.print(std::cout);
+	fanout.print(std::cout);
 
-			// The following is the best way to retrieve a disparity map / image / confidence map in OpenCV Mat.
-			// If the buffer is not duplicated, it will be replaced by a next retrieve (retrieveImage, normalizeMeasure, getView...)
-			// Disparity, depth, confidence are 32F buffer by default and 8UC4 buffer in normalized format (displayable grayscale)
+	FramePipeline pipeline(4, dropPolicy);
+	pipeline.setPreviewInterval(previewInterval);
+	// Live ZED timestamps come from the system clock, SVO ones were recorded
+	pipeline.setTrackFrameAge(zed && !readSVO);
+	Telemetry &telemetry = pipeline.telemetry();
 
+	TelemetryExporter telemetryExporter;
+	if (!telemetryName.empty() && !telemetryExporter.start(telemetry, telemetryName, telemetryInterval))
+		std::cout << "Cannot write telemetry to " << telemetryName << std::endl;
 
-			// -- The next part is about displaying the data --
+	// Synthetic and replayed sources pace themselves, --fps caps the camera here
+	SourcePacer capturePacer(zed ? replayFps : 0);
 
-			// Normalize the disparity / depth map in order to use the full color range of gray level image
-			if (displayDisp)
-				slMat2cvMat(zed->normalizeMeasure(sl::zed::MEASURE::DISPARITY)).copyTo(disp);
-			else
-				slMat2cvMat(zed->normalizeMeasure(sl::zed::MEASURE::DEPTH)).copyTo(disp);
+	// Capture thread : the source copies out anything the next grab would replace
+	pipeline.setCapture([&](PipelineFrame &frame) -> bool {
+		unsigned int streams = demand.streams(frame.preview) | fanout.beginFrame(frame);
+		capturePacer.wait();
+		{
+			TELEMETRY_SCOPE(telemetry, METRIC_GRAB);
+			if (!source->grab(frame.source, streams))
+				return false;
+		}
+		if (!recordName.empty()) {
+			TELEMETRY_SCOPE(telemetry, METRIC_RECORD);
+			recorder.write(frame.source);
+		}
+		fanout.capture(frame, *source);
+		if (streams & FRAME_VIEW) {
+			// The view may have shared a buffer last time, don't write into it
+			frame.view.release();
+			if (!fanout.sharedView(frame, viewID, frame.view) && !source->retrieveView(viewID, frame.view))
+				frame.view = frame.source.left;
+		}
+		return true;
+	});
 
-			
-			// To get the depth at a given position, click on the disparity / depth map image
-			cv::resize(disp, dispDisplay, displaySize);
-			imshow(mouseStruct.name, dispDisplay);
+	// Commands with a key shortcut go to the main loop, the others are answered right away
+	KeyQueue commandKeys;
+	ControlChannel::Handler handler = [&](const std::string &command) -> std::string {
+		int key = commandKey(command);
+		if (key < 0)
+			return controlCommand(command, bandSet, telemetry, depthQuery);
+		commandKeys.push(key);
+		return "ok " + command;
+	};
+	ControlChannel control;
+	if (controlPort > 0) {
+		if (control.open((unsigned short)controlPort, handler))
+			std::cout << "Listening for commands on UDP port " << controlPort << std::endl;
+		else
+			std::cout << "Cannot open control port " << controlPort << std::endl;
+	}
+	ConsoleControl console;
+	if (headless)
+		console.open(handler);
 
-			if (displayConfidenceMap) {
-				slMat2cvMat(zed->normalizeMeasure(sl::zed::MEASURE::CONFIDENCE)).copyTo(confidencemap);
-				cv::resize(confidencemap, confidencemapDisplay, displaySize);
-				imshow("confidence", confidencemapDisplay);
+	// Only touched by the processing thread
+	std::vector<DepthBand> bands;
+	BandMaskMode bandMode;
+	std::atomic<bool> saveCloud(false);
+	PointCloudProjector cloudProjector;
+	cloudProjector.setIntrinsics(source->intrinsics());
+	PointCloud cloud, decimatedCloud;
+	VoxelGrid cloudVoxels;
+	std::vector<unsigned char> cloudBuffer;
+	TemporalFilter temporalFilter;
+	temporalFilter.setParams(temporalParams);
+	bool temporalActive = false;
+	SpatialFilter spatialFilter;
+	spatialFilter.setParams(spatialParams);
+	AutoRangeController autoRange;
+	autoRange.setParams(rangeParams);
+	std::cout << "Depth range " << formatAutoRange(rangeParams) << std::endl;
+
+	// Processing thread : frame for Spout in the chosen encoding, already bottom-up so publishing doesn't flip it again
+	pipeline.setProcess([&](PipelineFrame &frame) {
+		bool filtering = temporalOn;
+		if (filtering) {
+			// History from before the filter was switched off is stale
+			if (!temporalActive)
+				temporalFilter.reset();
+			temporalFilter.apply(frame.source.depth, frame.source.confidence, frame.filtered);
+		}
+		else
+			frame.filtered.release();
+		temporalActive = filtering;
+		if (spatialOn) {
+			// In place over the temporal filter output when there is one
+			spatialFilter.apply(frame.depth(), frame.source.left, frame.filtered);
+		}
+		fanout.process(frame);
+		// One pass over the depth for the frame statistics, which also give the bounds of the plane
+		depthStats(frame.depth(), frame.depthStats);
+		autoRange.update(frame.depthStats);
+		// Filtered as published, whatever encoding or bands Spout gets
+		depthQuery.publish(frame.depth(), frame.frameId, frame.source.timestamp, &frame.depthStats);
+		if (saveCloud.exchange(false)) {
+			// Binary point cloud of this frame, colored when the left image was grabbed
+			cloudProjector.project(frame.depth(), frame.source.left, frame.source.confidence, cloudParams, cloud);
+			const PointCloud* saved = &cloud;
+			if (cloudParams.voxelMm > 0) {
+				cloudVoxels.filter(cloud, cloudParams.voxelMm, decimatedCloud);
+				saved = &decimatedCloud;
 			}
+			std::ostringstream name;
+			name << "cloud_" << frame.frameId << ".zpc";
+			size_t size = packPointCloud(*saved, cloudBuffer);
+			std::ofstream file(name.str().c_str(), std::ios::binary);
+			file.write((const char*)&cloudBuffer[0], size);
+			std::cout << "Saved " << saved->count << " points to " << name.str() << std::endl;
+		}
+		if (bandSet.get(bands, bandMode)) {
+			// Band masks replace the depth while any band is set
+			depthBandMask(frame.depth(), frame.plane, bands, bandMode, true);
+			return;
+		}
+		if (encoding != DEPTH_PLANE8) {
+			encodeDepth(frame.depth(), frame.plane, encoding, true);
+			return;
+		}
+		DepthPlaneParams params;
+		params.autoRange = false;
+		params.nearMm = frame.depthStats.nearMm;
+		params.farMm = frame.depthStats.farMm;
+		params.inverse = displayDisp;
+		params.flip = true;
+		depthToPlane(frame.depth(), frame.plane, params);
+	});
 
-			// 'viewID' can be 'SIDE mode' or 'VIEW mode'
-			if (viewID >= sl::zed::LEFT && viewID < sl::zed::LAST_SIDE)
-				slMat2cvMat(zed->retrieveImage(static_cast<sl::zed::SIDE> (viewID))).copyTo(anaglyph);
-			else
-				slMat2cvMat(zed->getView(static_cast<sl::zed::VIEW_MODE> (viewID - (int)sl::zed::LAST_SIDE))).copyTo(anaglyph);
+	Opencv2Spout::setMemoryRing(ringSlots);
+
+	// Publish thread : the sender is created here so its GL context belongs to this thread
+	Opencv2Spout* converterOne = NULL;
+	cv::Mat netDepth;
+	pipeline.setPublish([&](PipelineFrame &frame) {
+		converterOne->draw(frame.plane, false, true);
+		fanout.publish(frame);
+		if (netSender.isOpen() || deltaPublisher.isOpen()) {
+			// Millimeters top-down whatever the Spout encoding
+			encodeDepth(frame.depth(), netDepth, DEPTH_R16_MM, false);
+			if (netSender.isOpen())
+				netSender.send(netDepth, frame.source.timestamp);
+			if (deltaPublisher.isOpen())
+				deltaPublisher.send(netDepth, frame.source.timestamp);
+		}
+	}, [&]() {
+		converterOne = new Opencv2Spout(argc, argv, 1280, 720, false, memoryShare, depthEncodingDXFormat(encoding));
+		fanout.createSenders(argc, argv, cv::Size(width, height), memoryShare);
+	});
 
-			cv::resize(anaglyph, anaglyphDisplay, displaySize);
-			imshow("VIEW", anaglyphDisplay);
+	// Preview thread : window sized images straight from the frame slot, each source read once
+	PreviewScaler planeScaler, viewScaler, confidenceScaler;
+	cv::Mat previewPlane;
+	pipeline.setPreview([&](PipelineFrame &frame, PipelinePreview &preview) {
+		if (frame.plane.type() == CV_8UC1) {
+			// Bottom-up like the Spout texture
+			planeScaler.resize(frame.plane, preview.plane, displaySize, 1.0f, true);
+		}
+		else {
+			// Exact encodings aren't viewable as they are, stretch the depth like the 8-bit plane
+			DepthPlaneParams params;
+			params.autoRange = false;
+			params.nearMm = frame.depthStats.nearMm;
+			params.farMm = frame.depthStats.farMm;
+			params.inverse = displayDisp;
+			depthToPlane(frame.depth(), previewPlane, params);
+			planeScaler.resize(previewPlane, preview.plane, displaySize);
+		}
+		if (frame.view.type() == CV_8UC4 && !frame.view.empty())
+			viewScaler.resize(frame.view, preview.view, displaySize);
+		else
+			preview.view.release();
+		// Confidence is 0-100
+		if (!frame.source.confidence.empty())
+			confidenceScaler.resize(frame.source.confidence, preview.confidence, displaySize, 2.55f);
+		else
+			preview.confidence.release();
+	});
 
-			key = cv::waitKey(5);
+	pipeline.start();
 
-			
-			/*char nombreReceiver[256];
-			strcpy_s(nombreReceiver, 256, "opencvReceiver");
-			bool receiverExists = conversor.initReceiver(nombreReceiver);
-			if (receiverExists)
-				cout << "Receiver " << nombreReceiver << " detected " << endl;
-			else
-			{
-				cout << "No receiver detected, tacking Camera in slot 0." << endl;
-		
-			}
-			if (true)*/
-			/*for (;;)
-			{
-				std::cout << "inside for loop /n";
-				if (cvWaitKey(30) > 0){
-					break;
-				}
-				else
-				{
-					conversor.draw(disp, true);
-				}
+	PipelinePreview preview;
+	std::chrono::steady_clock::time_point lastStats = std::chrono::steady_clock::now();
 
-			}*/
-		
-			cv::Mat planeR;
-			cv::extractChannel(disp, planeR, 0);
-			converterOne.draw(planeR, true);
-			//converterOne.draw(planeG, true);
-
-			//conversor.draw()
-			
-			// Keyboard shortcuts
-			switch (key) {
-			case 'b':
-				if (confidenceThres >= 10)
-					confidenceThres -= 10;
-				break;
-			case 'n':
-				if (confidenceThres <= 90)
-					confidenceThres += 10;
-				break;
-				// From 'SIDE' enum
-			case '0': // Left
-				viewID = 0;
-				std::cout << "Current View switched to Left (rectified/aligned)" << std::endl;
-				break;
-			case '1': // Right
-				viewID = 1;
-				std::cout << "Current View switched to Right (rectified/aligned)" << std::endl;
-				break;
-				// From 'VIEW' enum
-			case '2': // Side by Side
-				viewID = 10;
-				std::cout << "Current View switched to Side by Side mode" << std::endl;
-				break;
-			case '3': // Overlay
-				viewID = 11;
-				std::cout << "Current View switched to Overlay mode" << std::endl;
-				break;
-			case '4': // Difference
-				viewID = 9;
-				std::cout << "Current View switched to Difference mode" << std::endl;
-				break;
-			case '5': // Anaglyph
-				viewID = 8;
-				std::cout << "Current View switched to Anaglyph mode" << std::endl;
-				break;
-			case 'c':
-				displayConfidenceMap = !displayConfidenceMap;
-				break;
-			case 's':
-				dm_type = (dm_type == sl::zed::SENSING_MODE::STANDARD) ? sl::zed::SENSING_MODE::FILL : sl::zed::SENSING_MODE::STANDARD;
-				std::cout << "SENSING_MODE " << sensing_mode2str(dm_type) << std::endl;
-				break;
-			case 'd':
-				displayDisp = !displayDisp;
-				break;
+	// Loop until 'q' is pressed
+	while (key != 'q') {
+		if (!headless && pipeline.latestPreview(preview)) {
+			// To get the depth at a given position, click on the disparity / depth map image
+			if (!preview.plane.empty())
+				imshow(mouseStruct.name, preview.plane);
+			if (displayConfidenceMap && !preview.confidence.empty())
+				imshow("confidence", preview.confidence);
+			if (!preview.view.empty())
+				imshow("VIEW", preview.view);
+		}
+
+		if (std::chrono::steady_clock::now() - lastStats > std::chrono::seconds(5)) {
+			pipeline.printStats(std::cout);
+			std::shared_ptr<const DepthSnapshot> latest = depthQuery.snapshot();
+			if (latest && latest->stats.pixels)
+				std::cout << "     depth : " << formatDepthFrameStats(latest->stats) << std::endl;
+			lastStats = std::chrono::steady_clock::now();
+		}
+
+		if (headless) {
+			// Nothing to draw, sleep until a command comes or the stats are due
+			key = commandKeys.wait(lastStats + std::chrono::seconds(5));
+		}
+		else {
+			key = cv::waitKey(previewInterval > 0 ? previewInterval : 66);
+			if (key < 0)
+				key = commandKeys.wait(std::chrono::steady_clock::now());
+		}
+
+		// Keyboard shortcuts
+		switch (key) {
+		case 'b':
+			if (confidenceThres >= 10)
+				confidenceThres -= 10;
+			source->setConfidenceThreshold(confidenceThres);
+			break;
+		case 'n':
+			if (confidenceThres <= 90)
+				confidenceThres += 10;
+			source->setConfidenceThreshold(confidenceThres);
+			break;
+			// From 'SIDE' enum
+		case '0': // Left
+			viewID = 0;
+			std::cout << "Current View switched to Left (rectified/aligned)" << std::endl;
+			break;
+		case '1': // Right
+			viewID = 1;
+			std::cout << "Current View switched to Right (rectified/aligned)" << std::endl;
+			break;
+			// From 'VIEW' enum
+		case '2': // Side by Side
+			viewID = 10;
+			std::cout << "Current View switched to Side by Side mode" << std::endl;
+			break;
+		case '3': // Overlay
+			viewID = 11;
+			std::cout << "Current View switched to Overlay mode" << std::endl;
+			break;
+		case '4': // Difference
+			viewID = 9;
+			std::cout << "Current View switched to Difference mode" << std::endl;
+			break;
+		case '5': // Anaglyph
+			viewID = 8;
+			std::cout << "Current View switched to Anaglyph mode" << std::endl;
+			break;
+		case 'c':
+			displayConfidenceMap = !displayConfidenceMap;
+			demand.update(confidenceWindow, displayConfidenceMap ? FRAME_CONFIDENCE : 0);
+			break;
+		case 's':
+			if (zedSource) {
+				sl::zed::SENSING_MODE mode = (zedSource->sensingMode() == sl::zed::SENSING_MODE::STANDARD) ? sl::zed::SENSING_MODE::FILL : sl::zed::SENSING_MODE::STANDARD;
+				zedSource->setSensingMode(mode);
+				std::cout << "SENSING_MODE " << sensing_mode2str(mode) << std::endl;
 			}
+			break;
+		case '[':
+		case ']':
+			if (recorded) {
+				// Seek relative to the frame being replayed
+				unsigned int current = recorded->frameIndex();
+				if (current >= recorded->frameCount())
+					current = recorded->frameCount() - 1;
+				long long target = (long long)recorded->timestamp(current) + (key == ']' ? 5000000000LL : -5000000000LL);
+				recorded->seekTime(target > 0 ? (unsigned long long)target : 0);
+			}
+			break;
+		case 'd':
+			displayDisp = !displayDisp;
+			break;
+		case 'p':
+			saveCloud = true;
+			break;
+		case 't':
+			temporalOn = !temporalOn;
+			demand.update(temporalConsumer, temporalOn ? temporalStreams : 0);
+			std::cout << "Temporal filter " << (temporalOn ? formatTemporalFilter(temporalParams) : "off") << std::endl;
+			break;
+		case 'f':
+			spatialOn = !spatialOn;
+			demand.update(spatialConsumer, spatialOn ? FRAME_DEPTH | FRAME_LEFT : 0);
+			std::cout << "Fill filter " << (spatialOn ? formatSpatialFilter(spatialParams) : "off") << std::endl;
+			break;
 		}
-		else key = cv::waitKey(5);
 	}
 
+	console.close();
+	control.close();
+	pipeline.stop();
+	telemetryExporter.stop();
+	if (recorder.isOpen() && !recorder.close())
+		std::cout << "Cannot finish recording " << recordName << ", it may have no index" << std::endl;
+	delete converterOne;
+	delete source;
 	delete zed;
 	return 0;
 }
-
@@ -0,0 +1,237 @@
+// DepthCodec round trips : lossless frames come back exactly and quantized
+// ones within half a step, every instruction set writes the same bytes and
+// reads them the same, rows stride apart. Odd sizes and sentinel-only frames,
+// then truncated and corrupted frames, which must fail or at least never
+// write past the frame. OpenCV isn't linked.
+#include "DepthCodec.h"
+#include "DepthEncoding.h"
+#include "KernelIsa.h"
+#include "TestCheck.h"
+#include <math.h>
+#include <string.h>
+#include <vector>
+using namespace std;
+
+typedef vector<unsigned short> Codes;
+
+// Deterministic noise for the frames
+static unsigned int s_seed = 21;
+static unsigned int nextRandom(unsigned int range)
+{
+	s_seed = s_seed * 1664525u + 1013904223u;
+	return (s_seed >> 8) % range;
+}
+
+// Camera-like depth : a slanted wall with a box in front, noise, and holes at the edges
+static Codes cameraFrame(int width, int height, size_t strideCodes)
+{
+	Codes codes(strideCodes * height, 0xABCD);
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			unsigned short &c = codes[y * strideCodes + x];
+			bool box = x > width / 3 && x < width / 2 && y > height / 4 && y < height * 3 / 4;
+			c = (unsigned short)((box ? 900 : 2500 + x * 3 + y) + nextRandom(9));
+			if (box && (x == width / 3 + 1 || x == width / 2 - 1))
+				c = DEPTH16_OCCLUSION;
+			else if (y < 2)
+				c = DEPTH16_TOO_FAR;
+			else if (x < 3)
+				c = DEPTH16_TOO_CLOSE;
+		}
+	}
+	return codes;
+}
+
+static bool sameCodes(const Codes &a, const Codes &b, int width, int height, size_t strideCodes)
+{
+	for (int y = 0; y < height; y++)
+	{
+		if (memcmp(&a[y * strideCodes], &b[y * strideCodes], width * sizeof(unsigned short)) != 0)
+			return false;
+	}
+	return true;
+}
+
+// Quantized codes come back within half a step, the step growing with the square of the depth
+static bool withinQuantization(const Codes &codes, const Codes &decoded, int width, int height, size_t strideCodes,
+	const DepthCodecParams &params)
+{
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			unsigned short c = codes[y * strideCodes + x], d = decoded[y * strideCodes + x];
+			if (c == DEPTH16_OCCLUSION || c == DEPTH16_TOO_CLOSE || c == DEPTH16_TOO_FAR)
+			{
+				if (d != c)
+					return false;
+				continue;
+			}
+			if (c <= params.nearMm)
+			{
+				if (fabs(d - params.nearMm) > 1)
+					return false;
+				continue;
+			}
+			double farthest = (c > d ? c : d) / 1000.0;
+			if (fabs((double)d - c) > params.stepMm * farthest * farthest / 2 + 1)
+				return false;
+		}
+	}
+	return true;
+}
+
+// Encodes with every instruction set the processor has, checks they write the
+// same bytes and decode the same codes. encoded is the scalar frame.
+static bool roundTrip(const Codes &codes, int width, int height, size_t strideCodes, const DepthCodecParams &params,
+	vector<unsigned char> &encoded, Codes &decoded)
+{
+	const KernelIsa isas[] = { KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2 };
+	const size_t stride = strideCodes * sizeof(unsigned short);
+	vector<unsigned char> other(depthCodecBound(width, height));
+	encoded.clear();
+	for (int i = 0; i < 3 && isas[i] <= bestKernelIsa(); i++)
+	{
+		DepthCodecParams isa = params;
+		isa.isa = isas[i];
+		size_t size = depthCodecEncode(&codes[0], width, height, stride, &isa, &other[0], other.size());
+		if (size == 0 || size > depthCodecBound(width, height))
+			return false;
+		if (encoded.empty())
+			encoded.assign(other.begin(), other.begin() + size);
+		else if (size != encoded.size() || memcmp(&encoded[0], &other[0], size) != 0)
+			return false;
+
+		int frameWidth = 0, frameHeight = 0;
+		if (!depthCodecInfo(&encoded[0], encoded.size(), &frameWidth, &frameHeight) || frameWidth != width || frameHeight != height)
+			return false;
+		Codes out(codes.size(), 0x5A5A);
+		if (!depthCodecDecode(&encoded[0], encoded.size(), &out[0], width, height, stride, isas[i]))
+			return false;
+		if (i == 0)
+			decoded = out;
+		else if (!sameCodes(decoded, out, width, height, strideCodes))
+			return false;
+		// The padding between rows is left alone
+		for (int y = 0; y < height; y++)
+		{
+			for (size_t x = width; x < strideCodes; x++)
+			{
+				if (out[y * strideCodes + x] != 0x5A5A)
+					return false;
+			}
+		}
+	}
+	return true;
+}
+
+static void checkCameraFrames()
+{
+	// Rows 16 codes apart more than the frame needs, like a cropped cv::Mat
+	const int width = 640, height = 360;
+	const size_t strideCodes = width + 16;
+	Codes codes = cameraFrame(width, height, strideCodes), decoded;
+	vector<unsigned char> encoded;
+	cout << "best instruction set " << kernelIsaName(bestKernelIsa()) << endl;
+
+	DepthCodecParams params;
+	depthCodecDefaults(&params);
+	bool ok = roundTrip(codes, width, height, strideCodes, params, encoded, decoded);
+	check(ok && sameCodes(codes, decoded, width, height, strideCodes), "lossless frame comes back exactly");
+	size_t lossless = encoded.size();
+
+	const float steps[] = { 1, 4 };
+	for (int q = 0; q < 2; q++)
+	{
+		params.mode = DEPTH_CODEC_QUANTIZED;
+		params.stepMm = steps[q];
+		ok = roundTrip(codes, width, height, strideCodes, params, encoded, decoded);
+		check(ok && withinQuantization(codes, decoded, width, height, strideCodes, params), "quantized frame within half a step");
+		check(encoded.size() < lossless, "quantized frame smaller than lossless");
+		cout << "quantized " << steps[q] << " mm at 1 m : ratio " << width * height * 2.0 / encoded.size() << endl;
+	}
+	cout << "lossless : ratio " << width * height * 2.0 / lossless << endl;
+}
+
+// Odd sizes, nothing but sentinels, noise and runs of one pixel, whole, then
+// cut short and with bits flipped
+static void checkEdgeCases()
+{
+	const int sizes[][2] = { { 1, 1 }, { 17, 3 }, { 1000, 1 }, { 64, 64 }, { 33, 31 } };
+	const size_t guard = 64;
+	bool edgesOk = true, truncatedOk = true, corruptOk = true;
+	for (int s = 0; s < 5; s++)
+	{
+		const int width = sizes[s][0], height = sizes[s][1];
+		for (int pattern = 0; pattern < 4; pattern++)
+		{
+			Codes codes(width * height);
+			for (size_t i = 0; i < codes.size(); i++)
+			{
+				unsigned short &c = codes[i];
+				switch (pattern)
+				{
+				case 0: c = i % 3 ? DEPTH16_OCCLUSION : DEPTH16_TOO_FAR; break;
+				case 1: c = (unsigned short)nextRandom(65536); break;
+				case 2: c = i % 2 ? DEPTH16_OCCLUSION : (unsigned short)(2 + nextRandom(65533)); break;
+				default: c = (unsigned short)(1000 + nextRandom(50)); break;
+				}
+			}
+			DepthCodecParams params;
+			depthCodecDefaults(&params);
+			vector<unsigned char> encoded;
+			Codes decoded;
+			if (!roundTrip(codes, width, height, width, params, encoded, decoded) || decoded != codes)
+			{
+				edgesOk = false;
+				continue;
+			}
+
+			// Decoded into a frame with guard codes behind it, which must stay as they are
+			Codes out(codes.size() + guard, 0x5A5A);
+			if (depthCodecDecode(&encoded[0], encoded.size() - 4, &out[0], width, height, width * 2, KERNEL_AUTO))
+				truncatedOk = false;
+			for (int flip = 0; flip < 20; flip++)
+			{
+				vector<unsigned char> corrupt(encoded);
+				corrupt[nextRandom((unsigned int)corrupt.size())] ^= (unsigned char)(1 << nextRandom(8));
+				depthCodecDecode(&corrupt[0], corrupt.size(), &out[0], width, height, width * 2, KERNEL_AUTO);
+			}
+			for (size_t i = codes.size(); i < out.size(); i++)
+				corruptOk = out[i] == 0x5A5A && corruptOk;
+		}
+	}
+	check(edgesOk, "odd sizes and sentinel frames come back exactly");
+	check(truncatedOk, "truncated frames rejected");
+	check(corruptOk, "corrupt frames never write past the frame");
+}
+
+static void checkRefusals()
+{
+	const int width = 32, height = 8;
+	Codes codes = cameraFrame(width, height, width), out(codes.size());
+	DepthCodecParams params;
+	depthCodecDefaults(&params);
+	vector<unsigned char> encoded(depthCodecBound(width, height));
+	check(depthCodecEncode(&codes[0], width, height, width * 2, &params, &encoded[0], 16) == 0, "capacity too small refused");
+	size_t size = depthCodecEncode(&codes[0], width, height, width * 2, &params, &encoded[0], encoded.size());
+	check(size > 0, "encode");
+	check(!depthCodecDecode(&encoded[0], size, &out[0], width + 1, height, (width + 1) * 2, KERNEL_AUTO), "size mismatch refused");
+	int w = 0, h = 0;
+	check(!depthCodecInfo((const unsigned char*)&codes[0], 24, &w, &h), "not an encoded frame");
+
+	params.mode = DEPTH_CODEC_QUANTIZED;
+	params.stepMm = 0.001f;
+	check(depthCodecEncode(&codes[0], width, height, width * 2, &params, &encoded[0], encoded.size()) == 0,
+		"step too fine for 16-bit codes refused");
+}
+
+int main()
+{
+	checkCameraFrames();
+	checkEdgeCases();
+	checkRefusals();
+	return testResult("Depth codec");
+}
@@ -0,0 +1,48 @@
+// The R32F meters round trip over every millimeter float from 1 mm to 32.768 m :
+// the decoded depth encodes back to the same meters and is the original or the
+// float next to it. Only the inline conversions are used, OpenCV isn't linked.
+#include "DepthEncoding.h"
+#include "TestCheck.h"
+#include <string.h>
+using namespace std;
+
+static float floatFromBits(unsigned int bits)
+{
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+int main()
+{
+	unsigned long long floats = 0, exact = 0, reencoded = 0, withinStep = 0;
+	double maxError = 0;
+	const unsigned int first = 0x3F800000, last = 0x47000000; // 1.0f, 32768.0f
+	for (unsigned int bits = first; bits < last; bits++)
+	{
+		float mm = floatFromBits(bits);
+		float meters = depthToMeters(mm);
+		float decoded = depthFromMeters(meters);
+		floats++;
+		if (decoded == mm)
+			exact++;
+		if (depthToMeters(decoded) == meters)
+			reencoded++;
+		if (decoded == mm || decoded == nextafterf(mm, INFINITY) || decoded == nextafterf(mm, -INFINITY))
+			withinStep++;
+		double error = fabs((double)decoded - mm);
+		if (error > maxError)
+			maxError = error;
+	}
+	cout << floats << " floats, " << 100.0 * exact / floats << "% exact, max error " << maxError << " mm" << endl;
+	check(reencoded == floats, "every decoded depth encodes back to the same meters");
+	check(withinStep == floats, "every decoded depth within one float step");
+	check(maxError < 0.002, "error under 0.002 mm");
+
+	// Sentinels and zero come back as they were
+	check(isnan(depthFromMeters(depthToMeters(NAN))), "NAN round trip");
+	check(depthFromMeters(depthToMeters(INFINITY)) == INFINITY, "+INFINITY round trip");
+	check(depthFromMeters(depthToMeters(-INFINITY)) == -INFINITY, "-INFINITY round trip");
+	check(depthFromMeters(depthToMeters(0.0f)) == 0.0f, "zero round trip");
+	return testResult("Depth encoding");
+}
@@ -0,0 +1,224 @@
+// The one-pass depth kernels against the OpenCV passes they replace :
+// depthToPlane against range, scale, narrow, mask and flip, linear and
+// inverse, on the frame's own range and a given one, and depthBandMask
+// against one inRange a band, in every mode. Every instruction set must
+// write the scalar bytes, and be within one level of OpenCV, which rounds
+// halves to even where the kernels round them up. On the synthetic scene and
+// on a window of it with sentinels sprinkled in, whose rows end part way
+// through a vector and aren't contiguous.
+#include "DepthKernels.h"
+#include "FrameSource.h"
+#include "TestCheck.h"
+#include <float.h>
+#include <math.h>
+#include <vector>
+using namespace std;
+
+// The plane built from separate OpenCV passes : range, scale, narrow, mask, flip
+static void multiPassPlane(const cv::Mat &depth, cv::Mat &plane, const DepthPlaneParams &params)
+{
+	cv::Mat finite, invalid, values, scaled;
+	cv::inRange(depth, -FLT_MAX, FLT_MAX, finite);
+	double minDepth = params.nearMm, maxDepth = params.farMm;
+	if (params.autoRange)
+		cv::minMaxLoc(depth, &minDepth, &maxDepth, NULL, NULL, finite);
+	if (params.inverse)
+	{
+		double k = 255.0 / (1.0 / minDepth - 1.0 / maxDepth);
+		cv::divide(1.0, depth, values);
+		values.convertTo(scaled, CV_8U, k, -k / maxDepth);
+	}
+	else
+	{
+		double k = 255.0 / (maxDepth - minDepth);
+		depth.convertTo(scaled, CV_8U, -k, maxDepth * k);
+	}
+	cv::bitwise_not(finite, invalid);
+	scaled.setTo(0, invalid);
+	if (params.flip)
+		cv::flip(scaled, plane, 0);
+	else
+		plane = scaled;
+}
+
+// The band mask from one inRange pass per band
+static void multiPassBandMask(const cv::Mat &depth, cv::Mat &mask, const vector<DepthBand> &bands, BandMaskMode mode, bool flip)
+{
+	cv::Mat inBand, combined = cv::Mat::zeros(depth.size(), CV_8UC1);
+	for (size_t n = 0; n < bands.size(); n++)
+	{
+		// Labels go in last band first so the first matching band wins
+		size_t i = mode == BAND_LABELS ? bands.size() - 1 - n : n;
+		cv::inRange(depth, bands[i].lowerMm, bands[i].upperMm, inBand);
+		if (mode == BAND_BITS)
+			cv::bitwise_or(combined, cv::Scalar(1 << i), combined, inBand);
+		else
+			combined.setTo(mode == BAND_LABELS ? bands[i].label : 255, inBand);
+	}
+	if (flip)
+		cv::flip(combined, mask, 0);
+	else
+		mask = combined;
+}
+
+// The synthetic scene, then a 637x359 window of a bigger copy with sentinels
+// every few pixels
+static void testFrames(vector<cv::Mat> &frames)
+{
+	SyntheticFrameSource scene(1280, 720);
+	DepthFrame frame;
+	scene.grab(frame, FRAME_DEPTH);
+	scene.grab(frame, FRAME_DEPTH);
+	frames.push_back(frame.depth.clone());
+
+	cv::Mat window = frame.depth.clone()(cv::Rect(3, 5, 637, 359));
+	const float sentinels[] = { NAN, INFINITY, -INFINITY };
+	for (int y = 0; y < window.rows; y++)
+	{
+		for (int x = (y * 7) % 13; x < window.cols; x += 13)
+			window.at<float>(y, x) = sentinels[(x + y) % 3];
+	}
+	frames.push_back(window);
+}
+
+static void checkPlanes(const vector<cv::Mat> &frames)
+{
+	const KernelIsa isas[] = { KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2 };
+	int checked = 0, wrong = 0;
+	double worst = 0;
+	for (size_t f = 0; f < frames.size(); f++)
+	{
+		const cv::Mat &depth = frames[f];
+		for (int variant = 0; variant < 8; variant++)
+		{
+			DepthPlaneParams params;
+			params.inverse = (variant & 1) != 0;
+			params.flip = (variant & 2) != 0;
+			params.autoRange = (variant & 4) == 0;
+			// A given range that clips both ends of the scene
+			params.nearMm = 1000.0f;
+			params.farMm = 4000.0f;
+
+			cv::Mat reference, scalar, plane;
+			multiPassPlane(depth, reference, params);
+			depthToPlane(depth, scalar, params, KERNEL_SCALAR);
+			for (int i = 0; i < 3 && isas[i] <= bestKernelIsa(); i++)
+			{
+				depthToPlane(depth, plane, params, isas[i]);
+				double fromReference = cv::norm(reference, plane, cv::NORM_INF);
+				bool ok = plane.type() == CV_8UC1 && plane.size() == depth.size() && fromReference <= 1 &&
+					cv::norm(scalar, plane, cv::NORM_INF) == 0;
+				if (!ok)
+				{
+					cout << "  " << kernelIsaName(isas[i]) << " " << depth.cols << "x" << depth.rows
+						<< (params.inverse ? " inverse" : " linear") << (params.flip ? " flipped" : "")
+						<< (params.autoRange ? "" : " given range") << " : " << fromReference << " from multipass" << endl;
+					wrong++;
+				}
+				if (fromReference > worst)
+					worst = fromReference;
+				checked++;
+			}
+		}
+	}
+	cout << "depthToPlane : " << checked - wrong << " / " << checked << " match, max difference " << worst << " to multipass" << endl;
+	check(wrong == 0, "depthToPlane matches the multipass plane and the scalar bytes");
+}
+
+// The values asked for each sentinel, whatever the instruction set
+static void checkSentinels()
+{
+	const KernelIsa isas[] = { KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2 };
+	cv::Mat depth(3, 37, CV_32FC1, cv::Scalar(2000.0f));
+	for (int x = 0; x < depth.cols; x++)
+	{
+		depth.at<float>(0, x) = NAN;
+		depth.at<float>(1, x) = -INFINITY;
+		depth.at<float>(2, x) = x % 2 ? INFINITY : 1000.0f + x * 100.0f;
+	}
+	DepthPlaneParams params;
+	params.occlusion = 1;
+	params.tooClose = 254;
+	params.tooFar = 7;
+	bool ok = true;
+	for (int i = 0; i < 3 && isas[i] <= bestKernelIsa(); i++)
+	{
+		cv::Mat plane;
+		depthToPlane(depth, plane, params, isas[i]);
+		for (int x = 0; x < depth.cols; x++)
+		{
+			ok = ok && plane.at<unsigned char>(0, x) == 1 && plane.at<unsigned char>(1, x) == 254 &&
+				(x % 2 == 0 || plane.at<unsigned char>(2, x) == 7);
+		}
+		// Nearest measure at 255, farthest at 0
+		ok = ok && plane.at<unsigned char>(2, 0) == 255 && plane.at<unsigned char>(2, 36) == 0;
+	}
+	check(ok, "sentinels written as asked, the range stretched over the measures");
+}
+
+static void checkRange(const vector<cv::Mat> &frames)
+{
+	const KernelIsa isas[] = { KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2 };
+	bool ok = true;
+	for (size_t f = 0; f < frames.size(); f++)
+	{
+		cv::Mat finite;
+		cv::inRange(frames[f], -FLT_MAX, FLT_MAX, finite);
+		double minExpected = 0, maxExpected = 0;
+		cv::minMaxLoc(frames[f], &minExpected, &maxExpected, NULL, NULL, finite);
+		for (int i = 0; i < 3 && isas[i] <= bestKernelIsa(); i++)
+		{
+			float minDepth, maxDepth;
+			ok = ok && depthRange(frames[f], minDepth, maxDepth, isas[i]) && minDepth == (float)minExpected && maxDepth == (float)maxExpected;
+		}
+	}
+	float minDepth, maxDepth;
+	check(ok, "depthRange is the range of the finite depths");
+	check(!depthRange(cv::Mat(4, 9, CV_32FC1, cv::Scalar(INFINITY)), minDepth, maxDepth), "no range without a measure");
+}
+
+static void checkBandMasks(const vector<cv::Mat> &frames)
+{
+	const KernelIsa isas[] = { KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2 };
+	const BandMaskMode modes[] = { BAND_BINARY, BAND_LABELS, BAND_BITS };
+	// Overlapping bands so the modes differ
+	vector<DepthBand> bands;
+	check(parseDepthBands("500:1500,1200:3000,3000:6000:200", bands) && bands.size() == 3, "bands parsed");
+	int checked = 0, wrong = 0;
+	for (size_t f = 0; f < frames.size(); f++)
+	{
+		for (int m = 0; m < 3; m++)
+		{
+			for (int flip = 0; flip < 2; flip++)
+			{
+				cv::Mat reference, mask;
+				multiPassBandMask(frames[f], reference, bands, modes[m], flip != 0);
+				for (int i = 0; i < 3 && isas[i] <= bestKernelIsa(); i++)
+				{
+					depthBandMask(frames[f], mask, bands, modes[m], flip != 0, isas[i]);
+					if (mask.size() != reference.size() || cv::norm(reference, mask, cv::NORM_INF) != 0)
+					{
+						cout << "  " << bandMaskModeName(modes[m]) << " " << kernelIsaName(isas[i]) << (flip ? " flipped" : "")
+							<< " differs" << endl;
+						wrong++;
+					}
+					checked++;
+				}
+			}
+		}
+	}
+	cout << "band masks " << formatDepthBands(bands) << " : " << checked - wrong << " / " << checked << " match" << endl;
+	check(wrong == 0, "band masks match the inRange passes");
+}
+
+int main()
+{
+	cout << "best instruction set " << kernelIsaName(bestKernelIsa()) << endl;
+	vector<cv::Mat> frames;
+	testFrames(frames);
+	checkPlanes(frames);
+	checkSentinels();
+	checkRange(frames);
+	checkBandMasks(frames);
+	return testResult("Depth kernels");
+}
@@ -0,0 +1,260 @@
+// DepthQueryService under load : the processing thread publishes 720p
+// frames as fast as it can while reader threads query points, rectangles and
+// polygons and one holds its snapshots a while. Every pixel of a frame holds
+// a depth following its id, so a reader seeing a frame change under it, or
+// an older frame after a newer one, shows. Before that, the region
+// statistics of every instruction set against a full sort. Reports the
+// publish times and the query rate.
+//
+// DepthQueryStress [seconds [readers]], 3 seconds and 4 readers by default
+#include "DepthQuery.h"
+#include "TestCheck.h"
+#include "opencv2/imgproc.hpp"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <thread>
+#include <vector>
+using namespace std;
+
+static double millisecondsPerCall(const function<void()> &call, int iterations)
+{
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++)
+		call();
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / iterations;
+}
+
+// The statistics by sorting everything, to check depthRegionStats against
+static void referenceRegionStats(const cv::Mat &depth, cv::Rect rect, const cv::Mat &mask, float percentile, DepthRoiStats &stats)
+{
+	memset(&stats, 0, sizeof(stats));
+	vector<float> values;
+	double sum = 0;
+	cv::Rect clipped = rect & cv::Rect(0, 0, depth.cols, depth.rows);
+	for (int y = clipped.y; y < clipped.y + clipped.height; y++)
+	{
+		for (int x = clipped.x; x < clipped.x + clipped.width; x++)
+		{
+			if (!mask.empty() && !mask.at<unsigned char>(y - rect.y, x - rect.x))
+				continue;
+			stats.pixels++;
+			float z = depth.at<float>(y, x);
+			if (z != z)
+				stats.occluded++;
+			else if (z == INFINITY)
+				stats.tooFar++;
+			else if (z == -INFINITY)
+				stats.tooClose++;
+			else
+			{
+				values.push_back(z);
+				sum += z;
+			}
+		}
+	}
+	stats.valid = (unsigned int)values.size();
+	if (values.empty())
+		return;
+	sort(values.begin(), values.end());
+	stats.minDepth = values.front();
+	stats.maxDepth = values.back();
+	stats.median = values[(values.size() - 1) / 2];
+	stats.percentile = values[(size_t)(percentile / 100.0 * (values.size() - 1) + 0.5)];
+	stats.mean = sum / values.size();
+}
+
+static bool sameRegionStats(const DepthRoiStats &a, const DepthRoiStats &b)
+{
+	if (a.pixels != b.pixels || a.valid != b.valid || a.occluded != b.occluded || a.tooClose != b.tooClose || a.tooFar != b.tooFar)
+		return false;
+	return a.valid == 0 || (a.minDepth == b.minDepth && a.maxDepth == b.maxDepth && a.median == b.median &&
+		a.percentile == b.percentile && fabs(a.mean - b.mean) <= 1e-4 * fabs(b.mean));
+}
+
+// Every pixel of a stress frame holds the same depth, which follows the frame id
+static inline float stressDepth(unsigned long long frameId)
+{
+	return 500.0f + (float)(frameId % 9973);
+}
+
+// Rectangles and polygons, clipped by the image edges, with every instruction set
+static void checkRegionStats()
+{
+	cv::RNG rng(24);
+	cv::Mat depth(360, 640, CV_32FC1);
+	for (int y = 0; y < depth.rows; y++)
+	{
+		for (int x = 0; x < depth.cols; x++)
+		{
+			int kind = rng.uniform(0, 12);
+			depth.at<float>(y, x) = kind == 0 ? NAN : kind == 1 ? INFINITY : kind == 2 ? -INFINITY :
+				(float)rng.uniform(300.0, 20000.0);
+		}
+	}
+	const KernelIsa isas[] = { KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2 };
+	vector<float> values;
+	int checked = 0, wrong = 0;
+	for (int t = 0; t < 300; t++)
+	{
+		cv::Rect rect(rng.uniform(-40, depth.cols), rng.uniform(-40, depth.rows), rng.uniform(1, 200), rng.uniform(1, 120));
+		cv::Mat mask;
+		if (t % 2)
+		{
+			// A triangle in the rectangle
+			mask = cv::Mat::zeros(rect.size(), CV_8UC1);
+			cv::Point corners[3] = { cv::Point(0, 0), cv::Point(rect.width - 1, rng.uniform(0, rect.height)),
+				cv::Point(rng.uniform(0, rect.width), rect.height - 1) };
+			cv::fillConvexPoly(mask, corners, 3, cv::Scalar(255));
+		}
+		float percentile = (float)rng.uniform(0.0, 100.0);
+		DepthRoiStats expected;
+		referenceRegionStats(depth, rect, mask, percentile, expected);
+		for (int i = 0; i < 3 && isas[i] <= bestKernelIsa(); i++)
+		{
+			DepthRoiStats stats;
+			depthRegionStats(depth, rect, mask, percentile, stats, values, isas[i]);
+			checked++;
+			if (!sameRegionStats(stats, expected))
+				wrong++;
+		}
+	}
+	cout << "region statistics : " << checked - wrong << " / " << checked << " match a full sort" << endl;
+	check(wrong == 0, "region statistics match a full sort with every instruction set");
+
+	cv::Rect whole(0, 0, depth.cols, depth.rows);
+	for (int i = 0; i < 3 && isas[i] <= bestKernelIsa(); i++)
+	{
+		DepthRoiStats stats;
+		cout << setw(10) << kernelIsaName(isas[i]) << " : whole frame median and p90 " << fixed << setprecision(3) << millisecondsPerCall([&]() {
+			depthRegionStats(depth, whole, cv::Mat(), 90.0f, stats, values, isas[i]);
+		}, 50) << " ms" << endl;
+	}
+}
+
+// The pipeline publishing 720p frames as fast as it can while readers
+// query, and one reader keeps its snapshot a while : no reader may see a
+// frame change under it, nor the publisher wait for them
+static void checkQueryStress(int seconds, int readers)
+{
+	DepthQueryService service;
+	atomic<bool> running(true);
+	atomic<unsigned long long> torn(0), backwards(0);
+	vector<unsigned long long> queries(readers, 0);
+	vector<thread> threads;
+	for (int r = 0; r < readers; r++)
+	{
+		threads.push_back(thread([&, r]() {
+			cv::RNG rng(100 + r);
+			unsigned long long lastFrame = 0;
+			vector<cv::Point> points(64);
+			vector<float> depths;
+			while (running)
+			{
+				unsigned long long frameId = 0;
+				bool consistent = true;
+				switch (r % 4)
+				{
+				case 0:
+				{
+					// Batches of points, as a script would ask
+					for (size_t i = 0; i < points.size(); i++)
+						points[i] = cv::Point(rng.uniform(0, 1280), rng.uniform(0, 720));
+					frameId = service.depthAt(points, depths);
+					for (size_t i = 0; frameId && i < depths.size(); i++)
+						consistent = consistent && depths[i] == stressDepth(frameId);
+					break;
+				}
+				case 1:
+				case 2:
+				{
+					DepthRoiStats stats;
+					if (r % 4 == 1)
+						frameId = service.regionStats(cv::Rect(rng.uniform(0, 1200), rng.uniform(0, 600), 80, 80), 90.0f, stats);
+					else
+					{
+						vector<cv::Point> polygon(3);
+						polygon[0] = cv::Point(rng.uniform(0, 1280), rng.uniform(0, 720));
+						polygon[1] = polygon[0] + cv::Point(60, 10);
+						polygon[2] = polygon[0] + cv::Point(20, 70);
+						frameId = service.regionStats(polygon, 50.0f, stats);
+					}
+					float z = stressDepth(frameId);
+					consistent = frameId == 0 || stats.valid == 0 ||
+						(stats.minDepth == z && stats.maxDepth == z && stats.median == z && stats.percentile == z);
+					break;
+				}
+				default:
+				{
+					// Held for a few frames, then checked again
+					shared_ptr<const DepthSnapshot> held = service.snapshot();
+					if (!held)
+						break;
+					frameId = held->frameId;
+					this_thread::sleep_for(chrono::milliseconds(5));
+					double minValue, maxValue;
+					cv::minMaxLoc(held->depth, &minValue, &maxValue);
+					consistent = held->frameId == frameId && minValue == stressDepth(frameId) && maxValue == minValue;
+					break;
+				}
+				}
+				if (!consistent)
+					torn++;
+				if (frameId < lastFrame)
+					backwards++;
+				if (frameId)
+					lastFrame = frameId;
+				queries[r]++;
+			}
+		}));
+	}
+
+	cv::Mat frame(720, 1280, CV_32FC1);
+	unsigned long long frameId = 0;
+	double slowestMs = 0, totalMs = 0;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	while (chrono::steady_clock::now() - start < chrono::seconds(seconds))
+	{
+		frameId++;
+		frame.setTo(stressDepth(frameId));
+		chrono::steady_clock::time_point before = chrono::steady_clock::now();
+		service.publish(frame, frameId, 0);
+		double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - before).count();
+		totalMs += ms;
+		if (ms > slowestMs)
+			slowestMs = ms;
+	}
+	double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	running = false;
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+
+	unsigned long long answered = 0;
+	bool everyReader = true;
+	for (int r = 0; r < readers; r++)
+	{
+		answered += queries[r];
+		everyReader = everyReader && queries[r] > 0;
+	}
+	cout << setprecision(2) << readers << " readers, " << frameId / elapsed << " frames/s published, mean publish "
+		<< totalMs / frameId << " ms, slowest " << slowestMs << " ms, " << answered / elapsed << " queries/s, "
+		<< torn << " torn, " << backwards << " out of order" << endl;
+	check(frameId > 0 && everyReader, "frames published and every reader answered");
+	check(torn == 0, "no frame changed under a reader");
+	check(backwards == 0, "no reader went back in time");
+}
+
+int main(int argc, char** argv)
+{
+	int seconds = argc > 1 ? atoi(argv[1]) : 3;
+	int readers = argc > 2 ? atoi(argv[2]) : 4;
+	cout << "Depth queries" << endl;
+	checkRegionStats();
+	checkQueryStress(seconds > 0 ? seconds : 3, readers > 0 ? readers : 4);
+	return testResult("Depth queries");
+}
@@ -0,0 +1,306 @@
+// depthStats against a full sort on rows that end part way through a vector,
+// every instruction set giving the same counts and histogram, then the
+// AutoRangeController : the frame range depthToPlane takes on its own, the
+// hysteresis holding the bounds through small moves and following large ones,
+// the limits, and a noisy scene where the smoothed percentiles must hold
+// steadier than the frame range and still follow someone walking in. Last
+// the parameter strings.
+#include "DepthStats.h"
+#include "DepthKernels.h"
+#include "FrameSource.h"
+#include "TestCheck.h"
+#include <math.h>
+#include <algorithm>
+#include <vector>
+using namespace std;
+
+static bool sameDepthStats(const DepthFrameStats &a, const DepthFrameStats &b)
+{
+	if (a.pixels != b.pixels || a.valid != b.valid || a.occluded != b.occluded || a.tooClose != b.tooClose ||
+		a.tooFar != b.tooFar || a.histogram != b.histogram)
+		return false;
+	return a.valid == 0 || (a.minDepth == b.minDepth && a.maxDepth == b.maxDepth && fabs(a.mean - b.mean) <= 1e-4 * fabs(b.mean));
+}
+
+// Sentinels and depths at random
+static void checkStats()
+{
+	const KernelIsa isas[] = { KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2 };
+	cv::RNG rng(25);
+	cv::Mat depth(359, 637, CV_32FC1);
+	vector<float> sorted;
+	for (int y = 0; y < depth.rows; y++)
+	{
+		for (int x = 0; x < depth.cols; x++)
+		{
+			int kind = rng.uniform(0, 12);
+			float z = kind == 0 ? NAN : kind == 1 ? INFINITY : kind == 2 ? -INFINITY : (float)rng.uniform(300.0, 20000.0);
+			depth.at<float>(y, x) = z;
+			if (kind > 2)
+				sorted.push_back(z);
+		}
+	}
+	sort(sorted.begin(), sorted.end());
+	DepthFrameStats expected;
+	depthStats(depth, expected, KERNEL_SCALAR);
+	check(expected.valid == sorted.size() && expected.minDepth == sorted.front() && expected.maxDepth == sorted.back() &&
+		expected.occluded + expected.tooClose + expected.tooFar + expected.valid == expected.pixels, "counts, min and max");
+	for (int i = 1; i < 3 && isas[i] <= bestKernelIsa(); i++)
+	{
+		DepthFrameStats stats;
+		depthStats(depth, stats, isas[i]);
+		if (!sameDepthStats(stats, expected))
+			cout << "  " << kernelIsaName(isas[i]) << " differs from the scalar statistics" << endl;
+		check(sameDepthStats(stats, expected), "every instruction set gives the same counts and histogram");
+	}
+
+	const float percentiles[] = { 0.0f, 2.0f, 5.0f, 25.0f, 50.0f, 75.0f, 95.0f, 98.0f, 100.0f };
+	double worst = 0;
+	for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++)
+	{
+		float exact = sorted[(size_t)(percentiles[i] / 100.0 * (sorted.size() - 1) + 0.5)];
+		double error = fabs(depthStatsPercentile(expected, percentiles[i]) - exact);
+		if (error > worst)
+			worst = error;
+	}
+	cout << depth.cols << "x" << depth.rows << " : percentiles within " << worst << " mm of a full sort" << endl;
+	check(worst <= DEPTH_STATS_BIN_MM, "percentiles within a bin of a full sort");
+	check(expected.median == depthStatsPercentile(expected, 50.0f), "median is the 50th percentile");
+
+	// Nothing measured, and far past the last bin
+	DepthFrameStats empty, far;
+	depthStats(cv::Mat(8, 9, CV_32FC1, cv::Scalar(NAN)), empty);
+	depthStats(cv::Mat(8, 9, CV_32FC1, cv::Scalar(50000.0f)), far);
+	check(empty.valid == 0 && empty.occluded == 72 && empty.median != empty.median, "nothing measured");
+	check(far.histogram[DEPTH_STATS_BINS - 1] == 72 && far.median == 50000.0f, "far past the last bin");
+}
+
+// The per-frame range through the controller makes the plane depthToPlane makes with its own
+static void checkFrameRange()
+{
+	SyntheticFrameSource scene(640, 360);
+	DepthFrame frame;
+	scene.grab(frame, FRAME_DEPTH);
+	AutoRangeParams params;
+	params.mode = AUTO_RANGE_FRAME;
+	AutoRangeController controller;
+	controller.setParams(params);
+	DepthFrameStats stats;
+	depthStats(frame.depth, stats);
+	controller.update(stats);
+	DepthPlaneParams own, given;
+	own.flip = given.flip = true;
+	given.autoRange = false;
+	given.nearMm = stats.nearMm;
+	given.farMm = stats.farMm;
+	cv::Mat ownPlane, givenPlane;
+	depthToPlane(frame.depth, ownPlane, own);
+	depthToPlane(frame.depth, givenPlane, given);
+	check(cv::norm(ownPlane, givenPlane, cv::NORM_INF) == 0, "frame range gives depthToPlane's own plane");
+
+	// A frame with nothing measured keeps the last bounds
+	DepthFrameStats nothing;
+	depthStats(cv::Mat(8, 9, CV_32FC1, cv::Scalar(-INFINITY)), nothing);
+	controller.update(nothing);
+	check(nothing.nearMm == given.nearMm && nothing.farMm == given.farMm, "nothing measured keeps the frame range");
+}
+
+// Depths evenly from nearMm to farMm, and as many sentinels as asked
+static DepthFrameStats rampStats(float nearMm, float farMm, int sentinels = 0)
+{
+	cv::Mat depth(100, 100, CV_32FC1);
+	for (int i = 0; i < (int)depth.total(); i++)
+		depth.at<float>(i / 100, i % 100) = i < sentinels ? NAN : nearMm + (farMm - nearMm) * i / (depth.total() - 1);
+	DepthFrameStats stats;
+	depthStats(depth, stats);
+	return stats;
+}
+
+static void checkHysteresis()
+{
+	AutoRangeParams params;
+	params.smoothing = 1.0f; // no smoothing, the hysteresis alone
+	AutoRangeController controller;
+	controller.setParams(params);
+
+	DepthFrameStats stats = rampStats(2000.0f, 6000.0f);
+	controller.update(stats);
+	const float nearMm = stats.nearMm, farMm = stats.farMm;
+	check(fabs(nearMm - depthStatsPercentile(stats, 2.0f)) < 0.01 && fabs(farMm - depthStatsPercentile(stats, 98.0f)) < 0.01,
+		"the first frame sets the bounds to its percentiles");
+
+	// Band of 5% of the span, about 190 mm : a move of 100 mm stays in it, both ways
+	const float band = params.hysteresis * (farMm - nearMm);
+	bool held = true;
+	for (int i = 0; i < 6; i++)
+	{
+		stats = rampStats(2000.0f + (i % 2 ? -100.0f : 100.0f), 6000.0f + (i % 2 ? -100.0f : 100.0f));
+		controller.update(stats);
+		held = held && stats.nearMm == nearMm && stats.farMm == farMm;
+	}
+	check(held, "bounds held through moves inside the hysteresis");
+
+	// A move of 1 m drags the bounds to a band short of the new percentiles
+	stats = rampStats(3000.0f, 7000.0f);
+	controller.update(stats);
+	float low = depthStatsPercentile(stats, 2.0f), high = depthStatsPercentile(stats, 98.0f);
+	check(fabs(stats.nearMm - (low - band)) < 0.01 && fabs(stats.farMm - (high - band)) < 0.01, "bounds follow past the hysteresis");
+
+	// Under 1% measured, the frame isn't gone by
+	const float keptNear = stats.nearMm, keptFar = stats.farMm;
+	stats = rampStats(500.0f, 900.0f, 9950);
+	controller.update(stats);
+	check(stats.valid == 50 && stats.nearMm == keptNear && stats.farMm == keptFar, "too few measures keep the bounds");
+
+	// A flat wall still gets the shortest span, and the bounds stay within the limits
+	AutoRangeController flat;
+	flat.setParams(params);
+	stats = rampStats(3000.0f, 3010.0f);
+	flat.update(stats);
+	check(fabs(stats.farMm - stats.nearMm - params.minSpanMm) < 0.01, "a flat scene gets the shortest span");
+	flat.reset();
+	cv::Mat wide(100, 100, CV_32FC1, cv::Scalar(100.0f));
+	wide.rowRange(50, 100).setTo(cv::Scalar(30000.0f));
+	depthStats(wide, stats);
+	flat.update(stats);
+	check(stats.nearMm == params.nearMm && stats.farMm == params.farMm, "bounds within the limits");
+
+	params.mode = AUTO_RANGE_FIXED;
+	params.nearMm = 800.0f;
+	params.farMm = 4500.0f;
+	controller.setParams(params);
+	controller.update(stats);
+	check(stats.nearMm == 800.0f && stats.farMm == 4500.0f, "fixed bounds");
+}
+
+// Frame to frame movement of the bounds and the frames they moved on
+struct RangeSteadiness
+{
+	double moved;
+	int movingFrames, frames;
+	float lastNear, lastFar;
+
+	RangeSteadiness() : moved(0), movingFrames(0), frames(0), lastNear(0), lastFar(0) {}
+	void add(const DepthFrameStats &stats)
+	{
+		if (frames > 0)
+		{
+			double step = fabs(stats.nearMm - lastNear) + fabs(stats.farMm - lastFar);
+			moved += step;
+			if (step > 0)
+				movingFrames++;
+		}
+		lastNear = stats.nearMm;
+		lastFar = stats.farMm;
+		frames++;
+	}
+	double meanStep() const { return frames > 1 ? moved / (frames - 1) : 0; }
+};
+
+// A noisy scene with flying pixels closer than anything, and someone walking
+// in half way : the range of every frame jumps with each of them, the
+// smoothed percentiles should hardly move until the scene does
+static void checkSteadiness()
+{
+	const int width = 640, height = 360, frames = 120;
+	SyntheticFrameSource scene(width, height);
+	cv::RNG rng(26);
+	const int modes[] = { AUTO_RANGE_FRAME, AUTO_RANGE_PERCENTILE };
+	AutoRangeController controllers[2];
+	RangeSteadiness steadiness[2], still[2];
+	for (int m = 0; m < 2; m++)
+	{
+		AutoRangeParams params;
+		params.mode = modes[m];
+		controllers[m].setParams(params);
+	}
+	DepthFrame frame;
+	cv::Mat noisy(height, width, CV_32FC1);
+	DepthFrameStats stats;
+	float walkedInNear = 0;
+	bool grabbed = true;
+	for (int f = 0; f < frames; f++)
+	{
+		grabbed = scene.grab(frame, FRAME_DEPTH) && grabbed;
+		// Speckle comes and goes, a frame in three has some
+		const float flying = rng.uniform(0, 3) == 0 ? 0.0005f : 0.0f;
+		for (int y = 0; y < height; y++)
+		{
+			const float* t = frame.depth.ptr<float>(y);
+			float* z = noisy.ptr<float>(y);
+			for (int x = 0; x < width; x++)
+			{
+				if (t[x] != t[x] || fabs(t[x]) == INFINITY)
+					z[x] = t[x];
+				else if (rng.uniform(0.0f, 1.0f) < flying)
+					z[x] = rng.uniform(150.0f, 600.0f);
+				else
+					z[x] = t[x] * (1.0f + 0.01f * (float)rng.gaussian(1.0));
+			}
+		}
+		if (f >= frames / 2)
+		{
+			// Someone at 1.2 m coming in from the left
+			int right = (f - frames / 2) * 8 + 60;
+			noisy(cv::Rect(0, height / 4, right < width / 3 ? right : width / 3, height * 3 / 4)).setTo(cv::Scalar(1200.0f));
+		}
+		depthStats(noisy, stats);
+		for (int m = 0; m < 2; m++)
+		{
+			controllers[m].update(stats);
+			steadiness[m].add(stats);
+			if (f < frames / 2)
+				still[m].add(stats);
+		}
+		if (f == frames / 2 - 1)
+			walkedInNear = stats.nearMm;
+	}
+	for (int m = 0; m < 2; m++)
+	{
+		cout << (m ? "percentile" : "frame") << " : bounds move " << still[m].meanStep() << " mm a frame on "
+			<< still[m].movingFrames << " / " << still[m].frames - 1 << " frames before, " << steadiness[m].meanStep()
+			<< " mm overall, ending at " << steadiness[m].lastNear << " - " << steadiness[m].lastFar << " mm" << endl;
+	}
+	check(grabbed, "synthetic frames");
+	check(still[1].meanStep() < still[0].meanStep(), "percentile bounds steadier than the frame range on noise");
+	check(still[1].movingFrames < (still[1].frames - 1) / 4, "percentile bounds still most frames");
+	check(steadiness[1].lastNear < walkedInNear, "and they follow someone walking in");
+}
+
+static void checkParams()
+{
+	AutoRangeParams params;
+	check(parseAutoRange("frame", params) && params.mode == AUTO_RANGE_FRAME, "frame");
+	check(parseAutoRange("fixed:500:4000", params) && params.mode == AUTO_RANGE_FIXED && params.nearMm == 500.0f &&
+		params.farMm == 4000.0f, "fixed:near:far");
+	check(parseAutoRange("percentile", params) && params.mode == AUTO_RANGE_PERCENTILE && params.lowPercentile == 2.0f,
+		"percentile alone keeps the percentiles");
+	check(parseAutoRange("percentile:5:95:0.2:0.1", params) && params.lowPercentile == 5.0f && params.highPercentile == 95.0f &&
+		params.smoothing == 0.2f && params.hysteresis == 0.1f, "percentile:low:high:smoothing:hysteresis");
+	check(parseAutoRange("percentile:1:99", params) && params.lowPercentile == 1.0f && params.smoothing == 0.2f,
+		"low and high alone");
+	AutoRangeParams parsed;
+	check(parseAutoRange(formatAutoRange(params), parsed) && parsed.mode == params.mode &&
+		parsed.lowPercentile == params.lowPercentile && parsed.hysteresis == params.hysteresis, "formatted parameters parse back");
+	params.mode = AUTO_RANGE_FIXED;
+	check(parseAutoRange(formatAutoRange(params), parsed) && parsed.mode == AUTO_RANGE_FIXED && parsed.farMm == params.farMm,
+		"fixed formats and parses back");
+
+	check(!parseAutoRange("fixed:4000:500", params) && !parseAutoRange("fixed:500", params) &&
+		!parseAutoRange("percentile:50:40", params) && !parseAutoRange("percentile:5:95:0", params) &&
+		!parseAutoRange("percentile:5:95:0.1:1", params) && !parseAutoRange("percentile:5:101", params) &&
+		!parseAutoRange("percentiles", params) && !parseAutoRange("percentile:5:95:0.1:0.1:1", params) &&
+		!parseAutoRange("auto", params), "out of range or malformed refused");
+	check(params.mode == AUTO_RANGE_FIXED && params.lowPercentile == 1.0f, "a refused string leaves the parameters alone");
+}
+
+int main()
+{
+	cout << "best instruction set " << kernelIsaName(bestKernelIsa()) << endl;
+	checkStats();
+	checkFrameRange();
+	checkHysteresis();
+	checkSteadiness();
+	checkParams();
+	return testResult("Depth statistics");
+}
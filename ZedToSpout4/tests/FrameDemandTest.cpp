@@ -0,0 +1,185 @@
+// FrameDemand driving a mock camera : outputs registered, changed and removed
+// while frames are grabbed, each grab asking for the union of what they
+// consume, the camera running only the passes that needs, and frames holding
+// only the streams asked for, from the mock and from the synthetic source.
+#include "FrameDemand.h"
+#include "TestCheck.h"
+#include <atomic>
+#include <thread>
+using namespace std;
+
+// Runs the passes like the ZED SDK would for the mask, through cameraPasses as
+// ZedFrameSource does, and fills only the streams asked for
+class MockCamera : public FrameSource
+{
+public:
+	MockCamera() : m_grabs(0), m_disparityPasses(0), m_measurePasses(0)
+	{
+		for (int i = 0; i < 4; i++)
+			m_retrieved[i] = 0;
+	}
+	cv::Size size() const { return cv::Size(64, 48); }
+	bool grab(DepthFrame &frame, unsigned int streams)
+	{
+		CameraPasses passes = cameraPasses(streams);
+		m_grabs++;
+		if (passes.disparity)
+			m_disparityPasses++;
+		if (passes.measure)
+			m_measurePasses++;
+		frame.timestamp = m_grabs;
+		retrieve(streams, FRAME_LEFT | FRAME_VIEW, frame.left, CV_8UC4);
+		retrieve(streams, FRAME_DEPTH, frame.depth, CV_32FC1);
+		retrieve(streams, FRAME_CONFIDENCE, frame.confidence, CV_32FC1);
+		for (int i = 0; i < 4; i++)
+		{
+			if (streams & (1 << i))
+				m_retrieved[i]++;
+		}
+		return true;
+	}
+
+	int grabs() const { return m_grabs; }
+	int disparityPasses() const { return m_disparityPasses; }
+	int measurePasses() const { return m_measurePasses; }
+	int retrieved(FrameStream stream) const
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			if (stream == 1 << i)
+				return m_retrieved[i];
+		}
+		return 0;
+	}
+private:
+	void retrieve(unsigned int streams, unsigned int wanted, cv::Mat &image, int type)
+	{
+		if (streams & wanted)
+			image.create(size(), type);
+		else
+			image.release();
+	}
+
+	int m_grabs, m_disparityPasses, m_measurePasses;
+	int m_retrieved[4];
+};
+
+// Only what was asked for is there; the left image also stands for the view
+static bool holdsOnly(const DepthFrame &frame, unsigned int streams)
+{
+	return frame.left.empty() == !(streams & (FRAME_LEFT | FRAME_VIEW)) &&
+		frame.depth.empty() == !(streams & FRAME_DEPTH) &&
+		frame.confidence.empty() == !(streams & FRAME_CONFIDENCE);
+}
+
+// 40 frames, one in 5 previewed. The Spout sender reads depth until frame 30,
+// a recorder depth and confidence from 10 to 14, the view window previews
+// and the confidence window previews once opened at frame 20.
+static void checkDemand()
+{
+	FrameDemand demand;
+	check(demand.streams(false) == 0 && demand.streams(true) == 0, "nothing asked for without outputs");
+	int spout = demand.add("spout", FRAME_DEPTH);
+	demand.add("view window", FRAME_VIEW, true);
+	int confidence = demand.add("confidence window", 0, true);
+	check(demand.streams(false) == FRAME_DEPTH && demand.streams(true) == (FRAME_DEPTH | FRAME_VIEW),
+		"preview outputs only count for previewed frames");
+
+	MockCamera camera;
+	DepthFrame frame;
+	int recorder = -1, mismatched = 0;
+	const int frames = 40, previewEvery = 5;
+	for (int i = 0; i < frames; i++)
+	{
+		if (i == 10)
+			recorder = demand.add("recorder", FRAME_DEPTH | FRAME_CONFIDENCE);
+		if (i == 15)
+			demand.remove(recorder);
+		if (i == 20)
+			demand.update(confidence, FRAME_CONFIDENCE);
+		if (i == 30)
+			demand.remove(spout);
+		unsigned int streams = demand.streams(i % previewEvery == 0);
+		if (!camera.grab(frame, streams) || !holdsOnly(frame, streams))
+			mismatched++;
+	}
+	demand.print(cout);
+
+	check(mismatched == 0, "frames hold only the streams asked for");
+	check(camera.grabs() == frames, "every frame grabbed");
+	check(camera.retrieved(FRAME_DEPTH) == 30, "depth while the sender or the recorder reads it");
+	check(camera.retrieved(FRAME_CONFIDENCE) == 5 + 4, "confidence for the recorder and the previews once the window opened");
+	check(camera.retrieved(FRAME_VIEW) == frames / previewEvery, "view for previews only");
+	check(camera.retrieved(FRAME_LEFT) == 0, "left never asked for");
+	check(camera.measurePasses() == 30, "measure pass only for depth");
+	check(camera.disparityPasses() == 32, "disparity pass for depth or confidence");
+	check(demand.streams(false) == 0 && demand.streams(true) == (FRAME_VIEW | FRAME_CONFIDENCE), "what is left registered");
+}
+
+static void checkPasses()
+{
+	const unsigned int masks[] = { 0, FRAME_LEFT, FRAME_VIEW, FRAME_CONFIDENCE, FRAME_DEPTH, FRAME_ALL };
+	const bool measure[] = { false, false, false, false, true, true };
+	const bool disparity[] = { false, false, false, true, true, true };
+	bool ok = true;
+	for (int i = 0; i < 6; i++)
+	{
+		CameraPasses passes = cameraPasses(masks[i]);
+		ok = passes.measure == measure[i] && passes.disparity == disparity[i] && ok;
+	}
+	check(ok, "camera passes for each mask");
+	string names;
+	check(string(frameStreamNames(FRAME_LEFT | FRAME_DEPTH, names)) == "left+depth", "stream names");
+	check(string(frameStreamNames(0, names)) == "none", "no stream named none");
+}
+
+// Outputs come and go on another thread while frames are grabbed : every mask
+// read is one the registrations made at some point
+static void checkConcurrent()
+{
+	FrameDemand demand;
+	demand.add("spout", FRAME_DEPTH);
+	atomic<bool> running(true);
+	thread ui([&]() {
+		while (running)
+		{
+			int id = demand.add("confidence window", FRAME_CONFIDENCE, true);
+			demand.update(id, FRAME_CONFIDENCE | FRAME_VIEW);
+			demand.remove(id);
+		}
+	});
+	bool ok = true;
+	for (int i = 0; i < 100000; i++)
+	{
+		unsigned int every = demand.streams(false), preview = demand.streams(true);
+		ok = every == FRAME_DEPTH && (preview & FRAME_DEPTH) && !(preview & FRAME_LEFT) && ok;
+	}
+	running = false;
+	ui.join();
+	check(ok, "masks read while outputs change");
+}
+
+// The synthetic scene skips what isn't asked for as well
+static void checkSyntheticSource()
+{
+	SyntheticFrameSource source(160, 90);
+	DepthFrame frame;
+	const unsigned int masks[] = { FRAME_DEPTH, FRAME_DEPTH | FRAME_VIEW, FRAME_DEPTH | FRAME_CONFIDENCE, FRAME_ALL };
+	bool ok = true;
+	for (int i = 0; i < 4; i++)
+	{
+		ok = source.grab(frame, masks[i]) && !frame.depth.empty() &&
+			frame.left.empty() == !(masks[i] & (FRAME_LEFT | FRAME_VIEW)) &&
+			frame.confidence.empty() == !(masks[i] & FRAME_CONFIDENCE) && ok;
+	}
+	check(ok, "synthetic frames hold only the streams asked for");
+}
+
+int main()
+{
+	checkDemand();
+	checkPasses();
+	checkConcurrent();
+	checkSyntheticSource();
+	return testResult("Frame demand");
+}
@@ -0,0 +1,102 @@
+// SpoutFrameEvent : receivers that timed out while the sender was idle must
+// leave nothing behind, the frames after wake each of them once
+#include "SpoutFrameEvent.h"
+#include "TestCheck.h"
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+using namespace std;
+
+static const int IDLE_TIMEOUTS = 5;
+static const int IDLE_TIMEOUT_MSEC = 20;
+static const int FRAMES = 20;
+static const int FRAME_INTERVAL_MSEC = 30;
+
+struct ReceiverResult
+{
+	unsigned long long idleWakeups, frames, frameWakeups;
+	bool idleQuiet; // no frame came while idle
+};
+
+// Waits out the idle timeouts, then picks up frames until the sender closes
+static ReceiverResult receive(const string &name, atomic<int> &ready)
+{
+	ReceiverResult result = { 0, 0, 0, true };
+	SpoutFrameEvent event;
+	if (!event.open(name.c_str()))
+		return result;
+	unsigned int last = event.sequence();
+	for (int i = 0; i < IDLE_TIMEOUTS; i++)
+		result.idleQuiet = !event.wait(last, IDLE_TIMEOUT_MSEC) && result.idleQuiet;
+	result.idleWakeups = event.wakeups();
+	ready++;
+	while (!event.senderClosed())
+	{
+		if (event.wait(last, 1000) && !event.senderClosed())
+			result.frames++;
+	}
+	result.frameWakeups = event.wakeups() - result.idleWakeups;
+	return result;
+}
+
+int main()
+{
+	string name = "ZedToSpoutEventTest" + to_string(getpid());
+	SpoutFrameEvent sender;
+	if (!check(sender.create(name.c_str()), "create the frame event"))
+		return testResult("Frame event");
+	SpoutFrameEvent receiver;
+	check(receiver.open(name.c_str()), "open the frame event");
+	check(receiver.sequence() == sender.sequence(), "receiver starts at the sender's sequence");
+
+	// Timeouts with nobody signaling leave no waiter counted
+	unsigned int last = receiver.sequence();
+	for (int i = 0; i < IDLE_TIMEOUTS; i++)
+		check(!receiver.wait(last, IDLE_TIMEOUT_MSEC), "idle wait times out");
+	check(receiver.waiters() == 0, "no waiter counted after the timeouts");
+	check(receiver.wakeups() == (unsigned long long)IDLE_TIMEOUTS, "one wakeup per idle timeout");
+
+	// The next frame wakes the receiver once
+	thread late([&sender]() {
+		this_thread::sleep_for(chrono::milliseconds(FRAME_INTERVAL_MSEC));
+		sender.signal();
+	});
+	unsigned long long before = receiver.wakeups();
+	check(receiver.wait(last, 1000) && last == sender.sequence(), "frame after the idle timeouts is picked up");
+	late.join();
+	check(receiver.wakeups() - before == 1, "one wakeup for the frame");
+	check(!receiver.wait(last, IDLE_TIMEOUT_MSEC), "no wakeup left over for the next wait");
+
+	// Receivers of their own idle a while, then count the wakeups of a paced sender's frames
+	const int receivers = 3;
+	atomic<int> ready(0);
+	vector<ReceiverResult> results(receivers);
+	vector<thread> threads;
+	for (int i = 0; i < receivers; i++)
+		threads.push_back(thread([&, i]() { results[i] = receive(name, ready); }));
+	while (ready < receivers)
+		this_thread::sleep_for(chrono::milliseconds(1));
+	for (int i = 0; i < FRAMES; i++)
+	{
+		this_thread::sleep_for(chrono::milliseconds(FRAME_INTERVAL_MSEC));
+		sender.signal();
+	}
+	sender.close();
+	for (int i = 0; i < receivers; i++)
+		threads[i].join();
+	for (int i = 0; i < receivers; i++)
+	{
+		const ReceiverResult &r = results[i];
+		cout << "Receiver " << i << " : " << r.idleWakeups << " idle wakeups, " << r.frames << " frames, "
+			<< r.frameWakeups << " wakeups" << endl;
+		check(r.idleQuiet && r.idleWakeups == (unsigned long long)IDLE_TIMEOUTS, "receiver idle timeouts");
+		// Frames may coalesce, never wake twice; one more for the close
+		check(r.frames > 0 && r.frames <= (unsigned long long)FRAMES, "receiver picks up the frames");
+		check(r.frameWakeups <= r.frames + 1, "one wakeup per frame");
+	}
+	check(receiver.senderClosed(), "closing the sender is seen");
+	return testResult("Frame event");
+}
@@ -0,0 +1,109 @@
+// FramePool : size classes, alignment, slots shared between Mats coming back
+// with the last one, misses past the biggest class or a full class. Then the
+// per frame work of the main loop and of Opencv2Spout::draw in memoryshare
+// mode on pooled Mats, flip, channel extraction, send and receive back,
+// checked to take nothing from the heap, malloc or new in any thread, once
+// warmed up. Opencv2Spout itself needs Spout and a GL context, the benchmark
+// checks it on Windows.
+#include "FramePool.h"
+#include "HeapCount.h"
+#include "SpoutMemorySender.h"
+#include "TestCheck.h"
+#include "opencv2/core.hpp"
+#include <stdint.h>
+#include <string>
+#include <unistd.h>
+using namespace std;
+
+static void checkPool()
+{
+	FramePool pool(2);
+	cv::Mat a, b, c;
+	pool.attach(a);
+	pool.attach(b);
+	pool.attach(c);
+	a.create(720, 1280, CV_8UC3);
+	check(((uintptr_t)a.data % FramePool::ALIGNMENT) == 0, "buffers are 64-byte aligned");
+	FramePool::Stats stats = pool.stats();
+	check(stats.hits == 1 && stats.misses == 0 && stats.heapAllocations == 1 && stats.inUse == 1, "first frame fills a slot");
+
+	// A copy shares the slot, it comes back with the last of them
+	unsigned char* data = a.data;
+	cv::Mat shared = a;
+	a.release();
+	check(pool.stats().inUse == 1, "slot held while a copy lives");
+	shared.release();
+	check(pool.stats().inUse == 0, "slot back with the last Mat");
+	a.create(720, 1280, CV_8UC3);
+	check(a.data == data && pool.stats().heapAllocations == 1, "a returned slot is reused");
+
+	// Smaller frames of the same class take the other slot, the third one misses
+	b.create(700, 1280, CV_8UC3);
+	c.create(600, 1280, CV_8UC3);
+	stats = pool.stats();
+	check(stats.heapAllocations == 2 && stats.misses == 1, "a full class misses to the standard allocator");
+	c.release();
+
+	// Past the biggest class
+	cv::Mat huge;
+	pool.attach(huge);
+	huge.create(8192, 8192 + 1, CV_8UC1);
+	check(pool.stats().misses == 2, "past the biggest class misses");
+	huge.release();
+	a.release();
+	b.release();
+	check(pool.stats().inUse == 0, "every slot back");
+}
+
+// What a frame goes through : the 8-bit plane flipped, one channel taken out,
+// the frame sent to the memoryshare map and read back, all on pooled Mats
+static bool runFrame(const cv::Mat &frame, FramePool &pool, SpoutMemorySender &sender, SpoutMemoryReceiver &receiver,
+	cv::Mat &flipped, cv::Mat &plane)
+{
+	cv::flip(frame, flipped, 0);
+	cv::extractChannel(frame, plane, 2);
+	cv::Mat received;
+	pool.attach(received);
+	return sender.send(flipped, false) && receiver.waitFrame(1000) && receiver.receive(received) &&
+		received.rows == frame.rows && received.cols == frame.cols;
+}
+
+static void checkSteadyState(const string &name)
+{
+	const int warmup = 5, frames = 100;
+	FramePool pool(4);
+	SpoutMemorySender sender;
+	SpoutMemoryReceiver receiver;
+	if (!check(sender.create(name.c_str(), 1280, 720) && receiver.open(name.c_str(), 1280, 720), "open the memoryshare map"))
+		return;
+	cv::Mat frame(720, 1280, CV_8UC3, cv::Scalar(10, 20, 30)), flipped, plane;
+	pool.attach(flipped);
+	pool.attach(plane);
+	bool ok = true;
+	for (int i = 0; i < warmup; i++)
+		ok = runFrame(frame, pool, sender, receiver, flipped, plane) && ok;
+
+	FramePool::Stats warm = pool.stats();
+	setHeapCounting(true);
+	unsigned long long before = heapAllocations();
+	for (int i = 0; i < frames; i++)
+		ok = runFrame(frame, pool, sender, receiver, flipped, plane) && ok;
+	unsigned long long allocations = heapAllocations() - before;
+	setHeapCounting(false);
+	FramePool::Stats stats = pool.stats();
+
+	cout << allocations << " heap allocations over " << frames << " frames, " << stats.hits - warm.hits << " pool hits" << endl;
+	check(ok, "every frame sent and received");
+	check(heapCountsMalloc(), "malloc counted");
+	check(allocations == 0, "no heap allocation in the steady state");
+	check(stats.misses == warm.misses && stats.heapAllocations == warm.heapAllocations, "no pool miss, no new slot");
+	receiver.release();
+	sender.release();
+}
+
+int main()
+{
+	checkPool();
+	checkSteadyState("ZedToSpoutFramePoolTest" + to_string(getpid()));
+	return testResult("Frame pool");
+}
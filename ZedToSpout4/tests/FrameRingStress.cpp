@@ -0,0 +1,184 @@
+// One writer fills 720p frames into a 4 slot SpoutFrameRing as fast as it
+// can while readers, separate processes on POSIX and threads with their own
+// mapping on Windows, read the newest frame and check every word of it.
+// Reports the writer and reader rates, the frames missed and the copies the
+// writer overran. Fails when a reader saw a torn frame or none.
+//
+// FrameRingStress [seconds [readers]], 5 seconds and 3 readers by default
+#include "SpoutFrameRing.h"
+#include "opencv2/core/hal/interface.h"
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+static const char* RING_STRESS_NAME = "ZedToSpoutRingStress";
+
+// Every word of a stress frame depends on its id, so a torn copy shows
+static inline unsigned int ringWord(unsigned long long frameId, size_t i)
+{
+	return (unsigned int)frameId * 2654435761u ^ (unsigned int)i;
+}
+
+struct RingReaderResult
+{
+	unsigned long long frames, torn, missed, retries, overruns;
+	double seconds;
+};
+
+// Reads the newest frame over and over with a mapping of its own until the writer closes the ring
+static RingReaderResult runRingReader(int seconds)
+{
+	RingReaderResult result;
+	memset(&result, 0, sizeof(result));
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	chrono::steady_clock::time_point deadline = start + chrono::seconds(seconds + 5);
+	SpoutFrameRing ring;
+	while (!ring.open(RING_STRESS_NAME))
+	{
+		if (chrono::steady_clock::now() > deadline)
+			return result;
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+	vector<unsigned int> frame((ring.capacity() + 3) / 4);
+	SpoutFrameInfo info;
+	for (;;)
+	{
+		SpoutFrameRing::ReadResult read = ring.read((unsigned char*)&frame[0], info);
+		if (read == SpoutFrameRing::RING_CLOSED || chrono::steady_clock::now() > deadline)
+			break;
+		if (read != SpoutFrameRing::RING_FRAME)
+		{
+			this_thread::yield();
+			continue;
+		}
+		for (size_t i = 0; i < info.size / 4; i++)
+		{
+			if (frame[i] != ringWord(info.frameId, i))
+			{
+				result.torn++;
+				break;
+			}
+		}
+	}
+	const SpoutFrameRing::ReaderStats &stats = ring.readerStats();
+	result.frames = stats.frames;
+	result.missed = stats.missed;
+	result.retries = stats.retries;
+	result.overruns = stats.overruns;
+	result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+static int runFrameRingStress(int seconds, int readers)
+{
+	const unsigned int width = 1280, height = 720, size = width * height * 4;
+	SpoutFrameRing ring;
+	if (!ring.create(RING_STRESS_NAME, 4, size))
+	{
+		cout << "Cannot create the frame ring" << endl;
+		return 1;
+	}
+	cout << "Frame ring stress, " << seconds << " s, 4 slots of " << width << "x" << height << " RGBA, "
+		<< readers << " readers" << endl;
+
+	vector<RingReaderResult> results(readers);
+#ifdef _WIN32
+	// Threads, each with its own view of the segment like a separate process
+	vector<thread> threads;
+	for (int i = 0; i < readers; i++)
+		threads.push_back(thread([&results, i, seconds]() { results[i] = runRingReader(seconds); }));
+#else
+	vector<pid_t> children;
+	vector<int> pipes;
+	for (int i = 0; i < readers; i++)
+	{
+		int fds[2];
+		if (pipe(fds) != 0)
+			break;
+		pid_t pid = fork();
+		if (pid == 0)
+		{
+			::close(fds[0]);
+			RingReaderResult result = runRingReader(seconds);
+			ssize_t written = ::write(fds[1], &result, sizeof(result));
+			_exit(written == (ssize_t)sizeof(result) ? 0 : 1);
+		}
+		::close(fds[1]);
+		if (pid < 0)
+		{
+			::close(fds[0]);
+			break;
+		}
+		children.push_back(pid);
+		pipes.push_back(fds[0]);
+	}
+#endif
+
+	// The writer never waits : a frame as fast as it can be filled
+	unsigned long long frames = 0, misnumbered = 0;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	chrono::steady_clock::time_point end = start + chrono::seconds(seconds);
+	while (chrono::steady_clock::now() < end)
+	{
+		unsigned int* words = (unsigned int*)ring.beginWrite(size);
+		unsigned long long id = frames + 1;
+		for (size_t i = 0; i < size / 4; i++)
+			words[i] = ringWord(id, i);
+		SpoutFrameInfo info;
+		info.size = size;
+		info.format = CV_8UC4;
+		info.width = width;
+		info.height = height;
+		ring.endWrite(info);
+		if (info.frameId != id)
+			misnumbered++;
+		frames++;
+	}
+	double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	ring.close();
+
+#ifdef _WIN32
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+#else
+	results.resize(children.size());
+	for (size_t i = 0; i < children.size(); i++)
+	{
+		if (::read(pipes[i], &results[i], sizeof(results[i])) != (ssize_t)sizeof(results[i]))
+			memset(&results[i], 0, sizeof(results[i]));
+		::close(pipes[i]);
+		int status = 0;
+		waitpid(children[i], &status, 0);
+	}
+#endif
+
+	cout << fixed << setprecision(1)
+		<< "Writer : " << frames / elapsed << " fps, " << frames * (double)size / elapsed / 1e9 << " GB/s" << endl;
+	bool ok = misnumbered == 0 && (int)results.size() == readers;
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const RingReaderResult &r = results[i];
+		cout << "Reader " << i << " : " << r.frames << " frames, " << (r.seconds > 0 ? r.frames / r.seconds : 0.0) << " fps, "
+			<< r.missed << " missed, " << r.retries << " retries, " << r.overruns << " overruns, " << r.torn << " torn" << endl;
+		if (r.frames == 0 || r.torn > 0)
+			ok = false;
+	}
+	cout << "Frame ring : " << (ok ? "ok" : "FAILED") << endl;
+	return ok ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+	int seconds = argc > 1 ? atoi(argv[1]) : 5;
+	int readers = argc > 2 ? atoi(argv[2]) : 3;
+	return runFrameRingStress(seconds > 0 ? seconds : 5, readers > 0 ? readers : 3);
+}
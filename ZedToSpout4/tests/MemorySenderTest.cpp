@@ -0,0 +1,134 @@
+// SpoutMemorySender and SpoutMemoryReceiver through the memoryshare map and
+// the frame ring : the flip, the RGBA expansion and packing, resizes and events
+#include "SpoutMemorySender.h"
+#include "TestCheck.h"
+#include <string.h>
+#include <string>
+#include <unistd.h>
+using namespace std;
+
+// Receives once the sender's event says there is a frame
+static bool receiveFrame(SpoutMemoryReceiver &receiver, cv::Mat &img)
+{
+	return receiver.waitFrame(1000) && receiver.receive(img);
+}
+
+// The RGBA word writeRGBA makes of a source pixel
+static unsigned int expectedWord(const cv::Mat &src, int y, int x)
+{
+	switch (src.type())
+	{
+	case CV_8UC1:
+		return src.at<unsigned char>(y, x) * 0x00010101u | 0xFF000000u;
+	case CV_8UC3:
+	{
+		cv::Vec3b p = src.at<cv::Vec3b>(y, x);
+		return p[2] | (p[1] << 8) | (p[0] << 16) | 0xFF000000u;
+	}
+	case CV_8UC4:
+	{
+		cv::Vec4b p = src.at<cv::Vec4b>(y, x);
+		return p[2] | (p[1] << 8) | (p[0] << 16) | ((unsigned int)p[3] << 24);
+	}
+	case CV_16UC1:
+		return src.at<unsigned short>(y, x) | 0xFF000000u;
+	default:
+		{
+			unsigned int bits;
+			memcpy(&bits, &src.at<float>(y, x), 4);
+			return bits;
+		}
+	}
+}
+
+static bool sameFrame(const cv::Mat &src, const cv::Mat &rgba, bool bInvert)
+{
+	if (rgba.type() != CV_8UC4 || rgba.cols != src.cols || rgba.rows != src.rows)
+		return false;
+	for (int y = 0; y < src.rows; y++)
+	{
+		const unsigned int* row = rgba.ptr<unsigned int>(y);
+		for (int x = 0; x < src.cols; x++)
+		{
+			if (row[x] != expectedWord(src, bInvert ? src.rows - 1 - y : y, x))
+				return false;
+		}
+	}
+	return true;
+}
+
+static cv::Mat testFrame(int rows, int cols, int type)
+{
+	cv::Mat frame(rows, cols, type);
+	cv::RNG rng(rows * 31 + type);
+	if (frame.depth() == CV_32F)
+		rng.fill(frame, cv::RNG::UNIFORM, 0.0f, 20000.0f);
+	else
+		rng.fill(frame, cv::RNG::UNIFORM, 0, frame.depth() == CV_16U ? 65536 : 256);
+	return frame;
+}
+
+static void checkMap(const string &name)
+{
+	SpoutMemorySender sender;
+	if (!check(sender.create(name.c_str(), 64, 48), "create the memoryshare sender"))
+		return;
+	SpoutMemoryReceiver receiver;
+	if (!check(receiver.open(name.c_str(), 64, 48), "open the memoryshare sender"))
+		return;
+	const int types[] = { CV_8UC1, CV_8UC3, CV_8UC4, CV_16UC1, CV_32FC1 };
+	for (int i = 0; i < 5; i++)
+	{
+		cv::Mat frame = testFrame(48, 64, types[i]), img;
+		for (int invert = 0; invert < 2; invert++)
+		{
+			check(sender.send(frame, invert != 0), "send a frame to the map");
+			check(receiveFrame(receiver, img) && sameFrame(frame, img, invert != 0), "the map holds the frame, flipped when asked");
+		}
+	}
+	check(!sender.send(cv::Mat(48, 64, CV_16SC1, cv::Scalar(0))), "unsupported type refused");
+	receiver.release();
+	sender.release();
+	SpoutMemoryReceiver late;
+	check(!late.open(name.c_str(), 64, 48), "a released sender can't be opened");
+}
+
+static void checkRing(const string &name)
+{
+	SpoutMemorySender sender;
+	if (!check(sender.create(name.c_str(), 64, 48, 3), "create the ring sender"))
+		return;
+	SpoutMemoryReceiver receiver;
+	if (!check(receiver.openRing(name.c_str()), "open the ring sender"))
+		return;
+	cv::Mat frame = testFrame(48, 64, CV_8UC3), img;
+	check(sender.send(frame), "send a frame to the ring");
+	check(receiveFrame(receiver, img) && sameFrame(frame, img, true), "the ring frame is the one sent");
+	check(!receiver.receive(img), "no new frame until the next is sent");
+
+	// A smaller frame goes in the same ring and carries its size
+	cv::Mat small = testFrame(24, 40, CV_8UC4);
+	check(sender.send(small), "send a smaller frame");
+	check(receiveFrame(receiver, img) && sameFrame(small, img, true), "the smaller frame comes with its size");
+
+	// A larger one makes a new ring, the receiver opens it again on the way
+	cv::Mat large = testFrame(96, 128, CV_16UC1);
+	check(sender.send(large), "send a larger frame");
+	bool received = false;
+	for (int i = 0; i < 5 && !received; i++)
+	{
+		check(sender.send(large), "send to the new ring");
+		received = receiveFrame(receiver, img) && sameFrame(large, img, true);
+	}
+	check(received, "the receiver follows the new ring");
+	const SpoutFrameRing::ReaderStats* stats = receiver.ringStats();
+	check(stats != NULL && stats->frames > 0, "ring reader statistics");
+}
+
+int main()
+{
+	string name = "ZedToSpoutSenderTest" + to_string(getpid());
+	checkMap(name);
+	checkRing(name + "Ring");
+	return testResult("Memory sender");
+}
@@ -0,0 +1,131 @@
+// NetworkDepthSender to NetworkDepthReceiver over loopback, UDP and TCP, raw,
+// compressed and as tile deltas, then with datagrams dropped and parity
+#include "NetworkDepth.h"
+#include "DepthEncoding.h"
+#include "TestCheck.h"
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// A moving ramp of millimeters with the DEPTH16 codes here and there
+static vector<cv::Mat> depthFrames(int count, int rows, int cols)
+{
+	vector<cv::Mat> frames;
+	cv::RNG rng(7);
+	for (int i = 0; i < count; i++)
+	{
+		cv::Mat frame(rows, cols, CV_16UC1);
+		for (int y = 0; y < rows; y++)
+		{
+			unsigned short* row = frame.ptr<unsigned short>(y);
+			for (int x = 0; x < cols; x++)
+				row[x] = (unsigned short)(500 + (x * 7 + y * 3 + i * 40) % 9000);
+		}
+		for (int k = 0; k < 200; k++)
+		{
+			static const unsigned short codes[] = { DEPTH16_OCCLUSION, DEPTH16_TOO_CLOSE, DEPTH16_TOO_FAR };
+			frame.at<unsigned short>(rng.uniform(0, rows), rng.uniform(0, cols)) = codes[k % 3];
+		}
+		frames.push_back(frame);
+	}
+	return frames;
+}
+
+struct TransferResult
+{
+	unsigned long long sent, received, mismatched;
+	NetworkReceiverStats stats;
+};
+
+// Sends every frame at about 60 fps while a thread checks what arrives against the frame of its sequence
+static TransferResult transfer(const vector<cv::Mat> &frames, NetworkTransport transport, bool compress,
+	double dropRate, int parityGroup, const TileDeltaParams* delta)
+{
+	TransferResult result;
+	memset(&result, 0, sizeof(result));
+	NetworkDepthReceiver receiver;
+	NetworkDepthSender sender;
+	if (!receiver.open(0, transport) || !sender.open("127.0.0.1", receiver.port(), transport, compress))
+		return result;
+	sender.setParityGroup(parityGroup);
+	sender.setDropRate(dropRate);
+	sender.setDelta(delta);
+
+	atomic<bool> receiving(true);
+	thread receiverThread([&]() {
+		cv::Mat image;
+		NetworkFrameInfo info;
+		while (receiving)
+		{
+			if (!receiver.receive(image, info, 50))
+				continue;
+			result.received++;
+			const cv::Mat &expected = frames[info.sequence % frames.size()];
+			if (image.size() != expected.size() || image.type() != expected.type() ||
+				memcmp(image.data, expected.data, expected.total() * expected.elemSize()) != 0)
+				result.mismatched++;
+		}
+	});
+	for (size_t i = 0; i < frames.size(); i++)
+	{
+		if (sender.send(frames[sender.sequence() % frames.size()], i + 1))
+			result.sent++;
+		this_thread::sleep_for(chrono::milliseconds(16));
+	}
+	// The last frames in flight
+	this_thread::sleep_for(chrono::milliseconds(200));
+	receiving = false;
+	receiverThread.join();
+	result.stats = receiver.stats();
+	return result;
+}
+
+int main()
+{
+	vector<cv::Mat> frames = depthFrames(30, 240, 320);
+	TileDeltaParams delta;
+	delta.toleranceMm = 0; // exact, so the frames compare
+	const NetworkTransport transports[] = { NETWORK_UDP, NETWORK_TCP };
+	const char* names[] = { "UDP", "TCP" };
+	for (int t = 0; t < 2; t++)
+	{
+		for (int mode = 0; mode < 3; mode++)
+		{
+			TransferResult r = transfer(frames, transports[t], mode == 1, 0.0, NETWORK_PARITY_GROUP, mode == 2 ? &delta : NULL);
+			const char* label = mode == 0 ? "raw" : mode == 1 ? "compressed" : "delta";
+			cout << names[t] << " " << label << " : " << r.sent << " sent, " << r.received << " received, "
+				<< r.mismatched << " mismatched" << endl;
+			check(r.sent == frames.size(), "every frame sent");
+			// Loopback keeps up at 60 fps, a frame may be replaced by the next before it is picked up
+			check(r.received >= r.sent * 3 / 4, "frames received over loopback");
+			check(r.mismatched == 0, "received frames are the ones sent");
+		}
+	}
+
+	// A float frame and an RGBA one go as they are
+	vector<cv::Mat> other;
+	other.push_back(cv::Mat(120, 160, CV_32FC1, cv::Scalar(1234.5f)));
+	other.push_back(cv::Mat(120, 160, CV_8UC4, cv::Scalar(10, 20, 30, 255)));
+	TransferResult mixed = transfer(other, NETWORK_UDP, false, 0.0, NETWORK_PARITY_GROUP, NULL);
+	check(mixed.received > 0 && mixed.mismatched == 0, "float and RGBA frames over UDP");
+
+	// One datagram in a hundred dropped : parity rebuilds most frames, the rest are dropped whole
+	TransferResult lossy = transfer(frames, NETWORK_UDP, false, 0.01, NETWORK_PARITY_GROUP, NULL);
+	cout << "UDP 1% loss : " << lossy.received << " received, " << lossy.stats.recovered << " datagrams rebuilt, "
+		<< lossy.stats.dropped << " frames dropped" << endl;
+	check(lossy.mismatched == 0, "no damaged frame delivered under loss");
+	check(lossy.stats.recovered > 0, "parity rebuilds lost datagrams");
+	check(lossy.received > 0, "frames arrive under loss");
+
+	NetworkTransport transport;
+	string host;
+	unsigned short port = 0;
+	check(parseNetworkAddress("tcp:10.0.0.2:9000", transport, host, port) && transport == NETWORK_TCP &&
+		host == "10.0.0.2" && port == 9000, "parse a sender address");
+	check(parseNetworkAddress("9001", transport, host, port) && transport == NETWORK_UDP && port == 9001,
+		"parse a receiver port");
+	return testResult("Network depth");
+}
@@ -0,0 +1,270 @@
+// PointCloudProjector against the pinhole model point by point, AVX2 giving
+// exactly the scalar points on the synthetic scene and on a window of it with
+// sentinels whose rows end part way through a vector. Then the culling of
+// sentinels, of the depth range and of the confidence, voxel centroids and
+// colors across the grid growing its table, the texture and the binary form.
+#include "PointCloud.h"
+#include "FrameSource.h"
+#include "TestCheck.h"
+#include <math.h>
+#include <string.h>
+#include <vector>
+using namespace std;
+
+static bool samePoints(const PointCloud &a, const PointCloud &b)
+{
+	if (a.count != b.count || a.hasColor != b.hasColor)
+		return false;
+	for (size_t p = 0; p < a.count; p++)
+	{
+		if (a.x[p] != b.x[p] || a.y[p] != b.y[p] || a.z[p] != b.z[p] || (a.hasColor && a.color[p] != b.color[p]))
+			return false;
+	}
+	return true;
+}
+
+// The points the pinhole model gives, row after row, the way the projector rounds them
+static void referenceCloud(const cv::Mat &depth, const cv::Mat &left, const cv::Mat &confidence,
+	const CameraIntrinsics &intrinsics, const PointCloudParams &params, PointCloud &cloud)
+{
+	const bool bColor = params.color && !left.empty();
+	const bool bConfidence = params.confidenceThreshold < 100 && !confidence.empty();
+	cloud.reserve(depth.total());
+	cloud.count = 0;
+	cloud.hasColor = bColor;
+	for (int y = 0; y < depth.rows; y++)
+	{
+		float rayY = (y - intrinsics.cy) / intrinsics.fy;
+		for (int x = 0; x < depth.cols; x++)
+		{
+			float z = depth.at<float>(y, x);
+			if (!(fabsf(z) < INFINITY) || z < params.nearMm || z > params.farMm)
+				continue;
+			if (bConfidence && confidence.at<float>(y, x) > params.confidenceThreshold)
+				continue;
+			cloud.x[cloud.count] = (x - intrinsics.cx) / intrinsics.fx * z;
+			cloud.y[cloud.count] = rayY * z;
+			cloud.z[cloud.count] = z;
+			if (bColor)
+				cloud.color[cloud.count] = left.at<unsigned int>(y, x);
+			cloud.count++;
+		}
+	}
+}
+
+// The synthetic scene, and a 637x359 window of it with sentinels every few
+// pixels and a confidence ramp, so the threshold culls some of each row
+static void checkProjection()
+{
+	SyntheticFrameSource scene(1280, 720);
+	DepthFrame frame;
+	scene.grab(frame);
+	check(scene.grab(frame) && !frame.left.empty() && !frame.confidence.empty(), "synthetic frame with color and confidence");
+
+	cv::Rect window(3, 5, 637, 359);
+	cv::Mat depth = frame.depth.clone()(window), confidence = frame.confidence.clone()(window);
+	const float sentinels[] = { NAN, INFINITY, -INFINITY };
+	for (int y = 0; y < depth.rows; y++)
+	{
+		for (int x = (y * 7) % 13; x < depth.cols; x += 13)
+			depth.at<float>(y, x) = sentinels[(x + y) % 3];
+		for (int x = 0; x < depth.cols; x++)
+			confidence.at<float>(y, x) = (float)((x * 3 + y) % 100);
+	}
+	const cv::Mat depths[] = { frame.depth, depth };
+	const cv::Mat lefts[] = { frame.left, frame.left(window) };
+	const cv::Mat confidences[] = { frame.confidence, confidence };
+
+	PointCloudParams variants[3];
+	variants[1].nearMm = 1500.0f;
+	variants[1].farMm = 6000.0f;
+	variants[1].confidenceThreshold = 60;
+	variants[2].color = false;
+	variants[2].confidenceThreshold = 30;
+
+	const KernelIsa isas[] = { KERNEL_SCALAR, KERNEL_AVX2 };
+	int checked = 0, wrong = 0;
+	for (int f = 0; f < 2; f++)
+	{
+		CameraIntrinsics intrinsics = defaultIntrinsics(depths[f].size());
+		PointCloudProjector projector;
+		projector.setIntrinsics(intrinsics);
+		for (int v = 0; v < 3; v++)
+		{
+			PointCloud reference, cloud;
+			referenceCloud(depths[f], lefts[f], confidences[f], intrinsics, variants[v], reference);
+			for (int i = 0; i < 2 && isas[i] <= bestKernelIsa(); i++)
+			{
+				projector.project(depths[f], lefts[f], confidences[f], variants[v], cloud, isas[i]);
+				if (!samePoints(reference, cloud))
+				{
+					cout << "  " << kernelIsaName(isas[i]) << " " << depths[f].cols << "x" << depths[f].rows << " variant " << v
+						<< " : " << cloud.count << " points, " << reference.count << " expected" << endl;
+					wrong++;
+				}
+				checked++;
+			}
+		}
+	}
+	cout << "projection : " << checked - wrong << " / " << checked << " match the pinhole model" << endl;
+	check(wrong == 0, "every instruction set gives the pinhole points");
+}
+
+// Every pixel of a known kind : sentinels, out of range, poorly confident, kept
+static void checkCulling()
+{
+	const KernelIsa isas[] = { KERNEL_SCALAR, KERNEL_AVX2 };
+	cv::Mat depth(2, 21, CV_32FC1), left(2, 21, CV_8UC4), confidence(2, 21, CV_32FC1);
+	const float values[] = { NAN, INFINITY, -INFINITY, 499.0f, 500.0f, 5000.0f, 5001.0f };
+	for (int y = 0; y < depth.rows; y++)
+	{
+		for (int x = 0; x < depth.cols; x++)
+		{
+			depth.at<float>(y, x) = values[x % 7];
+			confidence.at<float>(y, x) = x < 14 ? 50.0f : 51.0f;
+			left.at<unsigned int>(y, x) = 0xFF000000u | (y << 8) | x;
+		}
+	}
+	PointCloudParams params;
+	params.nearMm = 500.0f;
+	params.farMm = 5000.0f;
+	params.confidenceThreshold = 50;
+	PointCloudProjector projector;
+	bool ok = true;
+	for (int i = 0; i < 2 && isas[i] <= bestKernelIsa(); i++)
+	{
+		PointCloud cloud;
+		projector.project(depth, left, confidence, params, cloud, isas[i]);
+		// Columns 4, 5, 11 and 12 of each row, the last seven are over the threshold
+		const int kept[] = { 4, 5, 11, 12 };
+		ok = ok && cloud.count == 8 && cloud.hasColor;
+		for (size_t p = 0; ok && p < cloud.count; p++)
+			ok = cloud.color[p] == (0xFF000000u | (unsigned int)((p / 4) << 8) | kept[p % 4]) && cloud.z[p] == values[kept[p % 4] % 7];
+
+		// At 100 the confidence isn't looked at
+		params.confidenceThreshold = 100;
+		projector.project(depth, left, confidence, params, cloud, isas[i]);
+		ok = ok && cloud.count == 12;
+		params.confidenceThreshold = 50;
+	}
+	check(ok, "sentinels, the depth range ends and poor confidence culled");
+
+	PointCloud cloud;
+	projector.project(depth, cv::Mat(), cv::Mat(), params, cloud);
+	check(cloud.count == 12 && !cloud.hasColor, "without color and confidence images");
+}
+
+// A cloud of count points in each of voxels voxels of a 10 mm grid, around
+// the origin so the indices go negative, the points of one voxel far apart in
+// the cloud. Colors vary with the point so the mean has to round.
+static void voxelCloud(int voxels, int count, PointCloud &cloud)
+{
+	cloud.reserve((size_t)voxels * count);
+	cloud.count = 0;
+	cloud.hasColor = true;
+	for (int k = 0; k < count; k++)
+	{
+		for (int v = 0; v < voxels; v++)
+		{
+			float offset = 1.0f + 3.0f * k;
+			cloud.x[cloud.count] = (v % 40 - 20) * 10.0f + offset;
+			cloud.y[cloud.count] = (v / 40 % 40 - 20) * 10.0f + offset;
+			cloud.z[cloud.count] = (v / 1600) * 10.0f + 500.0f + offset;
+			cloud.color[cloud.count] = (unsigned int)(v % 256) | ((unsigned int)(k * 85) << 8) | ((unsigned int)(k % 2) << 16) | 0xFF000000u;
+			cloud.count++;
+		}
+	}
+}
+
+// Centroid and rounded mean color of each voxel, in first hit order
+static bool checkVoxelCentroids(int voxels, int count, const PointCloud &out)
+{
+	if ((int)out.count != voxels || !out.hasColor)
+		return false;
+	unsigned int g = 0, r = 0;
+	for (int k = 0; k < count; k++)
+	{
+		g += k * 85;
+		r += k % 2;
+	}
+	unsigned int meanColor = 0xFF000000u | (((g + count / 2) / count) << 8) | (((r + count / 2) / count) << 16);
+	float offset = 1.0f + 1.5f * (count - 1);
+	for (int v = 0; v < voxels; v++)
+	{
+		if (fabs(out.x[v] - ((v % 40 - 20) * 10.0f + offset)) > 0.001 ||
+			fabs(out.y[v] - ((v / 40 % 40 - 20) * 10.0f + offset)) > 0.001 ||
+			fabs(out.z[v] - ((v / 1600) * 10.0f + 500.0f + offset)) > 0.001 ||
+			out.color[v] != (meanColor | (unsigned int)(v % 256)))
+			return false;
+	}
+	return true;
+}
+
+// The table starts at 4096 slots and is kept half full, 5000 voxels make it
+// grow part way through a frame; a small frame after it and a big one again
+// must find the voxels of their own frame only
+static void checkVoxels()
+{
+	VoxelGrid grid;
+	PointCloud in, out;
+	const int frames[][2] = { { 5000, 3 }, { 100, 2 }, { 5000, 3 }, { 2047, 1 } };
+	bool ok = true;
+	for (int f = 0; f < 4; f++)
+	{
+		voxelCloud(frames[f][0], frames[f][1], in);
+		grid.filter(in, 10.0f, out);
+		if (!checkVoxelCentroids(frames[f][0], frames[f][1], out))
+		{
+			cout << "  frame " << f << " : " << out.count << " voxels, " << frames[f][0] << " expected" << endl;
+			ok = false;
+		}
+	}
+	check(ok, "voxel centroids and colors, across the table growing");
+
+	in.count = 0;
+	grid.filter(in, 10.0f, out);
+	check(out.count == 0, "an empty cloud");
+	voxelCloud(10, 2, in);
+	grid.filter(in, 0.0f, out);
+	check(out.count == 0, "no leaf size, no voxels");
+}
+
+static void checkOutputs()
+{
+	PointCloud cloud, unpacked;
+	voxelCloud(300, 1, cloud);
+	vector<unsigned char> packed;
+	size_t size = packPointCloud(cloud, packed);
+	check(size == sizeof(PointCloudHeader) + 300 * 16 && unpackPointCloud(&packed[0], size, unpacked) &&
+		samePoints(cloud, unpacked), "binary form round trip with color");
+	check(!unpackPointCloud(&packed[0], size - 1, unpacked), "truncated binary form refused");
+	packed[0] = 'X';
+	check(!unpackPointCloud(&packed[0], size, unpacked), "wrong magic refused");
+
+	cloud.hasColor = false;
+	size = packPointCloud(cloud, packed);
+	check(size == sizeof(PointCloudHeader) + 300 * 12 && unpackPointCloud(&packed[0], size, unpacked) &&
+		samePoints(cloud, unpacked), "binary form round trip without color");
+	cloud.count = 0;
+	size = packPointCloud(cloud, packed);
+	check(unpackPointCloud(&packed[0], size, unpacked) && unpacked.count == 0, "empty cloud round trip");
+
+	// Meters and the color as a float, then empty texels
+	voxelCloud(3, 1, cloud);
+	cv::Mat texture;
+	pointCloudToTexture(cloud, cv::Size(2, 2), texture);
+	const cv::Vec4f first = texture.at<cv::Vec4f>(0, 0), last = texture.at<cv::Vec4f>(1, 1);
+	check(texture.type() == CV_32FC4 && first[0] == cloud.x[0] * 0.001f && first[2] == cloud.z[0] * 0.001f &&
+		first[3] == 0.0f && texture.at<cv::Vec4f>(0, 1)[3] == 1.0f && last[0] != last[0] && last[3] == 0.0f,
+		"texture in meters, color as R * 65536 + G * 256 + B, NAN past the points");
+}
+
+int main()
+{
+	cout << "best instruction set " << kernelIsaName(bestKernelIsa()) << endl;
+	checkProjection();
+	checkCulling();
+	checkVoxels();
+	checkOutputs();
+	return testResult("Point cloud");
+}
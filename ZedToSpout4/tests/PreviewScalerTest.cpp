@@ -0,0 +1,127 @@
+// PreviewScaler against the convert, cv::resize INTER_AREA and cv::flip it
+// replaces : the depth plane, the left image and the confidence of the
+// synthetic scene, and noise, shrunk to the preview window, by whole and by
+// uneven ratios, and grown to it from sources smaller than the window, one
+// of them a window of a bigger image whose rows aren't contiguous. Every
+// instruction set must write the scalar bytes, and be within one level of
+// OpenCV, which rounds halves to even and works its weights out its own way.
+#include "PreviewScaler.h"
+#include "FrameSource.h"
+#include "TestCheck.h"
+#include "opencv2/imgproc.hpp"
+#include <vector>
+using namespace std;
+
+// The preview as the UI made it before : scale in floats, resize, narrow, flip
+static void referencePreview(const cv::Mat &src, cv::Mat &dst, cv::Size size, float scale, bool flip)
+{
+	cv::Mat converted, resized, narrowed;
+	src.convertTo(converted, CV_32F, scale);
+	cv::resize(converted, resized, size, 0, 0, cv::INTER_AREA);
+	resized.convertTo(narrowed, CV_8U);
+	if (flip)
+		cv::flip(narrowed, dst, 0);
+	else
+		dst = narrowed;
+}
+
+struct PreviewSource
+{
+	const char* name;
+	cv::Mat image;
+	float scale;
+};
+
+// The three images the UI shows, at the camera size, and noise in each type
+static void previewSources(vector<PreviewSource> &sources)
+{
+	SyntheticFrameSource scene(1280, 720);
+	DepthFrame frame;
+	scene.grab(frame);
+	scene.grab(frame);
+
+	// A plane of the depth, 255 near and 0 far, without the kernels
+	cv::Mat plane(frame.depth.size(), CV_8UC1);
+	for (int y = 0; y < plane.rows; y++)
+	{
+		for (int x = 0; x < plane.cols; x++)
+		{
+			float z = frame.depth.at<float>(y, x);
+			plane.at<unsigned char>(y, x) = z >= 0.0f && z < 10000.0f ? (unsigned char)(255 - (int)(z * 0.0255f)) : 0;
+		}
+	}
+	cv::RNG rng(16);
+	cv::Mat grey(720, 1280, CV_8UC1), colour(720, 1280, CV_8UC4), floats(720, 1280, CV_32FC1);
+	rng.fill(grey, cv::RNG::UNIFORM, 0, 256);
+	rng.fill(colour, cv::RNG::UNIFORM, 0, 256);
+	rng.fill(floats, cv::RNG::UNIFORM, -20.0, 120.0);
+
+	PreviewSource list[] = {
+		{ "plane", plane, 1.0f },
+		{ "left", frame.left.clone(), 1.0f },
+		{ "confidence", frame.confidence.clone(), 2.55f },
+		{ "grey noise", grey, 1.0f },
+		{ "colour noise", colour, 1.0f },
+		// Out of range both ways, the narrowing clamps
+		{ "float noise", floats, 2.55f },
+	};
+	sources.assign(list, list + sizeof(list) / sizeof(list[0]));
+}
+
+int main()
+{
+	cout << "best instruction set " << kernelIsaName(bestKernelIsa()) << endl;
+	const KernelIsa isas[] = { KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2 };
+	const cv::Size displaySize(720, 404);
+	vector<PreviewSource> sources;
+	previewSources(sources);
+
+	// Source windows and target sizes : shrunk unevenly and by two, then grown
+	// from a window with odd rows that aren't contiguous and from a small corner
+	const cv::Rect windows[] = { cv::Rect(0, 0, 1280, 720), cv::Rect(0, 0, 1280, 720), cv::Rect(3, 5, 637, 359), cv::Rect(40, 30, 200, 120) };
+	const cv::Size targets[] = { displaySize, cv::Size(640, 360), displaySize, displaySize };
+
+	// One scaler through every size, so the coverage is rebuilt on each change
+	PreviewScaler scaler;
+	int checked = 0, wrong = 0;
+	double worst = 0;
+	for (size_t s = 0; s < sources.size(); s++)
+	{
+		for (int w = 0; w < 4; w++)
+		{
+			const cv::Mat src = sources[s].image(windows[w]);
+			for (int flip = 0; flip < 2; flip++)
+			{
+				cv::Mat reference, scalar, scaled;
+				referencePreview(src, reference, targets[w], sources[s].scale, flip != 0);
+				scaler.resize(src, scalar, targets[w], sources[s].scale, flip != 0, KERNEL_SCALAR);
+				for (int i = 0; i < 3 && isas[i] <= bestKernelIsa(); i++)
+				{
+					scaler.resize(src, scaled, targets[w], sources[s].scale, flip != 0, isas[i]);
+					bool sameShape = scaled.size() == targets[w] && scaled.type() == reference.type();
+					double fromReference = sameShape ? cv::norm(reference, scaled, cv::NORM_INF) : 256;
+					if (!sameShape || fromReference > 1 || cv::norm(scalar, scaled, cv::NORM_INF) != 0)
+					{
+						cout << "  " << sources[s].name << " " << kernelIsaName(isas[i]) << " " << src.cols << "x" << src.rows
+							<< " to " << targets[w].width << "x" << targets[w].height << (flip ? " flipped" : "")
+							<< " : " << fromReference << " from OpenCV" << endl;
+						wrong++;
+					}
+					if (fromReference > worst)
+						worst = fromReference;
+					checked++;
+				}
+			}
+		}
+	}
+	cout << "preview : " << checked - wrong << " / " << checked << " match, max difference " << worst << " to OpenCV" << endl;
+	check(wrong == 0, "every instruction set writes the scalar bytes, within one level of INTER_AREA");
+
+	// The same size asked again after another reuses the coverage and gives the same bytes
+	cv::Mat first, again;
+	scaler.resize(sources[0].image, first, displaySize);
+	scaler.resize(sources[0].image(windows[3]), again, displaySize);
+	scaler.resize(sources[0].image, again, displaySize);
+	check(cv::norm(first, again, cv::NORM_INF) == 0, "coverage rebuilt when the sizes come back");
+	return testResult("Preview scaler");
+}
@@ -0,0 +1,148 @@
+// The POSIX SpoutSharedMemory backend and the memoryshare map on top of it,
+// with a second process attaching the way a receiver does
+#include "Spout/SpoutSharedMemory.h"
+#include "Spout/SpoutMemoryShare.h"
+#include "TestCheck.h"
+#include <string.h>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <sys/wait.h>
+#include <unistd.h>
+using namespace std;
+
+// With the process id, a run that crashed leaves nothing the next one finds
+static string g_segment = "ZedToSpoutShmTest" + to_string(getpid());
+#define SEGMENT_NAME g_segment.c_str()
+static const int SEGMENT_SIZE = 4096;
+
+// Runs child in a forked process, its return value is the exit status
+template <typename Child>
+static int inChild(Child child)
+{
+	pid_t pid = fork();
+	if (pid == 0)
+		_exit(child());
+	if (pid < 0)
+		return -1;
+	int status = 0;
+	waitpid(pid, &status, 0);
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static void checkSegment()
+{
+	SpoutSharedMemory owner;
+	check(owner.Create(SEGMENT_NAME, SEGMENT_SIZE) == SPOUT_CREATE_SUCCESS, "create a new segment");
+	check(owner.Create(SEGMENT_NAME, SEGMENT_SIZE) == SPOUT_ALREADY_CREATED, "create again on the same object");
+	char* buffer = owner.Lock();
+	if (!check(buffer != NULL, "lock the new segment"))
+		return;
+	for (int i = 0; i < SEGMENT_SIZE; i++)
+		buffer[i] = (char)(i * 7);
+	owner.Unlock();
+
+	// A second creator attaches and keeps the size the segment was made with
+	SpoutSharedMemory attached;
+	check(attached.Create(SEGMENT_NAME, 16) == SPOUT_ALREADY_EXISTS, "create an existing segment attaches");
+	check(attached.Buffer() && attached.Buffer()[SEGMENT_SIZE - 1] == (char)((SEGMENT_SIZE - 1) * 7), "attached segment keeps its size and content");
+	attached.Close();
+
+	// Another process sees the content and its writes come back
+	int status = inChild([]() {
+		SpoutSharedMemory reader;
+		if (!reader.Open(SEGMENT_NAME))
+			return 1;
+		char* data = reader.Lock();
+		if (!data)
+			return 2;
+		for (int i = 0; i < SEGMENT_SIZE; i++)
+		{
+			if (data[i] != (char)(i * 7))
+				return 3;
+		}
+		data[0] = 42;
+		reader.Unlock();
+		return 0;
+	});
+	check(status == 0, "another process opens, locks and reads the segment");
+	check(owner.Buffer()[0] == 42, "the other process's write is seen");
+
+	// The lock keeps the other process out until it is released, its wait times out
+	check(owner.Lock() != NULL, "lock for the other process to wait on");
+	status = inChild([]() {
+		SpoutSharedMemory reader;
+		if (!reader.Open(SEGMENT_NAME))
+			return 1;
+		return reader.Lock() == NULL ? 0 : 2;
+	});
+	check(status == 0, "lock held by the owner times out in another process");
+	owner.Unlock();
+	status = inChild([]() {
+		SpoutSharedMemory reader;
+		if (!reader.Open(SEGMENT_NAME) || !reader.Lock())
+			return 1;
+		reader.Unlock();
+		return 0;
+	});
+	check(status == 0, "lock released by the owner is taken by another process");
+
+	// Nested locks of one object take the mutex once
+	check(owner.Lock() != NULL && owner.Lock() != NULL, "nested lock");
+	owner.Unlock();
+	owner.Unlock();
+	check(owner.Lock() != NULL, "lock after nested unlocks");
+	owner.Unlock();
+
+	// The creator removes the names, a mapping still open stays usable
+	SpoutSharedMemory late;
+	check(late.Open(SEGMENT_NAME), "open before the owner closes");
+	owner.Close();
+	check(late.Buffer() && late.Buffer()[0] == 42, "open mapping survives the owner closing");
+	SpoutSharedMemory after;
+	check(!after.Open(SEGMENT_NAME), "open fails once the owner closed");
+}
+
+static void checkMemoryShare()
+{
+	string shareName = "ZedToSpoutShareTest" + to_string(getpid());
+	const char* name = shareName.c_str();
+	spoutMemoryShare sender, receiver;
+	check(!receiver.OpenSenderMemory(name), "open a sender that doesn't exist");
+	if (!check(sender.CreateSenderMemory(name, 64, 32), "create the sender map"))
+		return;
+	unsigned int width = 0, height = 0;
+	check(sender.GetSenderMemorySize(width, height) && width == 64 && height == 32, "sender map size");
+	unsigned char* pixels = sender.LockSenderMemory();
+	if (check(pixels != NULL, "lock the sender map"))
+	{
+		memset(pixels, 0x5A, 64 * 32 * 4);
+		sender.UnlockSenderMemory();
+	}
+	check(receiver.OpenSenderMemory(name), "open the sender map");
+	pixels = receiver.LockSenderMemory();
+	if (check(pixels != NULL, "lock the receiver map"))
+	{
+		check(pixels[0] == 0x5A && pixels[64 * 32 * 4 - 1] == 0x5A, "receiver reads the sender pixels");
+		receiver.UnlockSenderMemory();
+	}
+	receiver.ReleaseSenderMemory();
+
+	// Resizing makes a new map under the same name
+	check(sender.UpdateSenderMemorySize(name, 128, 64), "resize the sender map");
+	pixels = sender.LockSenderMemory();
+	if (check(pixels != NULL, "lock the resized map"))
+	{
+		pixels[128 * 64 * 4 - 1] = 1;
+		sender.UnlockSenderMemory();
+	}
+	sender.ReleaseSenderMemory();
+	check(!receiver.OpenSenderMemory(name), "open a released sender");
+}
+
+int main()
+{
+	checkSegment();
+	checkMemoryShare();
+	return testResult("Shared memory");
+}
@@ -0,0 +1,109 @@
+// SocketUtil over loopback : UDP datagrams, a TCP connection carrying a
+// frame-sized buffer both ways, and the timeouts the receivers rely on
+#include "SocketUtil.h"
+#include "TestCheck.h"
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+using namespace std;
+
+static void checkUdp()
+{
+	intptr_t receiver = openUdpSocket(0, false);
+	intptr_t sender = openUdpSocket(0, false);
+	if (!check(receiver != NO_SOCKET && sender != NO_SOCKET, "open UDP sockets on free ports"))
+		return;
+	unsigned short port = socketPort(receiver);
+	check(port != 0, "port of a socket opened on port 0");
+	setSocketBuffers(receiver, 1 << 20);
+
+	check(!waitReadable(receiver, 20), "nothing to read before the first datagram");
+	unsigned int address = 0;
+	check(resolveHost("127.0.0.1", address) && address == htonl(INADDR_LOOPBACK), "resolve a dotted address");
+	unsigned int named = 0;
+	check(resolveHost("localhost", named) && named == htonl(INADDR_LOOPBACK), "resolve localhost");
+
+	sockaddr_in to;
+	memset(&to, 0, sizeof(to));
+	to.sin_family = AF_INET;
+	to.sin_port = htons(port);
+	to.sin_addr.s_addr = address;
+	const int datagrams = 32;
+	unsigned char out[1400], in[2048];
+	for (int i = 0; i < datagrams; i++)
+	{
+		memset(out, i, sizeof(out));
+		check(sendto((SOCKET)sender, (const char*)out, sizeof(out), 0, (const sockaddr*)&to, sizeof(to)) == (int)sizeof(out),
+			"send a datagram");
+	}
+	// Loopback neither loses nor reorders them
+	for (int i = 0; i < datagrams; i++)
+	{
+		if (!check(waitReadable(receiver, 1000), "datagram to read"))
+			break;
+		int n = recvfrom((SOCKET)receiver, (char*)in, sizeof(in), 0, NULL, NULL);
+		check(n == (int)sizeof(out) && in[0] == i && in[n - 1] == i, "datagram received whole and in order");
+	}
+
+	check(setReceiveTimeout(receiver, 30), "set a receive timeout");
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	int n = recvfrom((SOCKET)receiver, (char*)in, sizeof(in), 0, NULL, NULL);
+	double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	check(n < 0 && socketTimedOut(), "receive times out");
+	check(ms >= 20 && ms < 1000, "receive timeout is the one set");
+	closeSocket(sender);
+	closeSocket(receiver);
+}
+
+static void checkTcp()
+{
+	intptr_t listener = openTcpListener(0, false);
+	if (!check(listener != NO_SOCKET, "open a TCP listener on a free port"))
+		return;
+	unsigned short port = socketPort(listener);
+
+	// A 720p RGBA frame and back, through sendAll and recvAll
+	vector<unsigned char> frame(1280 * 720 * 4), echoed(frame.size());
+	for (size_t i = 0; i < frame.size(); i++)
+		frame[i] = (unsigned char)(i * 131 >> 3);
+	atomic<bool> echoing(true);
+	bool served = false;
+	thread server([&]() {
+		if (!waitReadable(listener, 2000))
+			return;
+		intptr_t client = (intptr_t)accept((SOCKET)listener, NULL, NULL);
+		if (client == NO_SOCKET)
+			return;
+		vector<unsigned char> buffer(frame.size());
+		setReceiveTimeout(client, 20);
+		served = recvAll(client, &buffer[0], buffer.size(), &echoing) && sendAll(client, &buffer[0], buffer.size());
+		// Waits for the client to close, recvAll sees the end of the stream
+		unsigned char byte;
+		served = !recvAll(client, &byte, 1, &echoing) && served;
+		closeSocket(client);
+	});
+
+	intptr_t s = connectTcpSocket(htonl(INADDR_LOOPBACK), port, 1000);
+	if (check(s != NO_SOCKET, "connect to the listener"))
+	{
+		check(sendAll(s, &frame[0], frame.size()), "send a frame");
+		check(recvAll(s, &echoed[0], echoed.size()) && echoed == frame, "frame echoed back intact");
+		closeSocket(s);
+	}
+	server.join();
+	check(served, "server received, echoed and saw the close");
+	closeSocket(listener);
+
+	// Nobody listens on the port any more
+	check(connectTcpSocket(htonl(INADDR_LOOPBACK), port, 200) == NO_SOCKET, "connect to a closed port fails");
+}
+
+int main()
+{
+	check(socketStartup(), "socket startup");
+	checkUdp();
+	checkTcp();
+	return testResult("Socket loopback");
+}
@@ -0,0 +1,154 @@
+// Times every spoutCopy conversion and the plain and flipped copies at
+// 720p, 1080p and 2K with the original functions, the AVX2 ones, row bands
+// on the thread pool and both, in GB/s read and written. Each mode is
+// checked byte for byte against the original first, flipped too and on rows
+// that end part way through a vector. Returns non-zero when one differs.
+// Windows only, like SpoutCopy.cpp.
+#include "Spout/SpoutCopy.h"
+#include <string.h>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+using namespace std;
+
+typedef vector<unsigned char> Buffer;
+
+// Buffers of the vector type's alignment, as cv::Mat and mapped buffers are
+static unsigned char* aligned(Buffer &buffer)
+{
+	return (unsigned char*)(((size_t)&buffer[0] + 63) & ~(size_t)63);
+}
+
+// One spoutCopy function the way the GL sender and receiver call it
+struct Kernel
+{
+	const char* name;
+	int srcBytes, dstBytes; // per pixel
+	function<void(spoutCopy &copy, unsigned char* src, unsigned char* dst, unsigned int width, unsigned int height, bool invert)> run;
+};
+
+struct Mode
+{
+	const char* name;
+	bool avx2, threads;
+};
+
+static double millisecondsPerCall(const function<void()> &call, int iterations)
+{
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++)
+		call();
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / iterations;
+}
+
+int main()
+{
+	typedef void (spoutCopy::*Conversion)(void*, void*, unsigned int, unsigned int, bool);
+	auto conversion = [](const char* name, int srcBytes, int dstBytes, Conversion convert) {
+		Kernel kernel = { name, srcBytes, dstBytes,
+			[convert](spoutCopy &copy, unsigned char* src, unsigned char* dst, unsigned int width, unsigned int height, bool invert) {
+				(copy.*convert)(src, dst, width, height, invert);
+			} };
+		return kernel;
+	};
+	auto pixelCopy = [](const char* name, int bytes, GLenum format, bool flip) {
+		Kernel kernel = { name, bytes, bytes,
+			[format, flip](spoutCopy &copy, unsigned char* src, unsigned char* dst, unsigned int width, unsigned int height, bool invert) {
+				copy.CopyPixels(src, dst, width, height, format, flip != invert);
+			} };
+		return kernel;
+	};
+	const Kernel kernels[] = {
+		pixelCopy("copy", 4, GL_RGBA, false),
+		pixelCopy("flip", 4, GL_RGBA, true),
+		pixelCopy("flip rgb", 3, GL_RGB, true),
+		conversion("rgba2bgra", 4, 4, &spoutCopy::rgba2bgra),
+		conversion("rgb2rgba", 3, 4, &spoutCopy::rgb2rgba),
+		conversion("bgr2rgba", 3, 4, &spoutCopy::bgr2rgba),
+		conversion("rgb2bgra", 3, 4, &spoutCopy::rgb2bgra),
+		conversion("bgr2bgra", 3, 4, &spoutCopy::bgr2bgra),
+		conversion("rgba2rgb", 4, 3, &spoutCopy::rgba2rgb),
+		conversion("rgba2bgr", 4, 3, &spoutCopy::rgba2bgr),
+		conversion("bgra2rgb", 4, 3, &spoutCopy::bgra2rgb),
+		conversion("bgra2bgr", 4, 3, &spoutCopy::bgra2bgr),
+	};
+	const int kernelCount = sizeof(kernels) / sizeof(kernels[0]);
+	// The original functions first, the others are checked against them
+	const Mode modes[] = {
+		{ "original", false, false },
+		{ "bands", false, true },
+		{ "AVX2", true, false },
+		{ "AVX2 bands", true, true },
+	};
+	const int modeCount = spoutCopy::HasAVX2() ? 4 : 2;
+	// The last is only checked : rows that end part way through a vector
+	const int sizes[][2] = { { 1280, 720 }, { 1920, 1080 }, { 2560, 1440 }, { 1283, 9 } };
+	const int timedSizes = 3;
+	const int iterations = 30;
+
+	spoutCopy copy;
+	int result = 0;
+	cout << "SpoutCopy, AVX2 " << (spoutCopy::HasAVX2() ? "yes" : "no") << ", "
+		<< thread::hardware_concurrency() << " threads, GB/s read and written" << endl;
+	cout << fixed << setprecision(2);
+	for (int s = 0; s < 4; s++)
+	{
+		const unsigned int width = sizes[s][0], height = sizes[s][1];
+		const size_t bytes = (size_t)width * height * 4;
+		Buffer srcBuffer(bytes + 64), referenceBuffer(bytes + 64), dstBuffer(bytes + 64);
+		unsigned char* src = aligned(srcBuffer);
+		unsigned char* reference = aligned(referenceBuffer);
+		unsigned char* dst = aligned(dstBuffer);
+		for (size_t i = 0; i < bytes; i++)
+			src[i] = (unsigned char)(i * 131 + (i >> 9));
+		if (s < timedSizes)
+			cout << " " << width << "x" << height << endl;
+
+		for (int k = 0; k < kernelCount; k++)
+		{
+			const Kernel &kernel = kernels[k];
+			// Every mode byte for byte, past the end of a 3 byte destination too
+			bool ok = true;
+			for (int invert = 0; invert < 2; invert++)
+			{
+				spoutCopy::SetAcceleration(false, false);
+				memset(reference, 0xCD, bytes);
+				kernel.run(copy, src, reference, width, height, invert != 0);
+				for (int m = 1; m < modeCount; m++)
+				{
+					spoutCopy::SetAcceleration(modes[m].avx2, modes[m].threads);
+					memset(dst, 0xCD, bytes);
+					kernel.run(copy, src, dst, width, height, invert != 0);
+					if (memcmp(reference, dst, bytes) != 0)
+						ok = false;
+				}
+			}
+			if (!ok)
+				result = 1;
+			if (s >= timedSizes)
+			{
+				if (!ok)
+					cout << " " << width << "x" << height << " " << kernel.name << " MISMATCH" << endl;
+				continue;
+			}
+
+			cout << setw(10) << kernel.name << " :";
+			const double moved = (double)width * height * (kernel.srcBytes + kernel.dstBytes);
+			for (int m = 0; m < modeCount; m++)
+			{
+				spoutCopy::SetAcceleration(modes[m].avx2, modes[m].threads);
+				double ms = millisecondsPerCall([&]() {
+					kernel.run(copy, src, dst, width, height, false);
+				}, iterations);
+				cout << " " << modes[m].name << " " << moved / (ms * 1e6);
+			}
+			cout << (ok ? "" : " MISMATCH") << endl;
+		}
+	}
+	spoutCopy::SetAcceleration(true, true);
+	cout << "SpoutCopy : " << (result == 0 ? "ok" : "FAILED") << endl;
+	return result;
+}
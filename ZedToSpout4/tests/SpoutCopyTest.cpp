@@ -0,0 +1,108 @@
+// The spoutCopy conversions the application goes through, SpoutMemorySender
+// and the texture upload : bgr2rgba, bgra2rgba and CopyPixels as RGBA and
+// RGB, flipped or not, with the original functions, AVX2, row bands and both,
+// against plain loops. Sizes include rows ending part way through a vector
+// and buffers that aren't a multiple of 128 bytes. Windows only, like
+// SpoutCopy.cpp.
+#include "Spout/SpoutCopy.h"
+#include "TestCheck.h"
+#include <string.h>
+#include <vector>
+using namespace std;
+
+typedef vector<unsigned char> Buffer;
+
+// Buffers of the vector type's alignment, as cv::Mat and mapped buffers are
+static unsigned char* aligned(Buffer &buffer)
+{
+	return (unsigned char*)(((size_t)&buffer[0] + 63) & ~(size_t)63);
+}
+
+// The source row that ends up in destination row y
+static int sourceRow(int y, int height, bool bInvert)
+{
+	return bInvert ? height - 1 - y : y;
+}
+
+static void referenceCopy(const unsigned char* src, unsigned char* dst, int rowBytes, int height, bool bInvert)
+{
+	for (int y = 0; y < height; y++)
+		memcpy(dst + (size_t)y * rowBytes, src + (size_t)sourceRow(y, height, bInvert) * rowBytes, rowBytes);
+}
+
+// Same words as SpoutMemorySender::writeRGBA
+static void referenceRGBA(const unsigned char* src, int channels, unsigned char* dst, int width, int height, bool bInvert)
+{
+	for (int y = 0; y < height; y++)
+	{
+		const unsigned char* in = src + (size_t)sourceRow(y, height, bInvert) * width * channels;
+		unsigned int* out = (unsigned int*)(dst + (size_t)y * width * 4);
+		for (int x = 0; x < width; x++, in += channels)
+			out[x] = in[2] | (in[1] << 8) | (in[0] << 16) | (channels == 4 ? (unsigned int)in[3] << 24 : 0xFF000000u);
+	}
+}
+
+struct Mode
+{
+	const char* name;
+	bool avx2, threads;
+};
+
+int main()
+{
+	const Mode modes[] = {
+		{ "original", false, false }, { "AVX2", true, false }, { "row bands", false, true }, { "AVX2 + row bands", true, true },
+	};
+	// 324 x 241 RGBA is a multiple of 16 bytes but not of 128
+	const int sizes[][2] = { { 1280, 720 }, { 1920, 1080 }, { 333, 241 }, { 324, 241 }, { 64, 48 } };
+	cout << "AVX2 " << (spoutCopy::HasAVX2() ? "available" : "not available") << endl;
+	spoutCopy copy;
+
+	for (int s = 0; s < 5; s++)
+	{
+		const int width = sizes[s][0], height = sizes[s][1];
+		const size_t bytes = (size_t)width * height * 4;
+		Buffer srcBuffer(bytes + 64), dstBuffer(bytes + 64), expectedBuffer(bytes);
+		unsigned char* src = aligned(srcBuffer);
+		unsigned char* dst = aligned(dstBuffer);
+		unsigned char* expected = &expectedBuffer[0];
+		for (size_t i = 0; i < bytes; i++)
+			src[i] = (unsigned char)(i * 131 + (i >> 9));
+
+		for (int m = 0; m < 4; m++)
+		{
+			spoutCopy::SetAcceleration(modes[m].avx2, modes[m].threads);
+			for (int invert = 0; invert < 2; invert++)
+			{
+				bool bInvert = invert != 0;
+				bool ok = true;
+
+				referenceRGBA(src, 3, expected, width, height, bInvert);
+				memset(dst, 0xCD, bytes);
+				copy.bgr2rgba(src, dst, width, height, bInvert);
+				ok = memcmp(dst, expected, bytes) == 0 && ok;
+
+				referenceRGBA(src, 4, expected, width, height, bInvert);
+				memset(dst, 0xCD, bytes);
+				copy.bgra2rgba(src, dst, width, height, bInvert);
+				ok = memcmp(dst, expected, bytes) == 0 && ok;
+
+				referenceCopy(src, expected, width * 4, height, bInvert);
+				memset(dst, 0xCD, bytes);
+				copy.CopyPixels(src, dst, width, height, GL_RGBA, bInvert);
+				ok = memcmp(dst, expected, bytes) == 0 && ok;
+
+				referenceCopy(src, expected, width * 3, height, bInvert);
+				memset(dst, 0xCD, bytes);
+				copy.CopyPixels(src, dst, width, height, GL_RGB, bInvert);
+				ok = memcmp(dst, expected, (size_t)width * height * 3) == 0 && ok;
+
+				if (!ok)
+					cout << "  " << modes[m].name << " " << width << "x" << height << (bInvert ? " flipped" : "") << endl;
+				check(ok, "conversion matches the plain loop");
+			}
+		}
+	}
+	spoutCopy::SetAcceleration(true, true);
+	return testResult("SpoutCopy");
+}
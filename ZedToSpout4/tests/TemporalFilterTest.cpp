@@ -0,0 +1,234 @@
+// TemporalFilter on a noisy synthetic sequence : the noise on still pixels
+// and the flicker of measures dropping out go down against the truth, with
+// and without the confidence weighting, and every instruction set gives the
+// same floats. Then steps, a poorly confident pixel that moves, invalid
+// measures held for a few frames, and the parameter strings.
+#include "TemporalFilter.h"
+#include "FrameSource.h"
+#include "TestCheck.h"
+#include <math.h>
+#include <string.h>
+using namespace std;
+
+// Past the camera's range the noise of the floor at the horizon would swamp the rest
+static const float SCORED_RANGE_MM = 20000.0f;
+
+// Error of one configuration over the noisy sequence. The error only counts
+// pixels measured in the frame, a held pixel shows an older depth on purpose.
+struct TemporalScore
+{
+	double stillSum, movingSum;
+	size_t still, moving, flicker, pixels;
+
+	TemporalScore() : stillSum(0), movingSum(0), still(0), moving(0), flicker(0), pixels(0) {}
+	void add(float truth, float previousTruth, float measured, float z)
+	{
+		pixels++;
+		bool truthValid = fabsf(truth) < INFINITY;
+		if (truthValid != (fabsf(z) < INFINITY))
+		{
+			flicker++;
+			return;
+		}
+		if (!truthValid || !(fabsf(measured) < INFINITY) || truth > SCORED_RANGE_MM)
+			return;
+		double error = (double)z - truth;
+		if (truth == previousTruth)
+		{
+			stillSum += error * error;
+			still++;
+		}
+		else
+		{
+			movingSum += error * error;
+			moving++;
+		}
+	}
+	double stillRms() const { return still ? sqrt(stillSum / still) : 0; }
+	double movingRms() const { return moving ? sqrt(movingSum / moving) : 0; }
+	double flickerRate() const { return pixels ? 100.0 * flicker / pixels : 0; }
+	void print(const char* name) const
+	{
+		cout << name << " : still " << stillRms() << " mm, moving " << movingRms() << " mm rms, "
+			<< flickerRate() << "% flicker" << endl;
+	}
+};
+
+// The synthetic scene as truth, with noise growing with depth and with the
+// confidence value of each pixel, and measures dropping out at random like
+// they do around the depth clamp
+static void checkNoisySequence()
+{
+	const int width = 320, height = 180, frames = 90;
+	const float dropout = 0.03f;
+	SyntheticFrameSource scene(width, height);
+	cv::RNG rng(12345);
+
+	TemporalFilterParams params;
+	TemporalFilterParams unweighted = params;
+	unweighted.confidenceWeight = 0.0f;
+	const KernelIsa isas[] = { KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2 };
+	TemporalFilter filters[3], unweightedFilter;
+	for (int i = 0; i < 3; i++)
+		filters[i].setParams(params);
+	unweightedFilter.setParams(unweighted);
+
+	DepthFrame frame;
+	cv::Mat truth, previousTruth, noisy(height, width, CV_32FC1), confidence(height, width, CV_32FC1);
+	cv::Mat filtered[3], unweightedOut;
+	TemporalScore raw, weightedScore, unweightedScore;
+	bool grabbed = true, isasMatch = true;
+	for (int f = 0; f < frames; f++)
+	{
+		grabbed = scene.grab(frame, FRAME_DEPTH) && grabbed;
+		frame.depth.copyTo(truth);
+		rng.fill(confidence, cv::RNG::UNIFORM, 0.0, 100.0);
+		for (int y = 0; y < height; y++)
+		{
+			const float* t = truth.ptr<float>(y);
+			const float* c = confidence.ptr<float>(y);
+			float* z = noisy.ptr<float>(y);
+			for (int x = 0; x < width; x++)
+			{
+				if (rng.uniform(0.0f, 1.0f) < dropout)
+					z[x] = INFINITY;
+				else
+					z[x] = t[x] + (float)rng.gaussian(1.0) * t[x] * (0.002f + 0.01f * c[x] / 100.0f);
+			}
+		}
+
+		for (int i = 0; i < 3 && isas[i] <= bestKernelIsa(); i++)
+		{
+			filters[i].apply(noisy, confidence, filtered[i], isas[i]);
+			if (i > 0 && memcmp(filtered[0].data, filtered[i].data, filtered[0].total() * sizeof(float)) != 0)
+				isasMatch = false;
+		}
+		unweightedFilter.apply(noisy, cv::Mat(), unweightedOut);
+
+		// Leave the filters a few frames to settle
+		if (f >= 10)
+		{
+			for (int y = 0; y < height; y++)
+			{
+				for (int x = 0; x < width; x++)
+				{
+					float t = truth.at<float>(y, x), p = previousTruth.at<float>(y, x);
+					float z = noisy.at<float>(y, x);
+					raw.add(t, p, z, z);
+					weightedScore.add(t, p, z, filtered[0].at<float>(y, x));
+					unweightedScore.add(t, p, z, unweightedOut.at<float>(y, x));
+				}
+			}
+		}
+		truth.copyTo(previousTruth);
+	}
+
+	cout << "temporal filter " << formatTemporalFilter(params) << ", " << frames << " noisy frames " << width << "x" << height << endl;
+	raw.print("raw");
+	unweightedScore.print("filtered");
+	weightedScore.print("confidence");
+	check(grabbed, "synthetic frames");
+	check(isasMatch, "every instruction set gives the same floats");
+	check(unweightedScore.stillRms() < raw.stillRms() && weightedScore.stillRms() < raw.stillRms(), "still noise reduced");
+	check(unweightedScore.flickerRate() < raw.flickerRate() && weightedScore.flickerRate() < raw.flickerRate(), "flicker reduced");
+	// Weighting by the confidence smooths still pixels more, moving ones no less fast
+	check(weightedScore.stillRms() < unweightedScore.stillRms(), "confidence weighting smooths still pixels more");
+	check(weightedScore.movingRms() < raw.movingRms() * 1.5, "moving pixels don't trail");
+}
+
+// Frames a row of still pixels takes to come within 0.1% of a depth step
+static int settlingFrames(float fromMm, float toMm, const TemporalFilterParams &params, float confidenceValue, KernelIsa isa)
+{
+	TemporalFilter filter;
+	filter.setParams(params);
+	cv::Mat depth(1, 64, CV_32FC1, cv::Scalar(fromMm)), confidence(1, 64, CV_32FC1, cv::Scalar(confidenceValue)), filtered;
+	for (int i = 0; i < 10; i++)
+		filter.apply(depth, confidence, filtered, isa);
+	depth.setTo(cv::Scalar(toMm));
+	for (int frames = 1; frames <= 100; frames++)
+	{
+		filter.apply(depth, confidence, filtered, isa);
+		bool settled = true;
+		for (int x = 0; x < depth.cols; x++)
+			settled = fabs(filtered.at<float>(0, x) - toMm) <= 0.001 * toMm && settled;
+		if (settled)
+			return frames;
+	}
+	return -1;
+}
+
+// Steps past the motion threshold go through at once, the smaller ones trail
+// like the noise does; confidence only slows the small ones down, even with
+// the full weight on a pixel of confidence 100
+static void checkSteps()
+{
+	TemporalFilterParams params;
+	TemporalFilterParams poor = params;
+	poor.confidenceWeight = 1.0f;
+	const KernelIsa isas[] = { KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2 };
+	for (int i = 0; i < 3 && isas[i] <= bestKernelIsa(); i++)
+	{
+		int smallStep = settlingFrames(2000.0f, 2020.0f, params, 0.0f, isas[i]);
+		int poorSmallStep = settlingFrames(2000.0f, 2020.0f, params, 100.0f, isas[i]);
+		cout << kernelIsaName(isas[i]) << " : a 1% step takes " << smallStep << " frame(s), "
+			<< poorSmallStep << " at confidence 100" << endl;
+		check(settlingFrames(2000.0f, 3000.0f, params, 0.0f, isas[i]) == 1, "a 50% step goes through at once");
+		check(smallStep > 1 && smallStep < 20, "a 1% step is smoothed");
+		check(poorSmallStep > smallStep, "poor confidence slows a small step down");
+		check(settlingFrames(2000.0f, 3000.0f, poor, 100.0f, isas[i]) == 1, "a poor pixel that moves far follows at once");
+		check(settlingFrames(2000.0f, 1000.0f, poor, 100.0f, isas[i]) == 1, "nearer too");
+	}
+}
+
+// An invalid measure shows the last depth for holdFrames frames, then the sentinel
+static void checkHold()
+{
+	TemporalFilterParams params;
+	params.holdFrames = 3;
+	TemporalFilter filter;
+	filter.setParams(params);
+	cv::Mat depth(2, 16, CV_32FC1, cv::Scalar(1500.0f)), filtered;
+	filter.apply(depth, cv::Mat(), filtered);
+	depth.setTo(cv::Scalar(-INFINITY));
+	bool held = true;
+	for (int i = 0; i < params.holdFrames; i++)
+	{
+		filter.apply(depth, cv::Mat(), filtered);
+		held = filtered.at<float>(1, 15) == 1500.0f && held;
+	}
+	check(held, "invalid measures held");
+	filter.apply(depth, cv::Mat(), filtered);
+	check(filtered.at<float>(1, 15) == -INFINITY, "then the sentinel shows");
+	depth.setTo(cv::Scalar(900.0f));
+	filter.apply(depth, cv::Mat(), filtered);
+	check(filtered.at<float>(0, 0) == 900.0f, "a measure after the sentinel starts afresh");
+
+	filter.reset();
+	depth.setTo(cv::Scalar(2500.0f));
+	filter.apply(depth, cv::Mat(), filtered);
+	check(filtered.at<float>(0, 3) == 2500.0f, "the first frame after a reset passes through");
+}
+
+static void checkParams()
+{
+	TemporalFilterParams params;
+	check(parseTemporalFilter("0.3:0.1:6:1", params) && params.alpha == 0.3f && params.motionRatio == 0.1f &&
+		params.holdFrames == 6 && params.confidenceWeight == 1.0f, "alpha:motion:hold:confidence");
+	TemporalFilterParams parsed;
+	check(parseTemporalFilter(formatTemporalFilter(params), parsed) && parsed.alpha == params.alpha &&
+		parsed.holdFrames == params.holdFrames, "formatted parameters parse back");
+	check(parseTemporalFilter("0.5", params) && params.alpha == 0.5f && params.holdFrames == 4, "alpha alone");
+	check(!parseTemporalFilter("0", params) && !parseTemporalFilter("0.2:0.05:4:1.5", params) &&
+		!parseTemporalFilter("0.2:0.05:300", params) && !parseTemporalFilter("0.2:", params) &&
+		!parseTemporalFilter("0.2:0.05:4:0.5:1", params), "out of range or malformed refused");
+	check(params.alpha == 0.5f, "a refused string leaves the parameters alone");
+}
+
+int main()
+{
+	checkNoisySequence();
+	checkSteps();
+	checkHold();
+	checkParams();
+	return testResult("Temporal filter");
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <iostream>
+
+// The checks of the test executables, each failure is printed with what was
+// checked and main returns testResult so ctest sees it
+static int g_testFailures = 0;
+
+static inline bool check(bool ok, const char* what)
+{
+	if (!ok)
+	{
+		std::cout << "  failed : " << what << std::endl;
+		g_testFailures++;
+	}
+	return ok;
+}
+
+static inline int testResult(const char* name)
+{
+	std::cout << name << " : " << (g_testFailures == 0 ? "ok" : "FAILED") << std::endl;
+	return g_testFailures == 0 ? 0 : 1;
+}
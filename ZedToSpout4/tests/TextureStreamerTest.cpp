@@ -0,0 +1,245 @@
+// TextureStreamer on a headless Mesa context (EGL surfaceless, llvmpipe) : every
+// frame format read back from the texture, flipped or not, for the ring, the
+// orphaned buffer and the direct upload, and the GL allocations of the steady
+// state counted by wrapping the GL entry points of this executable.
+// Exits 77, skipped, when no EGL display can be had.
+#include "TextureStreamer.h"
+#include "TestCheck.h"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <dlfcn.h>
+#include <string.h>
+#include <set>
+#include <vector>
+using namespace std;
+
+// GL calls that allocate, and the pixel buffers each upload went through
+static unsigned long long s_genTextures = 0, s_texImages = 0, s_genBuffers = 0, s_bufferData = 0;
+static vector<GLuint> s_unpackBuffers;
+
+// The library function a wrapper below stands in for
+template <typename T> static T nextGL(T, const char* name)
+{
+	return (T)dlsym(RTLD_NEXT, name);
+}
+
+extern "C" {
+void glGenTextures(GLsizei n, GLuint* textures)
+{
+	static decltype(&glGenTextures) next = nextGL(&glGenTextures, "glGenTextures");
+	s_genTextures++;
+	next(n, textures);
+}
+
+void glTexImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLint border,
+	GLenum format, GLenum type, const void* pixels)
+{
+	static decltype(&glTexImage2D) next = nextGL(&glTexImage2D, "glTexImage2D");
+	s_texImages++;
+	next(target, level, internalFormat, width, height, border, format, type, pixels);
+}
+
+void glGenBuffers(GLsizei n, GLuint* buffers)
+{
+	static decltype(&glGenBuffers) next = nextGL(&glGenBuffers, "glGenBuffers");
+	s_genBuffers++;
+	next(n, buffers);
+}
+
+void glBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+{
+	static decltype(&glBufferData) next = nextGL(&glBufferData, "glBufferData");
+	s_bufferData++;
+	next(target, size, data, usage);
+}
+
+void glBindBuffer(GLenum target, GLuint buffer)
+{
+	static decltype(&glBindBuffer) next = nextGL(&glBindBuffer, "glBindBuffer");
+	if (target == GL_PIXEL_UNPACK_BUFFER && buffer != 0)
+		s_unpackBuffers.push_back(buffer);
+	next(target, buffer);
+}
+}
+
+static unsigned long long allocations()
+{
+	return s_genTextures + s_texImages + s_genBuffers + s_bufferData;
+}
+
+static bool createContext()
+{
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (!getPlatformDisplay)
+		return false;
+	EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	EGLint major, minor;
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor) || !eglBindAPI(EGL_OPENGL_API))
+		return false;
+	const EGLint attributes[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config;
+	EGLint configs = 0;
+	if (!eglChooseConfig(display, attributes, &config, 1, &configs) || configs == 0)
+		return false;
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+	return context != EGL_NO_CONTEXT && eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+}
+
+struct Format
+{
+	const char* name;
+	GLenum format, type;
+	GLenum readFormat; // what the texture is read back as
+};
+
+// A frame of pitch bytes per row, some more than the row needs, every byte telling its place
+static vector<unsigned char> makeFrame(int height, size_t rowBytes, size_t pitch, int frame)
+{
+	vector<unsigned char> pixels(pitch * height);
+	for (int y = 0; y < height; y++)
+	{
+		for (size_t x = 0; x < rowBytes; x++)
+			pixels[y * pitch + x] = (unsigned char)(x * 7 + y * 13 + frame * 29);
+	}
+	return pixels;
+}
+
+// Reads the texture back, texture row 0 at the bottom, and compares with the frame rows
+static bool matches(const TextureStreamer &streamer, const Format &format, const vector<unsigned char> &pixels,
+	size_t pitch, int width, int height, bool bFlipped)
+{
+	size_t rowBytes = (size_t)width * TextureStreamer::bytesPerPixel(format.format, format.type);
+	vector<unsigned char> texture(rowBytes * height);
+	glBindTexture(GL_TEXTURE_2D, streamer.texture());
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glGetTexImage(GL_TEXTURE_2D, 0, format.readFormat, format.type, &texture[0]);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	for (int row = 0; row < height; row++)
+	{
+		int y = bFlipped ? row : height - 1 - row;
+		if (memcmp(&texture[row * rowBytes], &pixels[y * pitch], rowBytes) != 0)
+			return false;
+	}
+	return true;
+}
+
+static void checkFormats(TextureStreamMode mode, const char* modeName)
+{
+	static const Format formats[] = {
+		{ "BGR", GL_BGR, GL_UNSIGNED_BYTE, GL_BGR },
+		{ "BGRA", GL_BGRA, GL_UNSIGNED_BYTE, GL_BGRA },
+		{ "LUMINANCE", GL_LUMINANCE, GL_UNSIGNED_BYTE, GL_RED },
+		{ "R16", GL_RED, GL_UNSIGNED_SHORT, GL_RED },
+		{ "R32F", GL_RED, GL_FLOAT, GL_RED },
+		{ "RGBA32F", GL_RGBA, GL_FLOAT, GL_RGBA },
+	};
+	TextureStreamer streamer;
+	streamer.setMode(mode);
+	for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++)
+	{
+		const Format &format = formats[f];
+		// Odd width, and a pitch past the end of each row like a cropped cv::Mat
+		const int width = 37, height = 23;
+		size_t rowBytes = (size_t)width * TextureStreamer::bytesPerPixel(format.format, format.type);
+		for (int padded = 0; padded < 2; padded++)
+		{
+			size_t pitch = rowBytes + (padded ? 12 : 0);
+			for (int flipped = 0; flipped < 2; flipped++)
+			{
+				// More frames than the ring has buffers, each one read back
+				bool ok = true;
+				for (int frame = 0; frame < TextureStreamer::PBO_COUNT + 2; frame++)
+				{
+					vector<unsigned char> pixels = makeFrame(height, rowBytes, pitch, frame);
+					// Floats from bytes that make finite positive numbers, the top byte of each kept under 0x40
+					if (format.type == GL_FLOAT)
+					{
+						for (size_t i = 3; i < pixels.size(); i += 4)
+							pixels[i] &= 0x3F;
+					}
+					ok = streamer.upload(&pixels[0], pitch, width, height, format.format, format.type, flipped != 0) &&
+						matches(streamer, format, pixels, pitch, width, height, flipped != 0) && ok;
+				}
+				if (!ok)
+					cout << "  " << modeName << " " << format.name << (flipped ? " flipped" : "") << (padded ? " padded" : "") << endl;
+				check(ok, "texture holds the frame uploaded");
+			}
+		}
+	}
+	check(streamer.activeMode() == mode, "mode asked for is the one used");
+	check(glGetError() == GL_NO_ERROR, "no GL error");
+	streamer.release();
+}
+
+// GL allocations and pixel buffers per frame once the texture exists
+static void checkSteadyState(TextureStreamMode mode, const char* modeName)
+{
+	const int width = 1280, height = 720, frames = 60;
+	vector<unsigned char> pixels = makeFrame(height, width * 4, width * 4, 0);
+	TextureStreamer streamer;
+	streamer.setMode(mode);
+	for (int i = 0; i < TextureStreamer::PBO_COUNT; i++)
+		streamer.upload(&pixels[0], width * 4, width, height, GL_BGRA, GL_UNSIGNED_BYTE, false);
+
+	unsigned long long before = allocations(), bufferDataBefore = s_bufferData;
+	s_unpackBuffers.clear();
+	for (int i = 0; i < frames; i++)
+		streamer.upload(&pixels[0], width * 4, width, height, GL_BGRA, GL_UNSIGNED_BYTE, false);
+	glFinish();
+	unsigned long long allocated = allocations() - before;
+	cout << modeName << " : " << (double)allocated / frames << " GL allocations per frame, "
+		<< streamer.stats().fenceWaits << " fence waits, " << streamer.stats().reallocations << " allocation" << endl;
+	check(streamer.stats().reallocations == 1, "texture allocated once");
+
+	if (mode == TEXTURE_STREAM_ORPHAN)
+	{
+		check(allocated == frames && s_bufferData - bufferDataBefore == frames, "orphan : one glBufferData per frame");
+	}
+	else
+		check(allocated == 0, "no GL allocation in the steady state");
+
+	if (mode == TEXTURE_STREAM_RING)
+	{
+		// Each frame goes through the buffer after the one of the frame before
+		set<GLuint> distinct(s_unpackBuffers.begin(), s_unpackBuffers.end());
+		bool cycles = s_unpackBuffers.size() == (size_t)frames && distinct.size() == (size_t)TextureStreamer::PBO_COUNT;
+		for (size_t i = TextureStreamer::PBO_COUNT; cycles && i < s_unpackBuffers.size(); i++)
+			cycles = s_unpackBuffers[i] == s_unpackBuffers[i - TextureStreamer::PBO_COUNT] && s_unpackBuffers[i] != s_unpackBuffers[i - 1];
+		check(cycles, "ring : frames go round the pixel buffers");
+	}
+	else if (mode == TEXTURE_STREAM_DIRECT)
+		check(s_unpackBuffers.empty(), "direct : no pixel buffer");
+
+	// A new size is a new texture
+	streamer.upload(&pixels[0], 640 * 4, 640, 360, GL_BGRA, GL_UNSIGNED_BYTE, false);
+	check(streamer.stats().reallocations == 2, "size change reallocates");
+	check(glGetError() == GL_NO_ERROR, "no GL error");
+	streamer.release();
+}
+
+int main()
+{
+	if (!createContext())
+	{
+		cout << "Texture streamer : skipped, no EGL display" << endl;
+		return 77;
+	}
+	cout << glGetString(GL_RENDERER) << " | " << glGetString(GL_VERSION) << endl;
+
+	const TextureStreamMode modes[] = { TEXTURE_STREAM_RING, TEXTURE_STREAM_ORPHAN, TEXTURE_STREAM_DIRECT };
+	const char* names[] = { "ring", "orphan", "direct" };
+	for (int m = 0; m < 3; m++)
+	{
+		checkFormats(modes[m], names[m]);
+		checkSteadyState(modes[m], names[m]);
+	}
+
+	// This context has fences, AUTO takes the ring
+	TextureStreamer automatic;
+	unsigned char pixel[4] = { 1, 2, 3, 4 };
+	automatic.upload(pixel, 4, 1, 1, GL_BGRA, GL_UNSIGNED_BYTE, true);
+	check(automatic.activeMode() == TEXTURE_STREAM_RING, "AUTO picks the ring with fences");
+	automatic.release();
+	return testResult("Texture streamer");
+}
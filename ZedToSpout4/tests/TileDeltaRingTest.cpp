@@ -0,0 +1,295 @@
+// Tile deltas encoded and decoded in memory, then through a SpoutFrameRing
+// and its SpoutFrameEvent : every frame rebuilt within the tolerance whatever
+// the tile size, every instruction set writing the same bytes, truncated
+// frames rejected. A subscriber that falls a whole ring behind refuses the
+// deltas until the next keyframe, one reading from another thread woken by
+// the event never rebuilds a wrong frame, and a publisher closing and coming
+// back at another size is picked up again from its first keyframe.
+#include "TileDelta.h"
+#include "DepthEncoding.h"
+#include "TestCheck.h"
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+using namespace std;
+
+static const char* TILE_RING_NAME = "ZedToSpoutTileDeltaTest";
+
+// A slanted wall with a box moving across it, sentinel edges, and the noise
+// a camera adds to a still room, more of it further away
+static void depthSequence(int width, int height, int frames, bool noise, vector<cv::Mat> &sequence)
+{
+	cv::RNG rng(23);
+	sequence.clear();
+	for (int f = 0; f < frames; f++)
+	{
+		cv::Mat codes(height, width, CV_16UC1);
+		int boxLeft = (f * 4) % width;
+		for (int y = 0; y < height; y++)
+		{
+			unsigned short* row = codes.ptr<unsigned short>(y);
+			for (int x = 0; x < width; x++)
+			{
+				bool box = x >= boxLeft && x < boxLeft + width / 5 && y > height / 4 && y < height * 3 / 4;
+				double z = box ? 900 : 2500 + x * 3 + y;
+				if (noise)
+					z += rng.gaussian(2.0 * z * z / 1e6);
+				row[x] = (unsigned short)(z + 0.5);
+				if (y < 2)
+					row[x] = DEPTH16_TOO_FAR;
+				else if (x < 3)
+					row[x] = DEPTH16_TOO_CLOSE;
+				else if (box && x == boxLeft)
+					row[x] = DEPTH16_OCCLUSION;
+			}
+		}
+		sequence.push_back(codes);
+	}
+}
+
+// Every pixel within the tolerance, sentinels exact
+static bool withinTolerance(const cv::Mat &codes, const cv::Mat &decoded, int toleranceMm)
+{
+	if (decoded.size() != codes.size() || decoded.type() != CV_16UC1)
+		return false;
+	for (int y = 0; y < codes.rows; y++)
+	{
+		const unsigned short* c = codes.ptr<unsigned short>(y);
+		const unsigned short* d = decoded.ptr<unsigned short>(y);
+		for (int x = 0; x < codes.cols; x++)
+		{
+			int diff = abs((int)c[x] - (int)d[x]);
+			bool sentinel = c[x] == DEPTH16_OCCLUSION || c[x] == DEPTH16_TOO_CLOSE || c[x] == DEPTH16_TOO_FAR ||
+				d[x] == DEPTH16_OCCLUSION || d[x] == DEPTH16_TOO_CLOSE || d[x] == DEPTH16_TOO_FAR;
+			if (diff > toleranceMm || (sentinel && diff != 0))
+				return false;
+		}
+	}
+	return true;
+}
+
+// Frame sizes that aren't a whole number of tiles, tile sizes and tolerances
+static void checkRoundTrips(const vector<cv::Mat> &clean, const vector<cv::Mat> &noisy)
+{
+	const int tileSizes[] = { 16, 32, 64 };
+	const int tolerances[] = { 0, 8, 24 };
+	int runs = 0, wrong = 0;
+	for (int n = 0; n < 2; n++)
+	{
+		const vector<cv::Mat> &sequence = n == 0 ? clean : noisy;
+		for (int t = 0; t < 3; t++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				TileDeltaParams params;
+				params.tileSize = tileSizes[t];
+				params.toleranceMm = tolerances[k];
+				TileDeltaEncoder encoder;
+				encoder.setParams(params);
+				TileDeltaDecoder decoder;
+				vector<unsigned char> encoded;
+				bool ok = true;
+				for (size_t i = 0; i < sequence.size(); i++)
+				{
+					size_t size = encoder.encode(sequence[i], encoded);
+					ok = ok && size > 0 && size <= tileDeltaBound(sequence[i].cols, sequence[i].rows, params.tileSize) &&
+						decoder.apply(encoded.data(), size) && withinTolerance(sequence[i], decoder.frame(), params.toleranceMm);
+				}
+				if (!ok)
+				{
+					cout << "  " << (n ? "noisy" : "clean") << " " << formatTileDelta(params) << " : frame not rebuilt" << endl;
+					wrong++;
+				}
+				runs++;
+			}
+		}
+	}
+	cout << "round trips : " << runs - wrong << " / " << runs << " sequences rebuilt within the tolerance" << endl;
+	check(wrong == 0, "every frame rebuilt within the tolerance");
+}
+
+static void checkIsas(const vector<cv::Mat> &noisy)
+{
+	const KernelIsa isas[] = { KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2 };
+	vector<unsigned char> reference, encoded;
+	bool same = true;
+	for (int i = 1; i < 3 && isas[i] <= bestKernelIsa(); i++)
+	{
+		TileDeltaParams params, scalarParams;
+		params.isa = isas[i];
+		scalarParams.isa = KERNEL_SCALAR;
+		TileDeltaEncoder encoder, scalar;
+		encoder.setParams(params);
+		scalar.setParams(scalarParams);
+		for (size_t f = 0; f < noisy.size(); f++)
+		{
+			size_t size = scalar.encode(noisy[f], reference);
+			same = encoder.encode(noisy[f], encoded) == size && memcmp(reference.data(), encoded.data(), size) == 0 && same;
+		}
+	}
+	check(same, "every instruction set writes the scalar bytes");
+}
+
+// A delta lost : refused until the keyframe, then right again. Cut short or too long : rejected.
+static void checkLostDelta(const vector<cv::Mat> &noisy)
+{
+	TileDeltaParams params;
+	params.keyframeInterval = 10;
+	TileDeltaEncoder encoder;
+	encoder.setParams(params);
+	TileDeltaDecoder decoder;
+	vector<unsigned char> encoded;
+	bool lossOk = true, truncatedOk = true;
+	for (int i = 0; i < 25; i++)
+	{
+		size_t size = encoder.encode(noisy[i], encoded);
+		if (i == 3)
+		{
+			truncatedOk = !decoder.apply(encoded.data(), size - 2) && !decoder.apply(encoded.data(), size + 2);
+			continue;
+		}
+		bool applied = decoder.apply(encoded.data(), size);
+		// Frames 4 to 9 build on the one lost, 10 is a keyframe
+		if (applied != (i < 3 || i >= 10) || (applied && !withinTolerance(noisy[i], decoder.frame(), params.toleranceMm)))
+			lossOk = false;
+	}
+	check(truncatedOk, "truncated frames rejected");
+	check(lossOk, "a lost delta refused until the keyframe");
+}
+
+// Single threaded, so which frames the ring still has is known
+static void checkRing(const vector<cv::Mat> &noisy)
+{
+	TileDeltaParams params;
+	params.keyframeInterval = 10;
+	TileDeltaPublisher publisher;
+	TileDeltaSubscriber subscriber;
+	check(!subscriber.open(TILE_RING_NAME), "no ring before the publisher");
+	bool created = publisher.create(TILE_RING_NAME, noisy[0].cols, noisy[0].rows, params, 4) && subscriber.open(TILE_RING_NAME);
+	check(created, "publisher and subscriber");
+	if (!created)
+		return;
+
+	// The keyframe after the event, then two frames read in order
+	cv::Mat depth;
+	unsigned long long timestamp = 0;
+	check(publisher.send(noisy[0], 1) && subscriber.waitFrame(1000) && subscriber.receive(depth, timestamp) && timestamp == 1 &&
+		withinTolerance(noisy[0], depth, params.toleranceMm), "keyframe");
+	bool sent = publisher.send(noisy[1], 2) && publisher.send(noisy[2], 3);
+	check(sent && subscriber.receive(depth, timestamp) && timestamp == 3 && withinTolerance(noisy[2], depth, params.toleranceMm) &&
+		subscriber.ringStats().frames == 3 && subscriber.ringStats().missed == 0, "frames read in order");
+	check(!subscriber.receive(depth, timestamp), "nothing new");
+	// One opening now starts on a delta
+	TileDeltaSubscriber late;
+	check(late.open(TILE_RING_NAME) && !late.receive(depth, timestamp) && late.refused() == 1, "a late subscriber refuses the delta");
+
+	// Six frames, more than the four slots, without a read : the frame after
+	// the last one read is gone, and every delta until the keyframe is refused
+	for (int i = 3; i < 9; i++)
+		publisher.send(noisy[i], i + 1);
+	bool refused = !subscriber.receive(depth, timestamp) && subscriber.refused() == 1 && subscriber.ringStats().missed > 0;
+	int i = 9;
+	for (; i < 30; i++)
+	{
+		publisher.send(noisy[i], i + 1);
+		if (publisher.encoder().lastWasKeyframe())
+			break;
+		refused = refused && !subscriber.receive(depth, timestamp);
+	}
+	check(refused, "a subscriber a whole ring behind refuses the deltas");
+	check(i == 10 && subscriber.receive(depth, timestamp) && timestamp == 11 && withinTolerance(noisy[10], depth, params.toleranceMm),
+		"then takes the keyframe");
+	check(late.receive(depth, timestamp) && timestamp == 11, "the late one too");
+	publisher.send(noisy[11], 12);
+	check(subscriber.receive(depth, timestamp) && timestamp == 12 && withinTolerance(noisy[11], depth, params.toleranceMm),
+		"and the deltas after it");
+
+	// The publisher goes and comes back at half the size : the ring is closed,
+	// the subscriber opens the new one and starts from its first keyframe
+	publisher.close();
+	check(!subscriber.receive(depth, timestamp), "closed ring");
+	vector<cv::Mat> half;
+	depthSequence(noisy[0].cols / 2, noisy[0].rows / 2, 3, true, half);
+	bool recreated = publisher.create(TILE_RING_NAME, half[0].cols, half[0].rows, params, 4) && publisher.send(half[0], 100);
+	check(recreated && subscriber.waitFrame(1000), "the event of the new publisher");
+	bool reopened = subscriber.receive(depth, timestamp) || subscriber.receive(depth, timestamp);
+	check(reopened && timestamp == 100 && withinTolerance(half[0], depth, params.toleranceMm), "reopened on the closed ring");
+	publisher.send(half[1], 101);
+	check(subscriber.receive(depth, timestamp) && timestamp == 101 && withinTolerance(half[1], depth, params.toleranceMm),
+		"deltas of the new publisher");
+	publisher.close();
+	subscriber.close();
+}
+
+// A subscriber thread woken by the event while frames go out at about 250 fps :
+// it may fall behind and wait for a keyframe, never rebuild a wrong frame
+static void checkSubscriberThread(const vector<cv::Mat> &noisy)
+{
+	TileDeltaParams params;
+	TileDeltaPublisher publisher;
+	if (!check(publisher.create(TILE_RING_NAME, noisy[0].cols, noisy[0].rows, params), "publisher"))
+		return;
+	const unsigned long long last = noisy.size();
+	atomic<unsigned long long> newest(0);
+	unsigned long long received = 0, wrong = 0;
+	unsigned long long refused = 0, missed = 0;
+	thread reader([&]() {
+		TileDeltaSubscriber subscriber;
+		if (!subscriber.open(TILE_RING_NAME))
+			return;
+		chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::seconds(10);
+		while (newest < last && chrono::steady_clock::now() < deadline)
+		{
+			if (!subscriber.waitFrame(100))
+				continue;
+			cv::Mat depth;
+			unsigned long long timestamp = 0;
+			if (!subscriber.receive(depth, timestamp))
+				continue;
+			if (timestamp < 1 || timestamp > last || !withinTolerance(noisy[timestamp - 1], depth, params.toleranceMm))
+				wrong++;
+			newest = timestamp;
+			received++;
+		}
+		refused = subscriber.refused();
+		missed = subscriber.ringStats().missed;
+	});
+	// Let the reader open the ring before the first keyframe
+	this_thread::sleep_for(chrono::milliseconds(50));
+	for (size_t i = 0; i < noisy.size(); i++)
+	{
+		publisher.send(noisy[i], i + 1);
+		this_thread::sleep_for(chrono::milliseconds(4));
+	}
+	// The last frame again until the reader has it, a keyframe comes within 30
+	// for a reader that fell behind
+	for (int k = 0; k < 200 && newest < last; k++)
+	{
+		publisher.send(noisy[last - 1], last);
+		this_thread::sleep_for(chrono::milliseconds(10));
+	}
+	reader.join();
+	publisher.close();
+	cout << "subscriber thread : " << received << " / " << last << " frames rebuilt, " << refused << " refused, "
+		<< missed << " missed in the ring" << endl;
+	check(received > 0 && wrong == 0, "the subscriber thread rebuilds every frame it takes within the tolerance");
+	check(refused == 0 || missed > 0, "deltas only refused after frames missed");
+}
+
+int main()
+{
+	cout << "best instruction set " << kernelIsaName(bestKernelIsa()) << endl;
+	// 10 and 6 tiles of 64 and a bit
+	vector<cv::Mat> clean, noisy;
+	depthSequence(648, 360, 40, false, clean);
+	depthSequence(648, 360, 40, true, noisy);
+	checkRoundTrips(clean, noisy);
+	checkIsas(noisy);
+	checkLostDelta(noisy);
+	checkRing(noisy);
+	checkSubscriberThread(noisy);
+	return testResult("Tile delta ring");
+}
@@ -35,10 +35,296 @@
 				   Revise rgb2rgba etc.
 		11.10.16 - Added SSSE detection and rgba-bgra function
 		04.01.17 - Added rgb2bgra, bgr2bgra, bgra2rgb, bgra2bgr
+		17.10.26 - Added AVX2 detection and AVX2 versions of the copies and conversions
+				   Large frames converted in row bands on the thread pool
+				   SetAcceleration to compare against the original functions
+				   memcpy_sse2 copies the end of buffers that aren't a multiple of 128 bytes
 
 */
 #include "spoutCopy.h"
 
+#if defined(_MSC_VER)
+#define SPOUT_AVX2_TARGET
+#else
+#define SPOUT_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+// Process wide settings, see SetAcceleration
+static bool s_bUseAVX2 = true;
+static bool s_bUseThreads = true;
+
+// A frame is split into bands of at least this many destination bytes,
+// smaller frames are not worth waking the pool for
+static const size_t BAND_BYTES = 1024*1024;
+
+
+//
+// Row functions used by ConvertRows, width in pixels
+// (in bytes for the copies). Each AVX2 function finishes
+// a row with the plain code and writes nothing outside it.
+//
+
+typedef void (*RowFunction)(const unsigned char *src, unsigned char *dst, unsigned int width);
+
+static void copy_row(const unsigned char *src, unsigned char *dst, unsigned int bytes)
+{
+	memcpy((void *)dst, (void *)src, bytes);
+}
+
+static void rgba_bgra_row(const unsigned char *src, unsigned char *dst, unsigned int width)
+{
+	const unsigned __int32 *source = (const unsigned __int32 *)src;
+	unsigned __int32 *dest = (unsigned __int32 *)dst;
+	for (unsigned int x = 0; x < width; x++) {
+		unsigned __int32 rgbapix = source[x];
+		dest[x] = (_rotl(rgbapix, 16) & 0x00ff00ff) | (rgbapix & 0xff00ff00);
+	}
+}
+
+// 3 to 4 bytes, the alpha opaque, swapping the first and third byte or not
+static void rgb_rgba_row(const unsigned char *src, unsigned char *dst, unsigned int width)
+{
+	for (unsigned int x = 0; x < width; x++) {
+		dst[0] = src[0];
+		dst[1] = src[1];
+		dst[2] = src[2];
+		dst[3] = (unsigned char)255;
+		src += 3;
+		dst += 4;
+	}
+}
+
+static void bgr_rgba_row(const unsigned char *src, unsigned char *dst, unsigned int width)
+{
+	for (unsigned int x = 0; x < width; x++) {
+		dst[0] = src[2];
+		dst[1] = src[1];
+		dst[2] = src[0];
+		dst[3] = (unsigned char)255;
+		src += 3;
+		dst += 4;
+	}
+}
+
+// 4 to 3 bytes, dropping the alpha
+static void rgba_rgb_row(const unsigned char *src, unsigned char *dst, unsigned int width)
+{
+	for (unsigned int x = 0; x < width; x++) {
+		dst[0] = src[0];
+		dst[1] = src[1];
+		dst[2] = src[2];
+		src += 4;
+		dst += 3;
+	}
+}
+
+static void rgba_bgr_row(const unsigned char *src, unsigned char *dst, unsigned int width)
+{
+	for (unsigned int x = 0; x < width; x++) {
+		dst[0] = src[2];
+		dst[1] = src[1];
+		dst[2] = src[0];
+		src += 4;
+		dst += 3;
+	}
+}
+
+SPOUT_AVX2_TARGET static void copy_row_avx2(const unsigned char *src, unsigned char *dst, unsigned int bytes)
+{
+	unsigned int i = 0;
+	// 128 bytes a cycle, as memcpy_sse2
+	for (; i + 128 <= bytes; i += 128) {
+		__m256i r0 = _mm256_loadu_si256((const __m256i *)(src + i));
+		__m256i r1 = _mm256_loadu_si256((const __m256i *)(src + i + 32));
+		__m256i r2 = _mm256_loadu_si256((const __m256i *)(src + i + 64));
+		__m256i r3 = _mm256_loadu_si256((const __m256i *)(src + i + 96));
+		_mm256_storeu_si256((__m256i *)(dst + i), r0);
+		_mm256_storeu_si256((__m256i *)(dst + i + 32), r1);
+		_mm256_storeu_si256((__m256i *)(dst + i + 64), r2);
+		_mm256_storeu_si256((__m256i *)(dst + i + 96), r3);
+	}
+	for (; i + 32 <= bytes; i += 32)
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_loadu_si256((const __m256i *)(src + i)));
+	if (i < bytes)
+		memcpy((void *)(dst + i), (void *)(src + i), bytes - i);
+}
+
+// The rgba_bgra_ssse3 shuffle, 8 pixels at a time
+SPOUT_AVX2_TARGET static void rgba_bgra_row_avx2(const unsigned char *src, unsigned char *dst, unsigned int width)
+{
+	const __m256i m = _mm256_setr_epi8(2,1,0,3, 6,5,4,7, 10,9,8,11, 14,13,12,15,
+									   2,1,0,3, 6,5,4,7, 10,9,8,11, 14,13,12,15);
+	unsigned int x = 0;
+	for (; x + 8 <= width; x += 8) {
+		__m256i p = _mm256_loadu_si256((const __m256i *)(src + x*4));
+		_mm256_storeu_si256((__m256i *)(dst + x*4), _mm256_shuffle_epi8(p, m));
+	}
+	rgba_bgra_row(src + x*4, dst + x*4, width - x);
+}
+
+// Each 128 bit lane takes 4 pixels, 12 bytes of source, so 8 pixels read 28
+// bytes and 4 of them belong to the next pixels : the loop stops 2 pixels early
+SPOUT_AVX2_TARGET static void rgb_rgba_avx2(const unsigned char *src, unsigned char *dst, unsigned int width, bool bSwap)
+{
+	const __m256i m = bSwap ?
+		_mm256_setr_epi8(2,1,0,-1, 5,4,3,-1, 8,7,6,-1, 11,10,9,-1, 2,1,0,-1, 5,4,3,-1, 8,7,6,-1, 11,10,9,-1) :
+		_mm256_setr_epi8(0,1,2,-1, 3,4,5,-1, 6,7,8,-1, 9,10,11,-1, 0,1,2,-1, 3,4,5,-1, 6,7,8,-1, 9,10,11,-1);
+	const __m256i alpha = _mm256_set1_epi32((int)0xff000000);
+	unsigned int x = 0;
+	for (; x + 10 <= width; x += 8) {
+		__m128i lo = _mm_loadu_si128((const __m128i *)(src + x*3));
+		__m128i hi = _mm_loadu_si128((const __m128i *)(src + x*3 + 12));
+		__m256i p = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+		_mm256_storeu_si256((__m256i *)(dst + x*4), _mm256_or_si256(_mm256_shuffle_epi8(p, m), alpha));
+	}
+	if (bSwap)
+		bgr_rgba_row(src + x*3, dst + x*4, width - x);
+	else
+		rgb_rgba_row(src + x*3, dst + x*4, width - x);
+}
+
+// Each lane packs its 4 pixels into 12 bytes and is stored with 16, the second
+// over the spare 4 of the first and 4 beyond its own : stopping 2 pixels early again
+SPOUT_AVX2_TARGET static void rgba_rgb_avx2(const unsigned char *src, unsigned char *dst, unsigned int width, bool bSwap)
+{
+	const __m256i m = bSwap ?
+		_mm256_setr_epi8(2,1,0, 6,5,4, 10,9,8, 14,13,12, -1,-1,-1,-1, 2,1,0, 6,5,4, 10,9,8, 14,13,12, -1,-1,-1,-1) :
+		_mm256_setr_epi8(0,1,2, 4,5,6, 8,9,10, 12,13,14, -1,-1,-1,-1, 0,1,2, 4,5,6, 8,9,10, 12,13,14, -1,-1,-1,-1);
+	unsigned int x = 0;
+	for (; x + 10 <= width; x += 8) {
+		__m256i p = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(src + x*4)), m);
+		_mm_storeu_si128((__m128i *)(dst + x*3), _mm256_castsi256_si128(p));
+		_mm_storeu_si128((__m128i *)(dst + x*3 + 12), _mm256_extracti128_si256(p, 1));
+	}
+	if (bSwap)
+		rgba_bgr_row(src + x*4, dst + x*3, width - x);
+	else
+		rgba_rgb_row(src + x*4, dst + x*3, width - x);
+}
+
+SPOUT_AVX2_TARGET static void rgb_rgba_row_avx2(const unsigned char *src, unsigned char *dst, unsigned int width)
+{
+	rgb_rgba_avx2(src, dst, width, false);
+}
+
+SPOUT_AVX2_TARGET static void bgr_rgba_row_avx2(const unsigned char *src, unsigned char *dst, unsigned int width)
+{
+	rgb_rgba_avx2(src, dst, width, true);
+}
+
+SPOUT_AVX2_TARGET static void rgba_rgb_row_avx2(const unsigned char *src, unsigned char *dst, unsigned int width)
+{
+	rgba_rgb_avx2(src, dst, width, false);
+}
+
+SPOUT_AVX2_TARGET static void rgba_bgr_row_avx2(const unsigned char *src, unsigned char *dst, unsigned int width)
+{
+	rgba_rgb_avx2(src, dst, width, true);
+}
+
+
+//
+// Row bands
+//
+// The calling thread and the Windows thread pool take bands of rows
+// in turn until all are done. The bands write separate rows so
+// the result is the same however they are shared out.
+//
+
+struct RowBands {
+	RowFunction function;
+	const unsigned char *src;
+	unsigned char *dst;
+	size_t srcPitch, dstPitch;
+	unsigned int width, height;
+	bool bInvert; // source rows bottom up
+	unsigned int count;
+	volatile LONG next;
+};
+
+static void ConvertBands(RowBands *bands)
+{
+	LONG band;
+	while ((band = InterlockedIncrement(&bands->next) - 1) < (LONG)bands->count) {
+		unsigned int y0 = (unsigned int)band * bands->height / bands->count;
+		unsigned int y1 = ((unsigned int)band + 1) * bands->height / bands->count;
+		for (unsigned int y = y0; y < y1; y++) {
+			unsigned int line = bands->bInvert ? bands->height - 1 - y : y;
+			bands->function(bands->src + line*bands->srcPitch, bands->dst + y*bands->dstPitch, bands->width);
+		}
+	}
+}
+
+static void CALLBACK BandWork(PTP_CALLBACK_INSTANCE instance, PVOID context, PTP_WORK work)
+{
+	ConvertBands((RowBands *)context);
+}
+
+static unsigned int ProcessorCount()
+{
+	static unsigned int processors = 0;
+	if (processors == 0) {
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		processors = info.dwNumberOfProcessors > 0 ? (unsigned int)info.dwNumberOfProcessors : 1;
+	}
+	return processors;
+}
+
+// Converts row by row with the AVX2 or the plain function, in bands when the frame is large.
+// Returns false when neither applies, the caller then goes on with its own code.
+static bool ConvertRows(RowFunction function, RowFunction function_avx2,
+						const void *src, size_t srcPitch, void *dst, size_t dstPitch,
+						unsigned int width, unsigned int height, bool bInvert)
+{
+	bool bAVX2 = s_bUseAVX2 && spoutCopy::HasAVX2();
+	unsigned int count = 1;
+	if (s_bUseThreads) {
+		count = (unsigned int)(dstPitch*height / BAND_BYTES);
+		if (count > ProcessorCount())
+			count = ProcessorCount();
+		if (count > height)
+			count = height;
+	}
+	if (!bAVX2 && count < 2)
+		return false;
+
+	RowBands bands;
+	bands.function = bAVX2 ? function_avx2 : function;
+	bands.src = (const unsigned char *)src;
+	bands.dst = (unsigned char *)dst;
+	bands.srcPitch = srcPitch;
+	bands.dstPitch = dstPitch;
+	bands.width = width;
+	bands.height = height;
+	bands.bInvert = bInvert;
+	bands.count = count > 1 ? count : 1;
+	bands.next = 0;
+
+	PTP_WORK work = NULL;
+	if (bands.count > 1) {
+		work = CreateThreadpoolWork(BandWork, &bands, NULL);
+		// Without the pool this thread takes every band
+		if (work) {
+			for (unsigned int i = 1; i < bands.count; i++)
+				SubmitThreadpoolWork(work);
+		}
+	}
+	ConvertBands(&bands);
+	if (work) {
+		WaitForThreadpoolWorkCallbacks(work, FALSE);
+		CloseThreadpoolWork(work);
+	}
+	return true;
+}
+
+void spoutCopy::SetAcceleration(bool bAVX2, bool bThreads)
+{
+	s_bUseAVX2 = bAVX2;
+	s_bUseThreads = bThreads;
+}
+
+
 spoutCopy::spoutCopy() {
 	m_bSSE2 = false;
 	m_bSSE3 = false;
@@ -65,6 +351,11 @@ void spoutCopy::CopyPixels(const unsigned char *source,
 		Size = width*height*3;
 	}
 
+	// AVX2 and / or row bands, flipped or not
+	unsigned int pitch = Size / (height > 0 ? height : 1);
+	if (ConvertRows(copy_row, copy_row_avx2, source, pitch, dest, pitch, pitch, height, bInvert))
+		return;
+
 	if(bInvert) {
 		FlipBuffer(source, dest, width, height, glFormat);
 	}
@@ -100,6 +391,9 @@ bool spoutCopy::FlipBuffer(const unsigned char *src,
 		pitch = width * 3; // RGB format specified
 	}
 
+	if (ConvertRows(copy_row, copy_row_avx2, src, pitch, dst, pitch, pitch, height, true))
+		return true;
+
 	unsigned int line_s = 0;
 	unsigned int line_t = (height - 1)*pitch;
 
@@ -173,6 +467,9 @@ void spoutCopy::memcpy_sse2(void* dst, void* src, size_t Size)
 		pDst += 128;
 	}
 
+	// The end that doesn't fill 8 registers
+	memcpy(pDst, pSrc, Size & 127);
+
 }
 
 
@@ -193,6 +490,9 @@ void spoutCopy::memcpy_sse2(void* dst, void* src, size_t Size)
 // SSSE3 | [bit 9] ECX
 // SSSE3 = (cpuid02 & (0x1 << 9)
 //
+// AVX2 | [bit 5] EBX of leaf 7, and OSXSAVE [bit 27] and AVX [bit 28] ECX of leaf 1
+// with the OS saving the YMM registers (XCR0 bits 1 and 2), see HasAVX2
+//
 // SSE4 not currently used :
 //
 // SSE4.1 and SSE4.2 are extensions of SSE, SSE2, SSE3, and SSSE3. 
@@ -241,6 +541,29 @@ void spoutCopy::CheckSSE()
 		m_bSSSE3 = ((CPUInfo[2] & (0x1 << 9)) || false);
 	}
 
+	// Kept for all objects, the class layout is unchanged
+	HasAVX2();
+
+}
+
+
+bool spoutCopy::HasAVX2()
+{
+	static int avx2 = -1; // not checked yet
+	if (avx2 < 0) {
+		int CPUInfo[4] = { -1 };
+		bool bAVX2 = false;
+		__cpuid(CPUInfo, 0);
+		int nIds = CPUInfo[0];
+		if (nIds >= 7) {
+			__cpuid(CPUInfo, 1);
+			bool bAVX = (CPUInfo[2] & (0x1 << 27)) && (CPUInfo[2] & (0x1 << 28)) && (_xgetbv(0) & 6) == 6;
+			__cpuidex(CPUInfo, 7, 0);
+			bAVX2 = bAVX && (CPUInfo[1] & (0x1 << 5));
+		}
+		avx2 = bAVX2 ? 1 : 0;
+	}
+	return avx2 == 1;
 }
 
 
@@ -249,6 +572,9 @@ void spoutCopy::CheckSSE()
 //
 void spoutCopy::rgba2bgra(void *rgba_source, void *bgra_dest, unsigned int width, unsigned int height, bool bInvert)
 {
+	if (ConvertRows(rgba_bgra_row, rgba_bgra_row_avx2, rgba_source, width*4, bgra_dest, width*4, width, height, bInvert))
+		return;
+
 	if (m_bSSE2 && m_bSSSE3 && ((width % 16) == 0)) // SSE3 available and 16 byte aligned width
 		rgba_bgra_ssse3(rgba_source, bgra_dest, width, height, bInvert);
 	else if (m_bSSE2) // SSE2 available
@@ -442,6 +768,9 @@ void spoutCopy::rgba_bgra_ssse3(void* rgba_source,  void *rgba_dest, unsigned in
 
 void spoutCopy::rgb2rgba(void *rgb_source, void *rgba_dest, unsigned int width, unsigned int height, bool bInvert)
 {
+	if (ConvertRows(rgb_rgba_row, rgb_rgba_row_avx2, rgb_source, width*3, rgba_dest, width*4, width, height, bInvert))
+		return;
+
 	unsigned long rgbsize = width*height*3;
 	unsigned long rgbpitch = width*3;
 	unsigned int x = 0;
@@ -475,6 +804,9 @@ void spoutCopy::rgb2rgba(void *rgb_source, void *rgba_dest, unsigned int width,
 
 void spoutCopy::bgr2rgba(void *bgr_source, void *rgba_dest, unsigned int width, unsigned int height, bool bInvert)
 {
+	if (ConvertRows(bgr_rgba_row, bgr_rgba_row_avx2, bgr_source, width*3, rgba_dest, width*4, width, height, bInvert))
+		return;
+
 	unsigned long rgbsize = width*height*3;
 	unsigned long rgbpitch = width*3;
 	unsigned int x = 0;
@@ -507,6 +839,9 @@ void spoutCopy::bgr2rgba(void *bgr_source, void *rgba_dest, unsigned int width,
 
 void spoutCopy::rgb2bgra(void *rgb_source, void *bgra_dest, unsigned int width, unsigned int height, bool bInvert)
 {
+	if (ConvertRows(bgr_rgba_row, bgr_rgba_row_avx2, rgb_source, width*3, bgra_dest, width*4, width, height, bInvert))
+		return;
+
 	unsigned long rgbsize = width*height*3;
 	unsigned long rgbpitch = width*3;
 	unsigned int x = 0;
@@ -539,6 +874,9 @@ void spoutCopy::rgb2bgra(void *rgb_source, void *bgra_dest, unsigned int width,
 
 void spoutCopy::bgr2bgra(void *bgr_source, void *bgra_dest, unsigned int width, unsigned int height, bool bInvert)
 {
+	if (ConvertRows(rgb_rgba_row, rgb_rgba_row_avx2, bgr_source, width*3, bgra_dest, width*4, width, height, bInvert))
+		return;
+
 	unsigned long bgrsize = width*height*3;
 	unsigned long bgrpitch = width*3;
 	unsigned int x = 0;
@@ -572,6 +910,9 @@ void spoutCopy::bgr2bgra(void *bgr_source, void *bgra_dest, unsigned int width,
 
 void spoutCopy::rgba2rgb(void *rgba_source, void *rgb_dest, unsigned int width, unsigned int height, bool bInvert)
 {
+	if (ConvertRows(rgba_rgb_row, rgba_rgb_row_avx2, rgba_source, width*4, rgb_dest, width*3, width, height, bInvert))
+		return;
+
 	unsigned long rgbsize = width*height*3;
 	unsigned long rgbpitch = width*3;
 	unsigned int x = 0;
@@ -603,6 +944,9 @@ void spoutCopy::rgba2rgb(void *rgba_source, void *rgb_dest, unsigned int width,
 
 void spoutCopy::rgba2bgr(void *rgba_source, void *bgr_dest, unsigned int width, unsigned int height, bool bInvert)
 {
+	if (ConvertRows(rgba_bgr_row, rgba_bgr_row_avx2, rgba_source, width*4, bgr_dest, width*3, width, height, bInvert))
+		return;
+
 	unsigned long rgbsize = width*height*3;
 	unsigned long rgbpitch = width*3;
 	unsigned int x = 0;
@@ -635,6 +979,9 @@ void spoutCopy::rgba2bgr(void *rgba_source, void *bgr_dest, unsigned int width,
 
 void spoutCopy::bgra2rgb(void *bgra_source, void *rgb_dest, unsigned int width, unsigned int height, bool bInvert)
 {
+	if (ConvertRows(rgba_bgr_row, rgba_bgr_row_avx2, bgra_source, width*4, rgb_dest, width*3, width, height, bInvert))
+		return;
+
 	unsigned long rgbsize = width*height*3;
 	unsigned long rgbpitch = width*3;
 	unsigned int x = 0;
@@ -667,6 +1014,9 @@ void spoutCopy::bgra2rgb(void *bgra_source, void *rgb_dest, unsigned int width,
 
 void spoutCopy::bgra2bgr(void *bgra_source, void *bgr_dest, unsigned int width, unsigned int height, bool bInvert)
 {
+	if (ConvertRows(rgba_rgb_row, rgba_rgb_row_avx2, bgra_source, width*4, bgr_dest, width*3, width, height, bInvert))
+		return;
+
 	unsigned long bgrsize = width*height*3;
 	unsigned long bgrpitch = width*3;
 	unsigned int x = 0;
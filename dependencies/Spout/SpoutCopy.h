@@ -40,6 +40,7 @@
 #include <intrin.h> // for cpuid to test for SSE2
 #include <emmintrin.h> // for SSE2
 #include <tmmintrin.h> // for SSSE3
+#include <immintrin.h> // for AVX2
 
 
 class SPOUT_DLLEXP spoutCopy {
@@ -79,6 +80,12 @@ class SPOUT_DLLEXP spoutCopy {
 		void bgra2rgb (void* bgra_source, void *rgb_dest,  unsigned int width, unsigned int height, bool bInvert = false);
 		void bgra2bgr (void* bgra_source, void *bgr_dest,  unsigned int width, unsigned int height, bool bInvert = false);
 
+		// For every spoutCopy in the process : AVX2 where the processor has it and
+		// large frames split into row bands on the thread pool. Both are on by
+		// default, off leaves the functions above to their SSE or plain code.
+		static void SetAcceleration(bool bAVX2, bool bThreads);
+		static bool HasAVX2(); // processor and OS
+
 	private :
 
 		void CheckSSE();
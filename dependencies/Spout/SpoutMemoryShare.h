@@ -37,7 +37,9 @@
 #ifndef __spoutMemoryShare__
 #define __spoutMemoryShare__
 
+#ifdef _WIN32
 #include <windowsx.h>
+#endif
 #include <string>
 #include "SpoutCommon.h"
 #include "SpoutSharedMemory.h"
@@ -38,12 +38,29 @@ http://www.codeproject.com/Articles/835818/Ultimate-Shared-Memory-A-flexible-cla
 #include "SpoutSharedMemory.h"
 #include <assert.h>
 #include <string>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#endif
 
 SpoutSharedMemory::SpoutSharedMemory()
 {
 	m_pBuffer = NULL;
 	m_hMutex = NULL;
+#ifdef _WIN32
 	m_hMap = NULL;
+#else
+	m_hMap = -1;
+	m_mapSize = 0;
+	m_bOwner = false;
+#endif
 	m_pName = NULL;
 	m_size = 0;
 	m_lockCount = 0;
@@ -54,6 +71,8 @@ SpoutSharedMemory::~SpoutSharedMemory()
 	Close();
 }
 
+#ifdef _WIN32
+
 // Create a new memory segment, or attach to an existing one
 SpoutCreateResult SpoutSharedMemory::Create(const char* name, int size)
 {
@@ -239,6 +258,213 @@ void SpoutSharedMemory::Unlock()
 	}
 }
 
+#else // POSIX
+
+// POSIX object names must start with a single slash and contain no others
+static std::string PosixName(const char* name, const char* suffix)
+{
+	std::string posixName = "/";
+	for (const char* c = name; *c; c++)
+		posixName += (*c == '/') ? '_' : *c;
+	posixName += suffix;
+	return posixName;
+}
+
+// Create a new memory segment, or attach to an existing one
+SpoutCreateResult SpoutSharedMemory::Create(const char* name, int size)
+{
+	assert(name);
+	assert(size);
+
+	if (m_hMap != -1) {
+		assert(strcmp(name, m_pName) == 0);
+		assert(m_pBuffer && m_hMutex);
+		return SPOUT_ALREADY_CREATED;
+	}
+
+	std::string mapName = PosixName(name, "");
+	bool alreadyExists = false;
+
+	m_hMap = shm_open(mapName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+	if (m_hMap == -1 && errno == EEXIST) {
+		// As with CreateFileMapping, an existing map keeps the size it was created with
+		alreadyExists = true;
+		m_hMap = shm_open(mapName.c_str(), O_RDWR, 0666);
+	}
+	if (m_hMap == -1) {
+		printf("SpoutSharedMemory::Create - shm_open error = %d\n", errno);
+		return SPOUT_CREATE_FAILED;
+	}
+
+	if (alreadyExists) {
+		struct stat st;
+		if (fstat(m_hMap, &st) != 0 || st.st_size == 0) {
+			Close();
+			return SPOUT_CREATE_FAILED;
+		}
+		m_mapSize = (int)st.st_size;
+	}
+	else {
+		if (ftruncate(m_hMap, size) != 0) {
+			shm_unlink(mapName.c_str());
+			Close();
+			return SPOUT_CREATE_FAILED;
+		}
+		m_mapSize = size;
+		m_bOwner = true;
+	}
+
+	void* pMap = mmap(NULL, m_mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_hMap, 0);
+	if (pMap == MAP_FAILED) {
+		Close();
+		return SPOUT_CREATE_FAILED;
+	}
+	m_pBuffer = (char*)pMap;
+
+	std::string mutexName = PosixName(name, "_mutex");
+	m_hMutex = sem_open(mutexName.c_str(), O_CREAT, 0666, 1);
+	if (m_hMutex == SEM_FAILED) {
+		m_hMutex = NULL;
+		Close();
+		return SPOUT_CREATE_FAILED;
+	}
+
+	m_pName = strdup(name);
+	m_size = size;
+
+	return alreadyExists ? SPOUT_ALREADY_EXISTS : SPOUT_CREATE_SUCCESS;
+}
+
+
+bool SpoutSharedMemory::Open(const char* name)
+{
+	assert(name);
+
+	if (m_hMap != -1) {
+		assert(strcmp(name, m_pName) == 0);
+		assert(m_pBuffer && m_hMutex);
+		return true;
+	}
+
+	std::string mapName = PosixName(name, "");
+	m_hMap = shm_open(mapName.c_str(), O_RDWR, 0666);
+	if (m_hMap == -1) {
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(m_hMap, &st) != 0 || st.st_size == 0) {
+		Close();
+		return false;
+	}
+	m_mapSize = (int)st.st_size;
+
+	void* pMap = mmap(NULL, m_mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_hMap, 0);
+	if (pMap == MAP_FAILED) {
+		Close();
+		return false;
+	}
+	m_pBuffer = (char*)pMap;
+
+	std::string mutexName = PosixName(name, "_mutex");
+	m_hMutex = sem_open(mutexName.c_str(), O_CREAT, 0666, 1);
+	if (m_hMutex == SEM_FAILED) {
+		m_hMutex = NULL;
+		Close();
+		return false;
+	}
+
+	m_pName = strdup(name);
+	m_size = 0;
+
+	return true;
+}
+
+void SpoutSharedMemory::Close()
+{
+	if (m_pBuffer) {
+		munmap(m_pBuffer, m_mapSize);
+		m_pBuffer = NULL;
+	}
+
+	if (m_hMap != -1) {
+		close(m_hMap);
+		m_hMap = -1;
+	}
+
+	if (m_hMutex) {
+		sem_close(m_hMutex);
+		m_hMutex = NULL;
+	}
+
+	// Unlike Windows there is no reference counting of named objects,
+	// so the creator removes the names. Processes that still have the
+	// map open keep their mapping until they close it.
+	if (m_pName) {
+		if (m_bOwner) {
+			shm_unlink(PosixName(m_pName, "").c_str());
+			sem_unlink(PosixName(m_pName, "_mutex").c_str());
+		}
+		free((void*)m_pName);
+		m_pName = NULL;
+	}
+
+	m_bOwner = false;
+	m_mapSize = 0;
+}
+
+
+char* SpoutSharedMemory::Lock()
+{
+	assert(m_lockCount >= 0);
+	assert(m_hMutex);
+
+	if(m_lockCount < 0 || !m_hMutex || !m_pBuffer) {
+		return NULL;
+	}
+
+	if (m_lockCount > 0) {
+		m_lockCount++;
+		return m_pBuffer;
+	}
+
+	// Same 67 msec timeout as the Windows mutex wait
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_nsec += 67 * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_sec += 1;
+		deadline.tv_nsec -= 1000000000L;
+	}
+
+	int result;
+	do {
+		result = sem_timedwait(m_hMutex, &deadline);
+	} while (result == -1 && errno == EINTR);
+
+	if (result != 0) {
+		return NULL;
+	}
+
+	m_lockCount++;
+
+	return m_pBuffer;
+}
+
+void SpoutSharedMemory::Unlock()
+{
+	assert(m_hMutex);
+
+	m_lockCount--;
+	assert(m_lockCount >= 0);
+
+	if (m_lockCount == 0) {
+		sem_post(m_hMutex);
+	}
+}
+
+#endif // _WIN32
+
 
 void SpoutSharedMemory::Debug()
 {
@@ -36,9 +36,14 @@
 #define __SpoutSharedMemory_
 
 #include "SpoutCommon.h"
+#ifdef _WIN32
 #include <windowsx.h>
 #include <d3d9.h>
 #include <wingdi.h>
+#else
+// POSIX backend : shm_open for the map and a named semaphore for the mutex
+#include <semaphore.h>
+#endif
 
 enum SpoutCreateResult
 {
@@ -65,13 +70,23 @@ public:
 	char* Lock();
 	void Unlock();
 
+	// The mapping without the mutex, for layouts that synchronize on their own
+	char* Buffer() const { return m_pBuffer; }
+
 	void Debug();
 
 private:
 
 	char*  m_pBuffer;
+#ifdef _WIN32
 	HANDLE m_hMap;
 	HANDLE m_hMutex;
+#else
+	int    m_hMap;    // shm file descriptor, -1 when closed
+	sem_t* m_hMutex;
+	int    m_mapSize; // mapped length, needed for munmap
+	bool   m_bOwner;  // the creator unlinks the names on Close
+#endif
 
 	int m_lockCount;
 